@@ -28,6 +28,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <vector>
 #include <cmath>
 #include <memory>
@@ -45,6 +46,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <syslog.h>
@@ -53,6 +55,7 @@
 #include "SipiCache.h"
 #include "shttps/Global.h"
 #include "SipiError.h"
+#include "SipiComputePool.h"
 
 static const char __file__[] = __FILE__;
 
@@ -77,101 +80,383 @@ namespace Sipi {
     } AListEle;
 
 
+    /*!
+     * Layout of the records of .sipicache up to version 1.x. The strings have a fixed length and
+     * are truncated if longer. Only used to read old cache files.
+     */
+    typedef struct {
+        size_t img_w, img_h;
+        size_t tile_w, tile_h;
+        int clevels;
+        int numpages;
+        char canonical[256];
+        char origpath[256];
+        char cachepath[256];
+#if defined(HAVE_ST_ATIMESPEC)
+        struct timespec mtime;
+#else
+        time_t mtime;
+#endif
+        time_t access_time;
+        off_t fsize;
+    } LegacyFileCacheRecord;
+
+    static const char cache_magic[] = "SIPICACHE2\n"; //!< first bytes of the current .sipicache format
+    static const size_t journal_min_entries = 10000; //!< the journal is compacted if it exceeds max(this, nfiles)
+
+    /*!
+     * Appends a record (as written to the snapshot and the journal) to a buffer.
+     */
+    static void encode_record(std::string &buf, char op, const std::string &canonical,
+                              const SipiCache::CacheRecord *cr, time_t access_time) {
+        SipiCache::FileCacheRecord fr;
+        memset(&fr, 0, sizeof(fr));
+        std::string origpath, cachepath;
+        if (cr != nullptr) {
+            fr.img_w = cr->img_w;
+            fr.img_h = cr->img_h;
+            fr.tile_w = cr->tile_w;
+            fr.tile_h = cr->tile_h;
+            fr.clevels = cr->clevels;
+            fr.numpages = cr->numpages;
+            fr.mtime = cr->mtime;
+            fr.fsize = cr->fsize;
+            fr.nhits = cr->nhits;
+            fr.cost = cr->cost;
+            origpath = cr->origpath;
+            cachepath = cr->cachepath;
+        }
+        fr.access_time = access_time;
+        fr.canonical_len = canonical.size();
+        fr.origpath_len = origpath.size();
+        fr.cachepath_len = cachepath.size();
+        buf.push_back(op);
+        buf.append((const char *) &fr, sizeof(fr));
+        buf.append(canonical);
+        buf.append(origpath);
+        buf.append(cachepath);
+    }
+    //============================================================================
+
+    /*!
+     * Reads records from a snapshot or journal and applies them to the table. Reading stops at the
+     * first incomplete record (e.g. a journal entry torn by a crash).
+     */
+    static size_t replay_records(std::istream &in, std::unordered_map<std::string, SipiCache::CacheRecord> &table) {
+        size_t n = 0;
+        char op;
+        while (in.get(op)) {
+            SipiCache::FileCacheRecord fr;
+            if (!in.read((char *) &fr, sizeof(fr))) break;
+            std::string canonical(fr.canonical_len, '\0'), origpath(fr.origpath_len, '\0'), cachepath(fr.cachepath_len, '\0');
+            if (!in.read(&canonical[0], fr.canonical_len)) break;
+            if (!in.read(&origpath[0], fr.origpath_len)) break;
+            if (!in.read(&cachepath[0], fr.cachepath_len)) break;
+            switch (op) {
+                case 'A': {
+                    SipiCache::CacheRecord cr;
+                    cr.img_w = fr.img_w;
+                    cr.img_h = fr.img_h;
+                    cr.tile_w = fr.tile_w;
+                    cr.tile_h = fr.tile_h;
+                    cr.clevels = fr.clevels;
+                    cr.numpages = fr.numpages;
+                    cr.origpath = origpath;
+                    cr.cachepath = cachepath;
+                    cr.mtime = fr.mtime;
+                    cr.access_time = fr.access_time;
+                    cr.fsize = fr.fsize;
+                    cr.nhits = fr.nhits;
+                    cr.cost = fr.cost;
+                    table[canonical] = cr;
+                    break;
+                }
+                case 'D': {
+                    table.erase(canonical);
+                    break;
+                }
+                case 'T': {
+                    auto it = table.find(canonical);
+                    if (it != table.end()) it->second.access_time = fr.access_time;
+                    break;
+                }
+                default: {
+                    return n; // corrupted
+                }
+            }
+            n++;
+        }
+        return n;
+    }
+    //============================================================================
+
+    /*!
+     * Hash of the canonical URL used to choose the subdirectory of a cache file (32 bit FNV-1a, which is
+     * – unlike std::hash – guaranteed to be the same for every build)
+     */
+    static uint32_t canonical_hash(const std::string &canonical) {
+        uint32_t h = 2166136261u;
+        for (unsigned char c : canonical) {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h;
+    }
+    //============================================================================
+
+    /*!
+     * Lists a directory of the cache. The names of the cache files (and if subdirs is not nullptr, of the
+     * shard subdirectories) are returned relative to the cache directory. Only names created by the cache
+     * itself are returned, i.e. files named "cache_*" and directories named by two hex digits (see
+     * getNewCacheFileName()). Everything else, e.g. an index or a derivative directory, is left alone.
+     */
+    static bool list_cache_dir(const std::string &cachedir, const std::string &prefix, std::vector<std::string> &files,
+                               std::vector<std::string> *subdirs) {
+        std::string dirpath = cachedir + "/" + prefix;
+        DIR *dir = opendir(dirpath.c_str());
+        if (dir == nullptr) return false;
+        struct dirent *dp;
+        while ((dp = readdir(dir)) != nullptr) {
+            bool is_cachefile = (strncmp(dp->d_name, "cache_", 6) == 0);
+            bool is_sharddir = isxdigit((unsigned char) dp->d_name[0]) && isxdigit((unsigned char) dp->d_name[1]) &&
+                               (dp->d_name[2] == '\0') && !isupper((unsigned char) dp->d_name[0]) &&
+                               !isupper((unsigned char) dp->d_name[1]);
+            if (!is_cachefile && !is_sharddir) continue;
+            bool is_dir;
+            if (dp->d_type == DT_UNKNOWN) {
+                struct stat fileinfo;
+                is_dir = (stat((dirpath + dp->d_name).c_str(), &fileinfo) == 0) && S_ISDIR(fileinfo.st_mode);
+            } else {
+                is_dir = (dp->d_type == DT_DIR);
+            }
+            if (is_dir) {
+                if (is_sharddir && (subdirs != nullptr)) subdirs->push_back(prefix + dp->d_name);
+            } else if (is_cachefile) {
+                files.push_back(prefix + dp->d_name);
+            }
+        }
+        closedir(dir);
+        return true;
+    }
+    //============================================================================
+
+    SipiCache::FrequencySketch::FrequencySketch(size_t expected_entries) : additions(0) {
+        width = 1;
+        while ((width < expected_entries) && (width < (1u << 24))) width <<= 1;
+        table = std::vector<std::atomic<uint8_t>>(4 * width);
+        for (auto &counter : table) counter.store(0, std::memory_order_relaxed);
+    }
+    //============================================================================
+
+    void SipiCache::FrequencySketch::increment(const std::string &key) {
+        uint32_t h1 = canonical_hash(key);
+        uint32_t h2 = (h1 >> 16) | (h1 << 16) | 1;
+        for (size_t row = 0; row < 4; row++) {
+            std::atomic<uint8_t> &counter = table[row * width + ((h1 + row * h2) & (width - 1))];
+            uint8_t c = counter.load(std::memory_order_relaxed);
+            if (c < 15) counter.store(c + 1, std::memory_order_relaxed); // races may lose an increment, that's ok
+        }
+
+        //
+        // aging: after 10 x width requests all counters are halved
+        //
+        if (++additions >= 10 * width) {
+            additions = 0;
+            for (auto &counter : table) counter.store(counter.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+        }
+    }
+    //============================================================================
+
+    unsigned SipiCache::FrequencySketch::estimate(const std::string &key) {
+        uint32_t h1 = canonical_hash(key);
+        uint32_t h2 = (h1 >> 16) | (h1 << 16) | 1;
+        unsigned est = 15;
+        for (size_t row = 0; row < 4; row++) {
+            unsigned c = table[row * width + ((h1 + row * h2) & (width - 1))].load(std::memory_order_relaxed);
+            if (c < est) est = c;
+        }
+        return est;
+    }
+    //============================================================================
+
     SipiCache::SipiCache(const std::string &cachedir_p, long long max_cachesize_p, unsigned max_nfiles_p,
-                         float cache_hysteresis_p) : _cachedir(cachedir_p), max_cachesize(max_cachesize_p),
-                                                     max_nfiles(max_nfiles_p), cache_hysteresis(cache_hysteresis_p) {
+                         float cache_hysteresis_p, EvictionPolicy eviction_policy_p, AdmissionPolicy admission_policy_p)
+            : _cachedir(cachedir_p), journal_fd(-1), journal_entries(0), old_journal(false),
+              compact_pending(false), compactor_stop(false), max_cachesize(max_cachesize_p),
+              max_nfiles(max_nfiles_p), cache_hysteresis(cache_hysteresis_p), eviction_policy(eviction_policy_p),
+              admission_policy(admission_policy_p), gdsf_clock(0.), nhits(0), nmisses(0), hit_bytes(0), miss_bytes(0),
+              nrejected(0), nevictions(0) {
 
         if (access(_cachedir.c_str(), R_OK | W_OK | X_OK) != 0) {
             throw SipiError(__file__, __LINE__, "Cache directory not available", errno);
         }
 
         std::string cachefilename = _cachedir + "/.sipicache";
+        std::string journalname = _cachedir + "/.sipijournal";
+        std::string oldjournalname = journalname + ".old";
         cachesize = 0;
         nfiles = 0;
 
-        syslog(LOG_INFO, "Cache at \"%s\" cachesize=%lld nfiles=%d hysteresis=%f", _cachedir.c_str(), max_cachesize,
-               max_nfiles, cache_hysteresis);
-        std::ifstream cachefile(cachefilename, std::ofstream::in | std::ofstream::binary);
+        syslog(LOG_INFO, "Cache at \"%s\" cachesize=%lld nfiles=%d hysteresis=%f policy=%s admission=%s", _cachedir.c_str(),
+               max_cachesize, max_nfiles, cache_hysteresis, (eviction_policy == EVICT_GDSF) ? "gdsf" : "lru",
+               (admission_policy == ADMIT_TINYLFU) ? "tinylfu" : "all");
+        if (admission_policy == ADMIT_TINYLFU) {
+            sketch.reset(new FrequencySketch(std::max<size_t>(max_nfiles, 1u << 16)));
+        }
+        //
+        // first we collect the files in the cache directory. Looking up the files in this set is much cheaper
+        // than checking the existence of each file listed in the cache file with a system call
+        //
+        std::unordered_set<std::string> files_on_disk;
+        {
+            std::vector<std::string> files;
+            std::vector<std::string> shard_dirs;
+            if (!list_cache_dir(_cachedir, "", files, &shard_dirs)) {
+                throw SipiError(__file__, __LINE__, "Couldn't read cache directory", errno);
+            }
 
-        struct dirent **namelist;
-        int n;
+            //
+            // the subdirectories are scanned in parallel
+            //
+            std::mutex files_locking;
+            SipiComputePool::run(0, shard_dirs.size(), [&](size_t i0, size_t i1) {
+                std::vector<std::string> shard_files;
+                for (size_t i = i0; i < i1; i++) {
+                    std::vector<std::string> subdirs;
+                    (void) list_cache_dir(_cachedir, shard_dirs[i] + "/", shard_files, &subdirs);
+                    for (const auto &subdir : subdirs) {
+                        (void) list_cache_dir(_cachedir, subdir + "/", shard_files, nullptr);
+                    }
+                }
+                std::lock_guard<std::mutex> files_guard(files_locking);
+                files.insert(files.end(), shard_files.begin(), shard_files.end());
+            }, 4);
+            files_on_disk.insert(files.begin(), files.end());
+        }
+
+        //
+        // the index is restored from the last snapshot (.sipicache) and the journal of the changes made since
+        //
+        std::unordered_map<std::string, CacheRecord> table;
+        std::ifstream cachefile(cachefilename, std::ofstream::in | std::ofstream::binary);
 
         if (!cachefile.fail()) {
-            cachefile.seekg(0, cachefile.end);
-            std::streampos length = cachefile.tellg();
-            cachefile.seekg(0, cachefile.beg);
-            int n = length / sizeof(SipiCache::FileCacheRecord);
             syslog(LOG_INFO, "Reading cache file...");
-
-            for (int i = 0; i < n; i++) {
-                SipiCache::FileCacheRecord fr;
-                cachefile.read((char *) &fr, sizeof(SipiCache::FileCacheRecord));
-                std::string accesspath = _cachedir + "/" + fr.cachepath;
-
-                if (access(accesspath.c_str(), R_OK) != 0) {
-                    //
-                    // we cannot find the file – probably it has been deleted => skip it
-                    //
-                    syslog(LOG_DEBUG, "Cache could'nt find file \"%s\" on disk!", fr.cachepath);
-                    continue;
+            char magic[sizeof(cache_magic) - 1];
+            if (cachefile.read(magic, sizeof(magic)) && (memcmp(magic, cache_magic, sizeof(magic)) == 0)) {
+                (void) replay_records(cachefile, table);
+            } else {
+                //
+                // cache file written by an older version of Sipi
+                //
+                cachefile.clear();
+                cachefile.seekg(0, cachefile.end);
+                std::streampos length = cachefile.tellg();
+                cachefile.seekg(0, cachefile.beg);
+                int n = length / sizeof(LegacyFileCacheRecord);
+
+                for (int i = 0; i < n; i++) {
+                    LegacyFileCacheRecord fr;
+                    cachefile.read((char *) &fr, sizeof(LegacyFileCacheRecord));
+                    CacheRecord cr;
+                    cr.img_w = fr.img_w;
+                    cr.img_h = fr.img_h;
+                    cr.tile_w = fr.tile_w;
+                    cr.tile_h = fr.tile_h;
+                    cr.clevels = fr.clevels;
+                    cr.numpages = fr.numpages;
+                    cr.origpath = fr.origpath;
+                    cr.cachepath = fr.cachepath;
+                    cr.mtime = fr.mtime;
+                    cr.access_time = fr.access_time;
+                    cr.fsize = fr.fsize;
+                    cr.nhits = 0;
+                    cr.cost = 0.;
+                    table[fr.canonical] = cr;
                 }
-
-                CacheRecord cr;
-                cr.img_w = fr.img_w;
-                cr.img_h = fr.img_h;
-                cr.tile_w = fr.img_w;
-                cr.tile_h = fr.tile_h;
-                cr.clevels = fr.clevels;
-                cr.numpages = fr.numpages;
-                cr.origpath = fr.origpath;
-                cr.cachepath = fr.cachepath;
-                cr.mtime = fr.mtime;
-                cr.access_time = fr.access_time;
-                cr.fsize = fr.fsize;
-                cachesize += fr.fsize;
-                nfiles++;
-                cachetable[fr.canonical] = cr;
-                syslog(LOG_INFO, "File \"%s\" adding to cache", cr.cachepath.c_str());
             }
         }
+        cachefile.close();
 
         //
-        // now we looking for files that are not in the list of cached files
-        // and we delete them
+        // a rotated journal is left over if the server stopped before the compactor had written the
+        // snapshot, it contains the older changes and is replayed first
         //
+        for (const auto &name : {oldjournalname, journalname}) {
+            std::ifstream journalfile(name, std::ifstream::in | std::ifstream::binary);
+            if (!journalfile.fail()) {
+                size_t n = replay_records(journalfile, table);
+                syslog(LOG_INFO, "Replayed %zu entries of the cache journal \"%s\"", n, name.c_str());
+            }
+            journalfile.close();
+        }
 
-        n = scandir(_cachedir.c_str(), &namelist, nullptr, alphasort);
+        for (auto &ele : table) {
+            auto on_disk = files_on_disk.find(ele.second.cachepath);
+            if (on_disk == files_on_disk.end()) {
+                //
+                // we cannot find the file – probably it has been deleted => skip it
+                //
+                syslog(LOG_DEBUG, "Cache could'nt find file \"%s\" on disk!", ele.second.cachepath.c_str());
+                continue;
+            }
+            files_on_disk.erase(on_disk); // what remains in the set at the end is not in the cache file
+
+            cachesize += ele.second.fsize;
+            nfiles++;
+            CacheShard &shard = cache_shard(ele.first);
+            shard.lru.push_front(ele.first);
+            shard.cachetable[ele.first] = {ele.second, shard.lru.begin(), ele.second.access_time, 0.};
+            syslog(LOG_DEBUG, "File \"%s\" adding to cache", ele.second.cachepath.c_str());
+        }
+        table.clear();
 
-        if (n < 0) {
-            perror("scandir");
-        } else {
-            while (n--) {
-                if (namelist[n]->d_name[0] == '.') continue; // files beginning with "." are not removed
-                std::string file_on_disk = namelist[n]->d_name;
-                bool found = false;
+        //
+        // the records have been read in arbitrary order, sort the LRU lists by access time
+        //
+        for (auto &shard : cache_shards) {
+            shard.lru.sort([&shard](const std::string &c1, const std::string &c2) {
+                return difftime(shard.cachetable[c1].cr.access_time, shard.cachetable[c2].cr.access_time) > 0.;
+            });
+            for (auto it = shard.lru.begin(); it != shard.lru.end(); ++it) {
+                shard.cachetable[*it].lru_pos = it;
+            }
+        }
 
-                for (const auto &ele : cachetable) {
-                    if (ele.second.cachepath == file_on_disk) found = true;
-                }
+        //
+        // write a fresh snapshot and start with an empty journal
+        //
+        {
+            std::lock_guard<std::mutex> journal_guard(journal_locking);
+            compact();
+        }
 
-                if (!found) {
+        //
+        // the files that are not in the list of cached files are deleted in the background, thus
+        // the server can start serving immediately
+        //
+        if (!files_on_disk.empty()) {
+            syslog(LOG_INFO, "Deleting %zu files not in cache file in the background...", files_on_disk.size());
+            std::vector<std::string> orphans(files_on_disk.begin(), files_on_disk.end());
+            cleaner = std::thread([this](std::vector<std::string> orphans) {
+                for (const auto &file_on_disk : orphans) {
                     std::string ff = _cachedir + "/" + file_on_disk;
-                    syslog(LOG_INFO, "File \"%s\" not in cache file! Deleting...", file_on_disk.c_str());
-                    remove(ff.c_str());
+                    syslog(LOG_DEBUG, "File \"%s\" not in cache file! Deleting...", file_on_disk.c_str());
+                    ::remove(ff.c_str());
                 }
-
-                free(namelist[n]);
-            }
-
-            free(namelist);
+            }, std::move(orphans));
         }
 
-        for (const auto &ele : cachetable) {
-            try {
-                (void) sizetable.at(ele.second.origpath);
-            } catch (const std::out_of_range &oor) {
-                SipiCache::SizeRecord tmp_cr = {ele.second.img_w, ele.second.img_h, ele.second.tile_w, ele.second.tile_h, ele.second.clevels,  ele.second.numpages, ele.second.mtime};
-                sizetable[ele.second.origpath] = tmp_cr;
+        compactor = std::thread(&SipiCache::run_compactor, this);
+
+        for (const auto &shard : cache_shards) {
+            for (const auto &ele : shard.cachetable) {
+                const CacheRecord &cr = ele.second.cr;
+                auto &sizetable = size_shard(cr.origpath).sizetable;
+                if (sizetable.find(cr.origpath) == sizetable.end()) {
+                    SipiCache::SizeRecord tmp_cr = {cr.img_w, cr.img_h, cr.tile_w, cr.tile_h, cr.clevels, cr.numpages, cr.mtime};
+                    sizetable[cr.origpath] = tmp_cr;
+                }
             }
         }
     }
@@ -179,30 +464,135 @@ namespace Sipi {
 
     SipiCache::~SipiCache() {
         syslog(LOG_DEBUG, "Closing cache...");
+        if (cleaner.joinable()) cleaner.join();
+        {
+            std::lock_guard<std::mutex> journal_guard(journal_locking);
+            compactor_stop = true;
+        }
+        compact_cond.notify_one();
+        if (compactor.joinable()) compactor.join();
+        std::lock_guard<std::mutex> journal_guard(journal_locking);
+        compact();
+        if (journal_fd >= 0) {
+            ::close(journal_fd);
+            journal_fd = -1;
+        }
+    }
+    //============================================================================
+
+    bool SipiCache::write_snapshot(void) {
+        //
+        // the snapshot is written to a temporary file and then atomically renamed, thus
+        // a crash during compaction leaves the old snapshot and journal intact
+        //
         std::string cachefilename = _cachedir + "/.sipicache";
-        std::ofstream cachefile(cachefilename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        std::string tmpname = cachefilename + ".tmp";
+        int fd = ::open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0) {
+            syslog(LOG_ERR, "Couldn't write cache file \"%s\": %s", tmpname.c_str(), strerror(errno));
+            return false;
+        }
 
-        if (!cachefile.fail()) {
-            for (const auto &ele : cachetable) {
-                SipiCache::FileCacheRecord fr;
-                fr.img_w = ele.second.img_w;
-                fr.img_h = ele.second.img_h;
-                fr.tile_w = ele.second.tile_w;
-                fr.tile_h = ele.second.tile_h;
-                fr.clevels = ele.second.clevels;
-                fr.numpages = ele.second.numpages;
-                (void) snprintf(fr.canonical, 256, "%s", ele.first.c_str());
-                (void) snprintf(fr.origpath, 256, "%s", ele.second.origpath.c_str());
-                (void) snprintf(fr.cachepath, 256, "%s", ele.second.cachepath.c_str());
-                fr.mtime = ele.second.mtime;
-                fr.fsize = ele.second.fsize;
-                fr.access_time = ele.second.access_time;
-                cachefile.write((char *) &fr, sizeof(SipiCache::FileCacheRecord));
-                syslog(LOG_DEBUG, "Writing \"%s\" to cache file...", ele.second.cachepath.c_str());
+        bool ok = true;
+        std::string buf(cache_magic, sizeof(cache_magic) - 1);
+        for (auto &shard : cache_shards) {
+            {
+                std::lock_guard<std::mutex> shard_guard(shard.locking);
+                for (const auto &ele : shard.cachetable) {
+                    encode_record(buf, 'A', ele.first, &ele.second.cr, ele.second.cr.access_time);
+                }
             }
+            if (buf.size() > 1024 * 1024) {
+                ok = ok && (::write(fd, buf.data(), buf.size()) == (ssize_t) buf.size());
+                buf.clear();
+            }
+        }
+        ok = ok && (::write(fd, buf.data(), buf.size()) == (ssize_t) buf.size());
+        ok = ok && (::fsync(fd) == 0);
+        ::close(fd);
+        if (!ok || (::rename(tmpname.c_str(), cachefilename.c_str()) != 0)) {
+            syslog(LOG_ERR, "Couldn't write cache file \"%s\": %s", cachefilename.c_str(), strerror(errno));
+            ::unlink(tmpname.c_str());
+            return false;
         }
+        return true;
+    }
+    //============================================================================
 
-        cachefile.close();
+    void SipiCache::compact(void) {
+        if (!write_snapshot()) return;
+
+        //
+        // the snapshot contains everything, start a new journal
+        //
+        std::string journalname = _cachedir + "/.sipijournal";
+        (void) ::unlink((journalname + ".old").c_str());
+        old_journal = false;
+        if (journal_fd >= 0) ::close(journal_fd);
+        journal_fd = ::open(journalname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (journal_fd < 0) {
+            syslog(LOG_ERR, "Couldn't open cache journal \"%s\": %s", journalname.c_str(), strerror(errno));
+        }
+        journal_entries = 0;
+    }
+    //============================================================================
+
+    bool SipiCache::rotate_journal(void) {
+        std::string journalname = _cachedir + "/.sipijournal";
+        std::string oldjournalname = journalname + ".old";
+        if (::rename(journalname.c_str(), oldjournalname.c_str()) != 0) {
+            syslog(LOG_ERR, "Couldn't rotate cache journal \"%s\": %s", journalname.c_str(), strerror(errno));
+            return false;
+        }
+        ::close(journal_fd);
+        journal_fd = ::open(journalname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (journal_fd < 0) {
+            syslog(LOG_ERR, "Couldn't open cache journal \"%s\": %s", journalname.c_str(), strerror(errno));
+        }
+        return true;
+    }
+    //============================================================================
+
+    void SipiCache::run_compactor(void) {
+        //
+        // The snapshot is taken after the journal has been rotated. Every change not yet in the old journal
+        // is in the new one, thus replaying the old journal and then the new one on top of the snapshot
+        // (even if it already contains some of the newer changes) restores the index. Once the snapshot is
+        // written, the old journal is not needed anymore.
+        //
+        std::unique_lock<std::mutex> journal_guard(journal_locking);
+        while (true) {
+            compact_cond.wait(journal_guard, [this] { return compact_pending || compactor_stop; });
+            if (compactor_stop) break;
+            journal_guard.unlock();
+            bool ok = write_snapshot();
+            if (ok) (void) ::unlink((_cachedir + "/.sipijournal.old").c_str());
+            journal_guard.lock();
+            if (ok) old_journal = false;
+            compact_pending = false;
+        }
+    }
+    //============================================================================
+
+    void SipiCache::journal(char op, const std::string &canonical, const CacheRecord *cr, time_t access_time) {
+        std::string buf;
+        encode_record(buf, op, canonical, cr, access_time);
+
+        std::lock_guard<std::mutex> journal_guard(journal_locking);
+        if (journal_fd < 0) return;
+        if (::write(journal_fd, buf.data(), buf.size()) != (ssize_t) buf.size()) {
+            syslog(LOG_ERR, "Couldn't write to cache journal: %s", strerror(errno));
+        }
+        if ((++journal_entries > std::max<size_t>(journal_min_entries, nfiles)) && !compact_pending) {
+            //
+            // if the last snapshot failed, the old journal is still needed and the journal is not rotated again
+            //
+            if (old_journal || (old_journal = rotate_journal())) {
+                compact_pending = true;
+                compact_cond.notify_one();
+            }
+            journal_entries = 0;
+        }
     }
     //============================================================================
 
@@ -267,41 +657,92 @@ namespace Sipi {
     }
     //============================================================================
 
-    int SipiCache::purge(bool use_lock) {
+    bool SipiCache::is_blocked(const std::string &path) {
+        BlockShard &bshard = block_shard(path);
+        std::lock_guard<std::mutex> block_guard(bshard.locking);
+        return bshard.blocked_files.find(path) != bshard.blocked_files.end();
+    }
+    //============================================================================
+
+    double SipiCache::priority(const CacheEntry &entry) {
+        if (eviction_policy == EVICT_GDSF) {
+            //
+            // H = L + frequency * cost / size, where L is the priority of the last evicted file
+            //
+            double cost = std::max(entry.cr.cost, 1.);
+            double size = (double) std::max<off_t>(entry.cr.fsize, 1);
+            return entry.gdsf_base + (double) (entry.cr.nhits + 1) * cost / size;
+        }
+        return (double) entry.cr.access_time;
+    }
+    //============================================================================
+
+    int SipiCache::purge(void) {
         if ((max_cachesize == 0) && (max_nfiles == 0)) return 0; // allow cache to grow indefinitely! dangerous!!
         int n = 0;
 
         if (((max_cachesize > 0) && (cachesize >= max_cachesize)) || ((max_nfiles > 0) && (nfiles >= max_nfiles))) {
-            std::vector<AListEle> alist;
-            std::unique_lock<std::mutex> locking_mutex_guard(locking, std::defer_lock);
-            if (use_lock) locking_mutex_guard.lock();
-
-            for (const auto &ele : cachetable) {
-                AListEle al = {ele.first, ele.second.access_time, ele.second.fsize};
-                alist.push_back(al);
-            }
-
-            sort(alist.begin(), alist.end(), _compare_access_time_asc);
+            std::unique_lock<std::mutex> purge_guard(purge_locking, std::try_to_lock);
+            if (!purge_guard.owns_lock()) return 0; // another thread is already purging
 
             long long cachesize_goal = max_cachesize * cache_hysteresis;
             int nfiles_goal = max_nfiles * cache_hysteresis;
+            unsigned attempts = nfiles; // every file is visited at most once (blocked files are skipped)
 
-            for (const auto &ele : alist) {
-                syslog(LOG_DEBUG, "Purging from cache \"%s\"...", cachetable[ele.canonical].cachepath.c_str());
-                std::string delpath = _cachedir + "/" + cachetable[ele.canonical].cachepath;
-
-                try {
-                    int cnt = blocked_files.at(delpath);
-                    syslog(LOG_WARNING, "Couldn't remove cache file for %s: file in use (%d)!", ele.canonical.c_str(), cnt);
-                } catch (const std::out_of_range &ex) {
-                    ::unlink(delpath.c_str());
-                    cachesize -= cachetable[ele.canonical].fsize;
-                    --nfiles;
-                    ++n;
-                    (void) cachetable.erase(ele.canonical);
-                }
+            while (attempts-- > 0) {
                 if ((max_cachesize > 0) && (cachesize < cachesize_goal)) break;
                 if ((max_nfiles > 0) && (nfiles < nfiles_goal)) break;
+
+                //
+                // find the file with the lowest priority among the least recently used files of all
+                // shards. For LRU only the oldest file of each shard is considered, for GDSF a few
+                // of the oldest files are sampled
+                //
+                size_t nsamples = (eviction_policy == EVICT_GDSF) ? 4 : 1;
+                size_t victim = nshards;
+                std::string victim_canonical;
+                double lowest = 0.;
+                for (size_t i = 0; i < nshards; i++) {
+                    std::lock_guard<std::mutex> shard_guard(cache_shards[i].locking);
+                    size_t k = 0;
+                    for (auto it = cache_shards[i].lru.rbegin(); (it != cache_shards[i].lru.rend()) && (k < nsamples); ++it, ++k) {
+                        double prio = priority(cache_shards[i].cachetable[*it]);
+                        if ((victim == nshards) || (prio < lowest)) {
+                            victim = i;
+                            victim_canonical = *it;
+                            lowest = prio;
+                        }
+                    }
+                }
+                if (victim == nshards) break; // cache is empty
+
+                CacheShard &shard = cache_shards[victim];
+                std::string canonical = victim_canonical;
+                bool removed = false;
+                {
+                    std::lock_guard<std::mutex> shard_guard(shard.locking);
+                    auto victim_it = shard.cachetable.find(canonical);
+                    if (victim_it == shard.cachetable.end()) continue; // removed in the meantime
+                    CacheEntry &entry = victim_it->second;
+                    syslog(LOG_DEBUG, "Purging from cache \"%s\"...", entry.cr.cachepath.c_str());
+                    std::string delpath = _cachedir + "/" + entry.cr.cachepath;
+
+                    if (is_blocked(delpath)) {
+                        syslog(LOG_WARNING, "Couldn't remove cache file for %s: file in use!", canonical.c_str());
+                        shard.lru.splice(shard.lru.begin(), shard.lru, entry.lru_pos); // it's in use, thus recently used
+                    } else {
+                        ::unlink(delpath.c_str());
+                        cachesize -= entry.cr.fsize;
+                        --nfiles;
+                        ++n;
+                        ++nevictions;
+                        if (eviction_policy == EVICT_GDSF) gdsf_clock = lowest; // aging of the remaining files
+                        shard.lru.erase(entry.lru_pos);
+                        (void) shard.cachetable.erase(victim_it);
+                        removed = true;
+                    }
+                }
+                if (removed) journal('D', canonical, nullptr);
             }
         }
 
@@ -309,11 +750,14 @@ namespace Sipi {
     }
     //============================================================================
 
-    std::string SipiCache::check(const std::string &origpath_p, const std::string &canonical_p, bool block_file) {
+    std::string SipiCache::check(const std::string &origpath_p, const std::string &canonical_p, bool block_file,
+                                 const struct stat *fileinfo_p) {
         struct stat fileinfo;
         SipiCache::CacheRecord fr;
 
-        if (stat(origpath_p.c_str(), &fileinfo) != 0) {
+        if (fileinfo_p != nullptr) {
+            fileinfo = *fileinfo_p;
+        } else if (stat(origpath_p.c_str(), &fileinfo) != 0) {
             throw SipiError(__file__, __LINE__, "Couldn't stat file \"" + origpath_p + "\"!", errno);
         }
 #if defined(HAVE_ST_ATIMESPEC)
@@ -324,37 +768,84 @@ namespace Sipi {
 
         std::string res;
 
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        try {
-            fr = cachetable.at(canonical_p);
-        } catch (const std::out_of_range &oor) {
-            return res; // return empty string, because we didn't find the file in cache
-        }
-
         //
         // get the current time (seconds since Epoch)
         //
         time_t at;
         time(&at);
-        cachetable[canonical_p].access_time = at;// update the access time!
+        bool journal_access = false;
+        if (sketch != nullptr) sketch->increment(canonical_p);
+        {
+            CacheShard &shard = cache_shard(canonical_p);
+            std::lock_guard<std::mutex> shard_guard(shard.locking);
+            auto it = shard.cachetable.find(canonical_p);
+            if (it == shard.cachetable.end()) {
+                ++nmisses;
+                return res; // return empty string, because we didn't find the file in cache
+            }
+            fr = it->second.cr;
+
+            it->second.cr.access_time = at;// update the access time!
+            it->second.cr.nhits++;
+            it->second.gdsf_base = gdsf_clock.load();
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_pos); // ... and move it to the front of the LRU list
+            if (difftime(at, it->second.journaled_atime) >= 60.) { // access times are journaled with a resolution of a minute
+                it->second.journaled_atime = at;
+                journal_access = true;
+            }
 
-        if (tcompare(mtime, fr.mtime) > 0) { // original file is newer than cache, we have to replace it...
-            return res; // return empty string, means "replace the file in the cache!"
-        } else {
-            std::string res = _cachedir + "/" + fr.cachepath;
-            if (block_file) {
-                blocked_files[res]++;
+            if (tcompare(mtime, fr.mtime) <= 0) { // otherwise the original file is newer than cache, we have to replace it...
+                ++nhits;
+                hit_bytes += fr.fsize;
+                res = _cachedir + "/" + fr.cachepath;
+                if (block_file) {
+                    BlockShard &bshard = block_shard(res);
+                    std::lock_guard<std::mutex> block_guard(bshard.locking);
+                    bshard.blocked_files[res]++;
+                }
+            } else {
+                ++nmisses;
             }
-            return res;
         }
+        if (journal_access) journal('T', canonical_p, nullptr, at);
+
+        return res; // an empty string means "replace the file in the cache!"
+    }
+    //============================================================================
+
+    bool SipiCache::admit(const std::string &canonical_p) {
+        if (admission_policy == ADMIT_ALL) return true;
+
+        //
+        // as long as there is room, every file is admitted
+        //
+        if (((max_cachesize == 0) || (cachesize < max_cachesize)) && ((max_nfiles == 0) || (nfiles + 1 < max_nfiles))) {
+            return true;
+        }
+
+        //
+        // TinyLFU: the new file has to be requested more often than the file that would be evicted next in its shard
+        //
+        std::string victim;
+        {
+            CacheShard &shard = cache_shard(canonical_p);
+            std::lock_guard<std::mutex> shard_guard(shard.locking);
+            if (shard.lru.empty()) return true;
+            victim = shard.lru.back();
+        }
+        if (sketch->estimate(canonical_p) > sketch->estimate(victim)) return true;
+        ++nrejected;
+        return false;
     }
     //============================================================================
 
     void SipiCache::deblock(std::string res) {
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        blocked_files[res]--;
-        if (blocked_files[res] < 1) {
-            blocked_files.erase(res);
+        BlockShard &bshard = block_shard(res);
+        std::lock_guard<std::mutex> block_guard(bshard.locking);
+        auto it = bshard.blocked_files.find(res);
+        if (it == bshard.blocked_files.end()) return;
+        if (--(it->second) < 1) {
+            bshard.blocked_files.erase(it);
         }
     }
 
@@ -363,8 +854,26 @@ namespace Sipi {
      *
      * \return the name of the file.
      */
-    std::string SipiCache::getNewCacheFileName(void) {
-        std::string filename = _cachedir + "/cache_XXXXXXXXXX";
+    std::string SipiCache::getNewCacheFileName(const std::string &canonical_p) {
+        std::string dirpath = _cachedir;
+        if (!canonical_p.empty()) {
+            //
+            // the files are distributed over 256 x 256 subdirectories (e.g. "3f/a0") by the hash of the canonical URL
+            //
+            char subdir[8];
+            uint32_t h = canonical_hash(canonical_p);
+            (void) snprintf(subdir, sizeof(subdir), "%02x", (unsigned) (h >> 24));
+            dirpath += std::string("/") + subdir;
+            if ((mkdir(dirpath.c_str(), 0755) != 0) && (errno != EEXIST)) {
+                throw SipiError(__file__, __LINE__, std::string("Couldn't create cache directory ") + dirpath, errno);
+            }
+            (void) snprintf(subdir, sizeof(subdir), "%02x", (unsigned) ((h >> 16) & 0xff));
+            dirpath += std::string("/") + subdir;
+            if ((mkdir(dirpath.c_str(), 0755) != 0) && (errno != EEXIST)) {
+                throw SipiError(__file__, __LINE__, std::string("Couldn't create cache directory ") + dirpath, errno);
+            }
+        }
+        std::string filename = dirpath + "/cache_XXXXXXXXXX";
         char *c_filename = &filename[0];
         int tmp_fd = mkstemp(c_filename);
 
@@ -386,14 +895,19 @@ namespace Sipi {
             size_t tile_w_p,
             size_t tile_h_p,
             int clevels_p,
-            int numpages_p) {
-        size_t pos = cachepath_p.rfind('/');
+            int numpages_p,
+            double render_cost_p) {
+        //
+        // the cache path is stored relative to the cache directory (including the subdirectories)
+        //
         std::string cachepath;
+        std::string cachedir_prefix = _cachedir + "/";
 
-        if (pos != std::string::npos) {
-            cachepath = cachepath_p.substr(pos + 1);
+        if (cachepath_p.compare(0, cachedir_prefix.size(), cachedir_prefix) == 0) {
+            cachepath = cachepath_p.substr(cachedir_prefix.size());
         } else {
-            cachepath = cachepath_p;
+            size_t pos = cachepath_p.rfind('/');
+            cachepath = (pos != std::string::npos) ? cachepath_p.substr(pos + 1) : cachepath_p;
         }
 
         struct stat fileinfo;
@@ -425,58 +939,69 @@ namespace Sipi {
         time(&at);
         fr.access_time = at;
         fr.fsize = fileinfo.st_size;
+        fr.nhits = 0;
+        fr.cost = render_cost_p;
+        miss_bytes += fr.fsize;
+
+        {
+            //
+            // we check if there is already a file with the same canonical name. If so,
+            // we remove it
+            //
+            CacheShard &shard = cache_shard(canonical_p);
+            std::lock_guard<std::mutex> shard_guard(shard.locking);
+            auto it = shard.cachetable.find(canonical_p);
+            if (it != shard.cachetable.end()) {
+                std::string toremove = _cachedir + "/" + it->second.cr.cachepath;
+                ::unlink(toremove.c_str());
+                cachesize -= it->second.cr.fsize;
+                --nfiles;
+                shard.lru.erase(it->second.lru_pos);
+                shard.cachetable.erase(it);
+            }
 
-        //
-        // we check if there is already a file with the same canonical name. If so,
-        // we remove it
-        //
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-        try {
-            SipiCache::CacheRecord tmp_fr = cachetable.at(canonical_p);
-            std::string toremove = _cachedir + "/" + tmp_fr.cachepath;
-            ::unlink(toremove.c_str());
-            cachesize -= tmp_fr.fsize;
-            --nfiles;
-        } catch (const std::out_of_range &oor) {
-            ; // do nothing...
+            shard.lru.push_front(canonical_p);
+            shard.cachetable[canonical_p] = {fr, shard.lru.begin(), fr.access_time, gdsf_clock.load()};
+            cachesize += fr.fsize;
+            ++nfiles;
         }
+        journal('A', canonical_p, &fr, fr.access_time);
 
-        purge(false);
-
-        cachetable[canonical_p] = fr;
-        cachesize += fr.fsize;
-
-        SipiCache::SizeRecord tmp_cr = {img_w_p, img_h_p, tile_w_p, tile_h_p, clevels_p, numpages_p};
-        sizetable[origpath_p] = tmp_cr;
+        {
+            SizeShard &sshard = size_shard(origpath_p);
+            std::lock_guard<std::mutex> size_guard(sshard.locking);
+            SipiCache::SizeRecord tmp_cr = {img_w_p, img_h_p, tile_w_p, tile_h_p, clevels_p, numpages_p, fr.mtime};
+            sshard.sizetable[origpath_p] = tmp_cr;
+        }
 
-        ++nfiles;
+        purge();
     }
     //============================================================================
 
     bool SipiCache::remove(const std::string &canonical_p) {
-        SipiCache::CacheRecord fr;
-        std::lock_guard<std::mutex> locking_mutex_guard(locking);
-
-        try {
-            fr = cachetable.at(canonical_p);
-        } catch (const std::out_of_range &oor) {
-            syslog(LOG_WARNING, "Couldn't remove cache for %s: not existing!", canonical_p.c_str());
-            return false; // return empty string, because we didn't find the file in cache
-        }
+        {
+            CacheShard &shard = cache_shard(canonical_p);
+            std::lock_guard<std::mutex> shard_guard(shard.locking);
+
+            auto it = shard.cachetable.find(canonical_p);
+            if (it == shard.cachetable.end()) {
+                syslog(LOG_WARNING, "Couldn't remove cache for %s: not existing!", canonical_p.c_str());
+                return false; // return empty string, because we didn't find the file in cache
+            }
 
-        std::string delpath = _cachedir + "/" + cachetable[canonical_p].cachepath;
-        try {
-            int cnt = blocked_files.at(delpath);
-            syslog(LOG_WARNING, "Couldn't remove cache for %s: file in use (%d)!", canonical_p.c_str(), cnt);
-            return false;
-        } catch (const std::out_of_range &ex) {
-            ;
+            std::string delpath = _cachedir + "/" + it->second.cr.cachepath;
+            if (is_blocked(delpath)) {
+                syslog(LOG_WARNING, "Couldn't remove cache for %s: file in use!", canonical_p.c_str());
+                return false;
+            }
+            syslog(LOG_DEBUG, "Delete from cache \"%s\"...", it->second.cr.cachepath.c_str());
+            ::remove(delpath.c_str());
+            cachesize -= it->second.cr.fsize;
+            shard.lru.erase(it->second.lru_pos);
+            shard.cachetable.erase(it);
+            --nfiles;
         }
-        syslog(LOG_DEBUG, "Delete from cache \"%s\"...", cachetable[canonical_p].cachepath.c_str());
-        ::remove(delpath.c_str());
-        cachesize -= cachetable[canonical_p].fsize;
-        cachetable.erase(canonical_p);
-        --nfiles;
+        journal('D', canonical_p, nullptr);
 
         return true;
     }
@@ -484,10 +1009,15 @@ namespace Sipi {
 
     void SipiCache::loop(ProcessOneCacheFile worker, void *userdata, SortMethod sm) {
         std::vector<AListEle> alist;
+        std::unordered_map<std::string, CacheRecord> records; // snapshot, the worker is called without holding a lock
 
-        for (const auto &ele : cachetable) {
-            AListEle al = {ele.first, ele.second.access_time, ele.second.fsize};
-            alist.push_back(al);
+        for (auto &shard : cache_shards) {
+            std::lock_guard<std::mutex> shard_guard(shard.locking);
+            for (const auto &ele : shard.cachetable) {
+                AListEle al = {ele.first, ele.second.cr.access_time, ele.second.cr.fsize};
+                alist.push_back(al);
+                records[ele.first] = ele.second.cr;
+            }
         }
 
         switch (sm) {
@@ -515,12 +1045,17 @@ namespace Sipi {
         int i = 1;
 
         for (const auto &ele : alist) {
-            worker(i, ele.canonical, cachetable[ele.canonical], userdata);
+            worker(i, ele.canonical, records[ele.canonical], userdata);
             i++;
         }
     }
     //============================================================================
 
+    SipiCache::Stats SipiCache::getStats(void) {
+        return {nhits, nmisses, hit_bytes, miss_bytes, nrejected, nevictions};
+    }
+    //============================================================================
+
     bool SipiCache::getSize(
             const std::string &origname_p,
             size_t &img_w,
@@ -528,9 +1063,12 @@ namespace Sipi {
             size_t &tile_w,
             size_t &tile_h,
             int &clevels,
-            int &numpages) {
+            int &numpages,
+            const struct stat *fileinfo_p) {
         struct stat fileinfo;
-        if (stat(origname_p.c_str(), &fileinfo) != 0) {
+        if (fileinfo_p != nullptr) {
+            fileinfo = *fileinfo_p;
+        } else if (stat(origname_p.c_str(), &fileinfo) != 0) {
             throw SipiError(__file__, __LINE__, "Couldn't stat file \"" + origname_p + "\"!", errno);
         }
 #if defined(HAVE_ST_ATIMESPEC)
@@ -539,24 +1077,24 @@ namespace Sipi {
         time_t mtime = fileinfo.st_mtime;
 #endif
 
-        try {
-            SipiCache::SizeRecord sr = sizetable.at(origname_p);
-            if (tcompare(mtime, sr.mtime) > 0) { // original file is newer than cache, we have to replace it..
-                std::lock_guard<std::mutex> locking_mutex_guard(locking);
-
-                sizetable.erase(origname_p);
-                return false; // means "replace the file in the cache"
-            }
-
-            img_w = sr.img_w;
-            img_h = sr.img_h;
-            tile_w = sr.tile_w;
-            tile_h = sr.tile_h;
-            clevels = sr.clevels;
-            numpages = sr.numpages;
-        } catch (const std::out_of_range &oor) {
+        SizeShard &sshard = size_shard(origname_p);
+        std::lock_guard<std::mutex> size_guard(sshard.locking);
+        auto it = sshard.sizetable.find(origname_p);
+        if (it == sshard.sizetable.end()) {
             return false;
         }
+        SipiCache::SizeRecord &sr = it->second;
+        if (tcompare(mtime, sr.mtime) > 0) { // original file is newer than cache, we have to replace it..
+            sshard.sizetable.erase(it);
+            return false; // means "replace the file in the cache"
+        }
+
+        img_w = sr.img_w;
+        img_h = sr.img_h;
+        tile_w = sr.tile_w;
+        tile_h = sr.tile_h;
+        clevels = sr.clevels;
+        numpages = sr.numpages;
 
         return true;
     }
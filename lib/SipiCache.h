@@ -24,12 +24,20 @@
 #ifndef __defined_sipi_cache_h
 #define __defined_sipi_cache_h
 
+#include <atomic>
+#include <cstdint>
 #include <ctime>
+#include <list>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 #include <unordered_set>
 #include <mutex>
+#include <condition_variable>
 #include <string>
+#include <thread>
 #include <sys/time.h>
+#include <sys/stat.h>
 #include <algorithm>
 
 #include "HasAtimeSpec.h"
@@ -52,17 +60,46 @@ namespace Sipi {
         } SortMethod;
 
         /*!
-         * A struct which is used to read/write the file containing all cache information on
-         * server start or server shutdown.
+         * Policy used to select the files to be removed if the cache is full
+         */
+        typedef enum {
+            EVICT_LRU,  //!< least recently used file first
+            EVICT_GDSF, //!< Greedy-Dual-Size-Frequency: files which are small, often used and expensive to render are kept
+        } EvictionPolicy;
+
+        /*!
+         * Policy used to decide if a newly rendered file is put into a full cache
+         */
+        typedef enum {
+            ADMIT_ALL,     //!< every file is cached
+            ADMIT_TINYLFU, //!< only files requested more often than the file they would replace (TinyLFU)
+        } AdmissionPolicy;
+
+        /*!
+         * Counters for comparing cache policies
+         */
+        typedef struct {
+            unsigned long long hits;        //!< number of requests served from the cache
+            unsigned long long misses;      //!< number of requests not found in the cache
+            unsigned long long hit_bytes;   //!< bytes served from the cache
+            unsigned long long miss_bytes;  //!< bytes of the files rendered and added to the cache
+            unsigned long long rejected;    //!< number of renditions not admitted to the cache
+            unsigned long long evictions;   //!< number of files removed to make room
+        } Stats;
+
+        /*!
+         * A struct which is used to read/write the snapshot (.sipicache) and the journal (.sipijournal)
+         * containing all cache information. Each record is followed by the canonical URL, the original path
+         * and the cache path (without terminating null character), thus strings of any length can be stored.
          */
         typedef struct {
             size_t img_w, img_h;
             size_t tile_w, tile_h;
             int clevels;
             int numpages;
-            char canonical[256];
-            char origpath[256];
-            char cachepath[256];
+            uint32_t canonical_len; //!< length of the canonical URL following the record
+            uint32_t origpath_len;  //!< length of the original path following the canonical URL
+            uint32_t cachepath_len; //!< length of the cache path following the original path
 #if defined(HAVE_ST_ATIMESPEC)
             struct timespec mtime; //!< entry time into cache
 #else
@@ -70,6 +107,8 @@ namespace Sipi {
 #endif
             time_t access_time;     //!< last access in seconds
             off_t fsize;
+            uint32_t nhits;         //!< number of cache hits
+            double cost;            //!< time needed to render the file in milliseconds
         } FileCacheRecord;
 
         /*!
@@ -91,6 +130,8 @@ namespace Sipi {
 #endif
             time_t access_time;     //!< last access in seconds
             off_t fsize;
+            uint32_t nhits;         //!< number of cache hits
+            double cost;            //!< time needed to render the file in milliseconds
         } CacheRecord;
 
         /*!
@@ -120,16 +161,126 @@ namespace Sipi {
                                             void *userdata);
 
     private:
-        std::mutex locking;
+        /*!
+         * Entry of the cache table. Each entry knows its position in the LRU list of its shard,
+         * thus it can be moved to the front or removed in O(1).
+         */
+        typedef struct {
+            CacheRecord cr;
+            std::list<std::string>::iterator lru_pos;
+            time_t journaled_atime; //!< access time last written to the journal
+            double gdsf_base;       //!< value of the GDSF clock at the last access
+        } CacheEntry;
+
+        /*!
+         * Count-min sketch with 4 bit counters estimating how often a canonical URL has been requested
+         * recently. Used for the TinyLFU admission policy. The counters are halved periodically, thus
+         * old requests are forgotten.
+         */
+        class FrequencySketch {
+        private:
+            std::vector<std::atomic<uint8_t>> table;
+            size_t width;
+            std::atomic<size_t> additions;
+
+        public:
+            FrequencySketch(size_t expected_entries);
+
+            void increment(const std::string &key);
+
+            unsigned estimate(const std::string &key);
+        };
+
+        /*!
+         * The cached files are distributed over several shards (by the hash of the canonical URL),
+         * each with its own lock and its own LRU list (most recently used first).
+         */
+        typedef struct {
+            std::mutex locking;
+            std::unordered_map<std::string, CacheEntry> cachetable; //!< map of the cached files of this shard
+            std::list<std::string> lru; //!< canonical URLs, most recently used first
+        } CacheShard;
+
+        typedef struct {
+            std::mutex locking;
+            std::unordered_map<std::string, SizeRecord> sizetable; //!< map of original file paths and image size
+        } SizeShard;
+
+        typedef struct {
+            std::mutex locking;
+            std::unordered_map<std::string, int> blocked_files; //!< cache files in use (path -> counter)
+        } BlockShard;
+
+        static const size_t nshards = 16;
+
         std::string _cachedir; //!< path to the cache directory
-        std::unordered_map<std::string, CacheRecord> cachetable; //!< Internal map of all cached files
-        std::unordered_map<std::string, SizeRecord> sizetable; //!< Internal map of original file paths and image size
-        std::unordered_map<std::string, int> blocked_files;
-        unsigned long long cachesize; //!< number of bytes in the cache
+        CacheShard cache_shards[nshards];
+        SizeShard size_shards[nshards];
+        BlockShard block_shards[nshards];
+        std::mutex purge_locking; //!< only one thread is purging at a time
+        std::thread cleaner; //!< removes files not known to the cache after startup
+        std::mutex journal_locking; //!< protects the journal, always acquired after a shard lock has been released
+        int journal_fd; //!< file descriptor of the journal (.sipijournal)
+        size_t journal_entries; //!< number of entries written to the journal since the last compaction
+        bool old_journal; //!< the rotated journal (.sipijournal.old) exists and is not yet covered by a snapshot
+        bool compact_pending; //!< the compactor has been asked to write a snapshot
+        bool compactor_stop; //!< the compactor thread has to terminate
+        std::condition_variable compact_cond; //!< wakes up the compactor, used with journal_locking
+        std::thread compactor; //!< writes the snapshots, thus request threads never wait for a compaction
+        std::atomic<unsigned long long> cachesize; //!< number of bytes in the cache
         unsigned long long max_cachesize; //!< maximum number of bytes that can be cached
-        unsigned nfiles; //!< number of files in cache
+        std::atomic<unsigned> nfiles; //!< number of files in cache
         unsigned max_nfiles; //!< maximum number of files that can be cached
         float cache_hysteresis; //!< If files are purged, what percentage we go below the maximum
+        EvictionPolicy eviction_policy;
+        AdmissionPolicy admission_policy;
+        std::atomic<double> gdsf_clock; //!< priority of the last evicted file (GDSF aging)
+        std::unique_ptr<FrequencySketch> sketch; //!< request frequencies (only for ADMIT_TINYLFU)
+        std::atomic<unsigned long long> nhits, nmisses, hit_bytes, miss_bytes, nrejected, nevictions;
+
+        inline static size_t shard_index(const std::string &key) { return std::hash<std::string>()(key) % nshards; }
+
+        inline CacheShard &cache_shard(const std::string &canonical) { return cache_shards[shard_index(canonical)]; }
+
+        inline SizeShard &size_shard(const std::string &origpath) { return size_shards[shard_index(origpath)]; }
+
+        inline BlockShard &block_shard(const std::string &path) { return block_shards[shard_index(path)]; }
+
+        bool is_blocked(const std::string &path);
+
+        /*!
+         * Priority of a cached file according to the eviction policy, the file with the lowest priority is
+         * removed first. The shard lock must be held.
+         */
+        double priority(const CacheEntry &entry);
+
+        /*!
+         * Appends an entry to the journal ('A': add, 'D': delete, 'T': access time). If the journal has
+         * become too long, it is rotated and the compactor thread is asked to write a new snapshot.
+         */
+        void journal(char op, const std::string &canonical, const CacheRecord *cr, time_t access_time = 0);
+
+        /*!
+         * Renames the journal to .sipijournal.old and starts a new one. The journal lock must be held.
+         */
+        bool rotate_journal(void);
+
+        /*!
+         * Writes a snapshot of the index to .sipicache. Only the shard locks are acquired.
+         */
+        bool write_snapshot(void);
+
+        /*!
+         * Writes a snapshot of the index to .sipicache and truncates the journal. The journal lock must be held,
+         * only used at startup and shutdown.
+         */
+        void compact(void);
+
+        /*!
+         * Main loop of the compactor thread.
+         */
+        void run_compactor(void);
+
     public:
 
         /*!
@@ -145,9 +296,12 @@ namespace Sipi {
          * \param[in] cache_hsyteresis_p If the maximum size of the cache is reached, some of the files that
          * have not been accessed recently will be deleted. The cache_hysteresis (between 0.0 and 1.0) defines the
          * amount of bytes that have to be cleared in relation to the max_cachesize_p.
+         * \param[in] eviction_policy_p Policy used to select the files to be removed
+         * \param[in] admission_policy_p Policy used to decide if a new file is added to a full cache
          */
         SipiCache(const std::string &cachedir_p, long long max_cachesize_p = 0, unsigned max_nfiles_p = 0,
-                  float cache_hysteresis_p = 0.1);
+                  float cache_hysteresis_p = 0.1, EvictionPolicy eviction_policy_p = EVICT_LRU,
+                  AdmissionPolicy admission_policy_p = ADMIT_ALL);
 
         /*!
          * Cleans up the cache, serializes the actual cache content into a file and closes all caching
@@ -173,34 +327,48 @@ namespace Sipi {
 
         /*!
          * Purge the cache to make room for more files. Uses the cache_hysteresis, max_cachesize and max_nfiles values
-         * for the amount of files that should be purged.
-         *
-         * \param[in] Use the cache-lock mutex
+         * for the amount of files that should be purged. The least recently used files are removed first, the
+         * cost is proportional to the number of removed files. If another thread is already purging, nothing is done.
          *
          * \returns Number of files being purged.
          */
-        int purge(bool use_lock = true);
+        int purge(void);
 
         /*!
          * check if a file is already in the cache and up-to-date
          *
          * \param[in] origpath_p The original path to the master file
          * \param[in] canonical_p The canonical URL according to the IIIF standard
+         * \param[in] fileinfo_p Stat information of the master file if the caller already has it (avoids a stat)
          *
          * \returns Returns an empty string if the file is not in the cache or if the file needs to be replaced.
          *          Otherwise returns tha path to the cached file.
          */
-        std::string check(const std::string &origpath_p, const std::string &canonical_p, bool block_file = false);
+        std::string check(const std::string &origpath_p, const std::string &canonical_p, bool block_file = false,
+                          const struct stat *fileinfo_p = nullptr);
 
         void deblock(std::string res);
 
 
         /*!
-         * Creates a new cache file with a unique name.
+         * Creates a new cache file with a unique name. If a canonical URL is given, the file is placed
+         * in a subdirectory derived from the hash of the URL, thus the directories don't grow too large.
+         *
+         * \param[in] canonical_p The canonical URL of the file to be cached
          *
          * \return the name of the file.
          */
-        std::string getNewCacheFileName(void);
+        std::string getNewCacheFileName(const std::string &canonical_p = "");
+
+        /*!
+         * Decide if a newly rendered file should be added to the cache. If the cache is full, the
+         * admission policy may reject files which are requested less often than the files they would replace.
+         *
+         * \param[in] canonical_p Canonical IIIF URL
+         *
+         * \returns true, if the file should be rendered into the cache
+         */
+        bool admit(const std::string &canonical_p);
 
         /*!
          * Add (or replace) a file to the cache.
@@ -208,6 +376,7 @@ namespace Sipi {
          * \param[in] origpath_p Path to the original master file
          * \param[in] canonical_p Canonical IIIF URL
          * \param[in] cachepath_p Path of the cache file
+         * \param[in] render_cost_p Time needed to render the file in milliseconds (used by EVICT_GDSF)
          */
         void add(
                 const std::string &origpath_p,
@@ -218,7 +387,8 @@ namespace Sipi {
                 size_t tile_w_p = 0,
                 size_t tile_h_p = 0,
                 int clevels_p = 0,
-                int numpages_p = 0);
+                int numpages_p = 0,
+                double render_cost_p = 0.);
 
         /*!
          * Remove one file from the cache
@@ -251,6 +421,15 @@ namespace Sipi {
          */
         inline unsigned getMaxNfiles(void) { return max_nfiles; }
 
+        /*!
+         * Get the counters of hits, misses, rejected and evicted files
+         */
+        Stats getStats(void);
+
+        inline EvictionPolicy getEvictionPolicy(void) { return eviction_policy; }
+
+        inline AdmissionPolicy getAdmissionPolicy(void) { return admission_policy; }
+
         /*!
          * get the path to the cache directory
          * \returns Path of the cache directory
@@ -273,6 +452,7 @@ namespace Sipi {
          * \param[in] original filename
          * \param[out] img_w Width of original image in pixels
          * \param[out] img_h Height of original image in pixels
+         * \param[in] fileinfo_p Stat information of the master file if the caller already has it (avoids a stat)
          */
         bool getSize(
                 const std::string &origname_p,
@@ -281,7 +461,8 @@ namespace Sipi {
                 size_t &tile_w,
                 size_t &tile_h,
                 int &clevels,
-                int &numpages);
+                int &numpages,
+                const struct stat *fileinfo_p = nullptr);
     };
 }
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <exception>
+
+#include "SipiComputePool.h"
+
+namespace Sipi {
+
+    SipiComputePool *SipiComputePool::_shared = nullptr;
+
+    SipiComputePool::SipiComputePool(int nthreads_p) : stopped(false), busy(0), max_queue_depth(0), tasks(0),
+                                                        busy_usec(0) {
+        nthreads = (nthreads_p > 0) ? nthreads_p : static_cast<int>(std::thread::hardware_concurrency());
+        if (nthreads < 1) nthreads = 1;
+        available = nthreads;
+        started = std::chrono::steady_clock::now();
+        for (int i = 0; i < nthreads; i++) {
+            workers.emplace_back(&SipiComputePool::worker, this);
+        }
+    }
+    //============================================================================
+
+    SipiComputePool::~SipiComputePool() {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            stopped = true;
+        }
+        jobs_cond.notify_all();
+        for (auto &w : workers) {
+            w.join();
+        }
+        if (_shared == this) _shared = nullptr;
+    }
+    //============================================================================
+
+    void SipiComputePool::worker(void) {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(jobs_mutex);
+                jobs_cond.wait(lock, [this] { return stopped || !jobs.empty(); });
+                if (jobs.empty()) return; // stopped and nothing left to do
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            busy++;
+            auto t0 = std::chrono::steady_clock::now();
+            job();
+            auto t1 = std::chrono::steady_clock::now();
+            busy_usec += std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+            tasks++;
+            busy--;
+        }
+    }
+    //============================================================================
+
+    void SipiComputePool::submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            jobs.push_back(std::move(job));
+            if (jobs.size() > max_queue_depth) max_queue_depth = jobs.size();
+        }
+        jobs_cond.notify_one();
+    }
+    //============================================================================
+
+    int SipiComputePool::reserve(int n) {
+        if (n <= 0) return 0;
+        int avail = available.load();
+        int granted;
+        do {
+            granted = std::min(n, avail);
+            if (granted <= 0) return 0;
+        } while (!available.compare_exchange_weak(avail, avail - granted));
+        return granted;
+    }
+    //============================================================================
+
+    void SipiComputePool::release(int n) {
+        if (n > 0) available += n;
+    }
+    //============================================================================
+
+    void SipiComputePool::parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)> &func,
+                                       size_t grain) {
+        if (end <= begin) return;
+        if (grain < 1) grain = 1;
+
+        size_t nchunks = (end - begin + grain - 1) / grain;
+        int helpers = (nchunks > 1) ? reserve(static_cast<int>(std::min(nchunks - 1, (size_t) nthreads))) : 0;
+        if (helpers == 0) {
+            func(begin, end);
+            return;
+        }
+
+        //
+        // we use a few more chunks than threads in order to balance uneven work
+        //
+        size_t nparts = std::min(nchunks, (size_t) (helpers + 1) * 4);
+        size_t chunk = (end - begin + nparts - 1) / nparts;
+
+        struct {
+            std::atomic<size_t> next;
+            std::mutex mutex;
+            std::condition_variable cond;
+            int pending;
+            std::exception_ptr error;
+        } state;
+        state.next = begin;
+        state.pending = helpers;
+
+        auto process = [&state, &func, chunk, end]() {
+            size_t b;
+            while ((b = state.next.fetch_add(chunk)) < end) {
+                try {
+                    func(b, std::min(b + chunk, end));
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    if (!state.error) state.error = std::current_exception();
+                    state.next = end; // stop the other threads
+                }
+            }
+        };
+
+        for (int i = 0; i < helpers; i++) {
+            submit([this, &state, &process]() {
+                process();
+                release(1);
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (--state.pending == 0) state.cond.notify_one(); // state lives as long as pending > 0
+            });
+        }
+
+        process();
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.cond.wait(lock, [&state] { return state.pending == 0; });
+        if (state.error) std::rethrow_exception(state.error);
+    }
+    //============================================================================
+
+    SipiComputePool::Stats SipiComputePool::stats(void) {
+        Stats s;
+        s.nthreads = nthreads;
+        s.busy = busy;
+        s.reserved = nthreads - available;
+        {
+            std::lock_guard<std::mutex> lock(jobs_mutex);
+            s.queue_depth = jobs.size();
+            s.max_queue_depth = max_queue_depth;
+        }
+        s.tasks = tasks;
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - started).count();
+        s.utilisation = (elapsed > 0) ? (double) busy_usec / ((double) elapsed * nthreads) : 0.0;
+        return s;
+    }
+    //============================================================================
+
+    void SipiComputePool::run(size_t begin, size_t end, const std::function<void(size_t, size_t)> &func,
+                              size_t grain) {
+        SipiComputePool *pool = _shared;
+        if (pool == nullptr) {
+            if (end > begin) func(begin, end);
+            return;
+        }
+        pool->parallel_for(begin, end, func, grain);
+    }
+    //============================================================================
+
+}
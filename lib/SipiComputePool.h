@@ -0,0 +1,149 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __defined_sipi_compute_pool_h
+#define __defined_sipi_compute_pool_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Sipi {
+
+    /*!
+     * SipiComputePool is the process wide pool of compute threads. It is owned by the
+     * SipiHttpServer and shared by all CPU intensive operations (Kakadu encoding/decoding,
+     * ICC transforms and scaling). The threads of the pool are lent as "tokens": an operation
+     * may only use additional threads if it can reserve them. If the pool is exhausted, the
+     * operation runs in the calling thread. This way the number of busy compute threads never
+     * exceeds the size of the pool, regardless of the number of concurrent requests.
+     */
+    class SipiComputePool {
+    public:
+        /*!
+         * Snapshot of the statistics of the pool
+         */
+        typedef struct {
+            int nthreads; //!< number of worker threads
+            int busy; //!< number of worker threads currently executing a job
+            int reserved; //!< number of threads currently reserved (including Kakadu)
+            size_t queue_depth; //!< number of jobs waiting in the queue
+            size_t max_queue_depth; //!< highest number of jobs which have been waiting
+            unsigned long long tasks; //!< number of jobs executed since start
+            double utilisation; //!< fraction of the worker time spent executing jobs since start
+        } Stats;
+
+    private:
+        static SipiComputePool *_shared;
+
+        int nthreads;
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> jobs;
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_cond;
+        bool stopped;
+
+        std::atomic<int> available; //!< number of threads which may still be reserved
+        std::atomic<int> busy;
+        size_t max_queue_depth;
+        std::atomic<unsigned long long> tasks;
+        std::atomic<unsigned long long> busy_usec;
+        std::chrono::steady_clock::time_point started;
+
+        void worker(void);
+
+        void submit(std::function<void()> job);
+
+    public:
+        /*!
+         * Constructor which starts the worker threads
+         *
+         * \param nthreads_p Number of worker threads. If 0, the number of processors is used.
+         */
+        SipiComputePool(int nthreads_p = 0);
+
+        /*!
+         * Stops all worker threads. Jobs still waiting in the queue are executed before.
+         */
+        ~SipiComputePool();
+
+        SipiComputePool(const SipiComputePool &) = delete;
+
+        SipiComputePool &operator=(const SipiComputePool &) = delete;
+
+        inline int size(void) { return nthreads; }
+
+        /*!
+         * Reserves up to n threads of the pool.
+         *
+         * \param n Number of threads requested
+         * \returns Number of threads granted (may be 0)
+         */
+        int reserve(int n);
+
+        /*!
+         * Gives back threads reserved before
+         *
+         * \param n Number of threads
+         */
+        void release(int n);
+
+        /*!
+         * Executes func on the range [begin, end) which is split into chunks of at least
+         * grain elements. The chunks are processed by as many threads as can be reserved and
+         * by the calling thread. The method returns after all chunks have been processed. An
+         * exception thrown by func is rethrown in the calling thread.
+         *
+         * \param begin Start of the range
+         * \param end End of the range (exclusive)
+         * \param func Function called with the bounds [b, e) of each chunk
+         * \param grain Minimal number of elements of a chunk
+         */
+        void parallel_for(size_t begin, size_t end, const std::function<void(size_t, size_t)> &func, size_t grain = 1);
+
+        Stats stats(void);
+
+        /*!
+         * Registers the pool used by the image processing functions. The caller keeps ownership.
+         *
+         * \param pool Pointer to the pool or nullptr
+         */
+        static inline void shared(SipiComputePool *pool) { _shared = pool; }
+
+        static inline SipiComputePool *shared(void) { return _shared; }
+
+        /*!
+         * Same as parallel_for, but using the shared pool. If no pool has been registered,
+         * func is called once in the calling thread for the whole range.
+         */
+        static void run(size_t begin, size_t end, const std::function<void(size_t, size_t)> &func, size_t grain = 1);
+    };
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SipiDecodedCache.h"
+#include "SipiImage.h"
+
+namespace Sipi {
+
+    SipiDecodedCache::SipiDecodedCache(size_t max_nbytes_p) : images(max_nbytes_p, max_nbytes_p / 2) {}
+    //============================================================================
+
+    std::string SipiDecodedCache::key(const std::string &path, time_t mtime, off_t fsize, int reduce) {
+        return path + "|" + std::to_string(mtime) + "|" + std::to_string(fsize) + "|" + std::to_string(reduce);
+    }
+    //============================================================================
+
+    std::shared_ptr<const SipiImage> SipiDecodedCache::get(const std::string &key_p) {
+        std::shared_ptr<const SipiImage> img;
+        return images.get(key_p, img) ? img : nullptr;
+    }
+    //============================================================================
+
+    bool SipiDecodedCache::add(const std::string &key_p, std::shared_ptr<const SipiImage> img_p) {
+        if (img_p == nullptr) return false;
+        return images.add(key_p, img_p, img_p->getNbytes());
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_decodedcache_h
+#define __defined_sipi_decodedcache_h
+
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "SipiLruCache.h"
+#include "SipiSingleFlight.h"
+
+namespace Sipi {
+
+    class SipiImage;
+
+    /*!
+     * SipiDecodedCache keeps decoded images of formats without a resolution pyramid (JPEG, PNG and
+     * striped TIFF) in memory. Such files have to be decoded completely for every region requested,
+     * thus a zoom session on a large JPEG decodes the same file for every tile. With this cache the
+     * tiles are cropped from the decoded pixels instead (see SipiImage::cropFrom()).
+     *
+     * An image may be decoded at a reduced resolution (JPEG supports reduce levels 1 to 3 by DCT scaling),
+     * the reduce level is part of the key. Since the key also contains the modification time and the size
+     * of the file, entries of modified files are never hit again and drop out of the cache by LRU eviction.
+     */
+    class SipiDecodedCache {
+    public:
+        /*!
+         * Statistics of the decoded image cache (hits are regions cropped from a cached image)
+         */
+        typedef SipiLruStats Stats;
+
+    private:
+        SipiLruCache<std::shared_ptr<const SipiImage>> images;
+        SipiSingleFlight decoding; //!< coalesces concurrent decodings of the same file
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nbytes_p Byte budget for the pixel buffers of the cached images
+         */
+        SipiDecodedCache(size_t max_nbytes_p);
+
+        /*!
+         * Builds the key of a decoded image
+         *
+         * \param[in] path Path of the image file
+         * \param[in] mtime Modification time of the image file
+         * \param[in] fsize Size of the image file
+         * \param[in] reduce Reduce level the image has been decoded with
+         */
+        static std::string key(const std::string &path, time_t mtime, off_t fsize, int reduce);
+
+        /*!
+         * Get a decoded image
+         *
+         * \param[in] key_p Key built by SipiDecodedCache::key()
+         *
+         * \returns The decoded image or nullptr, if not in the cache
+         */
+        std::shared_ptr<const SipiImage> get(const std::string &key_p);
+
+        /*!
+         * Add a decoded image to the cache. Images larger than half of the byte budget are ignored.
+         *
+         * \param[in] key_p Key built by SipiDecodedCache::key()
+         * \param[in] img_p The decoded image, which must not be modified afterwards
+         *
+         * \returns true, if the image has been added
+         */
+        bool add(const std::string &key_p, std::shared_ptr<const SipiImage> img_p);
+
+        /*!
+         * Size of the largest image (in bytes) which is added to the cache
+         */
+        inline size_t maxImageSize(void) const { return images.maxEntrySize(); }
+
+        /*!
+         * Joins the decoding of an image. Only the leader decodes the file, the other requests wait and
+         * look into the cache again (see SipiSingleFlight).
+         *
+         * \param[in] key_p Key built by SipiDecodedCache::key()
+         * \param[out] ticket Ticket which indicates if the caller has to decode the file
+         */
+        inline void join(const std::string &key_p, SipiSingleFlight::Ticket &ticket) { decoding.join(key_p, ticket); }
+
+        /*!
+         * Get the statistics of the decoded image cache
+         */
+        inline Stats stats(void) { return images.stats(); }
+    };
+
+}
+
+#endif
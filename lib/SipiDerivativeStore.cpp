@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "SipiError.h"
+#include "SipiImage.h"
+#include "SipiSource.h"
+#include "SipiDerivativeStore.h"
+
+static const char __file__[] = __FILE__;
+
+namespace Sipi {
+
+    //
+    // true, if the existing directory dir is parent or lies within parent
+    //
+    static bool within(const std::string &dir, const std::string &parent) {
+        char resolved[PATH_MAX];
+        if (realpath(dir.c_str(), resolved) == nullptr) return false;
+        std::string rdir = resolved;
+        if (realpath(parent.c_str(), resolved) == nullptr) return false;
+        std::string rparent = resolved;
+        if (rparent.back() != '/') rparent += '/';
+        return (rdir + "/").compare(0, rparent.size(), rparent) == 0;
+    }
+    //============================================================================
+
+    SipiDerivativeStore::SipiDerivativeStore(const std::string &dir_p, size_t max_nbytes_p, unsigned threshold_p,
+                                             const std::string &cachedir_p)
+            : dir(dir_p), max_nbytes(max_nbytes_p), nbytes(0), threshold(threshold_p), stopped(false), hits(0),
+              transcoded(0), failed(0), evictions(0) {
+        bool created = (mkdir(dir.c_str(), 0755) == 0);
+        if (!created && (errno != EEXIST)) {
+            throw SipiError(__file__, __LINE__, "Couldn't create derivative directory " + dir, errno);
+        }
+
+        //
+        // the derivatives would be taken for cache files by SipiCache and vice versa
+        //
+        if (!cachedir_p.empty() && within(dir, cachedir_p)) {
+            if (created) (void) rmdir(dir.c_str());
+            throw SipiError(__file__, __LINE__, "Derivative directory " + dir + " must not lie within the cache directory " +
+                                                cachedir_p);
+        }
+
+        //
+        // collect the existing derivatives, the most recently modified ones are considered most recently used.
+        // Files left over from an interrupted transcoding are removed
+        //
+        DIR *dirp = opendir(dir.c_str());
+        if (dirp == nullptr) {
+            throw SipiError(__file__, __LINE__, "Couldn't read derivative directory " + dir, errno);
+        }
+        std::vector<std::pair<time_t, DerivativeRecord>> existing;
+        struct dirent *dp;
+        while ((dp = readdir(dirp)) != nullptr) {
+            std::string fname = dp->d_name;
+            if (fname[0] == '.') continue;
+            std::string fpath = dir + "/" + fname;
+            if ((fname.size() > 4) && (fname.compare(fname.size() - 4, 4, ".tmp") == 0)) {
+                ::remove(fpath.c_str());
+                continue;
+            }
+            struct stat fileinfo;
+            if ((stat(fpath.c_str(), &fileinfo) != 0) || !S_ISREG(fileinfo.st_mode)) continue;
+            existing.push_back({fileinfo.st_mtime, {fname, (size_t) fileinfo.st_size}});
+        }
+        closedir(dirp);
+        std::sort(existing.begin(), existing.end(),
+                  [](const std::pair<time_t, DerivativeRecord> &a, const std::pair<time_t, DerivativeRecord> &b) {
+                      return a.first > b.first;
+                  });
+        for (const auto &ele : existing) {
+            lru.push_back(ele.second);
+            table[ele.second.name] = std::prev(lru.end());
+            nbytes += ele.second.nbytes;
+        }
+        evict(0);
+        syslog(LOG_INFO, "Derivative store at \"%s\": %zu files, %zu bytes (budget %zu bytes)", dir.c_str(),
+               table.size(), nbytes, max_nbytes);
+
+        worker_thread = std::thread(&SipiDerivativeStore::worker, this);
+    }
+    //============================================================================
+
+    SipiDerivativeStore::~SipiDerivativeStore() {
+        {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            stopped = true;
+        }
+        queue_cond.notify_all();
+        if (worker_thread.joinable()) worker_thread.join();
+    }
+    //============================================================================
+
+    void SipiDerivativeStore::evict(size_t needed) {
+        while (!lru.empty() && (nbytes + needed > max_nbytes)) {
+            DerivativeRecord &rec = lru.back();
+            ::remove((dir + "/" + rec.name).c_str());
+            nbytes -= rec.nbytes;
+            table.erase(rec.name);
+            lru.pop_back();
+            evictions++;
+        }
+    }
+    //============================================================================
+
+    std::string SipiDerivativeStore::name(const std::string &path, time_t mtime, off_t fsize) {
+        uint64_t h = 14695981039346656037ull; // 64 bit FNV-1a
+        for (unsigned char c : path) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        char buf[80];
+        (void) snprintf(buf, sizeof(buf), "%016llx_%lld_%lld.jp2", (unsigned long long) h, (long long) mtime,
+                        (long long) fsize);
+        return buf;
+    }
+    //============================================================================
+
+    std::string SipiDerivativeStore::lookup(const SipiSource &source, size_t img_w, size_t img_h) {
+        std::string dname = name(source.path(), source.mtime(), source.size());
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(dname);
+        if (it != table.end()) {
+            lru.splice(lru.begin(), lru, it->second); // move to front
+            hits++;
+            return dir + "/" + dname;
+        }
+        if ((img_w <= 1024) || (img_h <= 1024)) return std::string();
+        if (queued.find(dname) != queued.end()) return std::string();
+
+        if (requests.size() > 100000) requests.clear(); // forget rarely requested files
+        if (++requests[dname] < threshold) return std::string();
+        requests.erase(dname);
+        queue.push_back({source.path(), dname});
+        queued.insert(dname);
+        queue_cond.notify_one();
+        return std::string();
+    }
+    //============================================================================
+
+    void SipiDerivativeStore::worker(void) {
+        std::unique_lock<std::mutex> lock(locking);
+        while (true) {
+            queue_cond.wait(lock, [this] { return stopped || !queue.empty(); });
+            if (stopped) return;
+            std::pair<std::string, std::string> job = queue.front();
+            queue.pop_front();
+
+            lock.unlock();
+            bool ok = transcode(job.first, job.second);
+            lock.lock();
+
+            queued.erase(job.second);
+            if (ok) {
+                transcoded++;
+            } else {
+                failed++;
+            }
+        }
+    }
+    //============================================================================
+
+    bool SipiDerivativeStore::transcode(const std::string &path, const std::string &dname) {
+        std::string derivpath = dir + "/" + dname;
+        std::string tmppath = derivpath + ".tmp";
+        try {
+            SipiSource source(path);
+            if (!source.ok() || (name(path, source.mtime(), source.size()) != dname)) {
+                return false; // the original has been removed or modified meanwhile
+            }
+            SipiImage img;
+            img.read(source);
+            img.write("jpx", tmppath);
+        } catch (const SipiImageError &err) {
+            syslog(LOG_WARNING, "Couldn't transcode \"%s\": %s", path.c_str(), err.to_string().c_str());
+            ::remove(tmppath.c_str());
+            return false;
+        } catch (const SipiError &err) {
+            syslog(LOG_WARNING, "Couldn't transcode \"%s\": %s", path.c_str(), err.to_string().c_str());
+            ::remove(tmppath.c_str());
+            return false;
+        }
+
+        struct stat fileinfo;
+        if ((stat(tmppath.c_str(), &fileinfo) != 0) || ((size_t) fileinfo.st_size > max_nbytes) ||
+            (::rename(tmppath.c_str(), derivpath.c_str()) != 0)) {
+            ::remove(tmppath.c_str());
+            return false;
+        }
+        syslog(LOG_INFO, "Transcoded \"%s\" into derivative %s", path.c_str(), dname.c_str());
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+
+        //
+        // the derivatives of former versions of the original are not needed anymore
+        //
+        std::string prefix = dname.substr(0, dname.find('_') + 1);
+        for (auto it = lru.begin(); it != lru.end();) {
+            if (it->name.compare(0, prefix.size(), prefix) == 0) {
+                ::remove((dir + "/" + it->name).c_str());
+                nbytes -= it->nbytes;
+                table.erase(it->name);
+                it = lru.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        evict(fileinfo.st_size);
+        lru.push_front({dname, (size_t) fileinfo.st_size});
+        table[dname] = lru.begin();
+        nbytes += fileinfo.st_size;
+        return true;
+    }
+    //============================================================================
+
+    SipiDerivativeStore::Stats SipiDerivativeStore::stats(void) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return {table.size(), nbytes, max_nbytes, queue.size(), hits, transcoded, failed, evictions};
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_derivativestore_h
+#define __defined_sipi_derivativestore_h
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include <sys/types.h>
+
+namespace Sipi {
+
+    class SipiSource;
+
+    /*!
+     * SipiDerivativeStore transcodes JPEG, PNG and striped TIFF files, which have to be decoded completely
+     * for every region, into tiled JPEG2000 files with resolution levels. A file is transcoded by a background
+     * thread after it has been requested a given number of times; as soon as the derivative is available,
+     * the regions are read from the derivative through the J2K reduce and region decoding. The derivatives are
+     * written losslessly (see SipiIOJ2k::write), thus the renditions do not change.
+     *
+     * The name of a derivative is derived from the path, the modification time and the size of the original,
+     * so a modified original is never served from an old derivative; old derivatives are removed when the new
+     * one is written or evicted by the byte budget of the store (least recently used first). Since no index is
+     * kept, the derivatives survive a restart of the server.
+     */
+    class SipiDerivativeStore {
+    public:
+        /*!
+         * Statistics of the derivative store
+         */
+        typedef struct {
+            size_t nfiles;          //!< number of derivatives in the store
+            size_t nbytes;          //!< size of all derivatives
+            size_t max_nbytes;      //!< byte budget of the store
+            size_t queued;          //!< number of files waiting to be transcoded
+            unsigned long long hits;        //!< number of requests served from a derivative
+            unsigned long long transcoded;  //!< number of files transcoded since start
+            unsigned long long failed;      //!< number of files which could not be transcoded
+            unsigned long long evictions;   //!< number of derivatives removed due to the byte budget
+        } Stats;
+
+    private:
+        typedef struct {
+            std::string name;
+            size_t nbytes;
+        } DerivativeRecord;
+
+        std::string dir;
+        size_t max_nbytes;
+        size_t nbytes;
+        unsigned threshold;
+
+        std::mutex locking;
+        std::list<DerivativeRecord> lru; //!< most recently used derivatives at the front
+        std::unordered_map<std::string, std::list<DerivativeRecord>::iterator> table; //!< name -> derivative
+        std::unordered_map<std::string, unsigned> requests; //!< number of requests of files not yet transcoded
+        std::deque<std::pair<std::string, std::string>> queue; //!< files to transcode (path, name of derivative)
+        std::unordered_set<std::string> queued; //!< names of the derivatives in the queue
+
+        std::condition_variable queue_cond;
+        bool stopped;
+        std::thread worker_thread;
+
+        unsigned long long hits;
+        unsigned long long transcoded;
+        unsigned long long failed;
+        unsigned long long evictions;
+
+        void evict(size_t needed);
+
+        void worker(void);
+
+        bool transcode(const std::string &path, const std::string &name);
+
+    public:
+        /*!
+         * Constructor. Scans the directory for existing derivatives and starts the background thread.
+         *
+         * \param[in] dir_p Directory of the derivatives (created if it does not exist)
+         * \param[in] max_nbytes_p Byte budget of the store
+         * \param[in] threshold_p Number of requests after which a file is transcoded
+         * \param[in] cachedir_p Directory of the file cache (see SipiCache), which must not contain the
+         * derivatives (an empty path disables the check)
+         *
+         * \throws SipiError if the directory cannot be created or lies within the cache directory
+         */
+        SipiDerivativeStore(const std::string &dir_p, size_t max_nbytes_p, unsigned threshold_p = 3,
+                            const std::string &cachedir_p = "");
+
+        /*!
+         * Stops the background thread after the file currently being transcoded
+         */
+        ~SipiDerivativeStore();
+
+        SipiDerivativeStore(const SipiDerivativeStore &) = delete;
+
+        SipiDerivativeStore &operator=(const SipiDerivativeStore &) = delete;
+
+        /*!
+         * Builds the file name of the derivative of an original
+         *
+         * \param[in] path Path of the original
+         * \param[in] mtime Modification time of the original
+         * \param[in] fsize Size of the original
+         */
+        static std::string name(const std::string &path, time_t mtime, off_t fsize);
+
+        /*!
+         * Looks for the derivative of an original and counts the request. If the original has been
+         * requested often enough, it is queued for transcoding. Images smaller than 1024 pixels in either
+         * dimension are not transcoded, since they are decoded fast enough.
+         *
+         * \param[in] source The opened original
+         * \param[in] img_w Width of the original
+         * \param[in] img_h Height of the original
+         *
+         * \returns The path of the derivative or an empty string, if there is none (yet)
+         */
+        std::string lookup(const SipiSource &source, size_t img_w, size_t img_h);
+
+        /*!
+         * Get the statistics of the derivative store
+         */
+        Stats stats(void);
+    };
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <syslog.h>
+#include <time.h>
 
 #include <string>
 #include <iostream>
@@ -35,9 +36,11 @@
 #include <cstdlib>
 #include <cstring>
 #include <vector>
+#include <map>
 #include <cmath>
 #include <utility>
-#include <regex>
+#include <chrono>
+#include <algorithm>
 #include <sys/stat.h>
 
 #include <SipiFilenameHash.h>
@@ -45,6 +48,8 @@
 
 #include "SipiImage.h"
 #include "SipiError.h"
+#include "SipiStripePipeline.h"
+#include "SipiSimd.h"
 #include "iiifparser/SipiSize.h"
 #include "iiifparser/SipiRegion.h"
 #include "iiifparser/SipiRotation.h"
@@ -198,6 +203,292 @@ namespace Sipi {
     }
     //=========================================================================
 
+    /*!
+     * Aborts a response whose status and headers have already been sent (e.g. a streamed
+     * rendition). An error response is not possible anymore, thus the error is logged, the
+     * partially written cache file is removed and the connection is closed, so the client
+     * sees an incomplete response.
+     *
+     * \param conn_obj the server connection.
+     * \param cachefile the cache file being written (if open).
+     * \param errmsg the error message.
+     */
+    static void abort_response(Connection &conn_obj, const std::string &cachefile, const std::string &errmsg) {
+        syslog(LOG_ERR, "GET %s: response aborted after sending the header: %s", conn_obj.uri().c_str(), errmsg.c_str());
+        if (conn_obj.isCacheFileOpen()) {
+            conn_obj.closeCacheFile();
+            unlink(cachefile.c_str());
+        }
+        conn_obj.keepAlive(false);
+    }
+    //=========================================================================
+
+    /*!
+     * Formats a time as HTTP date (RFC 7231, e.g. "Sun, 06 Nov 1994 08:49:37 GMT")
+     */
+    static std::string http_date(time_t t) {
+        struct tm tmbuf;
+        char timebuf[64];
+        std::strftime(timebuf, sizeof timebuf, "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&t, &tmbuf));
+        return timebuf;
+    }
+    //=========================================================================
+
+    /*!
+     * Checks the validators of a conditional GET request (If-None-Match and If-Modified-Since).
+     * According to RFC 7232, If-Modified-Since is ignored if the request has an If-None-Match header.
+     *
+     * \param conn_obj the server connection.
+     * \param etag the (strong or weak) entity tag of the current representation.
+     * \param mtime the modification time of the current representation.
+     * \return true, if the client's copy is still valid and "304 Not Modified" can be sent.
+     */
+    static bool is_not_modified(Connection &conn_obj, const std::string &etag, time_t mtime) {
+        std::string if_none_match = conn_obj.header("if-none-match");
+        if (!if_none_match.empty()) {
+            std::string opaque = (etag.compare(0, 2, "W/") == 0) ? etag.substr(2) : etag;
+            std::stringstream ss(if_none_match);
+            std::string tag;
+            while (std::getline(ss, tag, ',')) {
+                size_t start = tag.find_first_not_of(" \t");
+                if (start == std::string::npos) continue;
+                size_t end = tag.find_last_not_of(" \t");
+                tag = tag.substr(start, end - start + 1);
+                if (tag.compare(0, 2, "W/") == 0) tag = tag.substr(2); // weak comparison
+                if ((tag == "*") || (tag == opaque)) return true;
+            }
+            return false;
+        }
+
+        std::string if_modified_since = conn_obj.header("if-modified-since");
+        if (!if_modified_since.empty()) {
+            struct tm tmbuf;
+            memset(&tmbuf, 0, sizeof(tmbuf));
+            if (strptime(if_modified_since.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tmbuf) == nullptr) {
+                return false;
+            }
+            return mtime <= timegm(&tmbuf);
+        }
+        return false;
+    }
+    //=========================================================================
+
+    /*!
+     * Creates a strong entity tag for a representation identified by a canonical URL (or a path)
+     * and the modification time of the original file.
+     */
+    static std::string make_etag(const std::string &canonical, time_t mtime) {
+        return SipiInfoCache::etag(canonical + "|" + std::to_string(mtime));
+    }
+    //=========================================================================
+
+    /*!
+     * Creates a weak entity tag for a rendered image. Depending on the path which rendered it (disk or
+     * memory cache, raw tile passthrough, streaming, JPEG2000 derivative, decoded cache...) the same
+     * URL may be answered with different, though visually equivalent bytes. A weak tag is sufficient
+     * for conditional requests, but byte ranges are never served for it (see send_file_validated()).
+     */
+    static std::string make_weak_etag(const std::string &canonical, time_t mtime) {
+        return "W/" + make_etag(canonical, mtime);
+    }
+    //=========================================================================
+
+    /*!
+     * Returns the render cost of a rendition in milliseconds: the wall time since render_start without
+     * the time the encoders of this thread spent sending to the client since send_ms_start (see SipiIO::send())
+     */
+    static double render_ms(std::chrono::steady_clock::time_point render_start, double send_ms_start) {
+        double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count();
+        return std::max(wall - (SipiIO::send_ms() - send_ms_start), 0.);
+    }
+    //=========================================================================
+
+    /*!
+     * Sets the validators of a response (ETag and Last-Modified)
+     */
+    static void set_validators(Connection &conn_obj, const std::string &etag, time_t mtime) {
+        conn_obj.header("ETag", etag);
+        conn_obj.header("Last-Modified", http_date(mtime));
+    }
+    //=========================================================================
+
+    typedef enum {
+        RANGE_NONE = 0,         //!< no (usable) range, the whole representation is sent
+        RANGE_PARTIAL = 1,      //!< a single satisfiable byte range
+        RANGE_UNSATISFIABLE = 2 //!< the range lies outside of the representation
+    } RangeType;
+
+    /*!
+     * Parses the Range header of a request (RFC 7233). Only a single byte range is supported
+     * ("bytes=first-last", "bytes=first-" or "bytes=-suffix"); multiple ranges and invalid
+     * expressions are ignored and the whole representation is sent. If the request has an If-Range
+     * header which does not match the current representation, the range is ignored as well.
+     *
+     * \param conn_obj the server connection.
+     * \param fsize size of the representation.
+     * \param etag the strong entity tag of the representation.
+     * \param mtime the modification time of the representation.
+     * \param start returns the first byte of the range.
+     * \param end returns the last byte of the range (inclusive).
+     * \return The type of the range
+     */
+    static RangeType parse_range(Connection &conn_obj, size_t fsize, const std::string &etag, time_t mtime,
+                                 size_t &start, size_t &end) {
+        std::string range = conn_obj.header("range");
+        if ((range.compare(0, 6, "bytes=") != 0) || (range.find(',') != std::string::npos)) return RANGE_NONE;
+
+        std::string if_range = conn_obj.header("if-range");
+        if (!if_range.empty()) {
+            if (if_range[0] == '"' || (if_range.compare(0, 2, "W/") == 0)) {
+                if (if_range != etag) return RANGE_NONE; // weak tags never match
+            } else {
+                struct tm tmbuf;
+                memset(&tmbuf, 0, sizeof(tmbuf));
+                if ((strptime(if_range.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tmbuf) == nullptr) ||
+                    (timegm(&tmbuf) != mtime)) {
+                    return RANGE_NONE;
+                }
+            }
+        }
+
+        std::string spec = range.substr(6);
+        size_t dash = spec.find('-');
+        if (dash == std::string::npos) return RANGE_NONE;
+        std::string first = spec.substr(0, dash);
+        std::string last = spec.substr(dash + 1);
+        if ((first.find_first_not_of("0123456789 ") != std::string::npos) ||
+            (last.find_first_not_of("0123456789 ") != std::string::npos) ||
+            (first.find_first_of("0123456789") == std::string::npos &&
+             last.find_first_of("0123456789") == std::string::npos)) {
+            return RANGE_NONE;
+        }
+
+        try {
+            if (first.find_first_of("0123456789") == std::string::npos) { // suffix range: the last n bytes
+                size_t suffix = std::stoull(last);
+                if ((suffix == 0) || (fsize == 0)) return RANGE_UNSATISFIABLE;
+                start = (suffix < fsize) ? fsize - suffix : 0;
+                end = fsize - 1;
+            } else {
+                start = std::stoull(first);
+                end = (last.find_first_of("0123456789") == std::string::npos) ? fsize - 1 : std::stoull(last);
+                if (start >= fsize) return RANGE_UNSATISFIABLE;
+                if (end < start) return RANGE_NONE;
+                if (end >= fsize) end = fsize - 1;
+            }
+        } catch (const std::out_of_range &err) {
+            return RANGE_NONE;
+        }
+        return RANGE_PARTIAL;
+    }
+    //=========================================================================
+
+    /*!
+     * Sends a file (an unmodified master or a file from the cache) with validators. Conditional requests
+     * are answered with "304 Not Modified", a single byte range with "206 Partial Content". Byte ranges
+     * are only supported for strong entity tags: rendered images (with a weak tag) are always sent as
+     * a whole, since another request for the same URL may have been rendered into different bytes.
+     * The status and the other headers (Content-Type etc.) have to be set by the caller.
+     *
+     * \param conn_obj the server connection.
+     * \param path path of the file to be sent.
+     * \param etag the strong or weak entity tag of the representation.
+     * \param mtime the modification time of the representation.
+     */
+    static void send_file_validated(Connection &conn_obj, const std::string &path, const std::string &etag,
+                                    time_t mtime) {
+        bool ranges = (etag.compare(0, 2, "W/") != 0);
+        set_validators(conn_obj, etag, mtime);
+        conn_obj.header("Accept-Ranges", ranges ? "bytes" : "none");
+        if (is_not_modified(conn_obj, etag, mtime)) {
+            conn_obj.status(Connection::NOT_MODIFIED);
+            conn_obj.setBuffer();
+            conn_obj.flush();
+            return;
+        }
+        if (!ranges) {
+            conn_obj.sendFile(path);
+            return;
+        }
+
+        struct stat fstatbuf;
+        if (stat(path.c_str(), &fstatbuf) != 0) {
+            throw SipiError(__file__, __LINE__, "Cannot stat file \"" + path + "\"", errno);
+        }
+        size_t fsize = fstatbuf.st_size;
+
+        size_t start, end;
+        switch (parse_range(conn_obj, fsize, etag, mtime, start, end)) {
+            case RANGE_PARTIAL: {
+                conn_obj.status(Connection::PARTIAL_CONTENT);
+                conn_obj.header("Content-Length", std::to_string(end - start + 1));
+                conn_obj.header("Content-Range",
+                                "bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" + std::to_string(fsize));
+                conn_obj.sendFile(path, 8192, start, end);
+                break;
+            }
+            case RANGE_UNSATISFIABLE: {
+                conn_obj.status(Connection::REQUESTED_RANGE_NOT_SATISFIABLE);
+                conn_obj.header("Content-Range", "bytes */" + std::to_string(fsize));
+                conn_obj.setBuffer();
+                conn_obj.flush();
+                break;
+            }
+            default: {
+                conn_obj.sendFile(path);
+            }
+        }
+    }
+    //=========================================================================
+
+    /*!
+     * Sends a representation held in memory with validators, conditional requests and byte ranges
+     * are handled as in send_file_validated().
+     *
+     * \param conn_obj the server connection.
+     * \param data the representation.
+     * \param etag the strong or weak entity tag of the representation.
+     * \param mtime the modification time of the representation.
+     */
+    static void send_data_validated(Connection &conn_obj, const std::string &data, const std::string &etag,
+                                    time_t mtime) {
+        bool ranges = (etag.compare(0, 2, "W/") != 0);
+        set_validators(conn_obj, etag, mtime);
+        conn_obj.header("Accept-Ranges", ranges ? "bytes" : "none");
+        if (is_not_modified(conn_obj, etag, mtime)) {
+            conn_obj.status(Connection::NOT_MODIFIED);
+            conn_obj.setBuffer();
+            conn_obj.flush();
+            return;
+        }
+        if (!ranges) {
+            conn_obj.sendAndFlush(data.data(), data.size());
+            return;
+        }
+
+        size_t start, end;
+        switch (parse_range(conn_obj, data.size(), etag, mtime, start, end)) {
+            case RANGE_PARTIAL: {
+                conn_obj.status(Connection::PARTIAL_CONTENT);
+                conn_obj.header("Content-Range", "bytes " + std::to_string(start) + "-" + std::to_string(end) + "/" +
+                                                 std::to_string(data.size()));
+                conn_obj.sendAndFlush(data.data() + start, end - start + 1);
+                break;
+            }
+            case RANGE_UNSATISFIABLE: {
+                conn_obj.status(Connection::REQUESTED_RANGE_NOT_SATISFIABLE);
+                conn_obj.header("Content-Range", "bytes */" + std::to_string(data.size()));
+                conn_obj.setBuffer();
+                conn_obj.flush();
+                break;
+            }
+            default: {
+                conn_obj.sendAndFlush(data.data(), data.size());
+            }
+        }
+    }
+    //=========================================================================
+
     /*!
      * Gets the IIIF prefix, IIIF identifier, and cookie from the HTTP request, and passes them to the Lua pre-flight function (whose
      * name is given by the constant pre_flight_func_name).
@@ -325,6 +616,42 @@ namespace Sipi {
     }
     //=========================================================================
 
+    /*!
+     * Calls the Lua pre-flight function, unless the pre_flight cache of the server has a valid
+     * result for the prefix, the identifier and the request headers which are part of the key.
+     * Throws SipiError if an error occurs (errors are not cached).
+     *
+     * \param conn_obj the server connection.
+     * \param serv the server instance.
+     * \param luaserver the Lua server that will be used to call the function.
+     * \param prefix the IIIF prefix.
+     * \param identifier the IIIF identifier.
+     * \return The result of the pre-flight function
+     */
+    static std::unordered_map<std::string,std::string>
+    cached_pre_flight(Connection &conn_obj, SipiHttpServer *serv, shttps::LuaServer &luaserver,
+                      const std::string &prefix, const std::string &identifier) {
+        std::shared_ptr<SipiPreflightCache> preflight_cache = serv->preflight_cache();
+        if (preflight_cache == nullptr) {
+            return call_pre_flight(conn_obj, luaserver, prefix, identifier);
+        }
+
+        std::vector<std::string> header_values;
+        for (auto &name: preflight_cache->headers()) {
+            header_values.push_back(conn_obj.header(name));
+        }
+        std::string key = SipiPreflightCache::key(prefix, identifier, header_values);
+
+        std::unordered_map<std::string,std::string> preflight_info;
+        if (preflight_cache->get(key, preflight_info)) {
+            return preflight_info;
+        }
+        preflight_info = call_pre_flight(conn_obj, luaserver, prefix, identifier); // may throw SipiError
+        preflight_cache->add(key, preflight_info);
+        return preflight_info;
+    }
+    //=========================================================================
+
     //
     // ToDo: Prepare for IIIF Authentication API !!!!
     //
@@ -337,6 +664,7 @@ namespace Sipi {
      * @param luaserver The Lua server instance
      * @param params the IIIF parameters
      * @param prefix_as_path
+     * @param check_readable if false, the caller has to test later if the file is readable
      * @return Pair of strings with permissions and filepath
      */
     static std::unordered_map<std::string,std::string> check_file_access(
@@ -344,13 +672,14 @@ namespace Sipi {
             SipiHttpServer *serv,
             shttps::LuaServer &luaserver,
             std::vector<std::string> &params,
-            bool prefix_as_path) {
+            bool prefix_as_path,
+            bool check_readable = true) {
         std::string infile;
 
         SipiIdentifier sid = SipiIdentifier(params[iiif_identifier]);
         std::unordered_map<std::string, std::string> pre_flight_info;
         if (luaserver.luaFunctionExists(pre_flight_func_name)) {
-            pre_flight_info = call_pre_flight(conn_obj, luaserver, urldecode(params[iiif_prefix]), sid.getIdentifier()); // may throw SipiError
+            pre_flight_info = cached_pre_flight(conn_obj, serv, luaserver, urldecode(params[iiif_prefix]), sid.getIdentifier()); // may throw SipiError
             infile = pre_flight_info["infile"];
         } else {
             if (prefix_as_path) {
@@ -363,7 +692,7 @@ namespace Sipi {
         //
         // test if we have access to the file
         //
-        if (access(infile.c_str(), R_OK) != 0) { // test, if file exists
+        if (check_readable && (access(infile.c_str(), R_OK) != 0)) { // test, if file exists
             throw SipiError(__file__, __LINE__, "Cannot read image file: " + infile);
         }
         pre_flight_info["infile"] = infile;
@@ -371,6 +700,50 @@ namespace Sipi {
     }
     //=========================================================================
 
+    /*!
+     * Sends an info.json response. Unless the response carries the IIIF auth services, it has an ETag and
+     * a Last-Modified header and conditional requests are answered with "304 Not Modified".
+     *
+     * \param conn_obj the server connection.
+     * \param record the serialized info.json with its validators.
+     */
+    static void send_info_record(Connection &conn_obj, const SipiInfoCache::InfoRecord &record) {
+        conn_obj.status(record.unauthorized ? Connection::StatusCodes::UNAUTHORIZED : Connection::StatusCodes::OK);
+        conn_obj.setBuffer(); // we want buffered output, since we send JSON text...
+        conn_obj.header("Access-Control-Allow-Origin", "*");
+        const std::string contenttype = conn_obj.header("accept");
+        if (record.is_image_file) {
+            if (!contenttype.empty() && (contenttype == "application/ld+json")) {
+                conn_obj.header("Content-Type", "application/ld+json;profile=\"http://iiif.io/api/image/3/context.json\"");
+            } else {
+                conn_obj.header("Content-Type", "application/json");
+                conn_obj.header("Link",
+                                "<http://iiif.io/api/image/3/context.json>; rel=\"http://www.w3.org/ns/json-ld#context\"; type=\"application/ld+json\"");
+            }
+        } else {
+            if (!contenttype.empty() && (contenttype == "application/ld+json")) {
+                conn_obj.header("Content-Type", "application/ld+json;profile=\"http://sipi.io/api/file/3/context.json\"");
+            } else {
+                conn_obj.header("Content-Type", "application/json");
+                conn_obj.header("Link",
+                                "<http://sipi.io/api/file/3/context.json>; rel=\"http://www.w3.org/ns/json-ld#context\"; type=\"application/ld+json\"");
+            }
+        }
+
+        if (!record.unauthorized) {
+            conn_obj.header("ETag", record.etag);
+            conn_obj.header("Last-Modified", http_date(record.mtime));
+            if (is_not_modified(conn_obj, record.etag, record.mtime)) {
+                conn_obj.status(Connection::StatusCodes::NOT_MODIFIED);
+                conn_obj.flush();
+                return;
+            }
+        }
+
+        conn_obj.sendAndFlush(record.json.c_str(), record.json.size());
+    }
+    //=========================================================================
+
     //
     // ToDo: Prepare for IIIF Authentication API !!!!
     //
@@ -381,15 +754,60 @@ namespace Sipi {
         //
         // here we start the lua script which checks for permissions
         //
+        // the file is only tested for readability if the info.json is not cached, thus
+        // conditional requests for cached responses are answered without touching the file
+        //
         std::unordered_map<std::string,std::string> access;
         try {
-            access = check_file_access(conn_obj, serv, luaserver, params, prefix_as_path);
+            access = check_file_access(conn_obj, serv, luaserver, params, prefix_as_path, false);
         }
         catch (SipiError &err) {
             send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
             return;
         }
 
+        std::string host = conn_obj.header("host");
+        std::string id;
+        if (params[iiif_prefix] == "") {
+            if (conn_obj.secure()) {
+                id = std::string("https://") + host + "/"  + params[iiif_identifier];
+            }
+            else {
+                id = std::string("http://") + host + "/"  + params[iiif_identifier];
+            }
+        } else {
+            if (conn_obj.secure()) {
+                id = std::string("https://") + host + "/" + params[iiif_prefix] + "/" + params[iiif_identifier];
+            }
+            else {
+                id = std::string("http://") + host + "/" + params[iiif_prefix] + "/" + params[iiif_identifier];
+            }
+        }
+
+        //
+        // the response depends on the id (including host and prefix) and on the result of the
+        // pre_flight script (file path and IIIF auth services), thus these make up the key
+        //
+        std::shared_ptr<SipiInfoCache> info_cache = serv->info_cache();
+        std::string info_key;
+        if (info_cache != nullptr) {
+            std::map<std::string, std::string> sorted_access(access.begin(), access.end());
+            info_key = id;
+            for (auto &item: sorted_access) {
+                info_key += "\n" + item.first + "=" + item.second;
+            }
+            std::shared_ptr<const SipiInfoCache::InfoRecord> record = info_cache->get(info_key);
+            if (record != nullptr) {
+                send_info_record(conn_obj, *record);
+                return;
+            }
+        }
+
+        if (::access(access["infile"].c_str(), R_OK) != 0) { // test, if file exists
+            send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, "Cannot read image file: " + access["infile"]);
+            return;
+        }
+
         std::string actual_mimetype = shttps::Parsing::getBestFileMimetype(access["infile"]);
 
         bool is_image_file = ((actual_mimetype == "image/tiff") ||
@@ -409,23 +827,6 @@ namespace Sipi {
             json_object_set_new(root, "@context", json_string("http://sipi.io/api/file/3/context.json"));
         }
 
-        std::string host = conn_obj.header("host");
-        std::string id;
-        if (params[iiif_prefix] == "") {
-            if (conn_obj.secure()) {
-                id = std::string("https://") + host + "/"  + params[iiif_identifier];
-            }
-            else {
-                id = std::string("http://") + host + "/"  + params[iiif_identifier];
-            }
-        } else {
-            if (conn_obj.secure()) {
-                id = std::string("https://") + host + "/" + params[iiif_prefix] + "/" + params[iiif_identifier];
-            }
-            else {
-                id = std::string("http://") + host + "/" + params[iiif_prefix] + "/" + params[iiif_identifier];
-            }
-        }
         json_object_set_new(root, "id", json_string(id.c_str()));
 
         if (is_image_file) {
@@ -510,11 +911,13 @@ namespace Sipi {
             // get cache info
             //
             std::shared_ptr<SipiCache> cache = serv->cache();
-            if ((cache == nullptr) || !cache->getSize(access["infile"], width, height, t_width, t_height, clevels, pagenum)) {
+            if ((cache == nullptr) || !cache->getSize(access["infile"], width, height, t_width, t_height, clevels, numpages)) {
                 Sipi::SipiImage tmpimg;
                 Sipi::SipiImgInfo info;
                 try {
-                    info = tmpimg.getDim(access["infile"], pagenum);
+                    std::shared_ptr<SipiInfoIndex> info_index = serv->info_index();
+                    info = (info_index != nullptr) ? info_index->getDim(access["infile"], pagenum) :
+                           tmpimg.getDim(access["infile"], pagenum);
                 }
                 catch (SipiImageError &err) {
                     send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err.to_string());
@@ -615,33 +1018,22 @@ namespace Sipi {
             json_object_set_new(root, "extraFeatures", extraFeatures);
 
         }
-        conn_obj.status(http_status);
-        conn_obj.setBuffer(); // we want buffered output, since we send JSON text...
-        conn_obj.header("Access-Control-Allow-Origin", "*");
-        const std::string contenttype = conn_obj.header("accept");
-        if (is_image_file) {
-            if (!contenttype.empty() && (contenttype == "application/ld+json")) {
-                conn_obj.header("Content-Type", "application/ld+json;profile=\"http://iiif.io/api/image/3/context.json\"");
-            } else {
-                conn_obj.header("Content-Type", "application/json");
-                conn_obj.header("Link",
-                                "<http://iiif.io/api/image/3/context.json>; rel=\"http://www.w3.org/ns/json-ld#context\"; type=\"application/ld+json\"");
-            }
-        } else {
-            if (!contenttype.empty() && (contenttype == "application/ld+json")) {
-                conn_obj.header("Content-Type", "application/ld+json;profile=\"http://sipi.io/api/file/3/context.json\"");
-            } else {
-                conn_obj.header("Content-Type", "application/json");
-                conn_obj.header("Link",
-                                "<http://sipi.io/api/file/3/context.json>; rel=\"http://www.w3.org/ns/json-ld#context\"; type=\"application/ld+json\"");
-            }
-        }
-
         char *json_str = json_dumps(root, JSON_INDENT(3));
-        conn_obj.sendAndFlush(json_str, strlen(json_str));
+        std::string json(json_str);
         free(json_str);
         json_decref(root);
-        return;
+
+        bool unauthorized = (http_status == Connection::StatusCodes::UNAUTHORIZED);
+        std::shared_ptr<const SipiInfoCache::InfoRecord> record = SipiInfoCache::record(access["infile"], json,
+                                                                                         is_image_file, unauthorized);
+        if (record == nullptr) {
+            send_error(conn_obj, Connection::NOT_FOUND, "File not found!");
+            return;
+        }
+        if (info_cache != nullptr) {
+            info_cache->add(info_key, access["infile"], record);
+        }
+        send_info_record(conn_obj, *record);
     }
     //=========================================================================
 
@@ -952,6 +1344,73 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
     //=========================================================================
 
 
+    /*!
+     * Upper bound of the bytes per pixel of an image read from a file of the given format. The number
+     * of channels and the bits per sample are only known after reading, thus up to 4 channels are assumed.
+     */
+    static size_t max_pixel_size(SipiQualityFormat::FormatType in_format, bool force_bps_8) {
+        size_t bps = (force_bps_8 || (in_format == SipiQualityFormat::JPG)) ? 8 : 16;
+        return 4 * bps / 8;
+    }
+    //=========================================================================
+
+    /*!
+     * Reduce level at which a file is decoded into the decoded image cache: JPEG files are decoded at the
+     * smallest reduce level (DCT scaling, 1 to 3) which still provides the requested resolution, all other
+     * formats at full resolution.
+     */
+    static int decoded_reduce(size_t img_w, size_t img_h, SipiQualityFormat::FormatType in_format,
+                              std::shared_ptr<SipiRegion> region, std::shared_ptr<SipiSize> size) {
+        int reduce = 0;
+        if (in_format == SipiQualityFormat::JPG) {
+            int roi_x, roi_y;
+            size_t roi_w, roi_h, nnx, nny;
+            int max_reduce = -1;
+            bool redonly;
+            region->crop_coords(img_w, img_h, roi_x, roi_y, roi_w, roi_h);
+            (void) size->get_size(roi_w, roi_h, nnx, nny, max_reduce, redonly);
+            while ((reduce < 3) && ((roi_w >> (reduce + 1)) >= nnx) && ((roi_h >> (reduce + 1)) >= nny)) reduce++;
+        }
+        return reduce;
+    }
+    //=========================================================================
+
+    /*!
+     * Reads a region of a JPEG, PNG or striped TIFF file through the decoded image cache. If the image is not
+     * in the cache, the whole file is decoded (see decoded_reduce()) and added to the cache. The region is then
+     * cropped and scaled from the decoded pixels.
+     */
+    static void read_decoded(SipiImage &img, SipiDecodedCache &decoded_cache, const SipiSource &source,
+                             size_t img_w, size_t img_h, SipiQualityFormat::FormatType in_format,
+                             std::shared_ptr<SipiRegion> region, std::shared_ptr<SipiSize> size, bool force_bps_8,
+                             ScalingQuality scaling_quality) {
+        ScalingMethod scaling_method = (in_format == SipiQualityFormat::PNG) ? scaling_quality.png :
+                                       scaling_quality.jpeg; // the TIFF reader uses the JPEG scaling quality
+        int reduce = decoded_reduce(img_w, img_h, in_format, region, size);
+
+        std::string key = SipiDecodedCache::key(source.path(), source.mtime(), source.size(), reduce);
+        std::shared_ptr<const SipiImage> master = decoded_cache.get(key);
+        if (master == nullptr) {
+            //
+            // concurrent tile requests for the same file wait for the first one instead of decoding it as well
+            //
+            SipiSingleFlight::Ticket ticket;
+            decoded_cache.join(key, ticket);
+            if (!ticket.leader() && ticket.wait(std::chrono::seconds(60))) {
+                master = decoded_cache.get(key);
+            }
+            if (master == nullptr) {
+                std::shared_ptr<SipiSize> reduced = (reduce > 0) ? std::make_shared<SipiSize>(reduce) : nullptr;
+                std::shared_ptr<SipiImage> decoded = std::make_shared<SipiImage>();
+                decoded->read(source, 0, nullptr, reduced, false, scaling_quality);
+                (void) decoded_cache.add(key, decoded);
+                master = decoded;
+            }
+        }
+        img.cropFrom(*master, img_w, img_h, region, size, force_bps_8, scaling_method);
+    }
+    //=========================================================================
+
     static void process_get_request(
             Connection &conn_obj,
             shttps::LuaServer &luaserver,
@@ -966,9 +1425,22 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
         std::string uri = conn_obj.uri(); // Has form "/pre/fix/es.../BAU_1_000441077_2_1.j2k/full/,1000/0/default.jpg"
 
         std::vector<std::string> parts;
+        parts.reserve(8);
         size_t pos = 0;
         size_t old_pos = 0;
 
+        //
+        // only parts containing escapes have to be decoded, all others are copied directly (which
+        // usually needs no allocation, since IIIF parameters are short)
+        //
+        auto add_part = [&](size_t start, size_t len) {
+            if (uri.find_first_of("%+", start) < start + len) {
+                parts.push_back(shttps::urldecode(uri.substr(start, len)));
+            } else {
+                parts.emplace_back(uri, start, len);
+            }
+        };
+
         //
         // IIIF URi schema:
         // {scheme}://{server}{/prefix}/{identifier}/{region}/{size}/{rotation}/{quality}.{format}
@@ -983,12 +1455,12 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                 continue;
             }
 
-            parts.push_back(shttps::urldecode(uri.substr(old_pos, pos - old_pos - 1)));
+            add_part(old_pos, pos - old_pos - 1);
             old_pos = pos;
         }
 
         if (old_pos != uri.length()) {
-            parts.push_back(shttps::urldecode(uri.substr(old_pos, std::string::npos)));
+            add_part(old_pos, uri.length() - old_pos);
         }
 
         if (parts.size() < 1) {
@@ -999,24 +1471,19 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
         std::vector<std::string> params;
 
         //
-        // below are regex expressions for the different parts of the IIIF URL
+        // check the syntax of the different parts of the IIIF URL (hand written matchers, no regex)
         //
-        std::string qualform_ex = "^(color|gray|bitonal|default)\\.(jpg|tif|png|jp2|pdf)$";
-        std::string rotation_ex = "^!?[-+]?[0-9]*\\.?[0-9]*$";
-        std::string size_ex = "^(\\^?max)|(\\^?pct:[0-9]*\\.?[0-9]*)|(\\^?[0-9]*,)|(\\^?,[0-9]*)|(\\^?!?[0-9]*,[0-9]*)$";
-        std::string region_ex = "^(full)|(square)|([0-9]+,[0-9]+,[0-9]+,[0-9]+)|(pct:[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*)$";
-
         bool qualform_ok = false;
-        if (parts.size() > 0) qualform_ok = std::regex_match(parts[parts.size() - 1], std::regex(qualform_ex));
+        if (parts.size() > 0) qualform_ok = SipiQualityFormat::is_valid(parts[parts.size() - 1]);
 
         bool rotation_ok = false;
-        if (parts.size() > 1) rotation_ok = std::regex_match(parts[parts.size() - 2], std::regex(rotation_ex));
+        if (parts.size() > 1) rotation_ok = SipiRotation::is_valid(parts[parts.size() - 2]);
 
         bool size_ok = false;
-        if (parts.size() > 2) size_ok = std::regex_match(parts[parts.size() - 3], std::regex(size_ex));
+        if (parts.size() > 2) size_ok = SipiSize::is_valid(parts[parts.size() - 3]);
 
         bool region_ok = false;
-        if (parts.size() > 3) region_ok = std::regex_match(parts[parts.size() - 4], std::regex(region_ex));
+        if (parts.size() > 3) region_ok = SipiRegion::is_valid(parts[parts.size() - 4]);
 
         if ((pos = parts[parts.size() - 1].find('.', 0)) != std::string::npos) {
             std::string fname_body = parts[parts.size() - 1].substr(0, pos);
@@ -1240,62 +1707,22 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                     if (stat(infile.c_str(), &fstatbuf) != 0) {
                         syslog(LOG_ERR, "Cannot fstat file %s ", infile.c_str());
                         send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR);
+                        return;
                     }
-                    size_t fsize = fstatbuf.st_size;
-#ifdef __APPLE__
-                    struct timespec rawtime = fstatbuf.st_mtimespec;
-#else
-                    struct timespec rawtime = fstatbuf.st_mtim;
-#endif
-                    char timebuf[100];
-                    std::strftime(timebuf, sizeof timebuf, "%a, %d %b %Y %H:%M:%S %Z", std::gmtime(&rawtime.tv_sec));
-
-                    std::string range = conn_obj.header("range");
-                    if (range.empty()) {
-                        conn_obj.header("Content-Type", actual_mimetype);
-                        conn_obj.header("Cache-Control", "public, must-revalidate, max-age=0");
-                        conn_obj.header("Pragma", "no-cache");
-                        conn_obj.header("Accept-Ranges", "bytes");
-                        conn_obj.header("Content-Length", std::to_string(fsize));
-                        conn_obj.header("Last-Modified", timebuf);
-                        conn_obj.header("Content-Transfer-Encoding: binary");
-                        conn_obj.sendFile(infile);
-                    }
-                    else {
-                        //
-                        // now we parse the range
-                        //
-                        std::regex re("bytes=\\s*(\\d+)-(\\d*)[\\D.*]?");
-                        std::cmatch m;
-                        int start = 0; // lets assume beginning of file
-                        int end = fsize - 1; // lets assume whole file
-                        if (std::regex_match (range.c_str(), m, re)) {
-                            if (m.size() < 2) {
-                                throw Error(__file__, __LINE__, "Range expression invalid!");
-                            }
-                            start = std::stoi(m[1]);
-                            if ((m.size() > 1) && !m[2].str().empty()) {
-                                end = std::stoi(m[2]);
-                            }
-                        }
-                        else {
-                            throw Error(__file__, __LINE__, "Range expression invalid!");
-                        }
 
-                        conn_obj.status(Connection::PARTIAL_CONTENT);
-                        conn_obj.header("Content-Type", actual_mimetype);
-                        conn_obj.header("Cache-Control", "public, must-revalidate, max-age=0");
-                        conn_obj.header("Pragma", "no-cache");
-                        conn_obj.header("Accept-Ranges", "bytes");
-                        conn_obj.header("Content-Length", std::to_string(end - start + 1));
-                        conn_obj.header("Content-Length", std::to_string(end - start + 1));
-                        std::stringstream ss;
-                        ss << "bytes " << start << "-" << end << "/" << fsize;
-                        conn_obj.header("Content-Range", ss.str());
-                        conn_obj.header("Content-Disposition",  std::string("inline; filename=") + urldecode(params[iiif_identifier]));
-                        conn_obj.header("Content-Transfer-Encoding: binary");
-                        conn_obj.header("Last-Modified", timebuf);
-                        conn_obj.sendFile(infile, 8192, start, end);
+                    conn_obj.header("Content-Type", actual_mimetype);
+                    conn_obj.header("Cache-Control", "public, must-revalidate, max-age=0");
+                    conn_obj.header("Pragma", "no-cache");
+                    conn_obj.header("Content-Disposition",  std::string("inline; filename=") + urldecode(params[iiif_identifier]));
+                    conn_obj.header("Content-Transfer-Encoding: binary");
+                    try {
+                        send_file_validated(conn_obj, infile, make_etag(infile, fstatbuf.st_mtime), fstatbuf.st_mtime);
+                    } catch (shttps::InputFailure iofail) {
+                        syslog(LOG_WARNING, "Browser unexpectedly closed connection");
+                        return;
+                    } catch (Sipi::SipiError &err) {
+                        send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
+                        return;
                     }
                     conn_obj.flush();
                 } else {
@@ -1337,7 +1764,7 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                 if (luaserver.luaFunctionExists(pre_flight_func_name)) {
                     std::unordered_map<std::string, std::string> pre_flight_info;
                     try {
-                        pre_flight_info = call_pre_flight(conn_obj, luaserver, params[iiif_prefix], sid.getIdentifier());
+                        pre_flight_info = cached_pre_flight(conn_obj, serv, luaserver, params[iiif_prefix], sid.getIdentifier());
                     } catch (SipiError &err) {
                         send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
                         return;
@@ -1379,12 +1806,23 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                     }
                 }
 
+                //
+                // open the file in the SIPI repo once; the mimetype, the dimensions, the validators and the
+                // image data are all taken from this handle
+                //
+                SipiSource source(infile);
+                if (!source.ok()) { // test, if file exists
+                    syslog(LOG_INFO, "File %s not found", infile.c_str());
+                    send_error(conn_obj, Connection::NOT_FOUND);
+                    return;
+                }
+
                 //
                 // determine the mimetype of the file in the SIPI repo
                 //
                 SipiQualityFormat::FormatType in_format = SipiQualityFormat::UNSUPPORTED;
 
-                std::string actual_mimetype = shttps::Parsing::getFileMimetype(infile).first;
+                std::string actual_mimetype = source.mimetype();
                 if (actual_mimetype == "image/tiff") in_format = SipiQualityFormat::TIF;
                 if (actual_mimetype == "image/jpeg") in_format = SipiQualityFormat::JPG;
                 if (actual_mimetype == "image/png") in_format = SipiQualityFormat::PNG;
@@ -1392,12 +1830,6 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                     in_format = SipiQualityFormat::JP2;
                 if (actual_mimetype == "application/pdf") in_format = SipiQualityFormat::PDF;
 
-                if (access(infile.c_str(), R_OK) != 0) { // test, if file exists
-                    syslog(LOG_INFO, "File %s not found", infile.c_str());
-                    send_error(conn_obj, Connection::NOT_FOUND);
-                    return;
-                }
-
                 float angle;
                 bool mirror = rotation.get_rotation(angle);
 
@@ -1434,11 +1866,14 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                     //
                     // get image dimensions, needed for get_canonical...
                     //
-                    if ((cache == nullptr) || !cache->getSize(infile, img_w, img_h, tile_w, tile_h, clevels, numpages)) {
+                    if ((cache == nullptr) ||
+                        !cache->getSize(infile, img_w, img_h, tile_w, tile_h, clevels, numpages, &source.fileinfo())) {
                         Sipi::SipiImage tmpimg;
                         Sipi::SipiImgInfo info;
                         try {
-                            info = tmpimg.getDim(infile, pagenum);
+                            std::shared_ptr<SipiInfoIndex> info_index = serv->info_index();
+                            info = (info_index != nullptr) ? info_index->getDim(source, pagenum) :
+                                   tmpimg.getDim(source, pagenum);
                         } catch (SipiImageError &err) {
                             send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err.to_string());
                             return;
@@ -1509,7 +1944,7 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                         default: {}
                     }
                     try {
-                        conn_obj.sendFile(infile);
+                        send_file_validated(conn_obj, infile, make_etag(canonical, source.mtime()), source.mtime());
                     } catch (shttps::InputFailure iofail) {
                         syslog(LOG_WARNING, "Browser unexpectedly closed connection");
                     } catch (Sipi::SipiError &err) {
@@ -1518,11 +1953,84 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                     return;
                 } // finish sending unmodified file in toto
 
-                if (cache != nullptr) {
+                //
+                // a JPEG tile which corresponds exactly to a tile of a JPEG compressed pyramidal TIFF is sent
+                // from the file as it is, without decoding and encoding it
+                //
+                if ((in_format == SipiQualityFormat::TIF) && (tile_w > 0) && (angle == 0.0) && !mirror &&
+                    watermark.empty() && (quality_format.format() == SipiQualityFormat::JPG) &&
+                    (quality_format.quality() == SipiQualityFormat::DEFAULT) && (sid.getPage() < 1)) {
+                    std::string tile;
+                    if (SipiIOTiff::readRawJpegTile(source, region, size, tile)) {
+                        conn_obj.status(Connection::OK);
+                        conn_obj.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
+                        conn_obj.header("Link", canonical_header);
+                        conn_obj.header("Content-Type", "image/jpeg");
+                        try {
+                            send_data_validated(conn_obj, tile, make_weak_etag(canonical, source.mtime()), source.mtime());
+                        } catch (shttps::InputFailure iofail) {
+                            syslog(LOG_WARNING, "Browser unexpectedly closed connection");
+                        }
+                        return;
+                    }
+                }
+
+                //
+                // first look into the memory cache: popular renditions are sent without reading the cache file.
+                // The original has already been opened above, and SipiMemCache::get() stat()s it again to
+                // compare its modification time once the revalidation interval has elapsed
+                //
+                std::shared_ptr<SipiMemCache> memcache = serv->memcache();
+                if (memcache != nullptr) {
+                    time_t orig_mtime;
+                    std::shared_ptr<const std::string> data = memcache->get(canonical, &orig_mtime);
+                    if (data != nullptr) {
+                        conn_obj.status(Connection::OK);
+                        conn_obj.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
+                        conn_obj.header("Link", canonical_header);
+
+                        // set the header (mimetype)
+                        switch (quality_format.format()) {
+                            case SipiQualityFormat::TIF: conn_obj.header("Content-Type", "image/tiff"); break;
+                            case SipiQualityFormat::JPG: conn_obj.header("Content-Type", "image/jpeg"); break;
+                            case SipiQualityFormat::PNG: conn_obj.header("Content-Type", "image/png"); break;
+                            case SipiQualityFormat::JP2: conn_obj.header("Content-Type", "image/jp2"); break;
+                            case SipiQualityFormat::PDF: conn_obj.header("Content-Type", "application/pdf"); break;
+                            default: {}
+                        }
+
+                        try {
+                            send_data_validated(conn_obj, *data, make_weak_etag(canonical, orig_mtime), orig_mtime);
+                        } catch (shttps::InputFailure err) {
+                            syslog(LOG_WARNING, "Browser unexpectedly closed connection");
+                        }
+                        return;
+                    }
+                }
+
+                //
+                // the validators of a rendition are derived from the canonical URL and the modification
+                // time of the original. If the client's copy is still valid, nothing has to be rendered.
+                // The tag is weak, as the bytes depend on the path which renders the image
+                //
+                std::string etag = make_weak_etag(canonical, source.mtime());
+                if (is_not_modified(conn_obj, etag, source.mtime())) {
+                    conn_obj.status(Connection::NOT_MODIFIED);
+                    conn_obj.header("Link", canonical_header);
+                    set_validators(conn_obj, etag, source.mtime());
+                    conn_obj.setBuffer();
+                    conn_obj.flush();
+                    return;
+                }
+
+                //
+                // sends the file from the disk cache, if available. Returns true if the request has been answered
+                //
+                auto send_cached_file = [&]() -> bool {
                     //!>
                     //!> here we check if the file is in the cache. If so, it's being blocked from deletion
                     //!>
-                    std::string cachefile = cache->check(infile, canonical, true); // we block the file from being deleted if successfull
+                    std::string cachefile = cache->check(infile, canonical, true, &source.fileinfo()); // we block the file from being deleted if successfull
 
                     if (!cachefile.empty()) {
                         syslog(LOG_DEBUG, "Using cachefile %s", cachefile.c_str());
@@ -1547,34 +2055,243 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
 
                         try {
                             //!> send the file from cache
-                            conn_obj.sendFile(cachefile);
+                            send_file_validated(conn_obj, cachefile, etag, source.mtime());
                             //!> from now on the cache file can be deleted again
                         } catch (shttps::InputFailure err) {
                             // -1 was thrown
                             syslog(LOG_WARNING, "Browser unexpectedly closed connection");
                             cache->deblock(cachefile);
-                            return;
+                            return true;
                         } catch (Sipi::SipiError &err) {
                             syslog(LOG_ERR, "Error sending cache file: \"%s\": %s", cachefile.c_str(), err.to_string().c_str());
                             send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
                             cache->deblock(cachefile);
-                            return;
+                            return true;
                         }
+                        //!> the file has been requested at least twice, promote it into the memory cache
+                        if (memcache != nullptr) memcache->add(infile, canonical, cachefile, &source.fileinfo());
                         cache->deblock(cachefile);
-                        return;
+                        return true;
                     }
                     cache->deblock(cachefile);
+                    return false;
+                };
+
+                //
+                // Concurrent requests for the same rendition are coalesced: only the first request (the leader)
+                // renders the image, the others wait for it to finish and then serve the cached file. If the
+                // leader fails, one of the waiting requests takes over.
+                //
+                SipiSingleFlight::Ticket render_ticket;
+                if (cache != nullptr) {
+                    while (true) {
+                        if (send_cached_file()) return;
+                        serv->inflight().join(canonical, render_ticket);
+                        if (render_ticket.leader()) break;
+                        if (!render_ticket.wait(std::chrono::seconds(serv->inflight_timeout()))) {
+                            syslog(LOG_WARNING, "GET %s: timeout waiting for concurrent rendition", uri.c_str());
+                            break; // render it ourselves
+                        }
+                    }
                 }
 
+                //
+                // the admission policy of the cache decides if the rendition is written to the cache
+                //
+                bool cache_it = (cache != nullptr) && cache->admit(canonical);
+                if (!cache_it) render_ticket.release(); // nothing to wait for, concurrent requests render themselves
+                //
+                // the render cost used by the GDSF eviction is the wall time of reading, processing and
+                // encoding, thus the work of the Kakadu and compute pool threads counts on both the streamed
+                // and the buffered path. The encoders write directly to the connection, the time they block
+                // on a slow client is subtracted
+                //
+                auto render_start = std::chrono::steady_clock::now();
+                double send_ms_start = SipiIO::send_ms();
+
                 Sipi::SipiImage img;
+                std::string cachefile;
+                bool stream_started = false; // the status and headers of a streamed rendition have been sent
+
+                //
+                // JPEG, PNG and striped TIFF files which are requested repeatedly are transcoded in the background
+                // into tiled JPEG2000 files with resolution levels (see SipiDerivativeStore). As soon as the
+                // derivative is available, the regions are read from it
+                //
+                std::unique_ptr<SipiSource> derivative;
+                SipiQualityFormat::FormatType read_format = in_format;
+                std::shared_ptr<SipiDerivativeStore> derivatives = serv->derivatives();
+                if ((derivatives != nullptr) && (region->getType() != SipiRegion::FULL) && (sid.getPage() < 1) &&
+                    ((in_format == SipiQualityFormat::JPG) || (in_format == SipiQualityFormat::PNG) ||
+                     ((in_format == SipiQualityFormat::TIF) && (tile_w == 0)))) {
+                    std::string derivpath = derivatives->lookup(source, img_w, img_h);
+                    if (!derivpath.empty()) {
+                        derivative = std::make_unique<SipiSource>(derivpath);
+                        if (derivative->ok()) {
+                            read_format = SipiQualityFormat::JP2;
+                        } else {
+                            derivative.reset(); // evicted meanwhile
+                        }
+                    }
+                }
+                const SipiSource &read_source = (derivative != nullptr) ? *derivative : source;
+
+                //
+                // regions of formats without resolution pyramid are cropped from the decoded image kept
+                // in memory (see SipiDecodedCache) instead of decoding the whole file for every tile. An
+                // image too large for the cache would be decoded completely for every tile, such regions
+                // are read directly from the file (with the region and scaling support of the reader)
+                //
+                std::shared_ptr<SipiDecodedCache> decoded_cache = serv->decoded_cache();
+                bool use_decoded = (decoded_cache != nullptr) && (region->getType() != SipiRegion::FULL) &&
+                                   (sid.getPage() < 1) &&
+                                   ((read_format == SipiQualityFormat::JPG) || (read_format == SipiQualityFormat::PNG) ||
+                                    ((read_format == SipiQualityFormat::TIF) && (tile_w == 0)));
+                if (use_decoded) {
+                    try {
+                        int reduce = decoded_reduce(img_w, img_h, read_format, region, size);
+                        size_t decoded_size = (img_w >> reduce) * (img_h >> reduce) * max_pixel_size(read_format, false);
+                        use_decoded = (decoded_size <= decoded_cache->maxImageSize());
+                    } catch (const SipiSizeError &) {
+                        use_decoded = false; // the reader reports the error
+                    } catch (const SipiError &) {
+                        use_decoded = false;
+                    }
+                }
+
+                //
+                // renditions which differ only in rotation, quality or format share the raster after reading,
+                // cropping and scaling (see SipiRasterCache). Since the raster has to be kept, renditions
+                // small enough for the raster cache are not streamed
+                //
+                bool force_bps_8 = (quality_format.format() == SipiQualityFormat::JPG);
+                std::shared_ptr<SipiRasterCache> raster_cache = serv->raster_cache();
+                std::shared_ptr<const SipiImage> raster;
+                std::string raster_key;
+                bool use_raster = false;
+                if ((raster_cache != nullptr) && (in_format != SipiQualityFormat::PDF)) {
+                    try {
+                        int roi_x = 0, roi_y = 0;
+                        size_t roi_w = img_w, roi_h = img_h, out_w, out_h;
+                        int max_reduce = -1;
+                        bool redonly;
+                        if (region->getType() != SipiRegion::FULL) {
+                            region->crop_coords(img_w, img_h, roi_x, roi_y, roi_w, roi_h);
+                        }
+                        (void) size->get_size(roi_w, roi_h, out_w, out_h, max_reduce, redonly);
+                        use_raster = (out_w * out_h * max_pixel_size(in_format, force_bps_8) <= raster_cache->maxRasterSize());
+                    } catch (const SipiSizeError &) {
+                        use_raster = false; // the reader reports the error
+                    } catch (const SipiError &) {
+                        use_raster = false;
+                    }
+                    if (use_raster) {
+                        raster_key = SipiRasterCache::canonical_key(source.path(), source.mtime(), source.size(),
+                                                                    sid.getPage(), canonical, force_bps_8);
+                        use_raster = !raster_key.empty();
+                    }
+                    if (use_raster) raster = raster_cache->get(raster_key);
+                }
+
+                //
+                // JPEG renditions which need no processing after decoding except the conversion to
+                // sRGB are streamed: if the reader supports it, the decoded stripes are converted
+                // and encoded immediately, so the whole image is never held in memory
+                //
+                if (!use_decoded && !use_raster && (quality_format.format() == SipiQualityFormat::JPG) &&
+                    ((quality_format.quality() == SipiQualityFormat::DEFAULT) ||
+                     (quality_format.quality() == SipiQualityFormat::COLOR)) &&
+                    (angle == 0.0) && !mirror && watermark.empty()) {
+                    Sipi::SipiCompressionParams qp = {{JPEG_QUALITY, std::to_string(serv->jpeg_quality())}};
+                    // like the buffered path below, JPEG renditions are always converted to sRGB
+                    auto target_icc = std::make_shared<SipiIcc>(icc_sRGB);
+                    auto pipeline = std::make_shared<SipiStripePipeline>(target_icc,
+                                                                         SipiImage::stripeWriter("jpg", "HTTP", &qp));
+                    pipeline->prologue([&](SipiImage *) {
+                        stream_started = true; // from now on errors cannot be sent to the client anymore
+                        if (cache_it) {
+                            //!> open the cache file to write into.
+                            cachefile = cache->getNewCacheFileName(canonical);
+                            conn_obj.openCacheFile(cachefile);
+                        }
+                        conn_obj.status(Connection::OK);
+                        conn_obj.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
+                        set_validators(conn_obj, etag, source.mtime());
+                        conn_obj.header("Link", canonical_header);
+                        conn_obj.header("Content-Type", "image/jpeg"); // set the header (mimetype)
+                        conn_obj.setChunkedTransfer();
+                    });
+                    img.connection(&conn_obj);
+                    img.stripe_sink(pipeline);
+                }
+
                 try {
-                    img.read(infile, sid.getPage(), region, size, quality_format.format() == SipiQualityFormat::JPG, serv->scaling_quality());
+                    if (raster != nullptr) {
+                        img = *raster;
+                    } else if (use_decoded) {
+                        read_decoded(img, *decoded_cache, source, img_w, img_h, in_format, region, size,
+                                     force_bps_8, serv->scaling_quality());
+                    } else {
+                        img.read(read_source, sid.getPage(), region, size, force_bps_8, serv->scaling_quality());
+                    }
                 } catch (const SipiImageError &err) {
+                    if (stream_started) {
+                        abort_response(conn_obj, cachefile, err.to_string());
+                        return;
+                    }
+                    if (conn_obj.isCacheFileOpen()) {
+                        conn_obj.closeCacheFile();
+                        unlink(cachefile.c_str());
+                    }
                     send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err.to_string());
                     return;
                 } catch (const SipiSizeError &err) {
+                    if (stream_started) {
+                        abort_response(conn_obj, cachefile, err.to_string());
+                        return;
+                    }
+                    if (conn_obj.isCacheFileOpen()) {
+                        conn_obj.closeCacheFile();
+                        unlink(cachefile.c_str());
+                    }
                     send_error(conn_obj, Connection::BAD_REQUEST, err.to_string());
                     return;
+                } catch (const shttps::InputFailure &err) {
+                    syslog(LOG_WARNING, "Browser unexpectedly closed connection");
+                    if (conn_obj.isCacheFileOpen()) {
+                        conn_obj.closeCacheFile();
+                        unlink(cachefile.c_str());
+                    }
+                    return;
+                } catch (const shttps::Error &err) {
+                    if (stream_started) {
+                        abort_response(conn_obj, cachefile, err.to_string());
+                        return;
+                    }
+                    if (conn_obj.isCacheFileOpen()) {
+                        conn_obj.closeCacheFile();
+                        unlink(cachefile.c_str());
+                    }
+                    send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
+                    return;
+                }
+
+                if (img.streamed()) {
+                    if (conn_obj.isCacheFileOpen()) {
+                        conn_obj.closeCacheFile();
+                        //!>
+                        //!> ATTENTION!!! Here we change the list of available cache files
+                        //!>
+                        double render_cost = render_ms(render_start, send_ms_start);
+                        cache->add(infile, canonical, cachefile, img_w, img_h, tile_w, tile_h, clevels, numpages, render_cost);
+                        render_ticket.release(); // waiting requests can now use the cache file
+                    }
+                    conn_obj.flush();
+                    return;
+                }
+
+                if (use_raster && (raster == nullptr)) {
+                    (void) raster_cache->add(raster_key, std::make_shared<const SipiImage>(img));
                 }
 
                 //
@@ -1617,13 +2334,13 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
 
                 img.connection(&conn_obj);
                 conn_obj.header("Cache-Control", "must-revalidate, post-check=0, pre-check=0");
-                std::string cachefile;
+                set_validators(conn_obj, etag, source.mtime());
 
                 try {
-                    if (cache != nullptr) {
+                    if (cache_it) {
                         try {
                             //!> open the cache file to write into.
-                            cachefile = cache->getNewCacheFileName();
+                            cachefile = cache->getNewCacheFileName(canonical);
                             conn_obj.openCacheFile(cachefile);
                         } catch (const shttps::Error &err) {
                             send_error(conn_obj, Connection::INTERNAL_SERVER_ERROR, err);
@@ -1704,11 +2421,13 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                         //!>
                         //!> ATTENTION!!! Here we change the list of available cache files
                         //!>
-                        cache->add(infile, canonical, cachefile, img_w, img_h, tile_w, tile_h, clevels, numpages);
+                        double render_cost = render_ms(render_start, send_ms_start);
+                        cache->add(infile, canonical, cachefile, img_w, img_h, tile_w, tile_h, clevels, numpages, render_cost);
+                        render_ticket.release(); // waiting requests can now use the cache file
                     }
 
                 } catch (Sipi::SipiError &err) {
-                    if (cache != nullptr) {
+                    if (conn_obj.isCacheFileOpen()) {
                         conn_obj.closeCacheFile();
                         unlink(cachefile.c_str());
                     }
@@ -1765,14 +2484,17 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
                                                                                                                  loglevel_p) {
         _salsah_prefix = "imgrep";
         _cache = nullptr;
+        _inflight_timeout = 60;
         _scaling_quality = {HIGH, HIGH, HIGH, HIGH};
     }
     //=========================================================================
 
     void SipiHttpServer::cache(const std::string &cachedir_p, long long max_cachesize_p, unsigned max_nfiles_p,
-                               float cache_hysteresis_p) {
+                               float cache_hysteresis_p, SipiCache::EvictionPolicy eviction_policy_p,
+                               SipiCache::AdmissionPolicy admission_policy_p) {
         try {
-            _cache = std::make_shared<SipiCache>(cachedir_p, max_cachesize_p, max_nfiles_p, cache_hysteresis_p);
+            _cache = std::make_shared<SipiCache>(cachedir_p, max_cachesize_p, max_nfiles_p, cache_hysteresis_p,
+                                                 eviction_policy_p, admission_policy_p);
         } catch (const SipiError &err) {
             _cache = nullptr;
             syslog(LOG_WARNING, "Couldn't open cache directory %s: %s", cachedir_p.c_str(), err.to_string().c_str());
@@ -1780,6 +2502,82 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
     }
     //=========================================================================
 
+    void SipiHttpServer::memcache(size_t max_nbytes_p, int revalidate_p) {
+        if (max_nbytes_p > 0) {
+            _memcache = std::make_shared<SipiMemCache>(max_nbytes_p, revalidate_p);
+        } else {
+            _memcache = nullptr;
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::info_index(const std::string &path_p) {
+        _info_index = nullptr;
+        if (path_p.empty()) return;
+        try {
+            _info_index = std::make_shared<SipiInfoIndex>(path_p);
+        } catch (const SipiError &err) {
+            syslog(LOG_WARNING, "Image info index disabled: %s", err.to_string().c_str());
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::info_cache(size_t max_nentries_p, int revalidate_p) {
+        if (max_nentries_p > 0) {
+            _info_cache = std::make_shared<SipiInfoCache>(max_nentries_p, revalidate_p);
+        } else {
+            _info_cache = nullptr;
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::preflight_cache(size_t max_nentries_p, int ttl_p,
+                                         const std::vector<std::string> &key_headers_p) {
+        if ((max_nentries_p > 0) && (ttl_p > 0)) {
+            _preflight_cache = std::make_shared<SipiPreflightCache>(max_nentries_p, ttl_p, key_headers_p);
+        } else {
+            _preflight_cache = nullptr;
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::decoded_cache(size_t max_nbytes_p) {
+        if (max_nbytes_p > 0) {
+            _decoded_cache = std::make_shared<SipiDecodedCache>(max_nbytes_p);
+        } else {
+            _decoded_cache = nullptr;
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::raster_cache(size_t max_nbytes_p) {
+        if (max_nbytes_p > 0) {
+            _raster_cache = std::make_shared<SipiRasterCache>(max_nbytes_p);
+        } else {
+            _raster_cache = nullptr;
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::derivatives(const std::string &dir_p, size_t max_nbytes_p, unsigned threshold_p) {
+        _derivatives = nullptr;
+        if (dir_p.empty() || (max_nbytes_p == 0)) return;
+        try {
+            _derivatives = std::make_shared<SipiDerivativeStore>(dir_p, max_nbytes_p, threshold_p,
+                                                                 (_cache != nullptr) ? _cache->getCacheDir() : "");
+        } catch (const SipiError &err) {
+            syslog(LOG_WARNING, "Derivative store disabled: %s", err.to_string().c_str());
+        }
+    }
+    //=========================================================================
+
+    void SipiHttpServer::compute_pool(int nthreads_p) {
+        SipiComputePool::shared(nullptr);
+        _compute_pool = std::make_shared<SipiComputePool>(nthreads_p);
+        SipiComputePool::shared(_compute_pool.get());
+    }
+    //=========================================================================
+
     void SipiHttpServer::run(void) {
         int old_ll = setlogmask(LOG_MASK(LOG_INFO));
         syslog(LOG_INFO, "Sipi server starting");
@@ -1787,6 +2585,7 @@ static void knora_send_info(Connection &conn_obj, SipiHttpServer *serv, shttps::
         // setting the image root
         //
         syslog(LOG_INFO, "Serving images from %s", _imgroot.c_str());
+        syslog(LOG_INFO, "Image kernels use %s", SipiSimd::name(SipiSimd::level()));
         syslog(LOG_DEBUG, "Salsah prefix: %s", _salsah_prefix.c_str());
         setlogmask(old_ll);
 
@@ -41,6 +41,15 @@
 #include "iiifparser/SipiRotation.h"
 #include "iiifparser/SipiQualityFormat.h"
 #include "SipiCache.h"
+#include "SipiMemCache.h"
+#include "SipiSingleFlight.h"
+#include "SipiComputePool.h"
+#include "SipiInfoIndex.h"
+#include "SipiInfoCache.h"
+#include "SipiPreflightCache.h"
+#include "SipiDecodedCache.h"
+#include "SipiRasterCache.h"
+#include "SipiDerivativeStore.h"
 
 #include "lua.hpp"
 #include "SipiIO.h"
@@ -64,6 +73,16 @@ namespace Sipi {
         std::vector<std::string> _dirs_to_exclude; //!< Directories which should have no subdirs even if subdirs are enabled
         std::string _logfile;
         std::shared_ptr<SipiCache> _cache;
+        std::shared_ptr<SipiMemCache> _memcache;
+        SipiSingleFlight _inflight; //!< renditions currently in progress, used to coalesce identical requests
+        int _inflight_timeout; //!< maximal number of seconds to wait for a concurrent rendition
+        std::shared_ptr<SipiComputePool> _compute_pool;
+        std::shared_ptr<SipiInfoIndex> _info_index; //!< persistent index of the image dimensions
+        std::shared_ptr<SipiInfoCache> _info_cache; //!< serialized info.json responses
+        std::shared_ptr<SipiPreflightCache> _preflight_cache; //!< results of the Lua pre_flight function
+        std::shared_ptr<SipiDecodedCache> _decoded_cache; //!< decoded images of formats without resolution pyramid
+        std::shared_ptr<SipiRasterCache> _raster_cache; //!< rasters after cropping and scaling, before encoding
+        std::shared_ptr<SipiDerivativeStore> _derivatives; //!< tiled JPEG2000 derivatives of JPEG, PNG and striped TIFF files
         int _jpeg_quality;
         std::unordered_map<std::string,SipiCompressionParams> _j2k_compression_profiles;
         ScalingQuality _scaling_quality;
@@ -171,10 +190,97 @@ namespace Sipi {
         inline ScalingQuality scaling_quality(void) { return _scaling_quality; }
 
         void cache(const std::string &cachedir_p, long long max_cachesize_p = 0, unsigned max_nfiles_p = 0,
-                   float cache_hysteresis_p = 0.1);
+                   float cache_hysteresis_p = 0.1, SipiCache::EvictionPolicy eviction_policy_p = SipiCache::EVICT_LRU,
+                   SipiCache::AdmissionPolicy admission_policy_p = SipiCache::ADMIT_ALL);
 
         inline std::shared_ptr<SipiCache> cache() { return _cache; }
 
+        /*!
+         * Creates the in-memory cache tier in front of the disk cache
+         *
+         * \param max_nbytes_p Byte budget of the memory cache (0 disables it)
+         * \param revalidate_p Seconds after which the modification time of the original is checked again
+         */
+        void memcache(size_t max_nbytes_p, int revalidate_p = 10);
+
+        inline std::shared_ptr<SipiMemCache> memcache() { return _memcache; }
+
+        inline SipiSingleFlight &inflight() { return _inflight; }
+
+        inline int inflight_timeout(void) { return _inflight_timeout; }
+
+        inline void inflight_timeout(int inflight_timeout_p) { _inflight_timeout = inflight_timeout_p; }
+
+        /*!
+         * Opens the persistent image info index
+         *
+         * \param path_p Path of the index file (an empty path disables the index)
+         */
+        void info_index(const std::string &path_p);
+
+        inline std::shared_ptr<SipiInfoIndex> info_index() { return _info_index; }
+
+        /*!
+         * Creates the cache of info.json responses
+         *
+         * \param max_nentries_p Maximal number of cached responses (0 disables the cache)
+         * \param revalidate_p Seconds after which the modification time of the image file is checked again
+         */
+        void info_cache(size_t max_nentries_p, int revalidate_p = 10);
+
+        inline std::shared_ptr<SipiInfoCache> info_cache() { return _info_cache; }
+
+        /*!
+         * Creates the cache of the results of the Lua pre_flight function
+         *
+         * \param max_nentries_p Maximal number of cached results (0 disables the cache)
+         * \param ttl_p Time to live of a result in seconds
+         * \param key_headers_p Names of the request headers which are part of the key (e.g. "cookie")
+         */
+        void preflight_cache(size_t max_nentries_p, int ttl_p, const std::vector<std::string> &key_headers_p);
+
+        inline std::shared_ptr<SipiPreflightCache> preflight_cache() { return _preflight_cache; }
+
+        /*!
+         * Creates the cache of decoded JPEG, PNG and striped TIFF images
+         *
+         * \param max_nbytes_p Byte budget of the pixel buffers (0 disables the cache)
+         */
+        void decoded_cache(size_t max_nbytes_p);
+
+        inline std::shared_ptr<SipiDecodedCache> decoded_cache() { return _decoded_cache; }
+
+        /*!
+         * Creates the cache of rasters shared by renditions which differ only in rotation, quality or format
+         *
+         * \param max_nbytes_p Byte budget of the pixel buffers (0 disables the cache)
+         */
+        void raster_cache(size_t max_nbytes_p);
+
+        inline std::shared_ptr<SipiRasterCache> raster_cache() { return _raster_cache; }
+
+        /*!
+         * Creates the store of tiled JPEG2000 derivatives, into which repeatedly requested JPEG, PNG and
+         * striped TIFF files are transcoded in the background
+         *
+         * \param dir_p Directory of the derivatives (an empty path disables the store)
+         * \param max_nbytes_p Byte budget of the store (0 disables the store)
+         * \param threshold_p Number of requests after which a file is transcoded
+         */
+        void derivatives(const std::string &dir_p, size_t max_nbytes_p, unsigned threshold_p);
+
+        inline std::shared_ptr<SipiDerivativeStore> derivatives() { return _derivatives; }
+
+        /*!
+         * Creates the pool of compute threads which is shared by all image processing
+         * operations (decoding, encoding, color conversion, scaling)
+         *
+         * \param nthreads_p Number of threads of the pool. If 0, the number of processors is used.
+         */
+        void compute_pool(int nthreads_p);
+
+        inline std::shared_ptr<SipiComputePool> compute_pool() { return _compute_pool; }
+
     };
 
 }
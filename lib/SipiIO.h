@@ -29,8 +29,13 @@
 #include <unordered_map>
 #include <string>
 #include <stdexcept>
+#include <memory>
+#include <chrono>
+
+#include "shttps/Connection.h"
 
 #include "SipiImage.h"
+#include "SipiSource.h"
 #include "iiifparser/SipiRegion.h"
 #include "iiifparser/SipiSize.h"
 
@@ -91,13 +96,76 @@ namespace Sipi {
 
     class SipiImage; //!< forward declaration of class SipiImage
 
+    /*!
+     * Interface of a consumer which receives the pixels of an image stripe by stripe instead of
+     * in one buffer. Readers supporting it hand over the decoded rows as they are produced, so
+     * that the memory needed is a few stripes and not the whole image.
+     */
+    class SipiStripeSink {
+    public:
+        virtual ~SipiStripeSink() {};
+
+        /*!
+         * Called by the reader as soon as the geometry and the metadata of the image are known.
+         * The sink may change the header fields of img (nc, bps, photo, icc) to describe the
+         * pixels it emits. If it returns false, img must be left unchanged and the reader
+         * decodes the image into one buffer as usual. The sink must not emit any output before
+         * the first stripe, so that the caller can still fall back to another way of writing.
+         *
+         * \param img Pointer to the SipiImage instance (the pixels are not yet available)
+         * \returns true, if the sink accepts the image
+         */
+        virtual bool begin(SipiImage *img) = 0;
+
+        /*!
+         * Called for each stripe of consecutive rows from top to bottom
+         *
+         * \param img Pointer to the SipiImage instance
+         * \param buf Interleaved pixels of the stripe in the format announced to begin()
+         * \param nrows Number of rows in buf
+         */
+        virtual void stripe(SipiImage *img, unsigned char *buf, size_t nrows) = 0;
+
+        /*!
+         * Called after the last stripe has been delivered
+         *
+         * \param img Pointer to the SipiImage instance
+         */
+        virtual void end(SipiImage *img) = 0;
+    };
+
     /*!
      * This is the virtual base class for all classes implementing image I/O.
      */
     class SipiIO {
+    private:
+        inline static double &thread_send_ms(void) {
+            thread_local double ms = 0.;
+            return ms;
+        }
+
     public:
         virtual ~SipiIO() {};
 
+        /*!
+         * Sends data written by an encoder to the HTTP connection. The time spent sending is
+         * summed up per thread, thus the server can exclude it from the render cost of a rendition.
+         *
+         * \param conobj The HTTP connection
+         * \param data Data to be sent
+         * \param nbytes Number of bytes
+         */
+        inline static void send(shttps::Connection *conobj, const void *data, size_t nbytes) {
+            auto start = std::chrono::steady_clock::now();
+            conobj->sendAndFlush(data, nbytes);
+            thread_send_ms() += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        /*!
+         * Returns the time in milliseconds the calling thread has spent in SipiIO::send()
+         */
+        inline static double send_ms(void) { return thread_send_ms(); }
+
 
         /*!
          * Method used to read an image file
@@ -122,6 +190,39 @@ namespace Sipi {
          */
         virtual SipiImgInfo getDim(std::string filepath, int pagenum) = 0;
 
+        /*!
+         * Checks the magic bytes at the beginning of a file. This is the sniffer by which the format
+         * registry of SipiImage selects the reader, it must not do any I/O.
+         *
+         * \param[in] header The first bytes of the file (at most SipiSource::header_size bytes)
+         * \param[in] len Number of bytes in header
+         * \returns The mime type of the file if it belongs to this format, an empty string otherwise
+         */
+        virtual std::string sniff(const unsigned char *header, size_t len) = 0;
+
+        /*!
+         * Method used to read an image from an already opened file. Formats which are able to
+         * read from a file descriptor override it, the default opens the file again by its path.
+         *
+         * \param *img Pointer to SipiImage instance
+         * \param source The opened image file
+         * (for the other parameters see above)
+         */
+        virtual bool read(SipiImage *img, const SipiSource &source, int pagenum, std::shared_ptr<SipiRegion> region,
+                          std::shared_ptr<SipiSize> size, bool force_bps_8, ScalingQuality scaling_quality) {
+            return read(img, source.path(), pagenum, region, size, force_bps_8, scaling_quality);
+        }
+
+        /*!
+         * Get the dimension of an image from an already opened file (see above)
+         *
+         * \param[in] source The opened image file
+         * \param[in] pagenum Page number
+         */
+        virtual SipiImgInfo getDim(const SipiSource &source, int pagenum) {
+            return getDim(source.path(), pagenum);
+        }
+
         /*!
          * Write an image for a file using the given file format implemented by the subclass
          *
@@ -131,6 +232,18 @@ namespace Sipi {
          * - "HTTP" means to write the image data to the HTTP-server output
          */
         virtual void write(SipiImage *img, std::string filepath, const SipiCompressionParams *params = nullptr) = 0;
+
+        /*!
+         * Returns a sink which encodes an image stripe by stripe. Formats which are not able to
+         * do so return nullptr.
+         *
+         * \param filepath Name of the image file to be written (see write())
+         * \param params Compression parameters
+         */
+        virtual std::shared_ptr<SipiStripeSink> stripeWriter(const std::string &filepath,
+                                                             const SipiCompressionParams *params = nullptr) {
+            return nullptr;
+        }
     };
 
 }
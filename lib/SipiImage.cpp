@@ -23,6 +23,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 
 //#include <memory>
@@ -34,6 +35,9 @@
 #include "shttps/Global.h"
 #include "shttps/Hash.h"
 #include "SipiImage.h"
+#include "SipiComputePool.h"
+#include "SipiResampler.h"
+#include "SipiSimd.h"
 #include "formats/SipiIOTiff.h"
 #include "formats/SipiIOJ2k.h"
 //#include "formats/SipiIOOpenJ2k.h"
@@ -74,6 +78,8 @@ namespace Sipi {
         exif = nullptr;
         skip_metadata = SKIP_NONE;
         conobj = nullptr;
+        sink = nullptr;
+        is_streamed = false;
     };
     //============================================================================
 
@@ -105,15 +111,19 @@ namespace Sipi {
         if (bufsiz > 0) {
             pixels = new byte[bufsiz];
             memcpy(pixels, img_p.pixels, bufsiz);
+        } else {
+            pixels = nullptr;
         }
 
-        xmp = std::make_shared<SipiXmp>(*img_p.xmp);
-        icc = std::make_shared<SipiIcc>(*img_p.icc);
-        iptc = std::make_shared<SipiIptc>(*img_p.iptc);
-        exif = std::make_shared<SipiExif>(*img_p.exif);
+        xmp = (img_p.xmp != nullptr) ? std::make_shared<SipiXmp>(*img_p.xmp) : nullptr;
+        icc = (img_p.icc != nullptr) ? std::make_shared<SipiIcc>(*img_p.icc) : nullptr;
+        iptc = (img_p.iptc != nullptr) ? std::make_shared<SipiIptc>(*img_p.iptc) : nullptr;
+        exif = (img_p.exif != nullptr) ? std::make_shared<SipiExif>(*img_p.exif) : nullptr;
         emdata = img_p.emdata;
         skip_metadata = img_p.skip_metadata;
         conobj = img_p.conobj;
+        sink = nullptr;
+        is_streamed = false;
     }
     //============================================================================
 
@@ -161,6 +171,8 @@ namespace Sipi {
         exif = nullptr;
         skip_metadata = SKIP_NONE;
         conobj = nullptr;
+        sink = nullptr;
+        is_streamed = false;
     }
     //============================================================================
 
@@ -177,6 +189,7 @@ namespace Sipi {
             nc = img_p.nc;
             bps = img_p.bps;
             es = img_p.es;
+            photo = img_p.photo;
             size_t bufsiz;
 
             switch (bps) {
@@ -195,15 +208,18 @@ namespace Sipi {
                 }
             }
 
+            delete[] pixels;
+            pixels = nullptr;
             if (bufsiz > 0) {
                 pixels = new byte[bufsiz];
                 memcpy(pixels, img_p.pixels, bufsiz);
             }
 
-            xmp = std::make_shared<SipiXmp>(*img_p.xmp);
-            icc = std::make_shared<SipiIcc>(*img_p.icc);
-            iptc = std::make_shared<SipiIptc>(*img_p.iptc);
-            exif = std::make_shared<SipiExif>(*img_p.exif);
+            xmp = (img_p.xmp != nullptr) ? std::make_shared<SipiXmp>(*img_p.xmp) : nullptr;
+            icc = (img_p.icc != nullptr) ? std::make_shared<SipiIcc>(*img_p.icc) : nullptr;
+            iptc = (img_p.iptc != nullptr) ? std::make_shared<SipiIptc>(*img_p.iptc) : nullptr;
+            exif = (img_p.exif != nullptr) ? std::make_shared<SipiExif>(*img_p.exif) : nullptr;
+            emdata = img_p.emdata;
             skip_metadata = img_p.skip_metadata;
             conobj = img_p.conobj;
         }
@@ -264,46 +280,50 @@ namespace Sipi {
     */
     void SipiImage::read(std::string filepath, int pagenum, std::shared_ptr<SipiRegion> region, std::shared_ptr<SipiSize> size,
                          bool force_bps_8, ScalingQuality scaling_quality) {
-        size_t pos = filepath.find_last_of('.');
-        std::string fext = filepath.substr(pos + 1);
-        std::string _fext;
-
-        bool got_file = false;
-        _fext.resize(fext.size());
-        std::transform(fext.begin(), fext.end(), _fext.begin(), ::tolower);
-
-        if ((_fext == "tif") || (_fext == "tiff")) {
-            got_file = io[std::string("tif")]->read(this, filepath, pagenum, region, size, force_bps_8, scaling_quality);
-        } else if ((_fext == "jpg") || (_fext == "jpeg")) {
-            got_file = io[std::string("jpg")]->read(this, filepath, pagenum, region, size, force_bps_8, scaling_quality);
-        } else if (_fext == "png") {
-            got_file = io[std::string("png")]->read(this, filepath, pagenum, region, size, force_bps_8, scaling_quality);
-        } else if ((_fext == "jp2") || (_fext == "jpx") || (_fext == "j2k")) {
-            got_file = io[std::string("jpx")]->read(this, filepath, pagenum, region, size, force_bps_8, scaling_quality);
-        }
-
-        if (!got_file) {
-            for (auto const &iterator : io) {
-                if ((got_file = iterator.second->read(this, filepath, pagenum, region, size, force_bps_8, scaling_quality))) break;
-            }
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
         }
+        read(source, pagenum, region, size, force_bps_8, scaling_quality);
+    }
+    //============================================================================
 
-        if (!got_file) {
-            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
+    std::string SipiImage::sniff(const unsigned char *header, size_t len, std::string &mimetype) {
+        for (auto const &iterator : io) {
+            mimetype = iterator.second->sniff(header, len);
+            if (!mimetype.empty()) return iterator.first;
+        }
+        return std::string();
+    }
+    //============================================================================
+
+    void SipiImage::read(const SipiSource &source, int pagenum, std::shared_ptr<SipiRegion> region,
+                         std::shared_ptr<SipiSize> size, bool force_bps_8, ScalingQuality scaling_quality) {
+        is_streamed = false;
+        auto reader = io.find(source.format());
+        if (reader == io.end()) {
+            throw SipiImageError(__file__, __LINE__, "Unsupported file format: " + source.path());
+        }
+        if (!reader->second->read(this, source, pagenum, region, size, force_bps_8, scaling_quality)) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + source.path());
         }
     }
     //============================================================================
 
     bool SipiImage::readOriginal(const std::string &filepath, int pagenum, std::shared_ptr<SipiRegion> region,
                                  std::shared_ptr<SipiSize> size, shttps::HashType htype) {
-        read(filepath, pagenum, region, size, false);
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
+        }
+        read(source, pagenum, region, size, false);
 
         if (!emdata.is_set()) {
             shttps::Hash internal_hash(htype);
             internal_hash.add_data(pixels, nx * ny * nc * bps / 8);
             std::string checksum = internal_hash.hash();
             std::string origname = shttps::getFileName(filepath);
-            std::string mimetype = shttps::Parsing::getFileMimetype(filepath).first;
+            std::string mimetype = source.mimetype();
             std::vector<unsigned char> iccprofile;
             if (icc != nullptr) {
                 iccprofile = icc->iccBytes();
@@ -326,13 +346,17 @@ namespace Sipi {
 
     bool SipiImage::readOriginal(const std::string &filepath, int pagenum, std::shared_ptr<SipiRegion> region,
                                  std::shared_ptr<SipiSize> size, const std::string &origname, shttps::HashType htype) {
-        read(filepath, pagenum, region, size, false);
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
+        }
+        read(source, pagenum, region, size, false);
 
         if (!emdata.is_set()) {
             shttps::Hash internal_hash(htype);
             internal_hash.add_data(pixels, nx * ny * nc * bps / 8);
             std::string checksum = internal_hash.hash();
-            std::string mimetype = shttps::Parsing::getFileMimetype(filepath).first;
+            std::string mimetype = source.mimetype();
             SipiEssentials emdata(origname, mimetype, shttps::HashType::sha256, checksum);
             essential_metadata(emdata);
         } else {
@@ -349,37 +373,24 @@ namespace Sipi {
     //============================================================================
 
     SipiImgInfo SipiImage::getDim(std::string filepath, int pagenum) {
-        size_t pos = filepath.find_last_of('.');
-        std::string fext = filepath.substr(pos + 1);
-        std::string _fext;
-
-        _fext.resize(fext.size());
-        std::transform(fext.begin(), fext.end(), _fext.begin(), ::tolower);
-
-        SipiImgInfo info;
-        std::string mimetype = shttps::Parsing::getFileMimetype(filepath).first;
-
-        if ((mimetype == "image/tiff") || (mimetype == "image/x-tiff")) {
-            info = io[std::string("tif")]->getDim(filepath, pagenum);
-        } else if ((mimetype == "image/jpeg") || (mimetype == "image/pjpeg")) {
-            info = io[std::string("jpg")]->getDim(filepath, pagenum);
-        } else if (mimetype == "image/png") {
-            info = io[std::string("png")]->getDim(filepath, pagenum);
-        } else if ((mimetype == "image/jp2") || (mimetype == "image/jpx")) {
-            info = io[std::string("jpx")]->getDim(filepath, pagenum);
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
         }
-        info.internalmimetype = mimetype;
+        return getDim(source, pagenum);
+    }
+    //============================================================================
 
-        if (info.success == SipiImgInfo::FAILURE) {
-            for (auto const &iterator : io) {
-                info = iterator.second->getDim(filepath, pagenum);
-                if (info.success != SipiImgInfo::FAILURE) break;
-            }
+    SipiImgInfo SipiImage::getDim(const SipiSource &source, int pagenum) {
+        SipiImgInfo info;
+        auto reader = io.find(source.format());
+        if (reader != io.end()) {
+            info = reader->second->getDim(source, pagenum);
         }
-
         if (info.success == SipiImgInfo::FAILURE) {
-            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + source.path());
         }
+        info.internalmimetype = source.mimetype();
         return info;
     }
     //============================================================================
@@ -396,6 +407,14 @@ namespace Sipi {
    }
     //============================================================================
 
+    std::shared_ptr<SipiStripeSink> SipiImage::stripeWriter(const std::string &ftype, const std::string &filepath,
+                                                            const SipiCompressionParams *params) {
+        auto it = io.find(ftype);
+        if (it == io.end()) return nullptr;
+        return it->second->stripeWriter(filepath, params);
+    }
+    //============================================================================
+
     void SipiImage::convertYCC2RGB(void) {
         if (bps == 8) {
             byte *inbuf = pixels;
@@ -494,8 +513,12 @@ namespace Sipi {
         in_formatter = icc->iccFormatter(this);
         out_formatter = target_icc_p.iccFormatter(new_bps);
 
+        //
+        // cmsFLAGS_NOCACHE makes the transform reentrant, so that bands of rows can be converted
+        // in parallel by the threads of the compute pool
+        //
         hTransform = cmsCreateTransform(icc->getIccProfile(), in_formatter, target_icc_p.getIccProfile(), out_formatter,
-                                        INTENT_PERCEPTUAL, 0);
+                                        INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
 
         if (hTransform == nullptr) {
             throw SipiImageError(__file__, __LINE__, "Couldn't create color transform");
@@ -503,7 +526,11 @@ namespace Sipi {
 
         byte *inbuf = pixels;
         byte *outbuf = new byte[nx * ny * nnc * new_bps / 8];
-        cmsDoTransform(hTransform, inbuf, outbuf, nx * ny);
+        size_t in_rowsize = nx * nc * bps / 8;
+        size_t out_rowsize = nx * nnc * new_bps / 8;
+        SipiComputePool::run(0, ny, [&](size_t y0, size_t y1) {
+            cmsDoTransform(hTransform, inbuf + y0 * in_rowsize, outbuf + y0 * out_rowsize, nx * (y1 - y0));
+        }, 64);
         cmsDeleteTransform(hTransform);
         icc = std::make_shared<SipiIcc>(target_icc_p);
         pixels = outbuf;
@@ -724,6 +751,73 @@ namespace Sipi {
     }
     //============================================================================
 
+    void SipiImage::cropFrom(const SipiImage &master, size_t full_w, size_t full_h, std::shared_ptr<SipiRegion> region,
+                             std::shared_ptr<SipiSize> size, bool force_bps_8, ScalingMethod scaling_method) {
+        //
+        // the region and the resulting size in full resolution pixels
+        //
+        int roi_x = 0, roi_y = 0;
+        size_t roi_w = full_w, roi_h = full_h;
+        if ((region != nullptr) && (region->getType() != SipiRegion::FULL)) {
+            region->crop_coords(full_w, full_h, roi_x, roi_y, roi_w, roi_h);
+        }
+        size_t nnx = roi_w, nny = roi_h;
+        if (size != nullptr) {
+            int reduce = -1;
+            bool redonly;
+            (void) size->get_size(roi_w, roi_h, nnx, nny, reduce, redonly);
+        }
+
+        //
+        // the region in the pixels of the master, which may have a reduced resolution
+        //
+        size_t x0 = ((size_t) roi_x * master.nx) / full_w;
+        size_t y0 = ((size_t) roi_y * master.ny) / full_h;
+        size_t x1 = std::min(((roi_x + roi_w) * master.nx + full_w - 1) / full_w, master.nx);
+        size_t y1 = std::min(((roi_y + roi_h) * master.ny + full_h - 1) / full_h, master.ny);
+        if ((x1 <= x0) || (y1 <= y0)) {
+            throw SipiImageError(__file__, __LINE__, "Region outside of the decoded image");
+        }
+
+        nx = x1 - x0;
+        ny = y1 - y0;
+        nc = master.nc;
+        bps = master.bps;
+        es = master.es;
+        photo = master.photo;
+        xmp = (master.xmp != nullptr) ? std::make_shared<SipiXmp>(*master.xmp) : nullptr;
+        icc = (master.icc != nullptr) ? std::make_shared<SipiIcc>(*master.icc) : nullptr;
+        iptc = (master.iptc != nullptr) ? std::make_shared<SipiIptc>(*master.iptc) : nullptr;
+        exif = (master.exif != nullptr) ? std::make_shared<SipiExif>(*master.exif) : nullptr;
+        emdata = master.emdata;
+        is_streamed = false;
+
+        size_t psize = nc * (bps / 8); // bytes per pixel
+        size_t sll = nx * psize;
+        delete[] pixels;
+        pixels = new byte[ny * sll];
+        for (size_t j = 0; j < ny; j++) {
+            memcpy(pixels + j * sll, master.pixels + ((y0 + j) * master.nx + x0) * psize, sll);
+        }
+
+        if ((nnx != nx) || (nny != ny)) {
+            switch (scaling_method) {
+                case HIGH: scale(nnx, nny);
+                    break;
+                case MEDIUM: scaleMedium(nnx, nny);
+                    break;
+                case LOW: scaleFast(nnx, nny);
+            }
+        }
+
+        if (force_bps_8) {
+            if (!to8bps()) {
+                throw SipiImageError(__file__, __LINE__, "Cannot convert to 8 Bits(sample");
+            }
+        }
+    }
+    //============================================================================
+
 
     /****************************************************************************/
 #define POSITION(x, y, c, n) ((n)*((y)*nx + (x)) + c)
@@ -795,25 +889,29 @@ namespace Sipi {
         if (bps == 8) {
             byte *inbuf = pixels;
             byte *outbuf = new byte[nnx * nny * nc];
-            for (size_t y = 0; y < nny; y++) {
-                for (size_t x = 0; x < nnx; x++) {
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (y * nnx + x) + k] = inbuf[nc * (ylut[y] * nx + xlut[x]) + k];
+            SipiComputePool::run(0, nny, [&](size_t y0, size_t y1) {
+                for (size_t y = y0; y < y1; y++) {
+                    for (size_t x = 0; x < nnx; x++) {
+                        for (size_t k = 0; k < nc; k++) {
+                            outbuf[nc * (y * nnx + x) + k] = inbuf[nc * (ylut[y] * nx + xlut[x]) + k];
+                        }
                     }
                 }
-            }
+            }, 16);
             pixels = outbuf;
             delete[] inbuf;
         } else if (bps == 16) {
             word *inbuf = (word *) pixels;
             word *outbuf = new word[nnx * nny * nc];
-            for (size_t y = 0; y < nny; y++) {
-                for (size_t x = 0; x < nnx; x++) {
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (y * nnx + x) + k] = inbuf[nc * (ylut[y] * nx + xlut[x]) + k];
+            SipiComputePool::run(0, nny, [&](size_t y0, size_t y1) {
+                for (size_t y = y0; y < y1; y++) {
+                    for (size_t x = 0; x < nnx; x++) {
+                        for (size_t k = 0; k < nc; k++) {
+                            outbuf[nc * (y * nnx + x) + k] = inbuf[nc * (ylut[y] * nx + xlut[x]) + k];
+                        }
                     }
                 }
-            }
+            }, 16);
             pixels = (byte *) outbuf;
             delete[] inbuf;
 
@@ -843,34 +941,32 @@ namespace Sipi {
         if (bps == 8) {
             byte *inbuf = pixels;
             byte *outbuf = new byte[nnx * nny * nc];
-            float rx, ry;
 
-            for (size_t j = 0; j < nny; j++) {
-                ry = ylut[j];
-                for (size_t i = 0; i < nnx; i++) {
-                    rx = xlut[i];
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnx + i) + k] = bilinn(inbuf, nx, rx, ry, k, nc);
-                    }
+            SipiComputePool::run(0, nny, [&](size_t j0, size_t j1) {
+                for (size_t j = j0; j < j1; j++) {
+                    size_t iy = (size_t) ylut[j];
+                    float ry = ylut[j] - (float) iy;
+                    const byte *row0 = inbuf + iy * nx * nc;
+                    const byte *row1 = (iy + 1 < ny) ? row0 + nx * nc : row0;
+                    SipiSimd::bilinear(row0, row1, nc, xlut.get(), nnx, ry, outbuf + j * nnx * nc);
                 }
-            }
+            }, 16);
 
             pixels = outbuf;
             delete[] inbuf;
         } else if (bps == 16) {
             word *inbuf = (word *) pixels;
             word *outbuf = new word[nnx * nny * nc];
-            float rx, ry;
 
-            for (size_t j = 0; j < nny; j++) {
-                ry = ylut[j];
-                for (size_t i = 0; i < nnx; i++) {
-                    rx = xlut[i];
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnx + i) + k] = bilinn(inbuf, nx, rx, ry, k, nc);
-                    }
+            SipiComputePool::run(0, nny, [&](size_t j0, size_t j1) {
+                for (size_t j = j0; j < j1; j++) {
+                    size_t iy = (size_t) ylut[j];
+                    float ry = ylut[j] - (float) iy;
+                    const word *row0 = inbuf + iy * nx * nc;
+                    const word *row1 = (iy + 1 < ny) ? row0 + nx * nc : row0;
+                    SipiSimd::bilinear(row0, row1, nc, xlut.get(), nnx, ry, outbuf + j * nnx * nc);
                 }
-            }
+            }, 16);
 
             pixels = (byte *) outbuf;
             delete[] inbuf;
@@ -886,125 +982,33 @@ namespace Sipi {
 
 
     bool SipiImage::scale(size_t nnx, size_t nny) {
-        size_t iix = 1, iiy = 1;
-        size_t nnnx, nnny;
-
         //
-        // if the scaling is less than 1 (that is, the image gets smaller), we first
-        // expand it to a integer multiple of the desired size, and then we just
-        // avarage the number of pixels. This is the "proper" way of downscale an
-        // image...
+        // a missing dimension is calculated from the aspect ratio
         //
-        if (nnx < nx) {
-            while (nnx * iix < nx) iix++;
-            nnnx = nnx * iix;
-        } else {
-            nnnx = nnx;
-        }
-
-        if (nny < ny) {
-            while (nny * iiy < ny) iiy++;
-            nnny = nny * iiy;
-        } else {
-            nnny = nny;
-        }
-
-        auto xlut = shttps::make_unique<float[]>(nnnx);
-        auto ylut = shttps::make_unique<float[]>(nnny);
-
-        for (size_t i = 0; i < nnnx; i++) {
-            xlut[i] = (float) (i * (nx - 1)) / (float) (nnnx - 1);
-        }
-        for (size_t j = 0; j < nnny; j++) {
-            ylut[j] = (float) (j * (ny - 1)) / (float) (nnny - 1);
-        }
+        if ((nnx == 0) && (nny == 0)) return true;
+        if (nnx == 0) nnx = std::max((size_t) 1, (size_t) ((double) nx * (double) nny / (double) ny + 0.5));
+        if (nny == 0) nny = std::max((size_t) 1, (size_t) ((double) ny * (double) nnx / (double) nx + 0.5));
+        if ((nnx == nx) && (nny == ny)) return true;
 
+        //
+        // separable Lanczos3 resampling with fixed-point weights; the source is processed destination row by
+        // destination row, so no intermediate image is needed (see SipiResampler)
+        //
+        SipiResampler resampler(nx, ny, nnx, nny, nc);
         if (bps == 8) {
             byte *inbuf = pixels;
-            byte *outbuf = new byte[nnnx * nnny * nc];
-            float rx, ry;
-
-            for (size_t j = 0; j < nnny; j++) {
-                ry = ylut[j];
-                for (size_t i = 0; i < nnnx; i++) {
-                    rx = xlut[i];
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnnx + i) + k] = bilinn(inbuf, nx, rx, ry, k, nc);
-                    }
-                }
-            }
-
+            byte *outbuf = new byte[nnx * nny * nc];
+            resampler.resample(inbuf, outbuf);
             pixels = outbuf;
             delete[] inbuf;
         } else if (bps == 16) {
             word *inbuf = (word *) pixels;
-            word *outbuf = new word[nnnx * nnny * nc];
-            float rx, ry;
-
-            for (size_t j = 0; j < nnny; j++) {
-                ry = ylut[j];
-                for (size_t i = 0; i < nnnx; i++) {
-                    rx = xlut[i];
-                    for (size_t k = 0; k < nc; k++) {
-                        outbuf[nc * (j * nnnx + i) + k] = bilinn(inbuf, nx, rx, ry, k, nc);
-                    }
-                }
-            }
-
+            word *outbuf = new word[nnx * nny * nc];
+            resampler.resample(inbuf, outbuf);
             pixels = (byte *) outbuf;
             delete[] inbuf;
         } else {
             return false;
-            // clean up and throw exception
-        }
-
-        //
-        // now we have to check if we have to average the pixels
-        //
-        if ((iix > 1) || (iiy > 1)) {
-            if (bps == 8) {
-                byte *inbuf = pixels;
-                byte *outbuf = new byte[nnx * nny * nc];
-                for (size_t j = 0; j < nny; j++) {
-                    for (size_t i = 0; i < nnx; i++) {
-                        for (size_t k = 0; k < nc; k++) {
-                            unsigned int accu = 0;
-
-                            for (size_t jj = 0; jj < iiy; jj++) {
-                                for (size_t ii = 0; ii < iix; ii++) {
-                                    accu += inbuf[nc * ((iiy * j + jj) * nnnx + (iix * i + ii)) + k];
-                                }
-                            }
-
-                            outbuf[nc * (j * nnx + i) + k] = accu / (iix * iiy);
-                        }
-                    }
-                }
-                pixels = outbuf;
-                delete[] inbuf;
-            } else if (bps == 16) {
-                word *inbuf = (word *) pixels;
-                word *outbuf = new word[nnx * nny * nc];
-
-                for (size_t j = 0; j < nny; j++) {
-                    for (size_t i = 0; i < nnx; i++) {
-                        for (size_t k = 0; k < nc; k++) {
-                            unsigned int accu = 0;
-
-                            for (size_t jj = 0; jj < iiy; jj++) {
-                                for (size_t ii = 0; ii < iix; ii++) {
-                                    accu += inbuf[nc * ((iiy * j + jj) * nnnx + (iix * i + ii)) + k];
-                                }
-                            }
-
-                            outbuf[nc * (j * nnx + i) + k] = accu / (iix * iiy);
-                        }
-                    }
-                }
-
-                pixels = (byte *) outbuf;
-                delete[] inbuf;
-            }
         }
 
         nx = nnx;
@@ -1357,29 +1361,43 @@ namespace Sipi {
         if (bps == 8) {
             byte *buf = pixels;
 
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    byte val = bilinn(wmbuf, wm_nx, xlut[i], ylut[j], 0, wm_nc);
+            //
+            // the blended value only depends on the sample and the watermark value, so it is tabulated
+            //
+            std::vector<byte> blend(256 * 256);
+            for (size_t val = 0; val < 256; val++) {
+                for (size_t v = 0; v < 256; v++) {
+                    float nval = (v / 255.) * (1.0F + val / 2550.0F) + val / 2550.0F;
+                    blend[val * 256 + v] = (nval > 1.0) ? 255 : floor(nval * 255. + .5);
+                }
+            }
 
-                    for (size_t k = 0; k < nc; k++) {
-                        float nval = (buf[nc * (j * nx + i) + k] / 255.) * (1.0F + val / 2550.0F) + val / 2550.0F;
-                        buf[nc * (j * nx + i) + k] = (nval > 1.0) ? 255 : floor(nval * 255. + .5);
+            SipiComputePool::run(0, ny, [&](size_t j0, size_t j1) {
+                for (size_t j = j0; j < j1; j++) {
+                    for (size_t i = 0; i < nx; i++) {
+                        byte val = bilinn(wmbuf, wm_nx, xlut[i], ylut[j], 0, wm_nc);
+                        const byte *lut = &blend[val * 256];
+                        byte *p = buf + nc * (j * nx + i);
+                        for (size_t k = 0; k < nc; k++) p[k] = lut[p[k]];
                     }
                 }
-            }
+            }, 16);
         } else if (bps == 16) {
             word *buf = (word *) pixels;
 
-            for (size_t j = 0; j < ny; j++) {
-                for (size_t i = 0; i < nx; i++) {
-                    for (size_t k = 0; k < nc; k++) {
+            SipiComputePool::run(0, ny, [&](size_t j0, size_t j1) {
+                for (size_t j = j0; j < j1; j++) {
+                    for (size_t i = 0; i < nx; i++) {
                         byte val = bilinn(wmbuf, wm_nx, xlut[i], ylut[j], 0, wm_nc);
-                        float nval =
-                                (buf[nc * (j * nx + i) + k] / 65535.0F) * (1.0F + val / 655350.0F) + val / 352500.F;
-                        buf[nc * (j * nx + i) + k] = (nval > 1.0) ? (word) 65535 : (word) floor(nval * 65535. + .5);
+                        for (size_t k = 0; k < nc; k++) {
+                            float nval =
+                                    (buf[nc * (j * nx + i) + k] / 65535.0F) * (1.0F + val / 655350.0F) + val / 352500.F;
+                            buf[nc * (j * nx + i) + k] =
+                                    (nval > 1.0) ? (word) 65535 : (word) floor(nval * 65535. + .5);
+                        }
                     }
                 }
-            }
+            }, 16);
         }
 
         delete[] wmbuf;
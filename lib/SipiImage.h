@@ -171,6 +171,8 @@ class SipiImageError : public std::exception {
         friend class SipiIOJpeg;    //!< I/O class for the JPEG file format
         friend class SipiIOPng;     //!< I/O class for the PNG file format
         friend class SipiIOPdf;     //!< I/O class for the PDF file format
+        friend class SipiJpegStripeWriter; //!< Writes JPEG images stripe by stripe
+        friend class SipiStripePipeline; //!< Converts the stripes of streamed images
     private:
         static std::unordered_map<std::string, std::shared_ptr<SipiIO> > io; //!< member variable holding a map of I/O class instances for the different file formats
         byte bilinn(byte buf[], register int nx, register float x, register float y, register int c, register int n);
@@ -194,6 +196,8 @@ class SipiImageError : public std::exception {
         SipiEssentials emdata; //!< Metadata to be stored in file header
         shttps::Connection *conobj; //!< Pointer to HTTP connection
         SkipMetadata skip_metadata; //!< If true, all metadata is stripped off
+        std::shared_ptr<SipiStripeSink> sink; //!< If not nullptr, readers may deliver the pixels stripe by stripe
+        bool is_streamed; //!< true, if the pixels have been delivered to the sink instead of being read
 
     public:
         //
@@ -229,6 +233,17 @@ class SipiImageError : public std::exception {
                                              const std::string &filename);
          */
 
+        /*!
+         * Format registry: passes the first bytes of a file to the sniffers of the io classes
+         * (see SipiIO::sniff()) in order to find the reader of the file.
+         *
+         * \param[in] header The first bytes of the file
+         * \param[in] len Number of bytes in header
+         * \param[out] mimetype The mime type reported by the sniffer
+         * \returns The key of the io class (e.g. "tif") or an empty string, if no reader recognizes the file
+         */
+        static std::string sniff(const unsigned char *header, size_t len, std::string &mimetype);
+
         /*!
          * Getter for nx
          */
@@ -256,6 +271,11 @@ class SipiImageError : public std::exception {
          */
         inline size_t getBps() { return bps; }
 
+        /*!
+         * Get the size of the pixel buffer in bytes
+         */
+        inline size_t getNbytes() const { return nx * ny * nc * (bps / 8); }
+
         /*! Destructor
          *
          * Destroys the image and frees all the resources associated with it
@@ -325,6 +345,20 @@ class SipiImageError : public std::exception {
          */
         inline shttps::Connection *connection() { return conobj; };
 
+        /*!
+         * Attaches a sink to which a reader supporting it delivers the pixels stripe by
+         * stripe instead of reading the whole image into memory (see \ref SipiStripeSink)
+         *
+         * \param[in] sink_p Pointer to the sink or nullptr
+         */
+        inline void stripe_sink(std::shared_ptr<SipiStripeSink> sink_p) { sink = sink_p; };
+
+        /*!
+         * Returns true, if the last read delivered the pixels to the stripe sink. In this
+         * case the image holds no pixels and all processing has been done by the sink.
+         */
+        inline bool streamed() { return is_streamed; };
+
         inline void essential_metadata(const SipiEssentials &emdata_p) { emdata = emdata_p; }
 
         inline SipiEssentials essential_metadata(void) { return emdata; }
@@ -344,6 +378,22 @@ class SipiImageError : public std::exception {
                   std::shared_ptr<SipiSize> size = nullptr, bool force_bps_8 = false,
                   ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH});
 
+        /*!
+         * Read an image from an already opened file. The format readers work on
+         * duplicates of the source's descriptor, so the source can be reused
+         * afterwards (e.g. for getDim or validators).
+         *
+         * \param[in] source The opened image file
+         *
+         * The reader is selected by the format sniffed from the file header (see sniff()),
+         * the file extension is ignored.
+         *
+         * \throws SipiImageError
+         */
+        void read(const SipiSource &source, int pagenum = 0, std::shared_ptr<SipiRegion> region = nullptr,
+                  std::shared_ptr<SipiSize> size = nullptr, bool force_bps_8 = false,
+                  ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH});
+
         /*!
          * Read an image that is to be considered an "original image". In this case
          * a SipiEssentials object is created containing the original name, the
@@ -403,6 +453,15 @@ class SipiImageError : public std::exception {
          */
         SipiImgInfo getDim(std::string filepath, int pagenum = 0);
 
+        /*!
+         * Get the dimension of the image from an already opened file
+         *
+         * \param[in] source The opened image file
+         * \param[in] pagenum Page that is to be used (for PDF's and multipage TIF's only, first page is 1)
+         * \return Info about image (see SipiImgInfo)
+         */
+        SipiImgInfo getDim(const SipiSource &source, int pagenum = 0);
+
         /*!
          * Get the dimension of the image object
          *
@@ -427,6 +486,16 @@ class SipiImageError : public std::exception {
          */
         void write(std::string ftype, std::string filepath, const SipiCompressionParams *params = nullptr);
 
+        /*!
+         * Returns a sink which writes an image stripe by stripe, or nullptr if the
+         * file format does not support this (see \ref SipiIO::stripeWriter)
+         *
+         * \param[in] ftype The file format that should be used to write the file
+         * \param[in] filepath String containing the path/filename
+         */
+        static std::shared_ptr<SipiStripeSink> stripeWriter(const std::string &ftype, const std::string &filepath,
+                                                            const SipiCompressionParams *params = nullptr);
+
 
         /*!
          * Convert full range YCbCr (YCC) to RGB colors
@@ -470,6 +539,25 @@ class SipiImageError : public std::exception {
          */
         bool crop(std::shared_ptr<SipiRegion> region);
 
+        /*!
+         * Creates the image of a region from an already decoded image (see SipiDecodedCache) instead of
+         * reading the file again. The metadata and the pixels of the region are copied, the region is then
+         * scaled to the requested size. The master may have been decoded at a reduced resolution, region and
+         * size are nevertheless given relative to the full resolution of the file.
+         *
+         * \param[in] master The decoded image
+         * \param[in] full_w Width of the image file in full resolution
+         * \param[in] full_h Height of the image file in full resolution
+         * \param[in] region Pointer to the SipiRegion (or nullptr for the full image)
+         * \param[in] size Pointer to the SipiSize (or nullptr for no scaling)
+         * \param[in] force_bps_8 We want in any case a 8 Bit/sample image. Reduce if necessary
+         * \param[in] scaling_method Scaling method used by the reader of the format
+         *
+         * \throws SipiImageError, SipiSizeError
+         */
+        void cropFrom(const SipiImage &master, size_t full_w, size_t full_h, std::shared_ptr<SipiRegion> region,
+                      std::shared_ptr<SipiSize> size, bool force_bps_8, ScalingMethod scaling_method);
+
         /*!
          * Resize an image using a high speed algorithm which may result in poor image quality
          *
@@ -479,7 +567,7 @@ class SipiImageError : public std::exception {
         bool scaleFast(size_t nnx, size_t nny);
 
         /*!
-         * Resize an image using some balance between speed and quality
+         * Resize an image using some balance between speed and quality (bilinear interpolation, see SipiSimd)
          *
          * \param[in] nnx New horizontal dimension (width)
          * \param[in] nny New vertical dimension (height)
@@ -487,10 +575,10 @@ class SipiImageError : public std::exception {
         bool scaleMedium(size_t nnx, size_t nny);
 
         /*!
-         * Resize an image using the best (but slow) algorithm
+         * Resize an image using the best algorithm (separable Lanczos3 resampling, see SipiResampler)
          *
-         * \param[in] nnx New horizontal dimension (width)
-         * \param[in] nny New vertical dimension (height)
+         * \param[in] nnx New horizontal dimension (width), if 0 it is calculated from nny and the aspect ratio
+         * \param[in] nny New vertical dimension (height), if 0 it is calculated from nnx and the aspect ratio
          */
         bool scale(size_t nnx = 0, size_t nny = 0);
 
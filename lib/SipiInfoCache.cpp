@@ -0,0 +1,129 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdint>
+#include <cstdio>
+
+#include <sys/stat.h>
+
+#include "SipiInfoCache.h"
+
+namespace Sipi {
+
+    SipiInfoCache::SipiInfoCache(size_t max_nentries_p, int revalidate_p)
+            : max_nentries(max_nentries_p), revalidate(revalidate_p), hits(0), misses(0) {}
+    //============================================================================
+
+    std::string SipiInfoCache::etag(const std::string &body) {
+        uint64_t h = 14695981039346656037ull; // 64 bit FNV-1a
+        for (unsigned char c : body) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        char buf[24];
+        (void) snprintf(buf, sizeof(buf), "\"%016llx\"", (unsigned long long) h);
+        return buf;
+    }
+    //============================================================================
+
+    std::shared_ptr<const SipiInfoCache::InfoRecord> SipiInfoCache::get(const std::string &key_p) {
+        std::string infile;
+        time_t mtime;
+        off_t fsize;
+        {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            auto it = table.find(key_p);
+            if (it == table.end()) {
+                misses++;
+                return nullptr;
+            }
+            lru.splice(lru.begin(), lru, it->second); // move to front
+            if (time(nullptr) - it->second->checked < revalidate) {
+                hits++;
+                return it->second->record;
+            }
+            infile = it->second->infile;
+            mtime = it->second->record->mtime;
+            fsize = it->second->record->fsize;
+        }
+
+        //
+        // the revalidation interval has elapsed; check the image file outside the lock
+        //
+        struct stat fileinfo;
+        bool valid = (stat(infile.c_str(), &fileinfo) == 0) && (fileinfo.st_mtime == mtime) &&
+                     (fileinfo.st_size == fsize);
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(key_p);
+        if (it == table.end()) { // has been removed meanwhile
+            misses++;
+            return nullptr;
+        }
+        if (!valid) {
+            lru.erase(it->second);
+            table.erase(it);
+            misses++;
+            return nullptr;
+        }
+        it->second->checked = time(nullptr);
+        hits++;
+        return it->second->record;
+    }
+    //============================================================================
+
+    std::shared_ptr<const SipiInfoCache::InfoRecord>
+    SipiInfoCache::record(const std::string &infile_p, const std::string &json_p, bool is_image_file_p,
+                          bool unauthorized_p) {
+        struct stat fileinfo;
+        if (stat(infile_p.c_str(), &fileinfo) != 0) return nullptr;
+        return std::make_shared<const InfoRecord>(InfoRecord{json_p, etag(json_p), fileinfo.st_mtime,
+                                                             fileinfo.st_size, is_image_file_p, unauthorized_p});
+    }
+    //============================================================================
+
+    void SipiInfoCache::add(const std::string &key_p, const std::string &infile_p,
+                            std::shared_ptr<const InfoRecord> record_p) {
+        if ((record_p == nullptr) || (max_nentries == 0)) return;
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(key_p);
+        if (it != table.end()) { // replace existing entry
+            lru.erase(it->second);
+            table.erase(it);
+        }
+        while (!lru.empty() && (lru.size() >= max_nentries)) {
+            table.erase(lru.back().key);
+            lru.pop_back();
+        }
+        lru.push_front({key_p, infile_p, record_p, time(nullptr)});
+        table[key_p] = lru.begin();
+    }
+    //============================================================================
+
+    SipiInfoCache::Stats SipiInfoCache::stats(void) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return {table.size(), max_nentries, hits, misses};
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_infocache_h
+#define __defined_sipi_infocache_h
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <sys/types.h>
+
+namespace Sipi {
+
+    /*!
+     * SipiInfoCache keeps the serialized info.json responses in memory. The key is built from
+     * everything the response depends on (the id with host and prefix, and the result of the pre_flight
+     * script), the entry is invalidated if the modification time or size of the image file changes.
+     * Each entry carries a strong ETag and the modification time, so that conditional requests can be
+     * answered with "304 Not Modified".
+     *
+     * As in SipiMemCache, the image file is only checked again after the revalidation interval has
+     * elapsed, in between entries are served without any system call.
+     */
+    class SipiInfoCache {
+    public:
+        /*!
+         * A cached info.json response
+         */
+        typedef struct {
+            std::string json;       //!< the serialized info.json
+            std::string etag;       //!< strong entity tag (including the double quotes)
+            time_t mtime;           //!< modification time of the image file (for Last-Modified)
+            off_t fsize;            //!< size of the image file
+            bool is_image_file;     //!< image (IIIF) or generic file (sipi file context)
+            bool unauthorized;      //!< response carries the IIIF auth services (status 401)
+        } InfoRecord;
+
+        /*!
+         * Statistics of the info cache
+         */
+        typedef struct {
+            size_t nentries;        //!< number of entries in the cache
+            size_t max_nentries;    //!< maximal number of entries
+            unsigned long long hits;      //!< number of info.json requests served from the cache
+            unsigned long long misses;    //!< number of info.json requests which had to be built
+        } Stats;
+
+    private:
+        typedef struct {
+            std::string key;
+            std::string infile;
+            std::shared_ptr<const InfoRecord> record;
+            time_t checked;         //!< last time the image file has been checked
+        } CacheRecord;
+
+        std::mutex locking;
+        std::list<CacheRecord> lru; //!< most recently used entries at the front
+        std::unordered_map<std::string, std::list<CacheRecord>::iterator> table;
+        size_t max_nentries;
+        int revalidate;
+        unsigned long long hits;
+        unsigned long long misses;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nentries_p Maximal number of cached responses
+         * \param[in] revalidate_p Number of seconds after which the image file is checked again
+         */
+        SipiInfoCache(size_t max_nentries_p, int revalidate_p = 10);
+
+        /*!
+         * Calculates a strong entity tag for a response body
+         *
+         * \param[in] body The response body
+         *
+         * \returns The entity tag including the double quotes
+         */
+        static std::string etag(const std::string &body);
+
+        /*!
+         * Creates the record of an info.json response
+         *
+         * \param[in] infile_p Path of the image file
+         * \param[in] json_p The serialized info.json
+         * \param[in] is_image_file_p true for IIIF image files
+         * \param[in] unauthorized_p true, if the response carries the IIIF auth services
+         *
+         * \returns The record (nullptr if the image file cannot be accessed)
+         */
+        static std::shared_ptr<const InfoRecord> record(const std::string &infile_p, const std::string &json_p,
+                                                        bool is_image_file_p, bool unauthorized_p);
+
+        /*!
+         * Get a cached info.json
+         *
+         * \param[in] key_p Cache key (see iiif_send_info)
+         *
+         * \returns The cached response or nullptr if not cached or outdated
+         */
+        std::shared_ptr<const InfoRecord> get(const std::string &key_p);
+
+        /*!
+         * Add an info.json to the cache
+         *
+         * \param[in] key_p Cache key
+         * \param[in] infile_p Path of the image file
+         * \param[in] record_p The record created by SipiInfoCache::record()
+         */
+        void add(const std::string &key_p, const std::string &infile_p, std::shared_ptr<const InfoRecord> record_p);
+
+        /*!
+         * Get the statistics of the info cache
+         */
+        Stats stats(void);
+    };
+
+}
+
+#endif
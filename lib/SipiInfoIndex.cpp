@@ -0,0 +1,241 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "HasAtimeSpec.h"
+#include "SipiInfoIndex.h"
+#include "SipiError.h"
+#include "SipiImage.h"
+
+static const char __file__[] = __FILE__;
+
+namespace Sipi {
+
+    static const char index_magic[8] = {'S', 'I', 'P', 'I', 'I', 'D', 'X', '2'};
+    static const size_t max_probes = 8; //!< number of slots searched for an entry (linear probing)
+
+    /*!
+     * 64 bit FNV-1a hash of path and page number. 0 is reserved for empty slots.
+     */
+    static uint64_t info_key(const std::string &filepath, int pagenum) {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : filepath) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        for (size_t i = 0; i < sizeof(pagenum); i++) {
+            h ^= (unsigned char) (pagenum >> (8 * i));
+            h *= 1099511628211ull;
+        }
+        return (h == 0) ? 1 : h;
+    }
+    //============================================================================
+
+    /*!
+     * Second hash of path and page number, independent of info_key(). The path itself is not stored
+     * in the slots, thus an entry is only used if both hashes match.
+     */
+    static uint64_t info_verify(const std::string &filepath, int pagenum) {
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ filepath.size();
+        for (unsigned char c : filepath) {
+            h = (h ^ c) * 0xff51afd7ed558ccdull;
+            h ^= h >> 29;
+        }
+        h ^= (uint64_t) (uint32_t) pagenum;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+    //============================================================================
+
+    static void file_mtime(const struct stat &fileinfo, int64_t &sec, int64_t &nsec) {
+#if defined(HAVE_ST_ATIMESPEC)
+        sec = fileinfo.st_mtimespec.tv_sec;
+        nsec = fileinfo.st_mtimespec.tv_nsec;
+#else
+        sec = fileinfo.st_mtim.tv_sec;
+        nsec = fileinfo.st_mtim.tv_nsec;
+#endif
+    }
+    //============================================================================
+
+    SipiInfoIndex::SipiInfoIndex(const std::string &path_p, size_t nslots_p) : path(path_p), fd(-1),
+                                                                                header(nullptr), slots(nullptr) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0) {
+            throw SipiError(__file__, __LINE__, "Couldn't open image info index \"" + path + "\"", errno);
+        }
+
+        //
+        // an existing index keeps its size, a new (or invalid) one is created with nslots_p entries
+        //
+        IndexHeader hdr;
+        bool valid = (::pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)) &&
+                     (memcmp(hdr.magic, index_magic, sizeof(index_magic)) == 0) && (hdr.nslots > 0);
+        nslots = valid ? hdr.nslots : nslots_p;
+        maplen = sizeof(IndexHeader) + nslots * sizeof(InfoSlot);
+
+        if (!valid) {
+            memset(&hdr, 0, sizeof(hdr));
+            memcpy(hdr.magic, index_magic, sizeof(index_magic));
+            hdr.nslots = nslots;
+            if ((::ftruncate(fd, 0) != 0) || (::ftruncate(fd, maplen) != 0) ||
+                (::pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))) {
+                ::close(fd);
+                throw SipiError(__file__, __LINE__, "Couldn't initialize image info index \"" + path + "\"", errno);
+            }
+        }
+
+        void *mem = ::mmap(nullptr, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+            ::close(fd);
+            throw SipiError(__file__, __LINE__, "Couldn't map image info index \"" + path + "\"", errno);
+        }
+        header = (IndexHeader *) mem;
+        slots = (InfoSlot *) ((char *) mem + sizeof(IndexHeader));
+        syslog(LOG_INFO, "Image info index \"%s\" with %zu entries", path.c_str(), nslots);
+    }
+    //============================================================================
+
+    SipiInfoIndex::~SipiInfoIndex() {
+        if (header != nullptr) ::munmap(header, maplen);
+        if (fd >= 0) ::close(fd);
+    }
+    //============================================================================
+
+    uint64_t SipiInfoIndex::checksum(const InfoSlot &slot) {
+        const unsigned char *p = (const unsigned char *) &slot;
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < offsetof(InfoSlot, check); i++) {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+    //============================================================================
+
+    bool SipiInfoIndex::lookup(const std::string &filepath, int pagenum, const struct stat &fileinfo,
+                               SipiImgInfo &info) {
+        uint64_t key = info_key(filepath, pagenum);
+        uint64_t verify = info_verify(filepath, pagenum);
+        int64_t mtime_sec, mtime_nsec;
+        file_mtime(fileinfo, mtime_sec, mtime_nsec);
+
+        std::shared_lock<std::shared_mutex> lock(locking);
+        for (size_t i = 0; i < max_probes; i++) {
+            const InfoSlot &slot = slots[(key + i) % nslots];
+            if (slot.key == 0) return false;
+            if ((slot.key != key) || (slot.verify != verify)) continue;
+            if ((slot.check != checksum(slot)) || (slot.mtime_sec != mtime_sec) || (slot.mtime_nsec != mtime_nsec) ||
+                (slot.fsize != (int64_t) fileinfo.st_size)) {
+                return false; // file has changed (or the slot is corrupt)
+            }
+            info.success = SipiImgInfo::DIMS;
+            info.width = slot.width;
+            info.height = slot.height;
+            info.tile_width = slot.tile_width;
+            info.tile_height = slot.tile_height;
+            info.clevels = slot.clevels;
+            info.numpages = slot.numpages;
+            info.internalmimetype = std::string(slot.mimetype, strnlen(slot.mimetype, sizeof(slot.mimetype)));
+            return true;
+        }
+        return false;
+    }
+    //============================================================================
+
+    void SipiInfoIndex::insert(const std::string &filepath, int pagenum, const struct stat &fileinfo,
+                               const SipiImgInfo &info) {
+        InfoSlot slot;
+        memset(&slot, 0, sizeof(slot));
+        slot.key = info_key(filepath, pagenum);
+        slot.verify = info_verify(filepath, pagenum);
+        file_mtime(fileinfo, slot.mtime_sec, slot.mtime_nsec);
+        slot.fsize = fileinfo.st_size;
+        slot.width = info.width;
+        slot.height = info.height;
+        slot.tile_width = info.tile_width;
+        slot.tile_height = info.tile_height;
+        slot.clevels = info.clevels;
+        slot.numpages = info.numpages;
+        (void) strncpy(slot.mimetype, info.internalmimetype.c_str(), sizeof(slot.mimetype) - 1);
+        slot.check = checksum(slot);
+
+        std::unique_lock<std::shared_mutex> lock(locking);
+        size_t target = slot.key % nslots; // if no free slot is found, the first one is overwritten
+        for (size_t i = 0; i < max_probes; i++) {
+            size_t index = (slot.key + i) % nslots;
+            if ((slots[index].key == 0) || ((slots[index].key == slot.key) && (slots[index].verify == slot.verify))) {
+                target = index;
+                break;
+            }
+        }
+        slots[target] = slot;
+    }
+    //============================================================================
+
+    SipiImgInfo SipiInfoIndex::getDim(const std::string &filepath, int pagenum) {
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            throw SipiImageError(__file__, __LINE__, "Could not read file " + filepath);
+        }
+        return getDim(source, pagenum);
+    }
+    //============================================================================
+
+    SipiImgInfo SipiInfoIndex::getDim(const SipiSource &source, int pagenum) {
+        const std::string &filepath = source.path();
+        const struct stat &fileinfo = source.fileinfo();
+
+        SipiImgInfo info;
+        if (lookup(filepath, pagenum, fileinfo, info)) return info;
+
+        SipiImage img;
+        info = img.getDim(source, pagenum);
+        if (info.success != SipiImgInfo::FAILURE) {
+            insert(filepath, pagenum, fileinfo, info);
+        }
+        return info;
+    }
+    //============================================================================
+
+    void SipiInfoIndex::add(const std::string &filepath) {
+        try {
+            (void) getDim(filepath, 0);
+        } catch (const SipiImageError &err) {
+            syslog(LOG_WARNING, "Couldn't add \"%s\" to the image info index: %s", filepath.c_str(), err.to_string().c_str());
+        } catch (const SipiError &err) {
+            syslog(LOG_WARNING, "Couldn't add \"%s\" to the image info index: %s", filepath.c_str(), err.to_string().c_str());
+        }
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_info_index_h
+#define __defined_sipi_info_index_h
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "SipiIO.h"
+
+namespace Sipi {
+
+    /*!
+     * SipiInfoIndex is a persistent index of the dimensions of the image files (width, height, tiling,
+     * resolution levels and number of pages). It is stored in a memory mapped file, thus it survives
+     * restarts and a lookup needs only one stat() of the image file instead of opening and parsing it.
+     *
+     * The entries are keyed by two independent hashes of the path and page number and are only valid as long as the modification
+     * time and size of the file are unchanged. The index has a fixed number of slots; if no free slot
+     * is found, an old entry is overwritten.
+     */
+    class SipiInfoIndex {
+    private:
+        typedef struct {
+            char magic[8];
+            uint64_t nslots;
+            char reserved[48];
+        } IndexHeader;
+
+        typedef struct {
+            uint64_t key;           //!< hash of path and page number, 0 for an empty slot
+            uint64_t verify;        //!< second, independent hash of path and page number
+            int64_t mtime_sec;      //!< modification time of the file
+            int64_t mtime_nsec;
+            int64_t fsize;          //!< size of the file
+            int32_t width;
+            int32_t height;
+            int32_t tile_width;
+            int32_t tile_height;
+            int32_t clevels;
+            int32_t numpages;
+            char mimetype[32];      //!< internal mime type
+            uint64_t check;         //!< checksum, detects slots torn by a crash
+        } InfoSlot;
+
+        std::string path;
+        int fd;
+        size_t nslots;
+        size_t maplen;
+        IndexHeader *header;
+        InfoSlot *slots;
+        std::shared_mutex locking;
+
+        static uint64_t checksum(const InfoSlot &slot);
+
+    public:
+        /*!
+         * Opens (or creates) the index file
+         *
+         * \param[in] path_p Path of the index file
+         * \param[in] nslots_p Number of entries of a newly created index
+         */
+        SipiInfoIndex(const std::string &path_p, size_t nslots_p = 1 << 20);
+
+        ~SipiInfoIndex();
+
+        /*!
+         * Looks up the dimensions of an image in the index
+         *
+         * \param[in] filepath Path of the image file
+         * \param[in] pagenum Page number
+         * \param[in] fileinfo stat() of the image file, the entry is only valid if mtime and size match
+         * \param[out] info The dimensions, if an entry has been found
+         *
+         * \returns true if a valid entry has been found
+         */
+        bool lookup(const std::string &filepath, int pagenum, const struct stat &fileinfo, SipiImgInfo &info);
+
+        /*!
+         * Adds (or replaces) the dimensions of an image
+         *
+         * \param[in] filepath Path of the image file
+         * \param[in] pagenum Page number
+         * \param[in] fileinfo stat() of the image file
+         * \param[in] info The dimensions
+         */
+        void insert(const std::string &filepath, int pagenum, const struct stat &fileinfo, const SipiImgInfo &info);
+
+        /*!
+         * Get the dimensions of an image. If the index has no valid entry, the file is
+         * read using SipiImage::getDim() and the result is added to the index.
+         *
+         * \param[in] filepath Path of the image file
+         * \param[in] pagenum Page number (for multipage files)
+         *
+         * \returns Info about the image. Only the dimensions and the internal mime type are
+         * kept in the index, thus info.success is at most SipiImgInfo::DIMS.
+         */
+        SipiImgInfo getDim(const std::string &filepath, int pagenum = 0);
+
+        /*!
+         * Same as above, but uses the stat information of an already opened file
+         *
+         * \param[in] source The opened image file
+         * \param[in] pagenum Page number (for multipage files)
+         */
+        SipiImgInfo getDim(const SipiSource &source, int pagenum = 0);
+
+        /*!
+         * Adds an image to the index (e.g. after it has been ingested)
+         *
+         * \param[in] filepath Path of the image file
+         */
+        void add(const std::string &filepath);
+    };
+
+}
+
+#endif
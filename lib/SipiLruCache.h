@@ -0,0 +1,205 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_lrucache_h
+#define __defined_sipi_lrucache_h
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Sipi {
+
+    /*!
+     * Statistics of a SipiLruCache
+     */
+    typedef struct {
+        size_t nentries;        //!< number of entries in the cache
+        size_t nbytes;          //!< number of bytes used by the entries
+        size_t max_nbytes;      //!< byte budget of the cache
+        unsigned long long hits;      //!< number of lookups which found an entry
+        unsigned long long misses;    //!< number of lookups which found no (valid) entry
+        unsigned long long evictions; //!< number of entries evicted due to the byte budget
+    } SipiLruStats;
+
+    /*!
+     * SipiLruCache is a thread safe map from strings to values with a byte budget. The size of each
+     * value is given when it is added; if the budget is exhausted, the least recently used entries
+     * are evicted. Values larger than the maximal entry size are not added at all, since they would
+     * flush most of the cache.
+     *
+     * It is the common base of the in-memory caches (SipiMemCache, SipiDecodedCache and SipiRasterCache).
+     * The values are usually shared pointers, thus an entry stays valid for the users which got it
+     * even after it has been evicted.
+     *
+     * \tparam Value Type of the cached values, must be copyable and comparable with ==
+     */
+    template<typename Value>
+    class SipiLruCache {
+    private:
+        typedef struct {
+            std::string key;
+            Value value;
+            size_t nbytes;
+        } Record;
+
+        typedef typename std::list<Record>::iterator RecordIterator;
+
+        std::mutex locking;
+        std::list<Record> lru; //!< most recently used entries at the front
+        std::unordered_map<std::string, RecordIterator> table;
+        size_t max_nbytes;
+        size_t max_entrysize;
+        size_t nbytes;
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long evictions;
+
+        /*!
+         * Removes an entry, the lock must be held
+         */
+        void erase(typename std::unordered_map<std::string, RecordIterator>::iterator it) {
+            nbytes -= it->second->nbytes;
+            lru.erase(it->second);
+            table.erase(it);
+        }
+
+        /*!
+         * Evicts the least recently used entries until needed bytes are available, the lock must be held
+         */
+        void evict(size_t needed) {
+            while (!lru.empty() && (nbytes + needed > max_nbytes)) {
+                Record &rec = lru.back();
+                nbytes -= rec.nbytes;
+                table.erase(rec.key);
+                lru.pop_back();
+                evictions++;
+            }
+        }
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nbytes_p Byte budget of the cache
+         * \param[in] max_entrysize_p Size of the largest value which is added
+         */
+        SipiLruCache(size_t max_nbytes_p, size_t max_entrysize_p)
+                : max_nbytes(max_nbytes_p), max_entrysize(max_entrysize_p), nbytes(0), hits(0), misses(0),
+                  evictions(0) {}
+
+        SipiLruCache(const SipiLruCache &) = delete;
+
+        SipiLruCache &operator=(const SipiLruCache &) = delete;
+
+        /*!
+         * Returns the size of the largest value which is added to the cache
+         */
+        inline size_t maxEntrySize(void) const { return max_entrysize; }
+
+        /*!
+         * Get a value. The entry becomes the most recently used one.
+         *
+         * \param[in] key_p The key
+         * \param[out] value_p The value, if found
+         *
+         * \returns true, if the key has been found
+         */
+        bool get(const std::string &key_p, Value &value_p) {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            auto it = table.find(key_p);
+            if (it == table.end()) {
+                misses++;
+                return false;
+            }
+            lru.splice(lru.begin(), lru, it->second); // move to front
+            hits++;
+            value_p = it->second->value;
+            return true;
+        }
+
+        /*!
+         * Add a value, an existing entry with the same key is replaced.
+         *
+         * \param[in] key_p The key
+         * \param[in] value_p The value
+         * \param[in] nbytes_p Size of the value in bytes
+         *
+         * \returns true, if the value has been added (false, if it is empty or too large)
+         */
+        bool add(const std::string &key_p, const Value &value_p, size_t nbytes_p) {
+            if ((nbytes_p == 0) || (nbytes_p > max_entrysize)) return false;
+
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            auto it = table.find(key_p);
+            if (it != table.end()) erase(it); // replace existing entry
+            evict(nbytes_p);
+            lru.push_front({key_p, value_p, nbytes_p});
+            table[key_p] = lru.begin();
+            nbytes += nbytes_p;
+            return true;
+        }
+
+        /*!
+         * Remove an entry
+         *
+         * \param[in] key_p The key
+         *
+         * \returns true, if an entry has been removed
+         */
+        bool remove(const std::string &key_p) {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            auto it = table.find(key_p);
+            if (it == table.end()) return false;
+            erase(it);
+            return true;
+        }
+
+        /*!
+         * Remove an entry which get() has returned, but which the caller found to be outdated. The
+         * entry is only removed if it still holds the same value, and the lookup is counted as a
+         * miss instead of a hit.
+         *
+         * \param[in] key_p The key
+         * \param[in] value_p The value returned by get()
+         */
+        void invalidate(const std::string &key_p, const Value &value_p) {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            if (hits > 0) hits--;
+            misses++;
+            auto it = table.find(key_p);
+            if ((it != table.end()) && (it->second->value == value_p)) erase(it);
+        }
+
+        /*!
+         * Get the statistics of the cache
+         */
+        SipiLruStats stats(void) {
+            std::lock_guard<std::mutex> locking_mutex_guard(locking);
+            return {table.size(), nbytes, max_nbytes, hits, misses, evictions};
+        }
+    };
+
+}
+
+#endif
@@ -254,6 +254,8 @@ namespace Sipi {
         if (top == 1) {
             canonical = std::string(lua_tostring(L, 1));
             lua_pop(L, 1);
+            std::shared_ptr<SipiMemCache> memcache = server->memcache();
+            if (memcache != nullptr) memcache->remove(canonical);
             lua_pushboolean(L, cache->remove(canonical));
         } else {
             lua_pop(L, top);
@@ -275,13 +277,371 @@ namespace Sipi {
             return 1;
         }
 
-        int n = cache->purge(true);
+        int n = cache->purge();
         lua_pushinteger(L, n);
 
         return 1;
     }
     //=========================================================================
 
+    /*!
+     * Get the hit ratios and counters of the file cache
+     * LUA: stats = cache.stats()
+     *      stats.hits, stats.misses, stats.hit_ratio, stats.byte_hit_ratio,
+     *      stats.rejected, stats.evictions, stats.policy, stats.admission
+     */
+    static int lua_cache_stats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiCache> cache = server->cache();
+
+        if (cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiCache::Stats stats = cache->getStats();
+        unsigned long long requests = stats.hits + stats.misses;
+        unsigned long long bytes = stats.hit_bytes + stats.miss_bytes;
+
+        lua_createtable(L, 0, 8); // table
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hit_ratio"); // table - "index_L1"
+        lua_pushnumber(L, (requests > 0) ? (double) stats.hits / (double) requests : 0.);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "byte_hit_ratio"); // table - "index_L1"
+        lua_pushnumber(L, (bytes > 0) ? (double) stats.hit_bytes / (double) bytes : 0.);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "rejected"); // table - "index_L1"
+        lua_pushinteger(L, stats.rejected);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "evictions"); // table - "index_L1"
+        lua_pushinteger(L, stats.evictions);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "policy"); // table - "index_L1"
+        lua_pushstring(L, (cache->getEvictionPolicy() == SipiCache::EVICT_GDSF) ? "gdsf" : "lru");
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "admission"); // table - "index_L1"
+        lua_pushstring(L, (cache->getAdmissionPolicy() == SipiCache::ADMIT_TINYLFU) ? "tinylfu" : "all");
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the in-memory cache
+     * LUA: stats = cache.memstats()
+     *      stats.nentries, stats.nbytes, stats.max_nbytes, stats.hits, stats.misses, stats.evictions
+     */
+    static int lua_cache_memstats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiMemCache> memcache = server->memcache();
+
+        if (memcache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiMemCache::Stats stats = memcache->stats();
+
+        lua_createtable(L, 0, 6); // table
+        lua_pushstring(L, "nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "evictions"); // table - "index_L1"
+        lua_pushinteger(L, stats.evictions);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the decoded image cache
+     * LUA: stats = cache.decodedstats()
+     *      stats.nentries, stats.nbytes, stats.max_nbytes, stats.hits, stats.misses, stats.evictions
+     */
+    static int lua_cache_decodedstats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiDecodedCache> decoded_cache = server->decoded_cache();
+
+        if (decoded_cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiDecodedCache::Stats stats = decoded_cache->stats();
+
+        lua_createtable(L, 0, 6); // table
+        lua_pushstring(L, "nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "evictions"); // table - "index_L1"
+        lua_pushinteger(L, stats.evictions);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the raster cache
+     * LUA: stats = cache.rasterstats()
+     *      stats.nentries, stats.nbytes, stats.max_nbytes, stats.hits, stats.misses, stats.evictions
+     */
+    static int lua_cache_rasterstats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiRasterCache> raster_cache = server->raster_cache();
+
+        if (raster_cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiRasterCache::Stats stats = raster_cache->stats();
+
+        lua_createtable(L, 0, 6); // table
+        lua_pushstring(L, "nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "evictions"); // table - "index_L1"
+        lua_pushinteger(L, stats.evictions);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the JPEG2000 derivative store
+     * LUA: stats = cache.derivativestats()
+     *      stats.nfiles, stats.nbytes, stats.max_nbytes, stats.queued, stats.hits, stats.transcoded,
+     *      stats.failed, stats.evictions
+     */
+    static int lua_cache_derivativestats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiDerivativeStore> derivatives = server->derivatives();
+
+        if (derivatives == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiDerivativeStore::Stats stats = derivatives->stats();
+
+        lua_createtable(L, 0, 8); // table
+        lua_pushstring(L, "nfiles"); // table - "index_L1"
+        lua_pushinteger(L, stats.nfiles);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nbytes"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nbytes);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "queued"); // table - "index_L1"
+        lua_pushinteger(L, stats.queued);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "transcoded"); // table - "index_L1"
+        lua_pushinteger(L, stats.transcoded);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "failed"); // table - "index_L1"
+        lua_pushinteger(L, stats.failed);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "evictions"); // table - "index_L1"
+        lua_pushinteger(L, stats.evictions);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the info.json cache
+     * LUA: stats = cache.infostats()
+     *      stats.nentries, stats.max_nentries, stats.hits, stats.misses
+     */
+    static int lua_cache_infostats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiInfoCache> info_cache = server->info_cache();
+
+        if (info_cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiInfoCache::Stats stats = info_cache->stats();
+
+        lua_createtable(L, 0, 4); // table
+        lua_pushstring(L, "nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Get the statistics of the cache of pre_flight results
+     * LUA: stats = cache.preflightstats()
+     *      stats.nentries, stats.max_nentries, stats.ttl, stats.hits, stats.misses, stats.expired
+     */
+    static int lua_cache_preflightstats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiPreflightCache> preflight_cache = server->preflight_cache();
+
+        if (preflight_cache == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiPreflightCache::Stats stats = preflight_cache->stats();
+
+        lua_createtable(L, 0, 6); // table
+        lua_pushstring(L, "nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_nentries"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_nentries);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "ttl"); // table - "index_L1"
+        lua_pushinteger(L, stats.ttl);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "hits"); // table - "index_L1"
+        lua_pushinteger(L, stats.hits);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "misses"); // table - "index_L1"
+        lua_pushinteger(L, stats.misses);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "expired"); // table - "index_L1"
+        lua_pushinteger(L, stats.expired);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    /*!
+     * Remove all cached pre_flight results (e.g. after permissions have been changed)
+     * LUA: cache.preflightclear()
+     */
+    static int lua_cache_preflightclear(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiPreflightCache> preflight_cache = server->preflight_cache();
+
+        if (preflight_cache != nullptr) {
+            preflight_cache->clear();
+        }
+        return 0;
+    }
+    //=========================================================================
+
     static const luaL_Reg cache_methods[] = {{"size",       lua_cache_size},
                                              {"max_size",   lua_cache_max_size},
                                              {"nfiles",     lua_cache_nfiles},
@@ -290,9 +650,73 @@ namespace Sipi {
                                              {"filelist",   lua_cache_filelist},
                                              {"delete",     lua_delete_cache_file},
                                              {"purge",      lua_purge_cache},
+                                             {"stats",      lua_cache_stats},
+                                             {"memstats",   lua_cache_memstats},
+                                             {"decodedstats", lua_cache_decodedstats},
+                                             {"rasterstats", lua_cache_rasterstats},
+                                             {"derivativestats", lua_cache_derivativestats},
+                                             {"infostats",  lua_cache_infostats},
+                                             {"preflightstats", lua_cache_preflightstats},
+                                             {"preflightclear", lua_cache_preflightclear},
                                              {0,            0}};
     //=========================================================================
 
+    /*!
+     * Get the statistics of the shared compute pool
+     * LUA: stats = compute.stats()
+     *      stats.nthreads, stats.busy, stats.reserved, stats.queue_depth,
+     *      stats.max_queue_depth, stats.tasks, stats.utilisation
+     */
+    static int lua_compute_stats(lua_State *L) {
+        lua_getglobal(L, sipiserver);
+        SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+        lua_remove(L, -1); // remove from stack
+        std::shared_ptr<SipiComputePool> pool = server->compute_pool();
+
+        if (pool == nullptr) {
+            lua_pushnil(L);
+            return 1;
+        }
+
+        SipiComputePool::Stats stats = pool->stats();
+
+        lua_createtable(L, 0, 7); // table
+        lua_pushstring(L, "nthreads"); // table - "index_L1"
+        lua_pushinteger(L, stats.nthreads);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "busy"); // table - "index_L1"
+        lua_pushinteger(L, stats.busy);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "reserved"); // table - "index_L1"
+        lua_pushinteger(L, stats.reserved);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "queue_depth"); // table - "index_L1"
+        lua_pushinteger(L, stats.queue_depth);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "max_queue_depth"); // table - "index_L1"
+        lua_pushinteger(L, stats.max_queue_depth);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "tasks"); // table - "index_L1"
+        lua_pushinteger(L, stats.tasks);
+        lua_rawset(L, -3); // table
+
+        lua_pushstring(L, "utilisation"); // table - "index_L1"
+        lua_pushnumber(L, stats.utilisation);
+        lua_rawset(L, -3); // table
+
+        return 1;
+    }
+    //=========================================================================
+
+    static const luaL_Reg compute_methods[] = {{"stats", lua_compute_stats},
+                                               {0,       0}};
+    //=========================================================================
+
     static int lua_filenamehash_helper(lua_State *L) {
         int top = lua_gettop(L);
 
@@ -997,6 +1421,16 @@ namespace Sipi {
                 lua_pushstring(L, err.to_string().c_str());
                 return 2;
             }
+
+            //
+            // the dimensions of a newly ingested file are added to the image info index
+            //
+            lua_getglobal(L, sipiserver);
+            SipiHttpServer *server = (SipiHttpServer *) lua_touserdata(L, -1);
+            lua_remove(L, -1); // remove from stack
+            if ((server != nullptr) && (server->info_index() != nullptr)) {
+                server->info_index()->add(imgpath);
+            }
         }
 
         lua_pop(L, lua_gettop(L));
@@ -1111,6 +1545,10 @@ namespace Sipi {
         luaL_setfuncs(L, cache_methods, 0);
         lua_setglobal(L, "cache");
 
+        lua_newtable(L); // table
+        luaL_setfuncs(L, compute_methods, 0);
+        lua_setglobal(L, "compute");
+
         lua_newtable(L); // table
         luaL_setfuncs(L, helper_methods, 0);
         lua_setglobal(L, "helper");
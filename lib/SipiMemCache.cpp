@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <syslog.h>
+
+#include "SipiMemCache.h"
+
+namespace Sipi {
+
+    SipiMemCache::SipiMemCache(size_t max_nbytes_p, int revalidate_p)
+            : entries(max_nbytes_p, max_nbytes_p / 8), revalidate(revalidate_p) {}
+    //============================================================================
+
+    std::shared_ptr<const std::string> SipiMemCache::get(const std::string &canonical_p, time_t *orig_mtime_p) {
+        std::shared_ptr<MemRecord> rec;
+        if (!entries.get(canonical_p, rec)) return nullptr;
+
+        //
+        // once the revalidation interval has elapsed, the original is checked again (outside the lock)
+        //
+        time_t now = time(nullptr);
+        if (now - rec->checked.load() >= revalidate) {
+            struct stat fileinfo;
+            if ((stat(rec->origpath.c_str(), &fileinfo) != 0) || (fileinfo.st_mtime != rec->orig_mtime)) {
+                entries.invalidate(canonical_p, rec);
+                return nullptr;
+            }
+            rec->checked = now;
+        }
+        if (orig_mtime_p != nullptr) *orig_mtime_p = rec->orig_mtime;
+        return rec->data;
+    }
+    //============================================================================
+
+    bool SipiMemCache::add(const std::string &origpath_p, const std::string &canonical_p,
+                           const std::string &cachepath_p, const struct stat *originfo_p) {
+        struct stat fileinfo;
+        if ((stat(cachepath_p.c_str(), &fileinfo) != 0) || ((size_t) fileinfo.st_size > entries.maxEntrySize())) {
+            return false;
+        }
+        struct stat originfo;
+        if (originfo_p != nullptr) {
+            originfo = *originfo_p;
+        } else if (stat(origpath_p.c_str(), &originfo) != 0) {
+            return false;
+        }
+
+        std::ifstream inf(cachepath_p, std::ios::in | std::ios::binary);
+        if (!inf) {
+            syslog(LOG_WARNING, "Couldn't read cache file \"%s\" into memory", cachepath_p.c_str());
+            return false;
+        }
+        std::ostringstream ss;
+        ss << inf.rdbuf();
+        auto data = std::make_shared<const std::string>(ss.str());
+        size_t nbytes = data->size();
+        return entries.add(canonical_p, std::make_shared<MemRecord>(origpath_p, std::move(data), originfo.st_mtime), nbytes);
+    }
+    //============================================================================
+
+}
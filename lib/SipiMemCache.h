@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_memcache_h
+#define __defined_sipi_memcache_h
+
+#include <atomic>
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <sys/stat.h>
+
+#include "SipiLruCache.h"
+
+namespace Sipi {
+
+    /*!
+     * SipiMemCache is an in-memory tier in front of the disk based SipiCache. It holds the
+     * encoded bytes of the most frequently requested renditions (identified by the canonical
+     * IIIF URL), so that they can be sent without reading the cache file. A file is promoted
+     * into memory when it is found in the disk cache, thus only renditions which have been requested
+     * at least twice occupy memory. If the byte budget is exhausted, the least recently used
+     * entries are evicted.
+     *
+     * The modification time of the original is only checked again after the revalidation
+     * interval has elapsed, in between entries are served without any system call.
+     */
+    class SipiMemCache {
+    public:
+        /*!
+         * Statistics of the memory cache (hits are requests served from memory)
+         */
+        typedef SipiLruStats Stats;
+
+    private:
+        struct MemRecord {
+            std::string origpath;
+            std::shared_ptr<const std::string> data;
+            time_t orig_mtime;            //!< modification time of the original when the entry was created
+            std::atomic<time_t> checked;  //!< last time the original has been checked
+
+            MemRecord(const std::string &origpath_p, std::shared_ptr<const std::string> data_p, time_t orig_mtime_p)
+                    : origpath(origpath_p), data(std::move(data_p)), orig_mtime(orig_mtime_p), checked(time(nullptr)) {}
+        };
+
+        SipiLruCache<std::shared_ptr<MemRecord>> entries; //!< canonical URL -> entry
+        int revalidate;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nbytes_p Byte budget of the cache
+         * \param[in] revalidate_p Number of seconds after which the modification time of the original
+         * is checked again
+         */
+        SipiMemCache(size_t max_nbytes_p, int revalidate_p = 10);
+
+        /*!
+         * Get the cached file for a canonical URL
+         *
+         * \param[in] canonical_p Canonical IIIF URL
+         * \param[out] orig_mtime_p If not nullptr, the modification time of the original is returned
+         *
+         * \returns The content of the cached file or nullptr if not in the cache or outdated.
+         */
+        std::shared_ptr<const std::string> get(const std::string &canonical_p, time_t *orig_mtime_p = nullptr);
+
+        /*!
+         * Load a file (usually from the disk cache) into the memory cache. Files larger than
+         * an eighth of the byte budget are ignored.
+         *
+         * \param[in] origpath_p Path to the original master file
+         * \param[in] canonical_p Canonical IIIF URL
+         * \param[in] cachepath_p Path of the file to be loaded
+         * \param[in] originfo_p Stat information of the master file if the caller already has it (avoids a stat)
+         *
+         * \returns true, if the file has been added
+         */
+        bool add(const std::string &origpath_p, const std::string &canonical_p, const std::string &cachepath_p,
+                 const struct stat *originfo_p = nullptr);
+
+        /*!
+         * Remove an entry from the memory cache
+         *
+         * \param[in] canonical_p Canonical IIIF URL
+         */
+        inline void remove(const std::string &canonical_p) { (void) entries.remove(canonical_p); }
+
+        /*!
+         * Get the statistics of the memory cache
+         */
+        inline Stats stats(void) { return entries.stats(); }
+    };
+
+}
+
+#endif
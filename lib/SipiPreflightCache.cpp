@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SipiPreflightCache.h"
+
+namespace Sipi {
+
+    SipiPreflightCache::SipiPreflightCache(size_t max_nentries_p, int ttl_p,
+                                           const std::vector<std::string> &key_headers_p)
+            : max_nentries(max_nentries_p), ttl(ttl_p), key_headers(key_headers_p), hits(0), misses(0),
+              expired(0) {}
+    //============================================================================
+
+    std::string SipiPreflightCache::key(const std::string &prefix, const std::string &identifier,
+                                        const std::vector<std::string> &header_values) {
+        //
+        // the parts are separated by '\0', which cannot occur in URLs or header values
+        //
+        std::string k = prefix;
+        k.push_back('\0');
+        k += identifier;
+        for (auto &value: header_values) {
+            k.push_back('\0');
+            k += value;
+        }
+        return k;
+    }
+    //============================================================================
+
+    bool SipiPreflightCache::get(const std::string &key_p, PreflightInfo &info_p) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(key_p);
+        if (it == table.end()) {
+            misses++;
+            return false;
+        }
+        if (std::chrono::steady_clock::now() >= it->second->expires) {
+            lru.erase(it->second);
+            table.erase(it);
+            expired++;
+            misses++;
+            return false;
+        }
+        lru.splice(lru.begin(), lru, it->second); // move to front
+        info_p = it->second->info;
+        hits++;
+        return true;
+    }
+    //============================================================================
+
+    void SipiPreflightCache::add(const std::string &key_p, const PreflightInfo &info_p) {
+        if (max_nentries == 0) return;
+        auto expires = std::chrono::steady_clock::now() + std::chrono::seconds(ttl);
+
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = table.find(key_p);
+        if (it != table.end()) { // replace existing entry
+            lru.erase(it->second);
+            table.erase(it);
+        }
+        while (!lru.empty() && (lru.size() >= max_nentries)) {
+            table.erase(lru.back().key);
+            lru.pop_back();
+        }
+        lru.push_front({key_p, info_p, expires});
+        table[key_p] = lru.begin();
+    }
+    //============================================================================
+
+    void SipiPreflightCache::clear(void) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        table.clear();
+        lru.clear();
+    }
+    //============================================================================
+
+    SipiPreflightCache::Stats SipiPreflightCache::stats(void) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return {table.size(), max_nentries, ttl, hits, misses, expired};
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_preflightcache_h
+#define __defined_sipi_preflightcache_h
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Sipi {
+
+    /*!
+     * SipiPreflightCache keeps the results of the Lua pre_flight function for a limited time. A viewer
+     * requests hundreds of tiles of the same image with the same cookies, and the pre_flight function
+     * often has to ask an external service for the permissions. The key is built from the prefix, the
+     * identifier and the values of a configurable set of request headers (by default the cookie, which is
+     * passed to the pre_flight function). Entries expire after the time to live; if the cache is full, the
+     * least recently used entries are evicted.
+     */
+    class SipiPreflightCache {
+    public:
+        typedef std::unordered_map<std::string, std::string> PreflightInfo;
+
+        /*!
+         * Statistics of the pre_flight cache
+         */
+        typedef struct {
+            size_t nentries;        //!< number of entries in the cache
+            size_t max_nentries;    //!< maximal number of entries
+            int ttl;                //!< time to live of an entry in seconds
+            unsigned long long hits;      //!< number of pre_flight calls answered from the cache
+            unsigned long long misses;    //!< number of pre_flight calls not found in the cache
+            unsigned long long expired;   //!< number of entries dropped because their time to live had elapsed
+        } Stats;
+
+    private:
+        typedef struct {
+            std::string key;
+            PreflightInfo info;
+            std::chrono::steady_clock::time_point expires;
+        } PreflightRecord;
+
+        std::mutex locking;
+        std::list<PreflightRecord> lru; //!< most recently used entries at the front
+        std::unordered_map<std::string, std::list<PreflightRecord>::iterator> table;
+        size_t max_nentries;
+        int ttl;
+        std::vector<std::string> key_headers;
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long expired;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nentries_p Maximal number of cached results
+         * \param[in] ttl_p Time to live of an entry in seconds
+         * \param[in] key_headers_p Names of the request headers (lower case) which are part of the key
+         */
+        SipiPreflightCache(size_t max_nentries_p, int ttl_p, const std::vector<std::string> &key_headers_p);
+
+        /*!
+         * Names of the request headers which are part of the key
+         */
+        inline const std::vector<std::string> &headers(void) const { return key_headers; }
+
+        /*!
+         * Builds the cache key
+         *
+         * \param[in] prefix IIIF prefix
+         * \param[in] identifier IIIF identifier
+         * \param[in] header_values Values of the request headers given by headers() (in the same order)
+         */
+        static std::string key(const std::string &prefix, const std::string &identifier,
+                               const std::vector<std::string> &header_values);
+
+        /*!
+         * Get a cached pre_flight result
+         *
+         * \param[in] key_p The cache key
+         * \param[out] info_p The cached result
+         *
+         * \returns true, if a valid entry has been found
+         */
+        bool get(const std::string &key_p, PreflightInfo &info_p);
+
+        /*!
+         * Add a pre_flight result to the cache
+         *
+         * \param[in] key_p The cache key
+         * \param[in] info_p The result of the pre_flight function
+         */
+        void add(const std::string &key_p, const PreflightInfo &info_p);
+
+        /*!
+         * Remove all entries (e.g. after the permissions have been changed)
+         */
+        void clear(void);
+
+        /*!
+         * Get the statistics of the pre_flight cache
+         */
+        Stats stats(void);
+    };
+
+}
+
+#endif
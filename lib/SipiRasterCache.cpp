@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SipiRasterCache.h"
+#include "SipiImage.h"
+
+namespace Sipi {
+
+    SipiRasterCache::SipiRasterCache(size_t max_nbytes_p) : rasters(max_nbytes_p, max_nbytes_p / 8) {}
+    //============================================================================
+
+    std::string SipiRasterCache::key(const std::string &path, time_t mtime, off_t fsize, int pagenum,
+                                     const std::string &canonical_region, const std::string &canonical_size,
+                                     bool force_bps_8) {
+        return path + "|" + std::to_string(mtime) + "|" + std::to_string(fsize) + "|" + std::to_string(pagenum) +
+               "|" + canonical_region + "|" + canonical_size + (force_bps_8 ? "|8" : "|0");
+    }
+    //============================================================================
+
+    std::string SipiRasterCache::canonical_key(const std::string &path, time_t mtime, off_t fsize, int pagenum,
+                                               const std::string &canonical, bool force_bps_8) {
+        size_t qualform_pos = canonical.rfind('/');
+        if ((qualform_pos == std::string::npos) || (qualform_pos == 0)) return "";
+        size_t rot_pos = canonical.rfind('/', qualform_pos - 1);
+        if ((rot_pos == std::string::npos) || (rot_pos == 0)) return "";
+        size_t size_pos = canonical.rfind('/', rot_pos - 1);
+        if ((size_pos == std::string::npos) || (size_pos == 0)) return "";
+        size_t region_pos = canonical.rfind('/', size_pos - 1);
+        if (region_pos == std::string::npos) return "";
+        return key(path, mtime, fsize, pagenum, canonical.substr(region_pos + 1, size_pos - region_pos - 1),
+                   canonical.substr(size_pos + 1, rot_pos - size_pos - 1), force_bps_8);
+    }
+    //============================================================================
+
+    std::shared_ptr<const SipiImage> SipiRasterCache::get(const std::string &key_p) {
+        std::shared_ptr<const SipiImage> img;
+        return rasters.get(key_p, img) ? img : nullptr;
+    }
+    //============================================================================
+
+    bool SipiRasterCache::add(const std::string &key_p, std::shared_ptr<const SipiImage> img_p) {
+        if (img_p == nullptr) return false;
+        return rasters.add(key_p, img_p, img_p->getNbytes());
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_rastercache_h
+#define __defined_sipi_rastercache_h
+
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+#include "SipiLruCache.h"
+
+namespace Sipi {
+
+    class SipiImage;
+
+    /*!
+     * SipiRasterCache keeps the pixels of renditions after reading, cropping and scaling, but before
+     * rotation, color conversion, watermarking and encoding. The disk cache (SipiCache) and SipiMemCache
+     * store the encoded result per canonical URL, thus requests which differ only in the rotation, the
+     * quality or the format (e.g. a thumbnail fetched as JPEG and as PNG) decode and scale the image again.
+     * With this cache, such requests only run the remaining steps on a copy of the cached raster.
+     *
+     * The key consists of the file (path, modification time and size), the page, the canonical region and size,
+     * and whether the raster has been reduced to 8 bits/sample. Entries of modified files are never hit again
+     * and drop out of the cache by LRU eviction.
+     */
+    class SipiRasterCache {
+    public:
+        /*!
+         * Statistics of the raster cache (hits are renditions made from a cached raster)
+         */
+        typedef SipiLruStats Stats;
+
+    private:
+        SipiLruCache<std::shared_ptr<const SipiImage>> rasters;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param[in] max_nbytes_p Byte budget for the pixel buffers of the cached rasters
+         */
+        SipiRasterCache(size_t max_nbytes_p);
+
+        /*!
+         * Builds the key of a raster
+         *
+         * \param[in] path Path of the image file
+         * \param[in] mtime Modification time of the image file
+         * \param[in] fsize Size of the image file
+         * \param[in] pagenum Page number (0 if the file has no pages)
+         * \param[in] canonical_region Canonical form of the region
+         * \param[in] canonical_size Canonical form of the size
+         * \param[in] force_bps_8 true, if the raster has been reduced to 8 bits/sample
+         */
+        static std::string key(const std::string &path, time_t mtime, off_t fsize, int pagenum,
+                               const std::string &canonical_region, const std::string &canonical_size,
+                               bool force_bps_8);
+
+        /*!
+         * Builds the key of a raster from the canonical URL of a rendition. The URL ends with
+         * region/size/rotation/quality.format, only region and size determine the raster.
+         *
+         * \param[in] path Path of the image file
+         * \param[in] mtime Modification time of the image file
+         * \param[in] fsize Size of the image file
+         * \param[in] pagenum Page number (0 if the file has no pages)
+         * \param[in] canonical Canonical URL of the rendition
+         * \param[in] force_bps_8 true, if the raster has been reduced to 8 bits/sample
+         *
+         * \returns The key, or an empty string if the URL has not enough parts
+         */
+        static std::string canonical_key(const std::string &path, time_t mtime, off_t fsize, int pagenum,
+                                         const std::string &canonical, bool force_bps_8);
+
+        /*!
+         * Returns the size of the largest raster which is added to the cache (an eighth of the budget)
+         */
+        inline size_t maxRasterSize(void) const { return rasters.maxEntrySize(); }
+
+        /*!
+         * Get a raster
+         *
+         * \param[in] key_p Key built by SipiRasterCache::key()
+         *
+         * \returns The raster or nullptr, if not in the cache
+         */
+        std::shared_ptr<const SipiImage> get(const std::string &key_p);
+
+        /*!
+         * Add a raster to the cache. Rasters larger than SipiRasterCache::maxRasterSize() are ignored.
+         *
+         * \param[in] key_p Key built by SipiRasterCache::key()
+         * \param[in] img_p The raster, which must not be modified afterwards
+         *
+         * \returns true, if the raster has been added
+         */
+        bool add(const std::string &key_p, std::shared_ptr<const SipiImage> img_p);
+
+        /*!
+         * Get the statistics of the raster cache
+         */
+        inline Stats stats(void) { return rasters.stats(); }
+    };
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "SipiComputePool.h"
+#include "SipiResampler.h"
+#include "SipiSimd.h"
+
+namespace Sipi {
+
+    static const int precision_bits = 14; //!< fractional bits of the fixed-point weights
+    static const int scratch_bits = 6;    //!< additional fractional bits of the vertically resampled row
+
+    static double sinc(double x) {
+        if (x == 0.0) return 1.0;
+        x *= M_PI;
+        return std::sin(x) / x;
+    }
+    //============================================================================
+
+    static double lanczos3_filter(double x) {
+        if ((x > -3.0) && (x < 3.0)) return sinc(x) * sinc(x / 3.0);
+        return 0.0;
+    }
+    //============================================================================
+
+    void SipiResampler::contributions(size_t in_size, size_t out_size, Contributions &contrib) {
+        const double kernel_support = 3.0;
+
+        //
+        // when downscaling, the kernel is stretched by the scaling factor, so that it covers all source pixels
+        //
+        double scale = (double) in_size / (double) out_size;
+        double filter_scale = std::max(scale, 1.0);
+        double support = kernel_support * filter_scale;
+
+        contrib.maxtaps = 2 * (size_t) std::ceil(support) + 1;
+        contrib.start.resize(out_size);
+        contrib.ntaps.resize(out_size);
+        contrib.weights.assign(out_size * contrib.maxtaps, 0);
+        std::vector<double> w(contrib.maxtaps);
+
+        for (size_t i = 0; i < out_size; i++) {
+            double center = ((double) i + 0.5) * scale;
+            long xmin = std::max((long) (center - support + 0.5), 0L);
+            long xmax = std::min((long) (center + support + 0.5), (long) in_size);
+            size_t n = std::min((size_t) (xmax - xmin), contrib.maxtaps);
+            double total = 0.0;
+            for (size_t k = 0; k < n; k++) {
+                w[k] = lanczos3_filter(((double) (xmin + (long) k) - center + 0.5) / filter_scale);
+                total += w[k];
+            }
+            if (total == 0.0) { // may only happen at the border: take the nearest pixel
+                n = 1;
+                xmin = std::min((long) center, (long) in_size - 1);
+                w[0] = total = 1.0;
+            }
+
+            //
+            // the fixed-point weights must add up to exactly 1.0, the rounding error goes to the largest weight
+            //
+            int32_t *iw = &contrib.weights[i * contrib.maxtaps];
+            int32_t sum = 0;
+            size_t kmax = 0;
+            for (size_t k = 0; k < n; k++) {
+                iw[k] = (int32_t) std::lround(w[k] / total * (double) (1 << precision_bits));
+                sum += iw[k];
+                if (iw[k] > iw[kmax]) kmax = k;
+            }
+            iw[kmax] += (1 << precision_bits) - sum;
+
+            contrib.start[i] = (size_t) xmin;
+            contrib.ntaps[i] = n;
+        }
+    }
+    //============================================================================
+
+    SipiResampler::SipiResampler(size_t nx_p, size_t ny_p, size_t nnx_p, size_t nny_p, size_t nc_p)
+            : nx(nx_p), ny(ny_p), nnx(nnx_p), nny(nny_p), nc(nc_p) {
+        if (nnx != nx) contributions(nx, nnx, xcontrib);
+        if (nny != ny) contributions(ny, nny, ycontrib);
+    }
+    //============================================================================
+
+    template<typename T>
+    void SipiResampler::run(const T *inbuf, T *outbuf, int32_t maxval) const {
+        //
+        // 8 bit samples fit into 32 bit accumulators, 16 bit samples need 64 bit
+        //
+        typedef typename std::conditional<sizeof(T) == 1, int32_t, int64_t>::type Acc;
+        const size_t insll = nx * nc;
+        const size_t outsll = nnx * nc;
+
+        SipiComputePool::run(0, nny, [&](size_t j0, size_t j1) {
+            std::vector<Acc> accu(insll);
+            // vertically resampled row, with scratch_bits fractional bits (padded by one sample for SipiSimd::convolve)
+            std::vector<int32_t> scratch(insll + 1);
+
+            for (size_t j = j0; j < j1; j++) {
+                //
+                // vertical pass: combine the contributing source rows into the scratch row
+                //
+                if (nny == ny) {
+                    const T *inrow = inbuf + j * insll;
+                    for (size_t s = 0; s < insll; s++) scratch[s] = (int32_t) inrow[s] << scratch_bits;
+                } else {
+                    std::fill(accu.begin(), accu.end(), 0);
+                    const int32_t *w = &ycontrib.weights[j * ycontrib.maxtaps];
+                    for (size_t t = 0; t < ycontrib.ntaps[j]; t++) {
+                        const T *inrow = inbuf + (ycontrib.start[j] + t) * insll;
+                        SipiSimd::accumulate(inrow, w[t], accu.data(), insll);
+                    }
+                    const int shift = precision_bits - scratch_bits;
+                    for (size_t s = 0; s < insll; s++) {
+                        scratch[s] = (int32_t) ((accu[s] + ((Acc) 1 << (shift - 1))) >> shift);
+                    }
+                }
+
+                //
+                // horizontal pass: resample the scratch row into the destination row
+                //
+                T *outrow = outbuf + j * outsll;
+                if (nnx == nx) {
+                    for (size_t s = 0; s < insll; s++) {
+                        int32_t v = (scratch[s] + (1 << (scratch_bits - 1))) >> scratch_bits;
+                        outrow[s] = (T) std::min(std::max(v, 0), maxval);
+                    }
+                } else {
+                    SipiSimd::convolve(scratch.data(), nc, nnx, xcontrib.start.data(), xcontrib.ntaps.data(),
+                                       xcontrib.weights.data(), xcontrib.maxtaps, precision_bits + scratch_bits,
+                                       outrow);
+                }
+            }
+        }, 16);
+    }
+    //============================================================================
+
+    void SipiResampler::resample(const uint8_t *inbuf, uint8_t *outbuf) const {
+        run<uint8_t>(inbuf, outbuf, 0xff);
+    }
+    //============================================================================
+
+    void SipiResampler::resample(const uint16_t *inbuf, uint16_t *outbuf) const {
+        run<uint16_t>(inbuf, outbuf, 0xffff);
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_resampler_h
+#define __defined_sipi_resampler_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Sipi {
+
+    /*!
+     * SipiResampler scales images with a separable Lanczos3 filter (windowed sinc with 3 lobes).
+     * The contributions of the source pixels to every destination column and row are computed once as
+     * fixed-point weight tables. The image is then resampled destination row by destination row: first the
+     * source rows contributing to the destination row are combined vertically into a single row, then this
+     * row is resampled horizontally. Thus, independent of the scaling factor, only a scratch row of the
+     * width of the source is needed besides the destination buffer.
+     *
+     * The destination rows are distributed over the shared compute pool (see SipiComputePool).
+     */
+    class SipiResampler {
+    private:
+        /*!
+         * Contributions of the source pixels to the destination pixels along one axis
+         */
+        typedef struct {
+            std::vector<size_t> start;      //!< first source pixel contributing to a destination pixel
+            std::vector<size_t> ntaps;      //!< number of contributing source pixels
+            std::vector<int32_t> weights;   //!< fixed-point weights, maxtaps per destination pixel
+            size_t maxtaps;
+        } Contributions;
+
+        size_t nx, ny, nnx, nny, nc;
+        Contributions xcontrib;
+        Contributions ycontrib;
+
+        static void contributions(size_t in_size, size_t out_size, Contributions &contrib);
+
+        template<typename T>
+        void run(const T *inbuf, T *outbuf, int32_t maxval) const;
+
+    public:
+        /*!
+         * Constructor which calculates the weight tables
+         *
+         * \param[in] nx_p Width of the source
+         * \param[in] ny_p Height of the source
+         * \param[in] nnx_p Width of the destination
+         * \param[in] nny_p Height of the destination
+         * \param[in] nc_p Number of samples per pixel
+         */
+        SipiResampler(size_t nx_p, size_t ny_p, size_t nnx_p, size_t nny_p, size_t nc_p);
+
+        /*!
+         * Resamples an image with 8 bits/sample
+         *
+         * \param[in] inbuf Source pixels (nx * ny * nc samples)
+         * \param[out] outbuf Destination pixels (nnx * nny * nc samples)
+         */
+        void resample(const uint8_t *inbuf, uint8_t *outbuf) const;
+
+        /*!
+         * Resamples an image with 16 bits/sample
+         *
+         * \param[in] inbuf Source pixels (nx * ny * nc samples)
+         * \param[out] outbuf Destination pixels (nnx * nny * nc samples)
+         */
+        void resample(const uint16_t *inbuf, uint16_t *outbuf) const;
+    };
+
+}
+
+#endif
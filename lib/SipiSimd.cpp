@@ -0,0 +1,474 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstring>
+
+#include "SipiSimd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIPI_SIMD_X86
+#include <immintrin.h>
+#define SIPI_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIPI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace Sipi {
+
+    //
+    // scalar kernels, these define the results of the vectorized versions
+    //
+    template<typename T, typename Acc>
+    static void accumulate_scalar(const T *src, int32_t weight, Acc *accu, size_t n) {
+        const Acc w = weight;
+        for (size_t i = 0; i < n; i++) accu[i] += w * (Acc) src[i];
+    }
+    //============================================================================
+
+    template<typename T, typename Acc>
+    static void convolve_scalar(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                                const int32_t *weights, size_t maxtaps, int shift, T *out) {
+        const Acc maxval = (Acc) ((1 << (8 * sizeof(T))) - 1);
+        for (size_t i = 0; i < n; i++) {
+            const int32_t *w = weights + i * maxtaps;
+            const int32_t *p = in + start[i] * nc;
+            for (size_t k = 0; k < nc; k++) {
+                Acc a = (Acc) 1 << (shift - 1);
+                for (size_t t = 0; t < ntaps[i]; t++) a += (Acc) w[t] * (Acc) p[t * nc + k];
+                a >>= shift;
+                out[i * nc + k] = (T) std::min(std::max(a, (Acc) 0), maxval);
+            }
+        }
+    }
+    //============================================================================
+
+    //
+    // Weights of the 4 neighbours, reproducing the cases and the rounding of SipiImage::bilinn().
+    // The weight w11 is applied to (p11 * rx), as in bilinn().
+    //
+    static inline void bilinear_weights(float rx, float ry, float &w00, float &w10, float &w01, float &w11) {
+        if ((rx < 1.0e-2) && (ry < 1.0e-2)) {
+            w00 = 1.0F;
+            w10 = w01 = w11 = 0.0F;
+            return;
+        }
+        w00 = 1 - rx - ry + rx * ry;
+        if (rx < 1.0e-2) {
+            w10 = w11 = 0.0F;
+            w01 = ry - rx * ry;
+        } else if (ry < 1.0e-2) {
+            w01 = w11 = 0.0F;
+            w10 = rx - rx * ry;
+        } else {
+            w10 = rx - rx * ry;
+            w01 = ry - rx * ry;
+            w11 = ry;
+        }
+    }
+    //============================================================================
+
+    //
+    // Neighbours of a source position; unused neighbours point to p00, so nothing outside the image is read
+    //
+    template<typename T>
+    static inline void bilinear_neighbours(const T *row0, const T *row1, size_t nc, int ix, float rx, float ry,
+                                           const T *&p00, const T *&p10, const T *&p01, const T *&p11) {
+        bool use_x = !(rx < 1.0e-2);
+        bool use_y = !(ry < 1.0e-2);
+        p00 = row0 + ix * nc;
+        p10 = use_x ? p00 + nc : p00;
+        p01 = use_y ? row1 + ix * nc : p00;
+        p11 = (use_x && use_y) ? p01 + nc : p00;
+    }
+    //============================================================================
+
+    template<typename T>
+    static void bilinear_scalar(const T *row0, const T *row1, size_t nc, const float *xlut, size_t n, float ry,
+                                T *out) {
+        for (size_t i = 0; i < n; i++) {
+            int ix = (int) xlut[i];
+            float rx = xlut[i] - (float) ix;
+            float w00, w10, w01, w11;
+            bilinear_weights(rx, ry, w00, w10, w01, w11);
+            const T *p00, *p10, *p01, *p11;
+            bilinear_neighbours(row0, row1, nc, ix, rx, ry, p00, p10, p01, p11);
+            for (size_t k = 0; k < nc; k++) {
+                out[i * nc + k] = (T) (((float) p00[k] * w00 + (float) p10[k] * w10 + (float) p01[k] * w01 +
+                                        (float) p11[k] * rx * w11) + 0.5);
+            }
+        }
+    }
+    //============================================================================
+
+#ifdef SIPI_SIMD_X86
+
+    //
+    // SSE4.1 kernels
+    //
+    SIPI_TARGET_SSE41
+    static void accumulate_sse41(const uint8_t *src, int32_t weight, int32_t *accu, size_t n) {
+        const __m128i w = _mm_set1_epi32(weight);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            int32_t s;
+            memcpy(&s, src + i, 4);
+            __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(s));
+            __m128i a = _mm_loadu_si128((const __m128i *) (accu + i));
+            _mm_storeu_si128((__m128i *) (accu + i), _mm_add_epi32(a, _mm_mullo_epi32(v, w)));
+        }
+        accumulate_scalar(src + i, weight, accu + i, n - i);
+    }
+    //============================================================================
+
+    SIPI_TARGET_SSE41
+    static void accumulate_sse41(const uint16_t *src, int32_t weight, int64_t *accu, size_t n) {
+        const __m128i w = _mm_set1_epi64x(weight);
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            int32_t s;
+            memcpy(&s, src + i, 4);
+            __m128i v = _mm_cvtepu16_epi64(_mm_cvtsi32_si128(s));
+            __m128i a = _mm_loadu_si128((const __m128i *) (accu + i));
+            _mm_storeu_si128((__m128i *) (accu + i), _mm_add_epi64(a, _mm_mul_epi32(v, w)));
+        }
+        accumulate_scalar(src + i, weight, accu + i, n - i);
+    }
+    //============================================================================
+
+    SIPI_TARGET_SSE41
+    static inline int32_t hsum_sse41(__m128i a) {
+        a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 3, 2)));
+        a = _mm_add_epi32(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(a);
+    }
+    //============================================================================
+
+    //
+    // nc == 3 or nc == 4: all samples of a pixel are convolved in one register
+    //
+    SIPI_TARGET_SSE41
+    static void convolve_pixels_sse41(const int32_t *in, size_t nc, size_t n, const size_t *start,
+                                      const size_t *ntaps, const int32_t *weights, size_t maxtaps, int shift,
+                                      uint8_t *out) {
+        const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        const __m128i maxval = _mm_set1_epi32(255);
+        for (size_t i = 0; i < n; i++) {
+            const int32_t *w = weights + i * maxtaps;
+            const int32_t *p = in + start[i] * nc;
+            __m128i a = round;
+            for (size_t t = 0; t < ntaps[i]; t++) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (p + t * nc));
+                a = _mm_add_epi32(a, _mm_mullo_epi32(v, _mm_set1_epi32(w[t])));
+            }
+            a = _mm_min_epi32(_mm_sra_epi32(a, count), maxval);
+            a = _mm_packus_epi32(a, a);
+            a = _mm_packus_epi16(a, a);
+            int32_t r = _mm_cvtsi128_si32(a);
+            memcpy(out + i * nc, &r, nc);
+        }
+    }
+    //============================================================================
+
+    //
+    // nc == 1: the taps are convolved in parallel
+    //
+    SIPI_TARGET_SSE41
+    static void convolve_gray_sse41(const int32_t *in, size_t n, const size_t *start, const size_t *ntaps,
+                                    const int32_t *weights, size_t maxtaps, int shift, uint8_t *out) {
+        for (size_t i = 0; i < n; i++) {
+            const int32_t *w = weights + i * maxtaps;
+            const int32_t *p = in + start[i];
+            __m128i a4 = _mm_setzero_si128();
+            size_t t = 0;
+            for (; t + 4 <= ntaps[i]; t += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *) (p + t));
+                a4 = _mm_add_epi32(a4, _mm_mullo_epi32(v, _mm_loadu_si128((const __m128i *) (w + t))));
+            }
+            int32_t a = hsum_sse41(a4) + (1 << (shift - 1));
+            for (; t < ntaps[i]; t++) a += w[t] * p[t];
+            a >>= shift;
+            out[i] = (uint8_t) std::min(std::max(a, 0), 255);
+        }
+    }
+    //============================================================================
+
+    SIPI_TARGET_SSE41
+    static void convolve_sse41(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                               const int32_t *weights, size_t maxtaps, int shift, uint8_t *out) {
+        switch (nc) {
+            case 1: convolve_gray_sse41(in, n, start, ntaps, weights, maxtaps, shift, out); break;
+            case 3:
+            case 4: convolve_pixels_sse41(in, nc, n, start, ntaps, weights, maxtaps, shift, out); break;
+            default: convolve_scalar<uint8_t, int32_t>(in, nc, n, start, ntaps, weights, maxtaps, shift, out);
+        }
+    }
+    //============================================================================
+
+    //
+    // the samples are inserted directly, copying 3 samples to memory and loading them as a whole would stall
+    //
+    template<size_t NC, typename T>
+    SIPI_TARGET_SSE41
+    static inline __m128 load_pixel_sse41(const T *p) {
+        return _mm_cvtepi32_ps(_mm_set_epi32((NC == 4) ? p[3] : 0, p[2], p[1], p[0]));
+    }
+    //============================================================================
+
+    template<size_t NC>
+    SIPI_TARGET_SSE41
+    static inline void store_pixel_sse41(__m128i v, uint8_t *p) {
+        v = _mm_packus_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        int32_t r = _mm_cvtsi128_si32(v);
+        memcpy(p, &r, NC);
+    }
+    //============================================================================
+
+    template<size_t NC>
+    SIPI_TARGET_SSE41
+    static inline void store_pixel_sse41(__m128i v, uint16_t *p) {
+        uint64_t r;
+        _mm_storel_epi64((__m128i *) &r, _mm_packus_epi32(v, v));
+        memcpy(p, &r, NC * sizeof(uint16_t));
+    }
+    //============================================================================
+
+    //
+    // nc == 3 or nc == 4: all samples of a pixel are interpolated in one register. The sum is formed in the
+    // same order as in the scalar code, and the rounding is done in double precision, so the results are
+    // identical.
+    //
+    template<typename T, size_t NC>
+    SIPI_TARGET_SSE41
+    static void bilinear_pixels_sse41(const T *row0, const T *row1, const float *xlut, size_t n, float ry, T *out) {
+        const size_t nc = NC;
+        const __m128d half = _mm_set1_pd(0.5);
+        for (size_t i = 0; i < n; i++) {
+            int ix = (int) xlut[i];
+            float rx = xlut[i] - (float) ix;
+            float w00, w10, w01, w11;
+            bilinear_weights(rx, ry, w00, w10, w01, w11);
+            const T *p00, *p10, *p01, *p11;
+            bilinear_neighbours(row0, row1, nc, ix, rx, ry, p00, p10, p01, p11);
+
+            __m128 s = _mm_mul_ps(load_pixel_sse41<NC>(p00), _mm_set1_ps(w00));
+            s = _mm_add_ps(s, _mm_mul_ps(load_pixel_sse41<NC>(p10), _mm_set1_ps(w10)));
+            s = _mm_add_ps(s, _mm_mul_ps(load_pixel_sse41<NC>(p01), _mm_set1_ps(w01)));
+            s = _mm_add_ps(s, _mm_mul_ps(_mm_mul_ps(load_pixel_sse41<NC>(p11), _mm_set1_ps(rx)), _mm_set1_ps(w11)));
+
+            __m128i lo = _mm_cvttpd_epi32(_mm_add_pd(_mm_cvtps_pd(s), half));
+            __m128i hi = _mm_cvttpd_epi32(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(s, s)), half));
+            store_pixel_sse41<NC>(_mm_unpacklo_epi64(lo, hi), out + i * nc);
+        }
+    }
+    //============================================================================
+
+    template<typename T>
+    SIPI_TARGET_SSE41
+    static void bilinear_sse41(const T *row0, const T *row1, size_t nc, const float *xlut, size_t n, float ry,
+                               T *out) {
+        switch (nc) {
+            case 3: bilinear_pixels_sse41<T, 3>(row0, row1, xlut, n, ry, out); break;
+            case 4: bilinear_pixels_sse41<T, 4>(row0, row1, xlut, n, ry, out); break;
+            default: bilinear_scalar(row0, row1, nc, xlut, n, ry, out);
+        }
+    }
+    //============================================================================
+
+    //
+    // AVX2 kernels (only where the wider registers pay off)
+    //
+    SIPI_TARGET_AVX2
+    static void accumulate_avx2(const uint8_t *src, int32_t weight, int32_t *accu, size_t n) {
+        const __m256i w = _mm256_set1_epi32(weight);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + i)));
+            __m256i a = _mm256_loadu_si256((const __m256i *) (accu + i));
+            _mm256_storeu_si256((__m256i *) (accu + i), _mm256_add_epi32(a, _mm256_mullo_epi32(v, w)));
+        }
+        accumulate_scalar(src + i, weight, accu + i, n - i);
+    }
+    //============================================================================
+
+    SIPI_TARGET_AVX2
+    static void accumulate_avx2(const uint16_t *src, int32_t weight, int64_t *accu, size_t n) {
+        const __m256i w = _mm256_set1_epi64x(weight);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_cvtepu16_epi64(_mm_loadl_epi64((const __m128i *) (src + i)));
+            __m256i a = _mm256_loadu_si256((const __m256i *) (accu + i));
+            _mm256_storeu_si256((__m256i *) (accu + i), _mm256_add_epi64(a, _mm256_mul_epi32(v, w)));
+        }
+        accumulate_scalar(src + i, weight, accu + i, n - i);
+    }
+    //============================================================================
+
+    SIPI_TARGET_AVX2
+    static void convolve_gray_avx2(const int32_t *in, size_t n, const size_t *start, const size_t *ntaps,
+                                   const int32_t *weights, size_t maxtaps, int shift, uint8_t *out) {
+        for (size_t i = 0; i < n; i++) {
+            const int32_t *w = weights + i * maxtaps;
+            const int32_t *p = in + start[i];
+            __m256i a8 = _mm256_setzero_si256();
+            size_t t = 0;
+            for (; t + 8 <= ntaps[i]; t += 8) {
+                __m256i v = _mm256_loadu_si256((const __m256i *) (p + t));
+                a8 = _mm256_add_epi32(a8, _mm256_mullo_epi32(v, _mm256_loadu_si256((const __m256i *) (w + t))));
+            }
+            __m128i a4 = _mm_add_epi32(_mm256_castsi256_si128(a8), _mm256_extracti128_si256(a8, 1));
+            int32_t a = hsum_sse41(a4) + (1 << (shift - 1));
+            for (; t < ntaps[i]; t++) a += w[t] * p[t];
+            a >>= shift;
+            out[i] = (uint8_t) std::min(std::max(a, 0), 255);
+        }
+    }
+    //============================================================================
+
+    SIPI_TARGET_AVX2
+    static void convolve_avx2(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                              const int32_t *weights, size_t maxtaps, int shift, uint8_t *out) {
+        if (nc == 1) {
+            convolve_gray_avx2(in, n, start, ntaps, weights, maxtaps, shift, out);
+        } else {
+            convolve_sse41(in, nc, n, start, ntaps, weights, maxtaps, shift, out);
+        }
+    }
+    //============================================================================
+
+#endif
+
+    //
+    // the kernels used, selected according to the instruction set
+    //
+    typedef struct {
+        SipiSimd::Level level;
+        void (*accumulate8)(const uint8_t *, int32_t, int32_t *, size_t);
+        void (*accumulate16)(const uint16_t *, int32_t, int64_t *, size_t);
+        void (*convolve8)(const int32_t *, size_t, size_t, const size_t *, const size_t *, const int32_t *, size_t,
+                          int, uint8_t *);
+        void (*bilinear8)(const uint8_t *, const uint8_t *, size_t, const float *, size_t, float, uint8_t *);
+        void (*bilinear16)(const uint16_t *, const uint16_t *, size_t, const float *, size_t, float, uint16_t *);
+    } Kernels;
+
+    static SipiSimd::Level supported(void) {
+#ifdef SIPI_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SipiSimd::AVX2;
+        if (__builtin_cpu_supports("sse4.1")) return SipiSimd::SSE41;
+#endif
+        return SipiSimd::SCALAR;
+    }
+    //============================================================================
+
+    static void select(SipiSimd::Level level, Kernels &k) {
+        k.level = std::min(level, supported());
+        k.accumulate8 = accumulate_scalar<uint8_t, int32_t>;
+        k.accumulate16 = accumulate_scalar<uint16_t, int64_t>;
+        k.convolve8 = convolve_scalar<uint8_t, int32_t>;
+        k.bilinear8 = bilinear_scalar<uint8_t>;
+        k.bilinear16 = bilinear_scalar<uint16_t>;
+#ifdef SIPI_SIMD_X86
+        if (k.level >= SipiSimd::SSE41) {
+            k.accumulate8 = accumulate_sse41;
+            k.accumulate16 = accumulate_sse41;
+            k.convolve8 = convolve_sse41;
+            k.bilinear8 = bilinear_sse41<uint8_t>;
+            k.bilinear16 = bilinear_sse41<uint16_t>;
+        }
+        if (k.level >= SipiSimd::AVX2) {
+            k.accumulate8 = accumulate_avx2;
+            k.accumulate16 = accumulate_avx2;
+            k.convolve8 = convolve_avx2;
+        }
+#endif
+    }
+    //============================================================================
+
+    static Kernels &kernels(void) {
+        static Kernels k = [] {
+            Kernels tmp;
+            select(SipiSimd::AVX2, tmp);
+            return tmp;
+        }();
+        return k;
+    }
+    //============================================================================
+
+    SipiSimd::Level SipiSimd::level(void) {
+        return kernels().level;
+    }
+    //============================================================================
+
+    void SipiSimd::level(Level level_p) {
+        select(level_p, kernels());
+    }
+    //============================================================================
+
+    const char *SipiSimd::name(Level level_p) {
+        switch (level_p) {
+            case SSE41: return "SSE4.1";
+            case AVX2: return "AVX2";
+            default: return "scalar";
+        }
+    }
+    //============================================================================
+
+    void SipiSimd::accumulate(const uint8_t *src, int32_t weight, int32_t *accu, size_t n) {
+        kernels().accumulate8(src, weight, accu, n);
+    }
+    //============================================================================
+
+    void SipiSimd::accumulate(const uint16_t *src, int32_t weight, int64_t *accu, size_t n) {
+        kernels().accumulate16(src, weight, accu, n);
+    }
+    //============================================================================
+
+    void SipiSimd::convolve(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                            const int32_t *weights, size_t maxtaps, int shift, uint8_t *out) {
+        kernels().convolve8(in, nc, n, start, ntaps, weights, maxtaps, shift, out);
+    }
+    //============================================================================
+
+    void SipiSimd::convolve(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                            const int32_t *weights, size_t maxtaps, int shift, uint16_t *out) {
+        //
+        // 16 bit samples need 64 bit products, which SSE/AVX2 cannot multiply efficiently
+        //
+        convolve_scalar<uint16_t, int64_t>(in, nc, n, start, ntaps, weights, maxtaps, shift, out);
+    }
+    //============================================================================
+
+    void SipiSimd::bilinear(const uint8_t *row0, const uint8_t *row1, size_t nc, const float *xlut, size_t n,
+                            float ry, uint8_t *out) {
+        kernels().bilinear8(row0, row1, nc, xlut, n, ry, out);
+    }
+    //============================================================================
+
+    void SipiSimd::bilinear(const uint16_t *row0, const uint16_t *row1, size_t nc, const float *xlut, size_t n,
+                            float ry, uint16_t *out) {
+        kernels().bilinear16(row0, row1, nc, xlut, n, ry, out);
+    }
+    //============================================================================
+
+}
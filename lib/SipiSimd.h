@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_simd_h
+#define __defined_sipi_simd_h
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Sipi {
+
+    /*!
+     * SipiSimd holds the inner loops of the image scaling code. Each kernel exists as portable scalar
+     * code and, on x86 processors, as SSE4.1 and/or AVX2 versions. The best version supported by the
+     * processor is selected once at runtime, so that the binary does not need to be compiled for a
+     * specific instruction set. All versions of a kernel produce exactly the same results.
+     */
+    class SipiSimd {
+    public:
+        typedef enum {
+            SCALAR = 0, //!< portable C++
+            SSE41 = 1,  //!< SSE up to version 4.1
+            AVX2 = 2    //!< AVX2
+        } Level;
+
+        /*!
+         * Returns the instruction set currently used by the kernels
+         */
+        static Level level(void);
+
+        /*!
+         * Restricts the kernels to the given instruction set (e.g. to compare the versions). If the
+         * processor doesn't support the instruction set, the best supported one is used. Must not be
+         * called while kernels are running.
+         *
+         * \param[in] level_p Instruction set to use
+         */
+        static void level(Level level_p);
+
+        /*!
+         * Returns the name of an instruction set
+         */
+        static const char *name(Level level_p);
+
+        /*!
+         * Adds a weighted source row to an accumulator row: accu[i] += weight * src[i]
+         *
+         * \param[in] src Source row
+         * \param[in] weight Fixed-point weight
+         * \param[in,out] accu Accumulator row
+         * \param[in] n Number of samples
+         */
+        static void accumulate(const uint8_t *src, int32_t weight, int32_t *accu, size_t n);
+
+        static void accumulate(const uint16_t *src, int32_t weight, int64_t *accu, size_t n);
+
+        /*!
+         * Convolves a row of fixed-point samples horizontally with a table of weights. The result is
+         * rounded, shifted right by shift bits and clamped to the range of the destination type.
+         * If nc is 3, in must be readable for one sample beyond its end.
+         *
+         * \param[in] in Source row
+         * \param[in] nc Number of samples per pixel
+         * \param[in] n Number of destination pixels
+         * \param[in] start First source pixel contributing to each destination pixel
+         * \param[in] ntaps Number of source pixels contributing to each destination pixel
+         * \param[in] weights Fixed-point weights, maxtaps per destination pixel
+         * \param[in] maxtaps Stride of the weight table
+         * \param[in] shift Number of fractional bits of the products
+         * \param[out] out Destination row
+         */
+        static void convolve(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                             const int32_t *weights, size_t maxtaps, int shift, uint8_t *out);
+
+        static void convolve(const int32_t *in, size_t nc, size_t n, const size_t *start, const size_t *ntaps,
+                             const int32_t *weights, size_t maxtaps, int shift, uint16_t *out);
+
+        /*!
+         * Bilinear interpolation of one destination row. The results are identical to
+         * SipiImage::bilinn() applied to every sample.
+         *
+         * \param[in] row0 Source row above the destination row
+         * \param[in] row1 Source row below the destination row (only read if ry >= 0.01)
+         * \param[in] nc Number of samples per pixel
+         * \param[in] xlut Horizontal source position of each destination pixel
+         * \param[in] n Number of destination pixels
+         * \param[in] ry Vertical distance of the destination row from row0 (0 <= ry < 1)
+         * \param[out] out Destination row
+         */
+        static void bilinear(const uint8_t *row0, const uint8_t *row1, size_t nc, const float *xlut, size_t n,
+                             float ry, uint8_t *out);
+
+        static void bilinear(const uint16_t *row0, const uint16_t *row1, size_t nc, const float *xlut, size_t n,
+                             float ry, uint16_t *out);
+    };
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SipiSingleFlight.h"
+
+namespace Sipi {
+
+    SipiSingleFlight::Ticket &SipiSingleFlight::Ticket::operator=(Ticket &&other) noexcept {
+        if (this != &other) {
+            release();
+            sf = other.sf;
+            key = std::move(other.key);
+            flight = std::move(other.flight);
+            is_leader = other.is_leader;
+            other.sf = nullptr;
+            other.is_leader = false;
+        }
+        return *this;
+    }
+    //============================================================================
+
+    bool SipiSingleFlight::Ticket::wait(std::chrono::seconds timeout) {
+        if ((sf == nullptr) || is_leader) return true;
+        std::unique_lock<std::mutex> lock(sf->locking);
+        return flight->cond.wait_for(lock, timeout, [this] { return flight->done; });
+    }
+    //============================================================================
+
+    void SipiSingleFlight::Ticket::release() {
+        if ((sf != nullptr) && is_leader) {
+            sf->land(key, flight);
+        }
+        sf = nullptr;
+        is_leader = false;
+        flight = nullptr;
+    }
+    //============================================================================
+
+    void SipiSingleFlight::land(const std::string &key, const std::shared_ptr<Flight> &flight) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = flights.find(key);
+        if ((it != flights.end()) && (it->second == flight)) {
+            flights.erase(it);
+        }
+        flight->done = true;
+        flight->cond.notify_all();
+    }
+    //============================================================================
+
+    void SipiSingleFlight::join(const std::string &key, Ticket &ticket) {
+        ticket.release();
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        auto it = flights.find(key);
+        ticket.sf = this;
+        ticket.key = key;
+        if (it == flights.end()) {
+            ticket.flight = std::make_shared<Flight>();
+            ticket.flight->done = false;
+            flights[key] = ticket.flight;
+            ticket.is_leader = true;
+        } else {
+            ticket.flight = it->second;
+            ticket.is_leader = false;
+        }
+    }
+    //============================================================================
+
+    size_t SipiSingleFlight::size(void) {
+        std::lock_guard<std::mutex> locking_mutex_guard(locking);
+        return flights.size();
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_single_flight_h
+#define __defined_sipi_single_flight_h
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Sipi {
+
+    /*!
+     * SipiSingleFlight coalesces concurrent requests for the same rendition. The first request for
+     * a key becomes the leader and renders the image, all other requests for the same key wait until
+     * the leader is done and then look into the cache again instead of rendering the image themselves.
+     */
+    class SipiSingleFlight {
+    private:
+        typedef struct {
+            bool done;
+            std::condition_variable cond;
+        } Flight;
+
+        std::mutex locking;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+
+        void land(const std::string &key, const std::shared_ptr<Flight> &flight);
+
+    public:
+        /*!
+         * A Ticket is returned by SipiSingleFlight::join(). If it is the leader, the flight ends when
+         * Ticket::release() is called or the ticket is destroyed.
+         */
+        class Ticket {
+            friend class SipiSingleFlight;
+        private:
+            SipiSingleFlight *sf;
+            std::string key;
+            std::shared_ptr<Flight> flight;
+            bool is_leader;
+
+        public:
+            inline Ticket() : sf(nullptr), is_leader(false) {}
+
+            Ticket(const Ticket &) = delete;
+
+            Ticket &operator=(const Ticket &) = delete;
+
+            Ticket &operator=(Ticket &&other) noexcept;
+
+            ~Ticket() { release(); }
+
+            /*!
+             * Returns true if this request has to render the image
+             */
+            inline bool leader() const { return is_leader; }
+
+            /*!
+             * Waits until the leader has finished (successfully or not)
+             *
+             * \param[in] timeout Maximal time to wait
+             * \returns false, if the timeout elapsed
+             */
+            bool wait(std::chrono::seconds timeout);
+
+            /*!
+             * Ends the flight of a leader and wakes up the waiting requests
+             */
+            void release();
+        };
+
+        /*!
+         * Joins the flight for the given key, creating it if no request for this key is in progress.
+         *
+         * \param[in] key Key of the rendition (usually the canonical URL)
+         * \param[out] ticket Ticket which indicates if the caller is the leader
+         */
+        void join(const std::string &key, Ticket &ticket);
+
+        /*!
+         * Returns the number of renditions currently in progress
+         */
+        size_t size(void);
+    };
+
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "SipiSource.h"
+#include "SipiImage.h"
+#include "shttps/Parsing.h"
+
+namespace Sipi {
+
+    SipiSource::SipiSource(const std::string &path_p) : _path(path_p), _fd(-1), _sniffed(false) {
+        memset(&_fileinfo, 0, sizeof(_fileinfo));
+        _fd = ::open(_path.c_str(), O_RDONLY);
+        if ((_fd >= 0) && (::fstat(_fd, &_fileinfo) != 0)) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+    //============================================================================
+
+    SipiSource::~SipiSource() {
+        if (_fd >= 0) ::close(_fd);
+    }
+    //============================================================================
+
+    int SipiSource::dup_fd(void) const {
+        if (_fd < 0) return -1;
+        int fd = ::dup(_fd);
+        if (fd < 0) return -1;
+        if (::lseek(fd, 0, SEEK_SET) != 0) { // the offset is shared with the original descriptor
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    //============================================================================
+
+    FILE *SipiSource::dup_file(void) const {
+        int fd = dup_fd();
+        if (fd < 0) return nullptr;
+        FILE *file = ::fdopen(fd, "rb");
+        if (file == nullptr) ::close(fd);
+        return file;
+    }
+    //============================================================================
+
+    void SipiSource::sniff(void) const {
+        if (_sniffed || (_fd < 0)) return;
+        _sniffed = true;
+        unsigned char header[header_size];
+        ssize_t n = ::pread(_fd, header, header_size, 0); // does not move the offset of the descriptor
+        if (n > 0) {
+            _format = SipiImage::sniff(header, static_cast<size_t>(n), _mimetype);
+        }
+        if (_format.empty()) {
+            _mimetype = shttps::Parsing::getFileMimetype(_path).first;
+        }
+    }
+    //============================================================================
+
+    const std::string &SipiSource::format(void) const {
+        sniff();
+        return _format;
+    }
+    //============================================================================
+
+    const std::string &SipiSource::mimetype(void) const {
+        sniff();
+        return _mimetype;
+    }
+    //============================================================================
+
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __defined_sipi_source_h
+#define __defined_sipi_source_h
+
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+#include <sys/stat.h>
+
+namespace Sipi {
+
+    /*!
+     * SipiSource is a request scoped handle of an image file. The file is opened and stat'ed once, and
+     * its format is sniffed at most once; the handle is then passed to the image readers, the cache and
+     * the info index instead of the path. On network file systems, every open() and stat() of the same
+     * file costs a round trip, thus this saves a large part of the latency of an uncached request.
+     *
+     * The readers get their own duplicate of the file descriptor (see dup_fd()), since the underlying
+     * libraries close the descriptors they are given.
+     *
+     * The format is determined by reading the first header_size bytes once and passing them to the
+     * sniffers of the format registry (see SipiImage::sniff()), independent of the file extension.
+     */
+    class SipiSource {
+    private:
+        std::string _path;
+        int _fd;
+        struct stat _fileinfo;
+        mutable bool _sniffed;
+        mutable std::string _format; //!< key of the reader in the format registry, sniffed lazily
+        mutable std::string _mimetype; //!< sniffed lazily
+
+        void sniff(void) const;
+
+    public:
+        static const size_t header_size = 512; //!< Number of bytes which are given to the format sniffers
+
+        /*!
+         * Opens the file. If the file cannot be opened, ok() returns false.
+         *
+         * \param[in] path_p Path of the image file
+         */
+        explicit SipiSource(const std::string &path_p);
+
+        SipiSource(const SipiSource &) = delete;
+
+        SipiSource &operator=(const SipiSource &) = delete;
+
+        ~SipiSource();
+
+        /*!
+         * Returns true, if the file could be opened and stat'ed
+         */
+        inline bool ok(void) const { return _fd >= 0; }
+
+        inline const std::string &path(void) const { return _path; }
+
+        inline int fd(void) const { return _fd; }
+
+        inline const struct stat &fileinfo(void) const { return _fileinfo; }
+
+        inline time_t mtime(void) const { return _fileinfo.st_mtime; }
+
+        inline off_t size(void) const { return _fileinfo.st_size; }
+
+        /*!
+         * Returns a duplicate of the file descriptor, positioned at the beginning of the file.
+         * The caller owns the descriptor and has to close it.
+         *
+         * \returns File descriptor or -1 on failure
+         */
+        int dup_fd(void) const;
+
+        /*!
+         * Returns a stdio stream on a duplicate of the file descriptor, positioned at the beginning
+         * of the file. The caller has to fclose() it.
+         *
+         * \returns Stream or nullptr on failure
+         */
+        FILE *dup_file(void) const;
+
+        /*!
+         * Returns the key of the reader for this file (e.g. "tif" or "jpx") in the format registry,
+         * or an empty string if the file is not an image format known to Sipi
+         */
+        const std::string &format(void) const;
+
+        /*!
+         * Returns the mime type of the file, it is determined only once. Files which are not
+         * recognized by the format registry (e.g. PDFs) are passed to libmagic
+         */
+        const std::string &mimetype(void) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <syslog.h>
+
+#include "SipiStripePipeline.h"
+#include "SipiComputePool.h"
+
+static const char __file__[] = __FILE__;
+
+namespace Sipi {
+
+    SipiStripePipeline::SipiStripePipeline(std::shared_ptr<SipiIcc> target_icc_p, std::shared_ptr<SipiStripeSink> encoder_p)
+            : target_icc(target_icc_p), encoder(encoder_p), transform(nullptr), nx(0), out_pixelsize(0) {
+        if (encoder == nullptr) {
+            throw SipiImageError(__file__, __LINE__, "No encoder for stripe pipeline");
+        }
+    }
+    //============================================================================
+
+    SipiStripePipeline::~SipiStripePipeline() {
+        if (transform != nullptr) cmsDeleteTransform(transform);
+    }
+    //============================================================================
+
+    bool SipiStripePipeline::begin(SipiImage *img) {
+        if (!img->es.empty()) return false; // alpha channels are handled by the unbuffered path only
+        if ((img->bps != 8) && (img->bps != 16)) return false;
+
+        std::shared_ptr<SipiIcc> src_icc = img->icc;
+        if (src_icc == nullptr) { // same assumptions as SipiImage::convertToIcc()
+            switch (img->nc) {
+                case 1: src_icc = std::make_shared<SipiIcc>(icc_GRAY_D50); break;
+                case 3: src_icc = std::make_shared<SipiIcc>(icc_sRGB); break;
+                case 4: src_icc = std::make_shared<SipiIcc>(icc_CYMK_standard); break;
+                default: return false;
+            }
+        }
+
+        std::shared_ptr<SipiIcc> dst_icc = target_icc;
+        if (dst_icc == nullptr) { // CIELAB cannot be encoded directly, same as the unbuffered writers
+            dst_icc = (cmsGetColorSpace(src_icc->getIccProfile()) == cmsSigLabData) ? std::make_shared<SipiIcc>(icc_sRGB) : src_icc;
+        }
+        PhotometricInterpretation photo;
+        switch (cmsGetColorSpace(dst_icc->getIccProfile())) {
+            case cmsSigGrayData: photo = MINISBLACK; break;
+            case cmsSigRgbData: photo = RGB; break;
+            case cmsSigCmykData: photo = SEPARATED; break;
+            case cmsSigLabData: photo = CIELAB; break;
+            default: return false;
+        }
+
+        cmsSetLogErrorHandler(icc_error_logger);
+        transform = cmsCreateTransform(src_icc->getIccProfile(), src_icc->iccFormatter(img),
+                                       dst_icc->getIccProfile(), dst_icc->iccFormatter(8),
+                                       INTENT_PERCEPTUAL, cmsFLAGS_NOCACHE);
+        if (transform == nullptr) {
+            throw SipiImageError(__file__, __LINE__, "Couldn't create color transform");
+        }
+
+        //
+        // from now on the image describes the pixels delivered to the encoder. If the encoder
+        // rejects the image, the header is restored and the reader decodes the image as usual
+        //
+        size_t old_nc = img->nc;
+        size_t old_bps = img->bps;
+        PhotometricInterpretation old_photo = img->photo;
+        std::shared_ptr<SipiIcc> old_icc = img->icc;
+        img->nc = cmsChannelsOf(cmsGetColorSpace(dst_icc->getIccProfile()));
+        img->bps = 8;
+        img->photo = photo;
+        img->icc = dst_icc;
+
+        bool accepted;
+        try {
+            accepted = encoder->begin(img);
+        } catch (const SipiImageError &err) {
+            syslog(LOG_WARNING, "Stripe encoder rejected image: %s", err.to_string().c_str());
+            accepted = false;
+        } catch (const SipiError &err) {
+            syslog(LOG_WARNING, "Stripe encoder rejected image: %s", err.to_string().c_str());
+            accepted = false;
+        }
+        if (!accepted) {
+            img->nc = old_nc;
+            img->bps = old_bps;
+            img->photo = old_photo;
+            img->icc = old_icc;
+            cmsDeleteTransform(transform);
+            transform = nullptr;
+            return false;
+        }
+
+        nx = img->nx;
+        out_pixelsize = img->nc;
+
+        //
+        // the encoder has not written anything yet (see SipiStripeSink::begin()), so the
+        // prologue may still e.g. set the HTTP header
+        //
+        if (prologue_func) prologue_func(img);
+        return true;
+    }
+    //============================================================================
+
+    void SipiStripePipeline::stripe(SipiImage *img, unsigned char *buf, size_t nrows) {
+        size_t out_rowsize = nx * out_pixelsize;
+        if (outbuf.size() < nrows * out_rowsize) outbuf.resize(nrows * out_rowsize);
+
+        //
+        // the input row size has to be derived from the transform, since the header of img
+        // already describes the output
+        //
+        cmsUInt32Number in_format = cmsGetTransformInputFormat(transform);
+        size_t in_rowsize = nx * (T_CHANNELS(in_format) + T_EXTRA(in_format)) * T_BYTES(in_format);
+        unsigned char *out = outbuf.data();
+        SipiComputePool::run(0, nrows, [&](size_t y0, size_t y1) {
+            cmsDoTransform(transform, buf + y0 * in_rowsize, out + y0 * out_rowsize, nx * (y1 - y0));
+        }, 16);
+
+        encoder->stripe(img, out, nrows);
+    }
+    //============================================================================
+
+    void SipiStripePipeline::end(SipiImage *img) {
+        encoder->end(img);
+        cmsDeleteTransform(transform);
+        transform = nullptr;
+    }
+    //============================================================================
+
+}
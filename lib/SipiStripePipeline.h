@@ -0,0 +1,82 @@
+/*
+ * Copyright © 2016 Lukas Rosenthaler, Andrea Bianco, Benjamin Geer,
+ * Ivan Subotic, Tobias Schweizer, André Kilchenmann, and André Fatton.
+ * This file is part of Sipi.
+ * Sipi is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * Sipi is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * Additional permission under GNU AGPL version 3 section 7:
+ * If you modify this Program, or any covered work, by linking or combining
+ * it with Kakadu (or a modified version of that library) or Adobe ICC Color
+ * Profiles (or a modified version of that library) or both, containing parts
+ * covered by the terms of the Kakadu Software Licence or Adobe Software Licence,
+ * or both, the licensors of this Program grant you additional permission
+ * to convey the resulting work.
+ * See the GNU Affero General Public License for more details.
+ * You should have received a copy of the GNU Affero General Public
+ * License along with Sipi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __defined_sipi_stripe_pipeline_h
+#define __defined_sipi_stripe_pipeline_h
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "lcms2.h"
+
+#include "SipiImage.h"
+#include "SipiIO.h"
+#include "metadata/SipiIcc.h"
+
+namespace Sipi {
+
+    /*!
+     * SipiStripePipeline converts the stripes delivered by a reader to the given ICC profile
+     * (or keeps the profile of the image if none is given) with 8 bits/sample and forwards them to an encoder (usually obtained by
+     * SipiImage::stripeWriter()). Thus an image can be transcoded while holding only
+     * a few stripes in memory. Images with alpha channels are not accepted.
+     */
+    class SipiStripePipeline : public SipiStripeSink {
+    private:
+        std::shared_ptr<SipiIcc> target_icc;
+        std::shared_ptr<SipiStripeSink> encoder;
+        std::function<void(SipiImage *)> prologue_func;
+        cmsHTRANSFORM transform;
+        size_t nx;
+        size_t out_pixelsize;
+        std::vector<unsigned char> outbuf;
+
+    public:
+        /*!
+         * Constructor
+         *
+         * \param target_icc_p ICC profile of the encoded image, nullptr to keep the profile of the image
+         * \param encoder_p Sink writing the converted stripes
+         */
+        SipiStripePipeline(std::shared_ptr<SipiIcc> target_icc_p, std::shared_ptr<SipiStripeSink> encoder_p);
+
+        ~SipiStripePipeline();
+
+        /*!
+         * Sets a function which is called once the image has been accepted by the encoder, before
+         * the first stripe is written (e.g. to set the HTTP header). It is not called if the image
+         * is rejected.
+         */
+        inline void prologue(std::function<void(SipiImage *)> prologue_p) { prologue_func = prologue_p; }
+
+        bool begin(SipiImage *img) override;
+
+        void stripe(SipiImage *img, unsigned char *buf, size_t nrows) override;
+
+        void end(SipiImage *img) override;
+    };
+
+}
+
+#endif
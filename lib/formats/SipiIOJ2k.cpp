@@ -31,6 +31,8 @@
 #include <cmath>
 #include <vector>
 #include <cstdio>
+#include <mutex>
+#include <algorithm>
 
 #include <fcntl.h>
 #include <string.h>
@@ -40,6 +42,7 @@
 
 #include "SipiError.h"
 #include "SipiIOJ2k.h"
+#include "SipiComputePool.h"
 
 
 
@@ -114,7 +117,7 @@ J2kHttpStream::~J2kHttpStream() {
 //........................................................................
 bool J2kHttpStream::write(const kdu_byte *buf, int num_bytes) {
   try {
-    conobj->sendAndFlush(buf, num_bytes);
+    SipiIO::send(conobj, buf, num_bytes);
   } catch (int i) {
     return false;
   }
@@ -191,34 +194,152 @@ class KduSipiError : public kdu_core::kdu_message {
 static KduSipiWarning kdu_sipi_warn("Kakadu-library: ");
 static KduSipiError kdu_sipi_error("Kakadu-library: ");
 
+//=============================================================================
+// Process-wide group of Kakadu worker threads. Creating a thread group for every
+// request is expensive, therefore a single group is created on first use and lent
+// to one encoding or decoding call at a time. A call finding the group busy runs
+// single threaded instead of spawning additional threads. If a shared compute pool
+// exists, the worker threads of the group have to be reserved from the pool, so
+// that Kakadu never runs on top of a fully loaded pool.
+//
+static int kdu_num_threads = 0; // 0: size of the compute pool or number of processors
+static std::mutex kdu_threads_mutex;
+static kdu_core::kdu_thread_env kdu_threads_env;
+static int kdu_threads_workers = 0; // number of worker threads of the created group
+static bool kdu_threads_created = false;
+static bool kdu_threads_busy = false;
+
+/*!
+* Local class which leases the shared thread group for the lifetime of the object
+*/
+class KduThreadLease {
+ private:
+  kdu_core::kdu_thread_env *env;
+  SipiComputePool *pool;
+  int reserved; // number of threads reserved from the compute pool
+  bool active; // true from handing out the environment until finish(), i.e. while jobs may be outstanding
+ public:
+  KduThreadLease();
+
+  ~KduThreadLease();
+
+  //
+  // the environment is attached to a codestream as soon as it is handed out, thus an
+  // exception thrown before start() must also terminate the worker threads
+  //
+  inline kdu_core::kdu_thread_env *get() {
+    active = (env != nullptr);
+    return env;
+  }
+
+  inline kdu_core::kdu_thread_env *start() { return get(); }
+
+  inline void finish(kdu_core::kdu_codestream &codestream) {
+    if (env != nullptr) env->cs_terminate(codestream);
+    active = false;
+  }
+};
+//-------------------------------------------------------------------------
+
+KduThreadLease::KduThreadLease() : env(nullptr), pool(SipiComputePool::shared()), reserved(0), active(false) {
+  std::lock_guard<std::mutex> lock(kdu_threads_mutex);
+  if (kdu_threads_busy) return; // another call is using the group
+
+  int num_workers;
+  if (kdu_threads_created) {
+    num_workers = kdu_threads_workers;
+  } else if (kdu_num_threads > 0) {
+    num_workers = kdu_num_threads - 1;
+  } else {
+    num_workers = ((pool != nullptr) ? pool->size() : kdu_get_num_processors()) - 1;
+  }
+  if (num_workers < 1) return;
+
+  if (pool != nullptr) {
+    reserved = pool->reserve(num_workers);
+    if (reserved < num_workers) { // the compute pool is exhausted
+      pool->release(reserved);
+      reserved = 0;
+      return;
+    }
+  }
+
+  if (!kdu_threads_created) {
+    kdu_threads_env.create();
+    kdu_threads_workers = 0;
+    for (int nt = 0; nt < num_workers; nt++) {
+      if (!kdu_threads_env.add_thread()) break; // Unable to create all the threads requested
+      kdu_threads_workers++;
+    }
+    if (pool != nullptr) {
+      pool->release(reserved - kdu_threads_workers);
+      reserved = kdu_threads_workers;
+    }
+    kdu_threads_created = true;
+  } else {
+    kdu_threads_env.change_group_owner_thread();
+  }
+  kdu_threads_busy = true;
+  env = &kdu_threads_env;
+}
+//-------------------------------------------------------------------------
+
+KduThreadLease::~KduThreadLease() {
+  if (env == nullptr) return;
+  if (pool != nullptr) pool->release(reserved);
+  std::lock_guard<std::mutex> lock(kdu_threads_mutex);
+  if (active) {
+    //
+    // coding has been aborted by an exception, either before or after start(); the state of
+    // the worker threads is unknown, so the group is destroyed and created again on next use
+    //
+    env->handle_exception(KDU_NULL_EXCEPTION);
+    env->destroy();
+    kdu_threads_created = false;
+  }
+  kdu_threads_busy = false;
+}
+//=============================================================================
+
+//
+// Checks the signature of a JPEG2000 file: 0 = no JPEG2000, 1 = raw codestream, 2 = JP2 family file
+//
+static int jpx_signature(const unsigned char *testbuf, size_t n) {
+  static const unsigned char sig0[] = {0xff, 0x52};
+  static const unsigned char sig1[] = {0xff, 0x4f, 0xff, 0x51};
+  static const unsigned char sig2[] = {0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20, 0x0D, 0x0A, 0x87, 0x0A};
+  if ((n >= 12) && (memcmp(sig2, testbuf, 12) == 0)) return 2;
+  if ((n >= 4) && (memcmp(sig1, testbuf, 4) == 0)) return 1;
+  if ((n >= 47) && (memcmp(sig0, testbuf + 45, 2) == 0)) return 1;
+  return 0;
+}
+//=============================================================================
+
 static bool is_jpx(const char *fname) {
   int inf;
   int retval = 0;
   if ((inf = ::open(fname, O_RDONLY)) != -1) {
-    char testbuf[48];
-    char sig0[] = {'\xff', '\x52'};
-    char sig1[] = {'\xff', '\x4f', '\xff', '\x51'};
-    char sig2[] = {'\x00', '\x00', '\x00', '\x0C', '\x6A', '\x50', '\x20', '\x20', '\x0D', '\x0A', '\x87',
-                   '\x0A'};
+    unsigned char testbuf[48];
     auto n = read(inf, testbuf, 48);
-    if ((n >= 47) && (memcmp(sig0, testbuf + 45, 2) == 0)) { retval = 1; }
-    else if ((n >= 4) && (memcmp(sig1, testbuf, 4) == 0)) { retval = 1; }
-    else if ((n >= 12) && (memcmp(sig2, testbuf, 12) == 0)) retval = 1;
+    if ((n > 0) && (jpx_signature(testbuf, n) != 0)) retval = 1;
+    close(inf);
   }
-  close(inf);
   return retval == 1;
 }
 //=============================================================================
 
+void SipiIOJ2k::setNumThreads(int nthreads) {
+  std::lock_guard<std::mutex> lock(kdu_threads_mutex);
+  kdu_num_threads = nthreads;
+}
+//=============================================================================
+
 
 bool SipiIOJ2k::read(SipiImage *img, std::string filepath, int pagenum, std::shared_ptr<SipiRegion> region,
                      std::shared_ptr<SipiSize> size, bool force_bps_8,
                      ScalingQuality scaling_quality) {
   if (!is_jpx(filepath.c_str())) return false; // It's not a JPGE2000....
 
-  int num_threads;
-  if ((num_threads = kdu_get_num_processors()) < 2) num_threads = 0;
-
   // Custom messaging services
   kdu_customize_warnings(&kdu_sipi_warn);
   kdu_customize_errors(&kdu_sipi_error);
@@ -290,8 +411,9 @@ bool SipiIOJ2k::read(SipiImage *img, std::string filepath, int pagenum, std::sha
     palette = jpx_stream.access_palette();
   }
 
+  KduThreadLease threads; // nullptr environment if the shared thread group is busy
   kdu_core::kdu_codestream codestream;
-  codestream.create(input);
+  codestream.create(input, threads.get());
   //codestream.set_fussy(); // Set the parsing error tolerance.
   codestream.set_fast(); // No errors expected in input
 
@@ -340,6 +462,7 @@ bool SipiIOJ2k::read(SipiImage *img, std::string filepath, int pagenum, std::sha
       roi.size.y = sy;
       do_roi = true;
     } catch (Sipi::SipiError &err) {
+      threads.finish(codestream);
       codestream.destroy();
       input->close();
       jpx_in.close(); // Not really necessary here.
@@ -531,55 +654,101 @@ bool SipiIOJ2k::read(SipiImage *img, std::string filepath, int pagenum, std::sha
   // In order to retrieve a 16-Bit image, use kdu_uin16 *buffer an the apropriate signature of the pull_stripe method
   //
   kdu_supp::kdu_stripe_decompressor decompressor;
-  decompressor.start(codestream);
-  int stripe_heights[4] = {dims.size.y, dims.size.y, dims.size.y,
-                           dims.size.y}; // enough for alpha channel (4 components)
-
-  if (force_bps_8) img->bps = 8; // forces kakadu to convert to 8 bit!
-  switch (img->bps) {
-    case 8: {
-      kdu_core::kdu_byte *buffer8 = new kdu_core::kdu_byte[(int) dims.area() * img->nc];
-      decompressor.pull_stripe(buffer8, stripe_heights);
-      img->pixels = (byte *) buffer8;
-      break;
-    }
-    case 12: {
-      std::vector<char> get_signed(img->nc, 0); // vector<bool> does not work -> special treatment in C++
-      kdu_core::kdu_int16 *buffer16 = new kdu_core::kdu_int16[(int) dims.area() * img->nc];
-      decompressor.pull_stripe(buffer16,
-                               stripe_heights,
-                               nullptr,
-                               nullptr,
-                               nullptr,
-                               nullptr,
-                               (bool *) get_signed.data());
-      img->pixels = (byte *) buffer16;
-      img->bps = 16;
-      break;
-    }
-    case 16: {
-      std::vector<char> get_signed(img->nc, 0); // vector<bool> does not work -> special treatment in C++
-      kdu_core::kdu_int16 *buffer16 = new kdu_core::kdu_int16[(int) dims.area() * img->nc];
-      decompressor.pull_stripe(buffer16,
-                               stripe_heights,
-                               nullptr,
-                               nullptr,
-                               nullptr,
-                               nullptr,
-                               (bool *) get_signed.data());
-      img->pixels = (byte *) buffer16;
-      break;
+  decompressor.start(codestream, false, false, threads.start());
+
+  //
+  // If a stripe sink is attached, the image is decoded in stripes of the recommended height
+  // which are handed over to the sink instead of decoding the whole region into one buffer.
+  // Palette and YCbCr images and images which have to be scaled after decoding are decoded
+  // as usual.
+  //
+  bool streaming = false;
+  size_t s_nx = img->nx, s_ny = img->ny, s_nc = img->nc; // the sink may change the header of img
+  size_t s_bps = (force_bps_8 || (img->bps == 8)) ? 8 : 16;
+  if ((img->sink != nullptr) && (rlut == NULL) && (img->photo != YCBCR) && ((size == nullptr) || redonly) &&
+      ((img->bps == 8) || (img->bps == 12) || (img->bps == 16))) {
+    size_t orig_bps = img->bps;
+    img->bps = s_bps;
+    streaming = img->sink->begin(img);
+    if (!streaming) img->bps = orig_bps;
+  }
+
+  if (streaming) {
+    std::vector<int> stripe_heights(s_nc), max_heights(s_nc);
+    decompressor.get_recommended_stripe_heights(8, 256, stripe_heights.data(), max_heights.data());
+    size_t rows = stripe_heights[0];
+    std::vector<kdu_core::kdu_byte> stripe(s_nx * rows * s_nc * s_bps / 8);
+    std::vector<char> get_signed(s_nc, 0); // vector<bool> does not work -> special treatment in C++
+    for (size_t y = 0; y < s_ny; y += rows) {
+      int h = (int) std::min(rows, s_ny - y);
+      std::fill(stripe_heights.begin(), stripe_heights.end(), h);
+      if (s_bps == 8) {
+        decompressor.pull_stripe(stripe.data(), stripe_heights.data());
+      } else {
+        decompressor.pull_stripe((kdu_core::kdu_int16 *) stripe.data(),
+                                 stripe_heights.data(),
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 (bool *) get_signed.data());
+      }
+      img->sink->stripe(img, stripe.data(), h);
     }
-    default: {
-      decompressor.finish();
-      codestream.destroy();
-      input->close();
-      jpx_in.close(); // Not really necessary here.
-      syslog(LOG_ERR, "Unsupported number of bits/sample: %ld !", img->bps);
-      throw SipiImageError(__file__, __LINE__, "Unsupported number of bits/sample!");
+    img->sink->end(img);
+    img->is_streamed = true;
+  } else {
+    int stripe_heights[4] = {dims.size.y, dims.size.y, dims.size.y,
+                             dims.size.y}; // enough for alpha channel (4 components)
+
+    if (force_bps_8) img->bps = 8; // forces kakadu to convert to 8 bit!
+    switch (img->bps) {
+      case 8: {
+        kdu_core::kdu_byte *buffer8 = new kdu_core::kdu_byte[(int) dims.area() * img->nc];
+        decompressor.pull_stripe(buffer8, stripe_heights);
+        img->pixels = (byte *) buffer8;
+        break;
+      }
+      case 12: {
+        std::vector<char> get_signed(img->nc, 0); // vector<bool> does not work -> special treatment in C++
+        kdu_core::kdu_int16 *buffer16 = new kdu_core::kdu_int16[(int) dims.area() * img->nc];
+        decompressor.pull_stripe(buffer16,
+                                 stripe_heights,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 (bool *) get_signed.data());
+        img->pixels = (byte *) buffer16;
+        img->bps = 16;
+        break;
+      }
+      case 16: {
+        std::vector<char> get_signed(img->nc, 0); // vector<bool> does not work -> special treatment in C++
+        kdu_core::kdu_int16 *buffer16 = new kdu_core::kdu_int16[(int) dims.area() * img->nc];
+        decompressor.pull_stripe(buffer16,
+                                 stripe_heights,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 nullptr,
+                                 (bool *) get_signed.data());
+        img->pixels = (byte *) buffer16;
+        break;
+      }
+      default: {
+        decompressor.finish();
+        threads.finish(codestream);
+        codestream.destroy();
+        input->close();
+        jpx_in.close(); // Not really necessary here.
+        syslog(LOG_ERR, "Unsupported number of bits/sample: %ld !", img->bps);
+        throw SipiImageError(__file__, __LINE__, "Unsupported number of bits/sample!");
+      }
     }
   }
   decompressor.finish();
+  threads.finish(codestream);
   codestream.destroy();
   input->close();
   jpx_in.close(); // Not really necessary here.
@@ -700,6 +869,20 @@ SipiImgInfo SipiIOJ2k::getDim(std::string filepath, int pagenum) {
 }
 //=============================================================================
 
+std::string SipiIOJ2k::sniff(const unsigned char *header, size_t len) {
+  switch (jpx_signature(header, len)) {
+    case 1:
+      return "image/x-jp2-codestream";
+    case 2:
+      // the brand of the file type box tells JP2 and JPX apart
+      if ((len >= 24) && (memcmp(header + 20, "jpx ", 4) == 0)) return "image/jpx";
+      return "image/jp2";
+    default:
+      return std::string();
+  }
+}
+//=============================================================================
+
 
 static void write_xmp_box(kdu_supp::jp2_family_tgt *tgt, const char *xmpstr) {
   kdu_supp::jp2_output_box out;
@@ -751,12 +934,8 @@ void SipiIOJ2k::write(SipiImage *img, std::string filepath, const SipiCompressio
   kdu_customize_warnings(&kdu_sipi_warn);
   kdu_customize_errors(&kdu_sipi_error);
 
-  int num_threads;
-
   kdu_membroker membroker;
 
-  if ((num_threads = kdu_get_num_processors()) < 2) num_threads = 0;
-
   try {
     // Construct code-stream object
     siz_params siz;
@@ -827,24 +1006,9 @@ void SipiIOJ2k::write(SipiImage *img, std::string filepath, const SipiCompressio
 
     output = jpx_stream.access_stream();
 
-    kdu_thread_env env;
-    kdu_thread_env *env_ref;
-
-    if (num_threads > 0) {
-      env.create();
-      for (int nt = 1; nt < num_threads; nt++) {
-        if (!env.add_thread()) {
-          num_threads = nt; // Unable to create all the threads requested
-          break;
-        }
-      }
-      env_ref = &env;
-    } else {
-      env_ref = nullptr;
-    }
-
+    KduThreadLease threads; // nullptr environment if the shared thread group is busy
     kdu_codestream codestream;
-    codestream.create(&siz, output, nullptr, 0, 0, env_ref, &membroker);
+    codestream.create(&siz, output, nullptr, 0, 0, threads.get(), &membroker);
 
     // Set up any specific coding parameters and finalize them.
     int num_clayers;
@@ -1199,7 +1363,7 @@ void SipiIOJ2k::write(SipiImage *img, std::string filepath, const SipiCompressio
                      0.0,     // size_tolerance
                      img->nc, // num_components
                      false,   // want_fastest [NO]
-                     env_ref);
+                     threads.start());
 
     //int *stripe_heights = new int[img->nc];
     int stripe_heights[5];
@@ -1239,7 +1403,8 @@ void SipiIOJ2k::write(SipiImage *img, std::string filepath, const SipiCompressio
     } else {
       throw SipiImageError(__file__, __LINE__, "Unsupported number of bits/sample!");
     }
-    compressor.finish(0, NULL, NULL, env_ref);
+    compressor.finish(0, NULL, NULL, threads.get());
+    threads.finish(codestream);
     // Finally, cleanup
     codestream.destroy(); // All done: simple as that.
     output->close(); // Not really necessary here.
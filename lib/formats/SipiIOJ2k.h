@@ -41,6 +41,17 @@ namespace Sipi {
     private:
     public:
         virtual ~SipiIOJ2k() {};
+
+        /*!
+         * Sets the size of the process-wide Kakadu thread group which is shared by all
+         * J2K encoding and decoding calls. Must be called before the first image is processed.
+         *
+         * \param nthreads Number of threads of the group (including the calling thread). If
+         * 0, the size of the shared compute pool (or the number of processors if there is
+         * no pool) is used. A value of 1 disables multithreading.
+         */
+        static void setNumThreads(int nthreads);
+
         /*!
          * Method used to read an image file
          *
@@ -63,6 +74,14 @@ namespace Sipi {
          */
         Sipi::SipiImgInfo getDim(std::string filepath, int pagenum = 0) override;
 
+        /*!
+         * Recognizes JPEG2000 files (JP2/JPX files and raw codestreams) by their signature
+         *
+         * \param[in] header The first bytes of the file
+         * \param[in] len Number of bytes in header
+         */
+        std::string sniff(const unsigned char *header, size_t len) override;
+
         /*!
          * Write a TIFF image to a file, stdout or to a memory buffer
          *
@@ -29,6 +29,7 @@
 #include <fstream>
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
 #include <syslog.h>
 
 #include <fcntl.h>
@@ -269,6 +270,7 @@ namespace Sipi {
         JOCTET *buffer; //!< Buffer for holding data to be written out
         size_t buflen;  //!< length of the buffer
         shttps::Connection *conobj; //!< Pointer to the connection objects
+        bool hold;      //!< if true, the buffer grows instead of being sent (see jpeg_html_release())
     } HtmlBuffer;
 
     /*!
@@ -286,8 +288,19 @@ namespace Sipi {
      */
     static boolean empty_html_buffer(j_compress_ptr cinfo) {
         HtmlBuffer *html_buffer = (HtmlBuffer *) cinfo->client_data;
+        if (html_buffer->hold) {
+            JOCTET *buffer = (JOCTET *) realloc(html_buffer->buffer, 2 * html_buffer->buflen * sizeof(JOCTET));
+            if (buffer == nullptr) {
+                throw JpegError("Couldn't allocate HTTP output buffer");
+            }
+            cinfo->dest->next_output_byte = buffer + html_buffer->buflen;
+            cinfo->dest->free_in_buffer = html_buffer->buflen;
+            html_buffer->buffer = buffer;
+            html_buffer->buflen *= 2;
+            return true;
+        }
         try {
-            html_buffer->conobj->sendAndFlush(html_buffer->buffer, html_buffer->buflen);
+            SipiIO::send(html_buffer->conobj, html_buffer->buffer, html_buffer->buflen);
         } catch (int i) { // an error occurred (possibly a broken pipe)
             throw JpegError("Couldn't write to HTTP socket");
             //return false;
@@ -306,7 +319,7 @@ namespace Sipi {
         HtmlBuffer *html_buffer = (HtmlBuffer *) cinfo->client_data;
         size_t nbytes = cinfo->dest->next_output_byte - html_buffer->buffer;
         try {
-            html_buffer->conobj->sendAndFlush(html_buffer->buffer, nbytes);
+            SipiIO::send(html_buffer->conobj, html_buffer->buffer, nbytes);
         } catch (int i) { // an error occured in sending the data (broken pipe?)
             // do nothing...
         }
@@ -333,6 +346,7 @@ namespace Sipi {
         html_buffer->buffer = (JOCTET *) malloc(buflen * sizeof(JOCTET));
         html_buffer->buflen = buflen;
         html_buffer->conobj = conobj;
+        html_buffer->hold = false;
 
         destmgr = (struct jpeg_destination_mgr *) malloc(sizeof(struct jpeg_destination_mgr));
 
@@ -344,6 +358,16 @@ namespace Sipi {
     }
     //=============================================================================
 
+    /*!
+     * Keeps (hold = true) or releases (hold = false) all data written to the HTTP destination in memory.
+     * While the data is kept, nothing is sent, so the HTTP header can still be changed.
+     */
+    static void jpeg_html_hold(struct jpeg_compress_struct *cinfo, bool hold) {
+        HtmlBuffer *html_buffer = (HtmlBuffer *) cinfo->client_data;
+        if (html_buffer != nullptr) html_buffer->hold = hold;
+    }
+    //=============================================================================
+
     void SipiIOJpeg::parse_photoshop(SipiImage *img, char *data, int length) {
         int slen = 0;
         unsigned int datalen = 0;
@@ -440,21 +464,48 @@ namespace Sipi {
     //=============================================================================
 
 
+    /*!
+    * Returns the smallest numerator of a DCT scaling factor scale_num/8 which still
+    * delivers at least w x h pixels from an image (or region) of img_w x img_h pixels.
+    * libjpeg-turbo then decodes directly to the reduced size.
+    */
+    static unsigned int jpegScaleNum(size_t img_w, size_t img_h, size_t w, size_t h) {
+        unsigned int num = 8;
+        while ((num > 1) && (((img_w * (num - 1) + 7) / 8) >= w) && (((img_h * (num - 1) + 7) / 8) >= h)) {
+            num--;
+        }
+        return num;
+    }
+    //=============================================================================
+
+
     bool SipiIOJpeg::read(SipiImage *img, std::string filepath, int pagenum, std::shared_ptr<SipiRegion> region,
                           std::shared_ptr<SipiSize> size, bool force_bps_8,
                           ScalingQuality scaling_quality)
     {
+        SipiSource source(filepath);
+        if (!source.ok()) return false;
+        return read(img, source, pagenum, region, size, force_bps_8, scaling_quality);
+    }
+    //=============================================================================
+
+    bool SipiIOJpeg::read(SipiImage *img, const SipiSource &source, int pagenum, std::shared_ptr<SipiRegion> region,
+                          std::shared_ptr<SipiSize> size, bool force_bps_8,
+                          ScalingQuality scaling_quality)
+    {
+        const std::string &filepath = source.path();
         int infile;
         //
-        // open the input file
+        // get our own descriptor of the already opened input file
         //
-        if ((infile = ::open(filepath.c_str(), O_RDONLY)) == -1) {
+        if ((infile = source.dup_fd()) == -1) {
             return false;
         }
         // workaround for bug #0011: jpeglib crashes the app when the file is not a jpeg file
         // we check the magic number before calling any jpeglib routines
         unsigned char magic[2];
         if (::read(infile, magic, 2) != 2) {
+            close(infile);
             return false;
         }
         if ((magic[0] != 0xff) || (magic[1] != 0xd8)) {
@@ -526,23 +577,33 @@ namespace Sipi {
             rtype = size->getType();
         }
 
-        if (no_cropping) {
+        //
+        // the region in full resolution pixels. If cropping, only the MCU columns and
+        // rows covering the region are decoded (see jpeg_crop_scanline/jpeg_skip_scanlines below)
+        //
+        int roi_x = 0, roi_y = 0;
+        size_t roi_w = cinfo.image_width, roi_h = cinfo.image_height;
+        try {
+            if (!no_cropping) {
+                region->crop_coords(cinfo.image_width, cinfo.image_height, roi_x, roi_y, roi_w, roi_h);
+            }
             //
-            // here we prepare tha scaling/reduce stuff...
+            // here we prepare the scaling stuff: libjpeg-turbo supports DCT scaling by scale_num/8, thus we
+            // decode to the smallest size which is not smaller than the requested size of the region
             //
-            int reduce = 3; // maximal reduce factor is 3: 1/1, 1/2, 1/4 and 1/8
-            bool redonly = true; // we assume that only a reduce is necessary
+            unsigned int scale_num = 8;
             if ((size != nullptr) && (rtype != SipiSize::FULL)) {
-                size->get_size(cinfo.image_width, cinfo.image_height, nnx, nny, reduce, redonly);
-            }
-            else {
-                reduce = 0;
+                int reduce = no_cropping ? 3 : -1;
+                bool redonly = true;
+                size->get_size(roi_w, roi_h, nnx, nny, reduce, redonly);
+                scale_num = jpegScaleNum(roi_w, roi_h, nnx, nny);
             }
-
-            if (reduce < 0) reduce = 0;
-            cinfo.scale_num = 1;
-            cinfo.scale_denom = 1;
-            for (int i = 0; i < reduce; i++) cinfo.scale_denom *= 2;
+            cinfo.scale_num = scale_num;
+            cinfo.scale_denom = 8;
+        } catch (...) { // invalid region or size
+            jpeg_destroy_decompress(&cinfo);
+            close(infile);
+            throw;
         }
         cinfo.do_fancy_upsampling = false;
 
@@ -658,8 +719,32 @@ namespace Sipi {
             img->icc = std::make_shared<SipiIcc>(icc_buffer, icc_buffer_len);
         }
 
+        //
+        // the region in output (i.e. scaled) pixels
+        //
+        JDIMENSION out_x = 0, out_y = 0;
+        JDIMENSION out_w, out_h;
+        JDIMENSION crop_x, crop_w; // column range actually decoded, aligned to MCU boundaries by libjpeg
         try {
             jpeg_start_decompress(&cinfo);
+
+            out_w = cinfo.output_width;
+            out_h = cinfo.output_height;
+            if (!no_cropping) {
+                size_t num = cinfo.scale_num;
+                out_x = (JDIMENSION) ((roi_x * num) / 8);
+                out_y = (JDIMENSION) ((roi_y * num) / 8);
+                out_w = std::min((JDIMENSION) (((roi_x + roi_w) * num + 7) / 8), cinfo.output_width) - out_x;
+                out_h = std::min((JDIMENSION) (((roi_y + roi_h) * num + 7) / 8), cinfo.output_height) - out_y;
+            }
+            crop_x = out_x;
+            crop_w = out_w;
+            if ((crop_x > 0) || (crop_w < cinfo.output_width)) {
+                jpeg_crop_scanline(&cinfo, &crop_x, &crop_w);
+            }
+            if (out_y > 0) {
+                jpeg_skip_scanlines(&cinfo, out_y);
+            }
         } catch (JpegError &jpgerr) {
             jpeg_destroy_decompress(&cinfo);
             close(infile);
@@ -667,8 +752,8 @@ namespace Sipi {
         }
 
         img->bps = 8;
-        img->nx = cinfo.output_width;
-        img->ny = cinfo.output_height;
+        img->nx = out_w;
+        img->ny = out_h;
         img->nc = cinfo.output_components;
         int colspace = cinfo.out_color_space; // JCS_UNKNOWN, JCS_GRAYSCALE, JCS_RGB, JCS_YCbCr, JCS_CMYK, JCS_YCCK
         switch (colspace) {
@@ -698,15 +783,17 @@ namespace Sipi {
                 throw SipiImageError(__file__, __LINE__, "Unsupported JPEG colorspace!");
             }
         }
-        int sll = cinfo.output_components * cinfo.output_width * sizeof(uint8);
+        int sll = cinfo.output_components * out_w * sizeof(uint8);
+        int decoded_sll = cinfo.output_components * cinfo.output_width * sizeof(uint8); // output_width == crop_w
+        size_t col_offset = cinfo.output_components * (out_x - crop_x);
 
         img->pixels = new byte[img->ny * sll];
 
         try {
-            linbuf = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, sll, 1);
+            linbuf = (*cinfo.mem->alloc_sarray)((j_common_ptr) &cinfo, JPOOL_IMAGE, decoded_sll, 1);
             for (size_t i = 0; i < img->ny; i++) {
                 jpeg_read_scanlines(&cinfo, linbuf, 1);
-                memcpy(&(img->pixels[i * sll]), linbuf[0], (size_t) sll);
+                memcpy(&(img->pixels[i * sll]), linbuf[0] + col_offset, (size_t) sll);
             }
         } catch (JpegError &jpgerr) {
             jpeg_destroy_decompress(&cinfo);
@@ -714,7 +801,11 @@ namespace Sipi {
             throw SipiImageError(__file__, __LINE__, "Error reading JPEG file: \"" + filepath + "\": " + jpgerr.what());
         }
         try {
-            jpeg_finish_decompress(&cinfo);
+            if (cinfo.output_scanline < cinfo.output_height) {
+                jpeg_abort_decompress(&cinfo); // the rows below the region are not needed
+            } else {
+                jpeg_finish_decompress(&cinfo);
+            }
         } catch (JpegError &jpgerr) {
             close(infile);
             throw SipiImageError(__file__, __LINE__, "Error reading JPEG file: \"" + filepath + "\": " + jpgerr.what());
@@ -729,26 +820,8 @@ namespace Sipi {
         }
         close(infile);
 
-
-        //
-        // do some cropping...
-        //
-        if (!no_cropping) { // not no cropping (!!) means "do crop"!
-            //
-            // let's first crop the region (we read the full size image in this case)
-            //
-            (void) img->crop(region);
-
-            //
-            // no we scale the region to the desired size
-            //
-            int reduce = -1;
-            bool redonly;
-            (void) size->get_size(img->nx, img->ny, nnx, nny, reduce, redonly);
-        }
-
         //
-        // resize/Scale the image if necessary
+        // resize/Scale the image if necessary (the region has already been cropped while decoding)
         //
         if ((size != NULL) && (rtype != SipiSize::FULL)) {
             if (rtype != SipiSize::FULL) {
@@ -777,15 +850,26 @@ namespace Sipi {
 
 
     SipiImgInfo SipiIOJpeg::getDim(std::string filepath, int pagenum) {
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            SipiImgInfo info;
+            info.success = SipiImgInfo::FAILURE;
+            return info;
+        }
+        return getDim(source, pagenum);
+    }
+    //=============================================================================
+
+    SipiImgInfo SipiIOJpeg::getDim(const SipiSource &source, int pagenum) {
         // portions derived from IJG code */
 
         FILE *infile;
         SipiImgInfo info;
 
         //
-        // open the input file
+        // get a stream on the already opened input file
         //
-        if ((infile = fopen(filepath.c_str(), "rb")) == nullptr) {
+        if ((infile = source.dup_file()) == nullptr) {
             // inlock.unlock();
             info.success = SipiImgInfo::FAILURE;
             return info;
@@ -899,9 +983,48 @@ namespace Sipi {
     }
     //============================================================================
 
+    std::string SipiIOJpeg::sniff(const unsigned char *header, size_t len) {
+        if ((len >= 3) && (header[0] == 0xff) && (header[1] == 0xd8) && (header[2] == 0xff)) {
+            return "image/jpeg";
+        }
+        return std::string();
+    }
+    //============================================================================
 
-    void SipiIOJpeg::write(SipiImage *img, std::string filepath, const SipiCompressionParams *params) {
-        int quality = 80;
+
+
+    /*!
+     * Local class which encodes a JPEG image stripe by stripe. SipiIOJpeg::write() passes the
+     * whole image as one stripe, SipiIOJpeg::stripeWriter() hands it out to stream images.
+     * When writing to HTTP, nothing is sent before the first stripe, so that the HTTP header
+     * can still be set after begin() has succeeded.
+     */
+    class SipiJpegStripeWriter : public SipiStripeSink {
+    private:
+        std::string filepath;
+        int quality;
+        bool progressive; //!< progressive JPEGs are buffered completely within libjpeg
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr jerr;
+        bool created;
+        int outfile;
+    public:
+        SipiJpegStripeWriter(const std::string &filepath_p, const SipiCompressionParams *params, bool progressive_p);
+
+        ~SipiJpegStripeWriter();
+
+        bool begin(SipiImage *img) override;
+
+        void stripe(SipiImage *img, unsigned char *buf, size_t nrows) override;
+
+        void end(SipiImage *img) override;
+    };
+    //============================================================================
+
+    SipiJpegStripeWriter::SipiJpegStripeWriter(const std::string &filepath_p, const SipiCompressionParams *params,
+                                               bool progressive_p) : filepath(filepath_p), quality(80),
+                                                                     progressive(progressive_p), created(false),
+                                                                     outfile(-1) {
         if ((params != nullptr) && (!params->empty())) {
             try {
                 quality = stoi(params->at(JPEG_QUALITY));
@@ -916,36 +1039,35 @@ namespace Sipi {
                 throw SipiImageError(__file__, __LINE__, "JPEG quality argument must be integer between 0 and 100");
             }
         }
+    }
+    //============================================================================
 
-        if (img->bps == 16) img->to8bps();
+    SipiJpegStripeWriter::~SipiJpegStripeWriter() {
+        if (created) jpeg_destroy_compress(&cinfo);
+        if (outfile != -1) close(outfile);
+    }
+    //============================================================================
 
-        //
-        // we have to check if the image has an alpha channel (not supported by JPEG). If
-        // so, we remove it!
-        //
-        if ((img->getNc() > 3) && (img->getNalpha() > 0)) { // we have an alpha channel....
-            for (size_t i = 3; i < (img->getNalpha() + 3); i++) img->removeChan(i);
+    bool SipiJpegStripeWriter::begin(SipiImage *img) {
+        if (img->bps != 8) {
+            throw SipiImageError(__file__, __LINE__, "JPEG requires 8 bits/sample (bps = " + std::to_string(img->bps) + ")!");
         }
 
-        struct jpeg_compress_struct cinfo;
-        struct jpeg_error_mgr jerr;
-
         cinfo.err = jpeg_std_error(&jerr);
         jerr.error_exit = jpegErrorExit;
 
-        int outfile = -1;        /* target file */
-        JSAMPROW row_pointer[1];    /* pointer to JSAMPLE row[s] */
-        int row_stride;        /* physical row width in image buffer */
-
         try {
             jpeg_create_compress(&cinfo);
         } catch (JpegError &jpgerr) {
             jpeg_destroy_compress(&cinfo);
             throw SipiImageError(__file__, __LINE__, jpgerr.what());
         }
+        created = true;
+
         if (filepath == "HTTP") { // we are transmitting the data through the webserver
             shttps::Connection *conobj = img->connection();
             jpeg_html_dest(&cinfo, conobj);
+            jpeg_html_hold(&cinfo, true); // nothing is sent before the first stripe
         } else {
             if (filepath == "stdout:") {
                 jpeg_stdio_dest(&cinfo, stdout);
@@ -999,30 +1121,20 @@ namespace Sipi {
                 cinfo.jpeg_color_space = JCS_YCbCr;
                 break;
             }
-            case CIELAB: {
-                img->convertToIcc(Sipi::icc_sRGB, 8);
-                cinfo.in_color_space = JCS_RGB;
-                cinfo.jpeg_color_space = JCS_RGB;
-                break;
-            }
             default: {
                 throw SipiImageError(__file__, __LINE__, "Unsupported JPEG colorspace: " + std::to_string(img->photo));
             }
         }
-        cinfo.progressive_mode = TRUE;
+        cinfo.progressive_mode = progressive ? TRUE : FALSE;
         cinfo.write_Adobe_marker = TRUE;
         cinfo.write_JFIF_header = TRUE;
         try {
             jpeg_set_defaults(&cinfo);
             jpeg_set_quality(&cinfo, quality, TRUE /* TRUE, then limit to baseline-JPEG values */);
 
-            jpeg_simple_progression(&cinfo);
+            if (progressive) jpeg_simple_progression(&cinfo);
             jpeg_start_compress(&cinfo, TRUE);
         } catch (JpegError &jpgerr) {
-            jpeg_finish_compress(&cinfo);
-            jpeg_destroy_compress(&cinfo);
-            if (outfile != -1) close(outfile);
-            //outlock.unlock();
             throw SipiImageError(__file__, __LINE__, jpgerr.what());
         }
 
@@ -1047,9 +1159,6 @@ namespace Sipi {
                 try {
                     jpeg_write_marker(&cinfo, JPEG_APP0 + 1, (JOCTET *) exifchunk.get(), start_l + buf.size());
                 } catch (JpegError &jpgerr) {
-                    jpeg_finish_compress(&cinfo);
-                    jpeg_destroy_compress(&cinfo);
-                    if (outfile != -1) close(outfile);
                     throw SipiImageError(__file__, __LINE__, jpgerr.what());
                 }
             } else {
@@ -1069,9 +1178,6 @@ namespace Sipi {
                 try {
                     jpeg_write_marker(&cinfo, JPEG_APP0 + 1, (JOCTET *) xmpchunk.get(), start_l + buf.size());
                 } catch (JpegError &jpgerr) {
-                    jpeg_finish_compress(&cinfo);
-                    jpeg_destroy_compress(&cinfo);
-                    if (outfile != -1) close(outfile);
                     throw SipiImageError(__file__, __LINE__, jpgerr.what());
                 }
             } else {
@@ -1111,9 +1217,6 @@ namespace Sipi {
                 try {
                     jpeg_write_marker(&cinfo, ICC_MARKER, iccchunk.get(), n_nextwrite + start_l);
                 } catch (JpegError &jpgerr) {
-                    jpeg_finish_compress(&cinfo);
-                    jpeg_destroy_compress(&cinfo);
-                    if (outfile != -1) close(outfile);
                     throw SipiImageError(__file__, __LINE__, jpgerr.what());
                 }
 
@@ -1144,8 +1247,6 @@ namespace Sipi {
                 try {
                     jpeg_write_marker(&cinfo, JPEG_APP0 + 13, (JOCTET *) iptcchunk.get(), start_l + buf.size());
                 } catch (JpegError &jpgerr) {
-                    jpeg_destroy_compress(&cinfo);
-                    if (outfile != -1) close(outfile);
                     throw SipiImageError(__file__, __LINE__, jpgerr.what());
                 }
             }
@@ -1163,39 +1264,76 @@ namespace Sipi {
                 sipi_buf[512] = '\0';
                 jpeg_write_marker(&cinfo, JPEG_COM, (JOCTET *) sipi_buf, len);
             } catch (JpegError &jpgerr) {
-                jpeg_destroy_compress(&cinfo);
-                if (outfile != -1) close(outfile);
                 throw SipiImageError(__file__, __LINE__, jpgerr.what());
             }
         }
 
-        row_stride = img->nx * img->nc;    /* JSAMPLEs per row in image_buffer */
+        return true;
+    }
+    //============================================================================
+
+    void SipiJpegStripeWriter::stripe(SipiImage *img, unsigned char *buf, size_t nrows) {
+        if (filepath == "HTTP") jpeg_html_hold(&cinfo, false);
+        size_t row_stride = img->nx * img->nc;    /* JSAMPLEs per row in image_buffer */
+        std::vector<JSAMPROW> row_pointers(nrows);
+        for (size_t i = 0; i < nrows; i++) {
+            row_pointers[i] = buf + i * row_stride;
+        }
 
         try {
-            while (cinfo.next_scanline < cinfo.image_height) {
-                // jpeg_write_scanlines expects an array of pointers to scanlines.
-                // Here the array is only one element long, but you could pass
-                // more than one scanline at a time if that's more convenient.
-                row_pointer[0] = &img->pixels[cinfo.next_scanline * row_stride];
-                (void) jpeg_write_scanlines(&cinfo, row_pointer, 1);
+            size_t written = 0;
+            while (written < nrows) {
+                written += jpeg_write_scanlines(&cinfo, row_pointers.data() + written, nrows - written);
             }
         } catch (JpegError &jpgerr) {
-            jpeg_destroy_compress(&cinfo);
-            if (outfile != -1) close(outfile);
             throw SipiImageError(__file__, __LINE__, jpgerr.what());
         }
+    }
+    //============================================================================
 
+    void SipiJpegStripeWriter::end(SipiImage *img) {
+        if (filepath == "HTTP") jpeg_html_hold(&cinfo, false);
         try {
             jpeg_finish_compress(&cinfo);
         } catch (JpegError &jpgerr) {
-            jpeg_destroy_compress(&cinfo);
-            if (outfile != -1) close(outfile);
             throw SipiImageError(__file__, __LINE__, jpgerr.what());
         }
-        if (outfile != -1) close(outfile);
+        if (outfile != -1) {
+            close(outfile);
+            outfile = -1;
+        }
 
         jpeg_destroy_compress(&cinfo);
+        created = false;
+    }
+    //============================================================================
+
+    void SipiIOJpeg::write(SipiImage *img, std::string filepath, const SipiCompressionParams *params) {
+        SipiJpegStripeWriter writer(filepath, params, true);
+
+        if (img->bps == 16) img->to8bps();
+
+        //
+        // we have to check if the image has an alpha channel (not supported by JPEG). If
+        // so, we remove it!
+        //
+        if ((img->getNc() > 3) && (img->getNalpha() > 0)) { // we have an alpha channel....
+            for (size_t i = 3; i < (img->getNalpha() + 3); i++) img->removeChan(i);
+        }
+
+        if (img->photo == CIELAB) {
+            img->convertToIcc(Sipi::icc_sRGB, 8);
+        }
+
+        writer.begin(img);
+        writer.stripe(img, img->pixels, img->ny);
+        writer.end(img);
+    }
+    //============================================================================
 
+    std::shared_ptr<SipiStripeSink> SipiIOJpeg::stripeWriter(const std::string &filepath,
+                                                             const SipiCompressionParams *params) {
+        return std::make_shared<SipiJpegStripeWriter>(filepath, params, false);
     }
 
 } // namespace
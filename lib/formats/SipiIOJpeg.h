@@ -62,6 +62,31 @@ namespace Sipi {
          */
         Sipi::SipiImgInfo getDim(std::string filepath, int pagenum = 0) override;
 
+        /*!
+         * Method used to read an image from an already opened file
+         *
+         * \param *img Pointer to SipiImage instance
+         * \param source The opened image file
+         */
+        bool read(SipiImage *img, const SipiSource &source, int pagenum = 0, std::shared_ptr<SipiRegion> region = nullptr,
+                  std::shared_ptr<SipiSize> size = nullptr, bool force_bps_8 = false,
+                  ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH}) override;
+
+        /*!
+         * Get the dimension of the image from an already opened file
+         *
+         * \param[in] source The opened image file
+         */
+        Sipi::SipiImgInfo getDim(const SipiSource &source, int pagenum = 0) override;
+
+        /*!
+         * Recognizes JPEG files by their SOI marker
+         *
+         * \param[in] header The first bytes of the file
+         * \param[in] len Number of bytes in header
+         */
+        std::string sniff(const unsigned char *header, size_t len) override;
+
 
         /*!
          * Write a JPEG image to a file, stdout or to a memory buffer
@@ -71,6 +96,15 @@ namespace Sipi {
          */
         void write(SipiImage *img, std::string filepath, const SipiCompressionParams *params = nullptr) override;
 
+        /*!
+         * Returns a sink writing a baseline JPEG stripe by stripe (progressive JPEGs
+         * would have to be buffered completely)
+         *
+         * \param filepath Name of the image file to be written.
+         */
+        std::shared_ptr<SipiStripeSink> stripeWriter(const std::string &filepath,
+                                                     const SipiCompressionParams *params = nullptr) override;
+
     };
 
 }
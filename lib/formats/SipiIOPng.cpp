@@ -134,15 +134,26 @@ namespace Sipi {
                          std::shared_ptr<SipiSize> size, bool force_bps_8,
                          ScalingQuality scaling_quality)
     {
+        SipiSource source(filepath);
+        if (!source.ok()) return false;
+        return read(img, source, pagenum, region, size, force_bps_8, scaling_quality);
+    }
+    //=============================================
+
+    bool SipiIOPng::read(SipiImage *img, const SipiSource &source, int pagenum, std::shared_ptr<SipiRegion> region,
+                         std::shared_ptr<SipiSize> size, bool force_bps_8,
+                         ScalingQuality scaling_quality)
+    {
+        const std::string &filepath = source.path();
         FILE *infile;
         unsigned char header[8];
         png_structp png_ptr;
         png_infop info_ptr;
         png_infop end_info;
         //
-        // open the input file
+        // get a stream on the already opened input file
         //
-        if ((infile = fopen(filepath.c_str(), "rb")) == nullptr) {
+        if ((infile = source.dup_file()) == nullptr) {
             return FALSE;
         }
 
@@ -338,14 +349,26 @@ namespace Sipi {
 
 
     SipiImgInfo SipiIOPng::getDim(std::string filepath, int pagenum) {
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            SipiImgInfo info;
+            info.success = SipiImgInfo::FAILURE;
+            return info;
+        }
+        return getDim(source, pagenum);
+    }
+    //=============================================
+
+    SipiImgInfo SipiIOPng::getDim(const SipiSource &source, int pagenum) {
+        const std::string &filepath = source.path();
         FILE *infile;
         SipiImgInfo info;
         unsigned char header[8];
 
         //
-        // open the input file
+        // get a stream on the already opened input file
         //
-        if ((infile = fopen(filepath.c_str(), "rb")) == nullptr) {
+        if ((infile = source.dup_file()) == nullptr) {
             info.success = SipiImgInfo::FAILURE;
             return info;
         }
@@ -389,6 +412,15 @@ namespace Sipi {
     }
     /*==========================================================================*/
 
+    std::string SipiIOPng::sniff(const unsigned char *header, size_t len) {
+        if ((len >= 8) && (png_sig_cmp(const_cast<png_bytep>(header), 0, 8) == 0)) {
+            return "image/png";
+        }
+        return std::string();
+    }
+    /*==========================================================================*/
+
+
 
     void create_text_chunk(PngTextPtr *png_textptr, char *key, char *str, unsigned int len) {
         png_text *chunk = png_textptr->next();
@@ -407,7 +439,7 @@ namespace Sipi {
         shttps::Connection *conn = (shttps::Connection *) png_get_io_ptr(png_ptr);
 
         try {
-            conn->sendAndFlush(data, length);
+            SipiIO::send(conn, data, length);
         } catch (int i) {
             // TODO: do nothing ??
         }
@@ -56,6 +56,31 @@ namespace Sipi {
          */
         Sipi::SipiImgInfo getDim(std::string filepath, int pagenum = 0) override;
 
+        /*!
+         * Method used to read an image from an already opened file
+         *
+         * \param *img Pointer to SipiImage instance
+         * \param source The opened image file
+         */
+        bool read(SipiImage *img, const SipiSource &source, int pagenum = 0, std::shared_ptr<SipiRegion> region = nullptr,
+                  std::shared_ptr<SipiSize> size = nullptr, bool force_bps_8 = true,
+                  ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH}) override;
+
+        /*!
+         * Get the dimension of the image from an already opened file
+         *
+         * \param[in] source The opened image file
+         */
+        Sipi::SipiImgInfo getDim(const SipiSource &source, int pagenum = 0) override;
+
+        /*!
+         * Recognizes PNG files by their signature
+         *
+         * \param[in] header The first bytes of the file
+         * \param[in] len Number of bytes in header
+         */
+        std::string sniff(const unsigned char *header, size_t len) override;
+
 
         /*!
          * Write a PNG image to a file, stdout or to a memory buffer
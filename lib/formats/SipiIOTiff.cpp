@@ -30,9 +30,13 @@
 #include <fstream>
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "shttps/Connection.h"
 #include "SipiError.h"
@@ -446,9 +450,234 @@ namespace Sipi {
     bool SipiIOTiff::read(SipiImage *img, std::string filepath, int pagenum, std::shared_ptr<SipiRegion> region,
                           std::shared_ptr<SipiSize> size, bool force_bps_8,
                           ScalingQuality scaling_quality) {
+        SipiSource source(filepath);
+        if (!source.ok()) return false;
+        return read(img, source, pagenum, region, size, force_bps_8, scaling_quality);
+    }
+    //============================================================================
+
+    /*!
+     * Opens a TIFF handle on a private duplicate of the source's file descriptor;
+     * libtiff takes ownership of the descriptor and closes it in TIFFClose.
+     */
+    static TIFF *tiff_open_source(const SipiSource &source) {
+        int fd = source.dup_fd();
+        if (fd < 0) return nullptr;
+        TIFF *tif = TIFFFdOpen(fd, source.path().c_str(), "r");
+        if (tif == nullptr) ::close(fd);
+        return tif;
+    }
+    //============================================================================
+
+    /*!
+     * A reduced resolution level of a pyramidal TIFF. The levels are either SubIFDs of the
+     * main image or the top level directories following it which are marked as FILETYPE_REDUCEDIMAGE.
+     */
+    struct TiffLevel {
+        uint32 width;
+        uint32 height;
+        tdir_t dirnum; //!< number of the top level directory (of the main image for SubIFDs)
+        toff_t subifd; //!< offset of the SubIFD, 0 for top level directories
+    };
+
+    /*!
+     * Collects the reduced resolution levels of the current directory which have the same pixel
+     * layout as the main image. The current directory is restored before returning.
+     *
+     * \returns The levels, the largest first
+     */
+    static std::vector<TiffLevel> tiff_reduced_levels(TIFF *tif) {
+        std::vector<TiffLevel> levels;
+        uint16 spp, bps, photo;
+        TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &spp, 1);
+        TIFF_GET_FIELD (tif, TIFFTAG_BITSPERSAMPLE, &bps, 1);
+        TIFF_GET_FIELD (tif, TIFFTAG_PHOTOMETRIC, &photo, PHOTOMETRIC_MINISBLACK);
+        tdir_t maindir = TIFFCurrentDirectory(tif);
+
+        std::vector<toff_t> subifds;
+        uint16 nsubifds;
+        toff_t *subifd_offsets;
+        if (TIFFGetField(tif, TIFFTAG_SUBIFD, &nsubifds, &subifd_offsets) == 1) {
+            subifds.assign(subifd_offsets, subifd_offsets + nsubifds); // the array is freed on directory change
+        }
+
+        auto add_level = [&](tdir_t dirnum, toff_t subifd) {
+            uint32 width, height;
+            uint16 lspp, lbps, lphoto;
+            if ((TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) == 0) ||
+                (TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height) == 0)) {
+                return;
+            }
+            TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &lspp, 1);
+            TIFF_GET_FIELD (tif, TIFFTAG_BITSPERSAMPLE, &lbps, 1);
+            TIFF_GET_FIELD (tif, TIFFTAG_PHOTOMETRIC, &lphoto, PHOTOMETRIC_MINISBLACK);
+            if ((lspp == spp) && (lbps == bps) && (lphoto == photo)) {
+                levels.push_back({width, height, dirnum, subifd});
+            }
+        };
+
+        //
+        // the reduced images directly following the main image (the next full resolution
+        // directory is the next page of a multipage TIFF)
+        //
+        while (TIFFReadDirectory(tif)) {
+            uint32 subfiletype;
+            TIFF_GET_FIELD (tif, TIFFTAG_SUBFILETYPE, &subfiletype, 0);
+            if ((subfiletype & FILETYPE_REDUCEDIMAGE) == 0) break;
+            add_level(TIFFCurrentDirectory(tif), 0);
+        }
+        for (auto offset : subifds) {
+            if (TIFFSetSubDirectory(tif, offset)) add_level(maindir, offset);
+        }
+        TIFFSetDirectory(tif, maindir);
+
+        std::sort(levels.begin(), levels.end(), [](const TiffLevel &a, const TiffLevel &b) { return a.width > b.width; });
+        return levels;
+    }
+    //============================================================================
+
+    /*!
+     * Counts the pages of a multipage TIFF. The reduced resolution images of a pyramid which are
+     * stored as top level directories (FILETYPE_REDUCEDIMAGE) are not pages. The current directory
+     * is restored before returning.
+     */
+    static int tiff_count_pages(TIFF *tif) {
+        tdir_t curdir = TIFFCurrentDirectory(tif);
+        int npages = 0;
+        if (TIFFSetDirectory(tif, 0)) {
+            do {
+                uint32 subfiletype;
+                TIFF_GET_FIELD (tif, TIFFTAG_SUBFILETYPE, &subfiletype, 0);
+                if ((subfiletype & FILETYPE_REDUCEDIMAGE) == 0) npages++;
+            } while (TIFFReadDirectory(tif));
+        }
+        TIFFSetDirectory(tif, curdir);
+        return npages;
+    }
+    //============================================================================
+
+    /*!
+     * Makes the full resolution directory of a page the current directory. Has to be called
+     * directly after opening the file.
+     *
+     * \param[in] pagenum Number of the page, starting with 1 (0 is the first page, too)
+     * \returns false, if the file has not that many pages
+     */
+    static bool tiff_set_page(TIFF *tif, int pagenum) {
+        int page = 1;
+        while (page < pagenum) {
+            if (!TIFFReadDirectory(tif)) return false;
+            uint32 subfiletype;
+            TIFF_GET_FIELD (tif, TIFFTAG_SUBFILETYPE, &subfiletype, 0);
+            if ((subfiletype & FILETYPE_REDUCEDIMAGE) == 0) page++;
+        }
+        return true;
+    }
+    //============================================================================
+
+    /*!
+     * Switches to the smallest reduced resolution level which still delivers at least nnx x nny
+     * pixels for the region. The image dimensions and the region are converted to the level.
+     *
+     * \returns true, if a reduced resolution level has been selected
+     */
+    static bool tiff_select_level(TIFF *tif, size_t &nx, size_t &ny, int &roi_x, int &roi_y, size_t &roi_w,
+                                  size_t &roi_h, size_t nnx, size_t nny) {
+        if ((nnx >= roi_w) || (nny >= roi_h)) return false;
+        tdir_t maindir = TIFFCurrentDirectory(tif);
+        std::vector<TiffLevel> levels = tiff_reduced_levels(tif);
+        for (auto level = levels.rbegin(); level != levels.rend(); ++level) {
+            uint64 lx = (uint64) roi_x * level->width / nx;
+            uint64 ly = (uint64) roi_y * level->height / ny;
+            uint64 lx_end = std::min<uint64>(((uint64) (roi_x + roi_w) * level->width + nx - 1) / nx, level->width);
+            uint64 ly_end = std::min<uint64>(((uint64) (roi_y + roi_h) * level->height + ny - 1) / ny, level->height);
+            if (((lx_end - lx) < nnx) || ((ly_end - ly) < nny)) continue;
+
+            bool ok = (level->subifd != 0) ? TIFFSetSubDirectory(tif, level->subifd) : TIFFSetDirectory(tif, level->dirnum);
+            if (!ok) {
+                TIFFSetDirectory(tif, maindir);
+                return false;
+            }
+            nx = level->width;
+            ny = level->height;
+            roi_x = (int) lx;
+            roi_y = (int) ly;
+            roi_w = (size_t) (lx_end - lx);
+            roi_h = (size_t) (ly_end - ly);
+            return true;
+        }
+        return false;
+    }
+    //============================================================================
+
+    /*!
+     * JPEG compressed YCbCr TIFFs (e.g. most pyramidal TIFFs) are converted to RGB by the
+     * JPEG codec of libtiff. Has to be called again after each change of the directory.
+     *
+     * \returns true, if the image data will be delivered as RGB
+     */
+    static bool tiff_jpeg_to_rgb(TIFF *tif) {
+        uint16 compression, photo;
+        TIFF_GET_FIELD (tif, TIFFTAG_COMPRESSION, &compression, COMPRESSION_NONE);
+        TIFF_GET_FIELD (tif, TIFFTAG_PHOTOMETRIC, &photo, PHOTOMETRIC_MINISBLACK);
+        if ((compression == COMPRESSION_JPEG) && (photo == PHOTOMETRIC_YCBCR)) {
+            TIFFSetField(tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+            return true;
+        }
+        return false;
+    }
+    //============================================================================
+
+    /*!
+     * Reads a region of a tiled TIFF. Only the tiles intersecting the region are decoded.
+     * For PLANARCONFIG_CONTIG the result is interleaved, for PLANARCONFIG_SEPARATE it
+     * consists of nc planes of w x h samples.
+     *
+     * \param[in] ps Bytes per sample
+     * \returns Buffer allocated with new[] or nullptr, if a tile could not be read
+     */
+    static uint8 *tiff_read_tiled_region(TIFF *tif, uint32 x, uint32 y, uint32 w, uint32 h, uint32 nc, uint32 ps,
+                                         uint16 planar) {
+        uint32 tw, th;
+        TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tw, 0);
+        TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &th, 0);
+        if ((tw == 0) || (th == 0)) return nullptr;
+
+        uint32 nplanes = (planar == PLANARCONFIG_SEPARATE) ? nc : 1;
+        size_t pixsize = (planar == PLANARCONFIG_SEPARATE) ? ps : ps * nc; // bytes per pixel in a plane
+        size_t row_bytes = w * pixsize;
+        size_t plane_bytes = row_bytes * h;
+
+        std::unique_ptr<uint8[]> tilebuf(new uint8[TIFFTileSize(tif)]);
+        uint8 *buf = new uint8[plane_bytes * nplanes];
+
+        for (uint32 plane = 0; plane < nplanes; plane++) {
+            for (uint32 ty = (y / th) * th; ty < y + h; ty += th) {
+                for (uint32 tx = (x / tw) * tw; tx < x + w; tx += tw) {
+                    if (TIFFReadTile(tif, tilebuf.get(), tx, ty, 0, plane) == -1) {
+                        delete[] buf;
+                        return nullptr;
+                    }
+                    uint32 x0 = std::max(x, tx), x1 = std::min(x + w, tx + tw);
+                    uint32 y0 = std::max(y, ty), y1 = std::min(y + h, ty + th);
+                    for (uint32 yy = y0; yy < y1; yy++) {
+                        memcpy(buf + plane * plane_bytes + (yy - y) * row_bytes + (x0 - x) * pixsize,
+                               tilebuf.get() + ((size_t) (yy - ty) * tw + (x0 - tx)) * pixsize, (x1 - x0) * pixsize);
+                    }
+                }
+            }
+        }
+        return buf;
+    }
+    //============================================================================
+
+    bool SipiIOTiff::read(SipiImage *img, const SipiSource &source, int pagenum, std::shared_ptr<SipiRegion> region,
+                          std::shared_ptr<SipiSize> size, bool force_bps_8,
+                          ScalingQuality scaling_quality) {
+        const std::string &filepath = source.path();
         TIFF *tif;
 
-        if (nullptr != (tif = TIFFOpen(filepath.c_str(), "r"))) {
+        if (nullptr != (tif = tiff_open_source(source))) {
             TIFFSetErrorHandler(tiffError);
             TIFFSetWarningHandler(tiffWarning);
 
@@ -459,6 +688,12 @@ namespace Sipi {
 
             (void) TIFFSetWarningHandler(nullptr);
 
+            if (!tiff_set_page(tif, pagenum)) {
+                TIFFClose(tif);
+                std::string msg = "Page " + std::to_string(pagenum) + " not found: " + filepath;
+                throw Sipi::SipiImageError(__file__, __LINE__, msg);
+            }
+
             if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &(img->nx)) == 0) {
                 TIFFClose(tif);
                 std::string msg = "TIFFGetField of TIFFTAG_IMAGEWIDTH failed: " + filepath;
@@ -471,7 +706,6 @@ namespace Sipi {
                 throw Sipi::SipiImageError(__file__, __LINE__, msg);
             }
 
-            unsigned int sll = (unsigned int) TIFFScanlineSize(tif);
             TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &stmp, 1);
             img->nc = (int) stmp;
 
@@ -721,7 +955,58 @@ namespace Sipi {
                 img->essential_metadata(se);
             }
 
-            if ((region == nullptr) || (region->getType() == SipiRegion::FULL)) {
+            //
+            // the region in full resolution pixels and the size of the result. The size is determined
+            // here, since the pixels may be read from a reduced resolution level of a pyramidal TIFF
+            //
+            int roi_x = 0, roi_y = 0;
+            size_t roi_w = img->nx, roi_h = img->ny;
+            size_t nnx = roi_w, nny = roi_h;
+            bool do_scale = false;
+            try {
+                if ((region != nullptr) && (region->getType() != SipiRegion::FULL)) {
+                    region->crop_coords(img->nx, img->ny, roi_x, roi_y, roi_w, roi_h);
+                }
+                if (size != nullptr) {
+                    int reduce = -1;
+                    bool redonly;
+                    do_scale = (size->get_size(roi_w, roi_h, nnx, nny, reduce, redonly) != SipiSize::FULL);
+                }
+            } catch (...) { // invalid region or size
+                TIFFClose(tif);
+                throw;
+            }
+
+            //
+            // if the image has reduced resolution levels, we read from the smallest level which still
+            // delivers at least the requested size (like the reduce factor for JPEG2000)
+            //
+            if (do_scale && tiff_select_level(tif, img->nx, img->ny, roi_x, roi_y, roi_w, roi_h, nnx, nny)) {
+                TIFF_GET_FIELD (tif, TIFFTAG_PLANARCONFIG, &planar, PLANARCONFIG_CONTIG);
+            }
+            if (tiff_jpeg_to_rgb(tif)) img->photo = RGB;
+            unsigned int sll = (unsigned int) TIFFScanlineSize(tif);
+
+            if (TIFFIsTiled(tif)) {
+                if ((img->bps != 8) && (img->bps != 16)) {
+                    TIFFClose(tif);
+                    std::string msg = "Tiled images with " + std::to_string(img->bps) + " bits/sample not supported in file " + filepath;
+                    throw Sipi::SipiImageError(__file__, __LINE__, msg);
+                }
+                int ps = img->bps / 8;
+                uint8 *inbuf = tiff_read_tiled_region(tif, roi_x, roi_y, roi_w, roi_h, img->nc, ps, planar);
+                if (inbuf == nullptr) {
+                    TIFFClose(tif);
+                    std::string msg = "TIFFReadTile failed in file " + filepath;
+                    throw Sipi::SipiImageError(__file__, __LINE__, msg);
+                }
+                img->nx = roi_w;
+                img->ny = roi_h;
+                img->pixels = inbuf;
+                if (planar == PLANARCONFIG_SEPARATE) {
+                    separateToContig(img, roi_w * ps); // convert to RGBRGBRGB...
+                }
+            } else if ((roi_x == 0) && (roi_y == 0) && (roi_w == img->nx) && (roi_h == img->ny)) {
                 if (planar == PLANARCONFIG_CONTIG) {
                     uint32 i;
                     uint8 *dataptr = new uint8[img->ny * sll];
@@ -761,9 +1046,6 @@ namespace Sipi {
                     separateToContig(img, sll); // convert to RGBRGBRGB...
                 }
             } else {
-                int roi_x, roi_y;
-                size_t roi_w, roi_h;
-                region->crop_coords(img->nx, img->ny, roi_x, roi_y, roi_w, roi_h);
                 int ps; // pixel size in bytes
 
                 switch (img->bps) {
@@ -980,19 +1262,13 @@ namespace Sipi {
             //
             // resize/Scale the image if necessary
             //
-            if (size != NULL) {
-                size_t nnx, nny;
-                int reduce = -1;
-                bool redonly;
-                SipiSize::SizeType rtype = size->get_size(img->nx, img->ny, nnx, nny, reduce, redonly);
-                if (rtype != SipiSize::FULL) {
-                    switch (scaling_quality.jpeg) {
-                        case HIGH: img->scale(nnx, nny);
-                            break;
-                        case MEDIUM: img->scaleMedium(nnx, nny);
-                            break;
-                        case LOW: img->scaleFast(nnx, nny);
-                    }
+            if (do_scale) {
+                switch (scaling_quality.jpeg) {
+                    case HIGH: img->scale(nnx, nny);
+                        break;
+                    case MEDIUM: img->scaleMedium(nnx, nny);
+                        break;
+                    case LOW: img->scaleFast(nnx, nny);
                 }
             }
             if (force_bps_8) {
@@ -1008,13 +1284,30 @@ namespace Sipi {
 
 
     SipiImgInfo SipiIOTiff::getDim(std::string filepath, int pagenum) {
+        SipiSource source(filepath);
+        if (!source.ok()) {
+            SipiImgInfo info;
+            info.success = SipiImgInfo::FAILURE;
+            return info;
+        }
+        return getDim(source, pagenum);
+    }
+    //============================================================================
+
+    SipiImgInfo SipiIOTiff::getDim(const SipiSource &source, int pagenum) {
+        const std::string &filepath = source.path();
         TIFF *tif;
         SipiImgInfo info;
-        if (nullptr != (tif = TIFFOpen(filepath.c_str(), "r"))) {
+        if (nullptr != (tif = tiff_open_source(source))) {
             //
             // OK, it's a TIFF file
             //
             (void) TIFFSetWarningHandler(nullptr);
+            if (!tiff_set_page(tif, pagenum)) {
+                TIFFClose(tif);
+                std::string msg = "Page " + std::to_string(pagenum) + " not found: " + filepath;
+                throw Sipi::SipiImageError(__file__, __LINE__, msg);
+            }
             unsigned int tmp_width;
 
             if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &tmp_width) == 0) {
@@ -1034,6 +1327,22 @@ namespace Sipi {
             info.height = tmp_height;
             info.success = SipiImgInfo::DIMS;
 
+            //
+            // tiled pyramidal TIFFs are announced like JPEG2000 files: the tile size and the number of
+            // resolution levels below the full resolution
+            //
+            if (TIFFIsTiled(tif)) {
+                uint32 tw, th;
+                TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tw, 0);
+                TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &th, 0);
+                info.tile_width = tw;
+                info.tile_height = th;
+                info.clevels = (int) tiff_reduced_levels(tif).size();
+            }
+
+            int npages = tiff_count_pages(tif);
+            if (npages > 1) info.numpages = npages;
+
             char *emdatastr;
             if (1 == TIFFGetField(tif, TIFFTAG_SIPIMETA, &emdatastr)) {
                 SipiEssentials se(emdatastr);
@@ -1048,6 +1357,164 @@ namespace Sipi {
     }
     //============================================================================
 
+    /*!
+     * Sets the height in the frame header of a JPEG stream. The tiles at the bottom border of a TIFF
+     * are padded, the decoder stops after the lines of the frame. Only the height may be changed: the
+     * decoder derives the number of MCUs per line from the width, thus a narrower frame than the one
+     * the entropy coded data has been written for would garble the tile.
+     *
+     * \returns false, if the stream has no frame header before the start of scan
+     */
+    static bool jpeg_set_frame_height(std::string &jpeg, size_t height) {
+        size_t pos = 2; // skip SOI
+        while (pos + 4 <= jpeg.size()) {
+            if ((unsigned char) jpeg[pos] != 0xff) return false;
+            unsigned char marker = jpeg[pos + 1];
+            if (marker == 0xda) return false; // SOS
+            size_t len = ((unsigned char) jpeg[pos + 2] << 8) | (unsigned char) jpeg[pos + 3];
+            bool sof = (marker >= 0xc0) && (marker <= 0xcf) && (marker != 0xc4) && (marker != 0xc8) && (marker != 0xcc);
+            if (sof) {
+                if (pos + 9 > jpeg.size()) return false;
+                jpeg[pos + 5] = (char) ((height >> 8) & 0xff);
+                jpeg[pos + 6] = (char) (height & 0xff);
+                return true;
+            }
+            pos += 2 + len;
+        }
+        return false;
+    }
+    //============================================================================
+
+    static bool tiff_raw_jpeg_tile(TIFF *tif, std::shared_ptr<SipiRegion> region, std::shared_ptr<SipiSize> size,
+                                   std::string &jpeg) {
+        uint32 width, height;
+        if ((TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) == 0) || (TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height) == 0)) {
+            return false;
+        }
+
+        //
+        // the ICC profile is only found in the directory of the main image
+        //
+        std::string icc;
+        uint32 icc_len;
+        unsigned char *icc_buf;
+        if (1 == TIFFGetField(tif, TIFFTAG_ICCPROFILE, &icc_len, &icc_buf)) {
+            icc.assign((char *) icc_buf, icc_len);
+        }
+
+        size_t nx = width, ny = height;
+        int roi_x = 0, roi_y = 0;
+        size_t roi_w = nx, roi_h = ny;
+        size_t nnx = roi_w, nny = roi_h;
+        try {
+            if ((region != nullptr) && (region->getType() != SipiRegion::FULL)) {
+                region->crop_coords(nx, ny, roi_x, roi_y, roi_w, roi_h);
+            }
+            if (size != nullptr) {
+                int reduce = -1;
+                bool redonly;
+                size->get_size(roi_w, roi_h, nnx, nny, reduce, redonly);
+            }
+        } catch (...) {
+            return false; // the error is reported by the regular read
+        }
+        (void) tiff_select_level(tif, nx, ny, roi_x, roi_y, roi_w, roi_h, nnx, nny);
+        if ((nnx != roi_w) || (nny != roi_h)) return false; // would have to be scaled
+
+        //
+        // the tile has to be JPEG compressed in a color space which the browser assumes (YCbCr or gray)
+        //
+        if (!TIFFIsTiled(tif)) return false;
+        uint16 compression, photo, spp, bps, planar;
+        TIFF_GET_FIELD (tif, TIFFTAG_COMPRESSION, &compression, COMPRESSION_NONE);
+        TIFF_GET_FIELD (tif, TIFFTAG_PHOTOMETRIC, &photo, PHOTOMETRIC_MINISBLACK);
+        TIFF_GET_FIELD (tif, TIFFTAG_SAMPLESPERPIXEL, &spp, 1);
+        TIFF_GET_FIELD (tif, TIFFTAG_BITSPERSAMPLE, &bps, 1);
+        TIFF_GET_FIELD (tif, TIFFTAG_PLANARCONFIG, &planar, PLANARCONFIG_CONTIG);
+        if ((compression != COMPRESSION_JPEG) || (bps != 8) || (planar != PLANARCONFIG_CONTIG)) return false;
+        if (!(((photo == PHOTOMETRIC_YCBCR) && (spp == 3)) || ((photo == PHOTOMETRIC_MINISBLACK) && (spp == 1)))) {
+            return false;
+        }
+
+        //
+        // the region has to be exactly one tile
+        //
+        uint32 tw, th;
+        TIFF_GET_FIELD (tif, TIFFTAG_TILEWIDTH, &tw, 0);
+        TIFF_GET_FIELD (tif, TIFFTAG_TILELENGTH, &th, 0);
+        if ((tw == 0) || (th == 0) || ((roi_x % tw) != 0) || ((roi_y % th) != 0)) return false;
+        if ((roi_w != std::min<size_t>(tw, nx - roi_x)) || (roi_h != std::min<size_t>(th, ny - roi_y))) return false;
+        if (roi_w != tw) return false; // the tiles at the right border are padded and have to be decoded
+
+        ttile_t tile = TIFFComputeTile(tif, roi_x, roi_y, 0, 0);
+        uint64 *bytecounts;
+        if ((TIFFGetField(tif, TIFFTAG_TILEBYTECOUNTS, &bytecounts) == 0) || (bytecounts[tile] < 4)) return false;
+        std::string raw(bytecounts[tile], '\0');
+        if (TIFFReadRawTile(tif, tile, &raw[0], raw.size()) != (tmsize_t) raw.size()) return false;
+        if (((unsigned char) raw[0] != 0xff) || ((unsigned char) raw[1] != 0xd8)) return false; // no SOI
+
+        //
+        // SOI, ICC profile (APP2 segments), the tables and the tile without its SOI
+        //
+        jpeg.assign("\xff\xd8", 2);
+        const size_t icc_chunk = 65519; // 65535 - 2 (length) - 12 ("ICC_PROFILE\0") - 2 (sequence number/count)
+        size_t nchunks = (icc.size() + icc_chunk - 1) / icc_chunk;
+        if (nchunks > 255) nchunks = 0; // too large for APP2 segments
+        for (size_t i = 0; i < nchunks; i++) {
+            size_t len = std::min(icc_chunk, icc.size() - i * icc_chunk);
+            size_t seglen = len + 16;
+            jpeg += "\xff\xe2";
+            jpeg += (char) ((seglen >> 8) & 0xff);
+            jpeg += (char) (seglen & 0xff);
+            jpeg.append("ICC_PROFILE\0", 12);
+            jpeg += (char) (i + 1);
+            jpeg += (char) nchunks;
+            jpeg.append(icc, i * icc_chunk, len);
+        }
+        uint32 tables_len;
+        unsigned char *tables;
+        if ((1 == TIFFGetField(tif, TIFFTAG_JPEGTABLES, &tables_len, &tables)) && (tables_len > 4)) {
+            jpeg.append((char *) tables + 2, tables_len - 4); // without SOI and EOI
+        }
+        jpeg.append(raw, 2, std::string::npos);
+
+        if (roi_h != th) {
+            if (!jpeg_set_frame_height(jpeg, roi_h)) return false;
+        }
+        return true;
+    }
+    //============================================================================
+
+    bool SipiIOTiff::readRawJpegTile(const SipiSource &source, std::shared_ptr<SipiRegion> region,
+                                     std::shared_ptr<SipiSize> size, std::string &jpeg) {
+        TIFF *tif = tiff_open_source(source);
+        if (tif == nullptr) return false;
+        TIFFSetErrorHandler(tiffError);
+        (void) TIFFSetWarningHandler(nullptr);
+        bool ok;
+        try {
+            ok = tiff_raw_jpeg_tile(tif, region, size, jpeg);
+        } catch (...) {
+            ok = false; // the regular read will report the error
+        }
+        TIFFClose(tif);
+        return ok;
+    }
+    //============================================================================
+
+    std::string SipiIOTiff::sniff(const unsigned char *header, size_t len) {
+        if (len < 4) return std::string();
+        // byte order mark followed by 42 (classic TIFF) or 43 (BigTIFF)
+        if ((header[0] == 'I') && (header[1] == 'I') && ((header[2] == 42) || (header[2] == 43)) && (header[3] == 0)) {
+            return "image/tiff";
+        }
+        if ((header[0] == 'M') && (header[1] == 'M') && (header[2] == 0) && ((header[3] == 42) || (header[3] == 43))) {
+            return "image/tiff";
+        }
+        return std::string();
+    }
+    //============================================================================
+
 
     void SipiIOTiff::write(SipiImage *img, std::string filepath, const SipiCompressionParams *params) {
         TIFF *tif;
@@ -1292,7 +1759,7 @@ namespace Sipi {
                 fflush(stdout);
             } else if (filepath == "HTTP") {
                 try {
-                    img->connection()->sendAndFlush(memtif->data, memtif->flen);
+                    SipiIO::send(img->connection(), memtif->data, memtif->flen);
                 } catch (int i) {
                     memTiffFree(memtif);
                     throw Sipi::SipiImageError(__file__, __LINE__,
@@ -1641,11 +2108,12 @@ namespace Sipi {
         } else if (img->bps == 16) {
             word *dataptr = (word *) img->pixels;
             word *tmpptr = new word[img->nc * img->ny * img->nx];
+            unsigned int swl = sll / 2; // scanline length in words
 
             for (unsigned int k = 0; k < img->nc; k++) {
                 for (unsigned int j = 0; j < img->ny; j++) {
                     for (unsigned int i = 0; i < img->nx; i++) {
-                        tmpptr[img->nc * (j * img->nx + i) + k] = dataptr[k * img->ny * sll + j * img->nx + i];
+                        tmpptr[img->nc * (j * img->nx + i) + k] = dataptr[k * img->ny * swl + j * img->nx + i];
                     }
                 }
             }
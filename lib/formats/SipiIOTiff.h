@@ -106,6 +106,49 @@ namespace Sipi {
         */
         SipiImgInfo getDim(std::string filepath, int pagenum) override;
 
+        /*!
+         * Method used to read an image from an already opened file
+         *
+         * \param *img Pointer to SipiImage instance
+         * \param source The opened image file
+         * \param pagenum Page of a multipage TIFF, starting with 1. Reduced resolution directories are not pages
+         */
+        bool read(SipiImage *img, const SipiSource &source, int pagenum = 0, std::shared_ptr<SipiRegion> region = nullptr,
+                  std::shared_ptr<SipiSize> size = nullptr, bool force_bps_8 = true,
+                  ScalingQuality scaling_quality = {HIGH, HIGH, HIGH, HIGH}) override;
+
+        /*!
+        * Get the dimension of the image from an already opened file
+        *
+        * \param[in] source The opened image file
+        * \param[in] pagenum Page of a multipage TIFF, starting with 1
+        * \return Image information, numpages is set for multipage TIFFs
+        */
+        SipiImgInfo getDim(const SipiSource &source, int pagenum) override;
+
+        /*!
+        * Recognizes classic and big TIFF files by their byte order mark and version number
+        *
+        * \param[in] header The first bytes of the file
+        * \param[in] len Number of bytes in header
+        */
+        std::string sniff(const unsigned char *header, size_t len) override;
+
+        /*!
+        * If the region and the size of a request correspond exactly to one tile of a JPEG compressed
+        * tiled TIFF (or of one of its reduced resolution levels), the tile is returned as a complete
+        * JPEG file without decoding it. The raw tile data is combined with the JPEGTables and the
+        * ICC profile of the image. The padded tiles at the right border are not passed through.
+        *
+        * \param[in] source The opened image file
+        * \param[in] region Requested region
+        * \param[in] size Requested size
+        * \param[out] jpeg The JPEG file
+        * \returns true, if the request could be answered with a raw tile
+        */
+        static bool readRawJpegTile(const SipiSource &source, std::shared_ptr<SipiRegion> region,
+                                    std::shared_ptr<SipiSize> size, std::string &jpeg);
+
 
         /*!
          * Write a TIFF image to a file, stdout or to a memory buffer
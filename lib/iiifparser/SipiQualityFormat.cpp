@@ -45,6 +45,20 @@ static const char __file__[] = __FILE__;
 
 namespace Sipi {
 
+    bool SipiQualityFormat::is_valid(const std::string &str) {
+        size_t dot = str.find('.');
+        if (dot == std::string::npos) return false;
+        bool quality_ok = ((str.compare(0, dot, "default") == 0) || (str.compare(0, dot, "color") == 0) ||
+                           (str.compare(0, dot, "gray") == 0) || (str.compare(0, dot, "bitonal") == 0));
+        if (!quality_ok) return false;
+        // compare() takes the length of the remainder into account (unlike strcmp, which stops at an embedded NUL)
+        size_t ext = dot + 1;
+        return (str.compare(ext, std::string::npos, "jpg") == 0) || (str.compare(ext, std::string::npos, "tif") == 0) ||
+               (str.compare(ext, std::string::npos, "png") == 0) || (str.compare(ext, std::string::npos, "jp2") == 0) ||
+               (str.compare(ext, std::string::npos, "pdf") == 0);
+    }
+    //-------------------------------------------------------------------------
+
     SipiQualityFormat::SipiQualityFormat(std::string str) {
         if (str.empty()) {
             quality_type = SipiQualityFormat::DEFAULT;
@@ -48,6 +48,16 @@ namespace Sipi {
 
         SipiQualityFormat(std::string str);
 
+        /*!
+         * Checks the syntax of the last part of a IIIF url ("{quality}.{format}"). This is a hand written
+         * replacement of a regular expression, it does not allocate.
+         *
+         * \param[in] str The quality/format part of the url
+         *
+         * \returns true, if quality and format are supported
+         */
+        static bool is_valid(const std::string &str);
+
         friend std::ostream &operator<<(std::ostream &lhs, const SipiQualityFormat &rhs);
 
         inline QualityType quality() { return quality_type; };
@@ -28,6 +28,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cctype>
 #include <cstring>
 #include <vector>
 #include <cmath>
@@ -47,6 +48,32 @@ namespace Sipi {
      *
      * @param str Region string from IIIF URL
      */
+    /*!
+     * Scans a decimal number "[0-9]*\.?[0-9]*" (or "[0-9]+" if integer_only is set) starting at pos
+     */
+    static bool scan_number(const std::string &str, size_t &pos, bool integer_only) {
+        size_t start = pos;
+        while ((pos < str.length()) && isdigit((unsigned char) str[pos])) pos++;
+        if (integer_only) return pos > start;
+        if ((pos < str.length()) && (str[pos] == '.')) pos++;
+        while ((pos < str.length()) && isdigit((unsigned char) str[pos])) pos++;
+        return true;
+    }
+    //-------------------------------------------------------------------------
+
+    bool SipiRegion::is_valid(const std::string &str) {
+        if ((str == "full") || (str == "square")) return true;
+        size_t pos = 0;
+        bool percent = (str.compare(0, 4, "pct:") == 0);
+        if (percent) pos = 4;
+        for (int i = 0; i < 4; i++) {
+            if ((i > 0) && ((pos >= str.length()) || (str[pos++] != ','))) return false;
+            if (!scan_number(str, pos, !percent)) return false;
+        }
+        return pos == str.length();
+    }
+    //-------------------------------------------------------------------------
+
     SipiRegion::SipiRegion(std::string str) {
         int n;
         if (str.empty() || (str == "full")) {
@@ -84,6 +84,16 @@ namespace Sipi {
          */
         SipiRegion(std::string str);
 
+        /*!
+         * Checks the syntax of the region part of a IIIF url ("full", "square", "x,y,w,h" or
+         * "pct:x,y,w,h"). This is a hand written replacement of a regular expression, it does not allocate.
+         *
+         * \param[in] str The region part of the url
+         *
+         * \returns true, if the syntax is valid
+         */
+        static bool is_valid(const std::string &str);
+
         /*!
          * Get the coordinate type that has bee used for construction of the region
          *
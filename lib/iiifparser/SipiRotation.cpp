@@ -29,6 +29,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cctype>
 #include <cstring>
 #include <vector>
 #include <cmath>
@@ -50,6 +51,18 @@ namespace Sipi {
         return;
     }
 
+    bool SipiRotation::is_valid(const std::string &str) {
+        size_t pos = 0;
+        size_t len = str.length();
+        if ((pos < len) && (str[pos] == '!')) pos++; // mirroring
+        if ((pos < len) && ((str[pos] == '-') || (str[pos] == '+'))) pos++;
+        while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+        if ((pos < len) && (str[pos] == '.')) pos++;
+        while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+        return pos == len;
+    }
+    //-------------------------------------------------------------------------
+
     SipiRotation::SipiRotation(std::string str) {
         try {
             if (str.empty()) {
@@ -39,6 +39,16 @@ namespace Sipi {
 
         SipiRotation(std::string str);
 
+        /*!
+         * Checks the syntax of the rotation part of a IIIF url (a number, optionally preceded by "!"
+         * for mirroring). This is a hand written replacement of a regular expression, it does not allocate.
+         *
+         * \param[in] str The rotation part of the url
+         *
+         * \returns true, if the syntax is valid
+         */
+        static bool is_valid(const std::string &str);
+
         inline bool get_rotation(float &rot) {
             rot = rotation;
             return mirror;
@@ -30,6 +30,7 @@
 #include <sstream>
 #include <cstdio>
 #include <cstdlib>
+#include <cctype>
 #include <cstring>
 #include <vector>
 #include <cmath>
@@ -50,6 +51,27 @@ namespace Sipi {
 
     size_t SipiSize::limitdim = 32000;
 
+    bool SipiSize::is_valid(const std::string &str) {
+        size_t pos = 0;
+        size_t len = str.length();
+        if ((pos < len) && (str[pos] == '^')) pos++; // upscaling
+        if (str.compare(pos, std::string::npos, "max") == 0) return true;
+        if (str.compare(pos, 4, "pct:") == 0) { // "pct:[0-9]*\.?[0-9]*"
+            pos += 4;
+            while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+            if ((pos < len) && (str[pos] == '.')) pos++;
+            while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+            return pos == len;
+        }
+        if ((pos < len) && (str[pos] == '!')) pos++; // "!?[0-9]*,[0-9]*"
+        while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+        if ((pos >= len) || (str[pos] != ',')) return false;
+        pos++;
+        while ((pos < len) && isdigit((unsigned char) str[pos])) pos++;
+        return pos == len;
+    }
+    //-------------------------------------------------------------------------
+
     SipiSize::SipiSize(std::string str) {
         nx = ny = w = h =0;
         percent = 0.F;
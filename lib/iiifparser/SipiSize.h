@@ -113,6 +113,17 @@ namespace Sipi {
          */
         SipiSize(std::string str);
 
+        /*!
+         * Checks the syntax of the size part of a IIIF url ("max", "pct:n", "w,", ",h", "w,h" or "!w,h",
+         * each optionally preceded by "^"). This is a hand written replacement of a regular expression,
+         * it does not allocate.
+         *
+         * \param[in] str The size part of the url
+         *
+         * \returns true, if the syntax is valid
+         */
+        static bool is_valid(const std::string &str);
+
         /*!
          * Comparison operator ">"
          */
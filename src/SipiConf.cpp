@@ -70,7 +70,79 @@ namespace Sipi {
         keep_alive = luacfg.configInteger("sipi", "keep_alive", 20);
         thumb_size = luacfg.configString("sipi", "thumb_size", "!128,128");
         cache_n_files = luacfg.configInteger("sipi", "cache_nfiles", 0);
+        cache_policy = luacfg.configString("sipi", "cache_policy", "lru");
+        cache_admission = luacfg.configString("sipi", "cache_admission", "all");
+        std::string memcachesize_str = luacfg.configString("sipi", "memcachesize", "0");
+
+        if (!memcachesize_str.empty()) {
+            size_t l = memcachesize_str.length();
+            char c = memcachesize_str[l - 1];
+
+            if (c == 'M') {
+                memcache_size = stoll(memcachesize_str.substr(0, l - 1)) * 1024 * 1024;
+            } else if (c == 'G') {
+                memcache_size = stoll(memcachesize_str.substr(0, l - 1)) * 1024 * 1024 * 1024;
+            } else {
+                memcache_size = stoll(memcachesize_str);
+            }
+        }
+
+        memcache_revalidate = luacfg.configInteger("sipi", "memcache_revalidate", 10);
+        std::string decodedcachesize_str = luacfg.configString("sipi", "decodedcachesize", "0");
+
+        if (!decodedcachesize_str.empty()) {
+            size_t l = decodedcachesize_str.length();
+            char c = decodedcachesize_str[l - 1];
+
+            if (c == 'M') {
+                decoded_cache_size = stoll(decodedcachesize_str.substr(0, l - 1)) * 1024 * 1024;
+            } else if (c == 'G') {
+                decoded_cache_size = stoll(decodedcachesize_str.substr(0, l - 1)) * 1024 * 1024 * 1024;
+            } else {
+                decoded_cache_size = stoll(decodedcachesize_str);
+            }
+        }
+
+        std::string rastercachesize_str = luacfg.configString("sipi", "rastercachesize", "0");
+
+        if (!rastercachesize_str.empty()) {
+            size_t l = rastercachesize_str.length();
+            char c = rastercachesize_str[l - 1];
+
+            if (c == 'M') {
+                raster_cache_size = stoll(rastercachesize_str.substr(0, l - 1)) * 1024 * 1024;
+            } else if (c == 'G') {
+                raster_cache_size = stoll(rastercachesize_str.substr(0, l - 1)) * 1024 * 1024 * 1024;
+            } else {
+                raster_cache_size = stoll(rastercachesize_str);
+            }
+        }
+
+        std::string derivativesize_str = luacfg.configString("sipi", "derivativesize", "0");
+
+        if (!derivativesize_str.empty()) {
+            size_t l = derivativesize_str.length();
+            char c = derivativesize_str[l - 1];
+
+            if (c == 'M') {
+                derivative_size = stoll(derivativesize_str.substr(0, l - 1)) * 1024 * 1024;
+            } else if (c == 'G') {
+                derivative_size = stoll(derivativesize_str.substr(0, l - 1)) * 1024 * 1024 * 1024;
+            } else {
+                derivative_size = stoll(derivativesize_str);
+            }
+        }
+
+        derivative_dir = luacfg.configString("sipi", "derivative_dir", "");
+        derivative_threshold = luacfg.configInteger("sipi", "derivative_threshold", 3);
+        info_index = luacfg.configString("sipi", "info_index", "");
+        info_cache_size = luacfg.configInteger("sipi", "info_cache_size", 10000);
+        preflight_cache_size = luacfg.configInteger("sipi", "preflight_cache_size", 0);
+        preflight_cache_ttl = luacfg.configInteger("sipi", "preflight_cache_ttl", 60);
+        preflight_cache_headers = luacfg.configString("sipi", "preflight_cache_headers", "cookie");
         n_threads = luacfg.configInteger("sipi", "nthreads", 2 * std::thread::hardware_concurrency());
+        compute_threads = luacfg.configInteger("sipi", "compute_threads", 0);
+        j2k_threads = luacfg.configInteger("sipi", "j2k_threads", 0);
         std::string max_post_size_str = luacfg.configString("sipi", "max_post_size", "0");
 
         if (!max_post_size_str.empty()) {
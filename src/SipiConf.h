@@ -60,7 +60,23 @@ namespace Sipi {
         int keep_alive;
         std::string thumb_size;
         int cache_n_files;
+        std::string cache_policy; //<! eviction policy of the file cache ("lru" or "gdsf")
+        std::string cache_admission; //<! admission policy of the file cache ("all" or "tinylfu")
+        size_t memcache_size; //<! byte budget of the in-memory cache in front of the disk cache
+        int memcache_revalidate; //<! seconds after which memory cached files are checked against the original
+        size_t decoded_cache_size; //<! byte budget of the decoded JPEG, PNG and striped TIFF images kept in memory
+        size_t raster_cache_size; //<! byte budget of the rasters shared by renditions differing in rotation, quality or format
+        size_t derivative_size; //<! byte budget of the tiled JPEG2000 derivatives (0: no transcoding)
+        std::string derivative_dir; //<! directory of the derivatives (default: cache directory with suffix "_derivatives")
+        int derivative_threshold; //<! number of requests after which a file is transcoded
+        std::string info_index; //<! path of the persistent image info index (default: in the cache directory)
+        int info_cache_size; //<! maximal number of info.json responses kept in memory
+        int preflight_cache_size; //<! maximal number of cached pre_flight results (0: no caching)
+        int preflight_cache_ttl; //<! seconds a pre_flight result is valid
+        std::string preflight_cache_headers; //<! comma separated request headers which are part of the pre_flight cache key
         int n_threads;
+        int compute_threads; //<! size of the pool of threads shared by the image processing operations
+        int j2k_threads; //<! size of the thread group used for encoding/decoding JPEG2000 images
         size_t max_post_size;
         std::string tmp_dir;
         std::string scriptdir;
@@ -144,9 +160,57 @@ namespace Sipi {
         inline int getCacheNFiles(void) { return cache_n_files; }
         inline void setCacheNFiles(int i) { cache_n_files = i; }
 
+        inline std::string getCachePolicy(void) { return cache_policy; }
+        inline void setCachePolicy(const std::string &str) { cache_policy = str; }
+
+        inline std::string getCacheAdmission(void) { return cache_admission; }
+        inline void setCacheAdmission(const std::string &str) { cache_admission = str; }
+
+        inline size_t getMemCacheSize(void) { return memcache_size; }
+        inline void setMemCacheSize(size_t i) { memcache_size = i; }
+
+        inline int getMemCacheRevalidate(void) { return memcache_revalidate; }
+        inline void setMemCacheRevalidate(int i) { memcache_revalidate = i; }
+
+        inline size_t getDecodedCacheSize(void) { return decoded_cache_size; }
+        inline void setDecodedCacheSize(size_t i) { decoded_cache_size = i; }
+
+        inline size_t getRasterCacheSize(void) { return raster_cache_size; }
+        inline void setRasterCacheSize(size_t i) { raster_cache_size = i; }
+
+        inline size_t getDerivativeSize(void) { return derivative_size; }
+        inline void setDerivativeSize(size_t i) { derivative_size = i; }
+
+        inline std::string getDerivativeDir(void) { return derivative_dir; }
+        inline void setDerivativeDir(const std::string &str) { derivative_dir = str; }
+
+        inline int getDerivativeThreshold(void) { return derivative_threshold; }
+        inline void setDerivativeThreshold(int i) { derivative_threshold = i; }
+
+        inline std::string getInfoIndex(void) { return info_index; }
+        inline void setInfoIndex(const std::string &str) { info_index = str; }
+
+        inline int getInfoCacheSize(void) { return info_cache_size; }
+        inline void setInfoCacheSize(int i) { info_cache_size = i; }
+
+        inline int getPreflightCacheSize(void) { return preflight_cache_size; }
+        inline void setPreflightCacheSize(int i) { preflight_cache_size = i; }
+
+        inline int getPreflightCacheTtl(void) { return preflight_cache_ttl; }
+        inline void setPreflightCacheTtl(int i) { preflight_cache_ttl = i; }
+
+        inline std::string getPreflightCacheHeaders(void) { return preflight_cache_headers; }
+        inline void setPreflightCacheHeaders(const std::string &str) { preflight_cache_headers = str; }
+
         inline int getNThreads(void) { return n_threads; }
         inline void setNThreads(int i) { n_threads = i; }
 
+        inline int getComputeThreads(void) { return compute_threads; }
+        inline void setComputeThreads(int i) { compute_threads = i; }
+
+        inline int getJ2kThreads(void) { return j2k_threads; }
+        inline void setJ2kThreads(int i) { j2k_threads = i; }
+
         inline size_t getMaxPostSize(void) { return max_post_size; }
         inline void setMaxPostSize(size_t i) { max_post_size = i; }
 
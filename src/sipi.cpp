@@ -34,6 +34,7 @@
 #include <sstream>
 #include <thread>
 #include <utility>
+#include <algorithm>
 #include <stdlib.h>
 #include <sys/stat.h>
 
@@ -59,6 +60,7 @@
 #include "shttps/Parsing.h"
 #include "SipiConf.h"
 #include "SipiIO.h"
+#include "formats/SipiIOJ2k.h"
 
 
 // A macro for silencing incorrect compiler warnings about unused variables.
@@ -160,10 +162,74 @@ static void sipiConfGlobals(lua_State *L, shttps::Connection &conn, void *user_d
   lua_pushinteger(L, conf->getCacheNFiles());
   lua_rawset(L, -3); // table1
 
+  lua_pushstring(L, "cache_policy"); // table1 - "index_L1"
+  lua_pushstring(L, conf->getCachePolicy().c_str());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "cache_admission"); // table1 - "index_L1"
+  lua_pushstring(L, conf->getCacheAdmission().c_str());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "memcache_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getMemCacheSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "memcache_revalidate"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getMemCacheRevalidate());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "decoded_cache_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getDecodedCacheSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "raster_cache_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getRasterCacheSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "derivative_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getDerivativeSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "derivative_dir"); // table1 - "index_L1"
+  lua_pushstring(L, conf->getDerivativeDir().c_str());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "derivative_threshold"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getDerivativeThreshold());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "info_index"); // table1 - "index_L1"
+  lua_pushstring(L, conf->getInfoIndex().c_str());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "info_cache_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getInfoCacheSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "preflight_cache_size"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getPreflightCacheSize());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "preflight_cache_ttl"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getPreflightCacheTtl());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "preflight_cache_headers"); // table1 - "index_L1"
+  lua_pushstring(L, conf->getPreflightCacheHeaders().c_str());
+  lua_rawset(L, -3); // table1
+
   lua_pushstring(L, "n_threads"); // table1 - "index_L1"
   lua_pushinteger(L, conf->getNThreads());
   lua_rawset(L, -3); // table1
 
+  lua_pushstring(L, "compute_threads"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getComputeThreads());
+  lua_rawset(L, -3); // table1
+
+  lua_pushstring(L, "j2k_threads"); // table1 - "index_L1"
+  lua_pushinteger(L, conf->getJ2kThreads());
+  lua_rawset(L, -3); // table1
+
   lua_pushstring(L, "max_post_size"); // table1 - "index_L1"
   lua_pushinteger(L, conf->getMaxPostSize());
   lua_rawset(L, -3); // table1
@@ -543,6 +609,18 @@ int main(int argc, char *argv[]) {
   int optNThreads = std::thread::hardware_concurrency();
   sipiopt.add_option("-t,--nthreads", optNThreads, "Number of threads for SIPI server")->envname("SIPI_NTHREADS");
 
+  int optComputeThreads = 0;
+  sipiopt.add_option("--computethreads",
+                     optComputeThreads,
+                     "Number of threads shared by all image processing operations (0: number of processors).")->envname(
+      "SIPI_COMPUTETHREADS");
+
+  int optJ2kThreads = 0;
+  sipiopt.add_option("--j2kthreads",
+                     optJ2kThreads,
+                     "Number of threads shared for encoding/decoding JPEG2000 images (0: size of compute pool).")->envname(
+      "SIPI_J2KTHREADS");
+
   std::string optMaxPostSize = "300M";
   sipiopt.add_option("--maxpost",
                      optMaxPostSize,
@@ -611,6 +689,90 @@ int main(int argc, char *argv[]) {
                      "If the cache becomes full, the given percentage of file space is marked for reuse (0.0 - 1.0).")->envname(
       "SIPI_CACHEHYSTERESIS");
 
+  std::string optCachePolicy = "lru";
+  sipiopt.add_option("--cachepolicy",
+                     optCachePolicy,
+                     "Policy for removing files from a full cache: 'lru' or 'gdsf' (size, frequency and rendering time).")->envname(
+      "SIPI_CACHEPOLICY")->check(CLI::IsMember({"lru", "gdsf"}));
+
+  std::string optCacheAdmission = "all";
+  sipiopt.add_option("--cacheadmission",
+                     optCacheAdmission,
+                     "Policy for adding files to a full cache: 'all' or 'tinylfu' (only frequently requested files).")->envname(
+      "SIPI_CACHEADMISSION")->check(CLI::IsMember({"all", "tinylfu"}));
+
+  std::string optMemCacheSize = "0";
+  sipiopt.add_option("--memcachesize",
+                     optMemCacheSize,
+                     "Maximal size of the in-memory cache in front of the file cache, e.g. '100M' (0: disabled).")->envname(
+      "SIPI_MEMCACHESIZE");
+
+  int optMemCacheRevalidate = 10;
+  sipiopt.add_option("--memcacherevalidate",
+                     optMemCacheRevalidate,
+                     "Number of seconds after which files in the in-memory cache are checked against the original.")->envname(
+      "SIPI_MEMCACHEREVALIDATE");
+
+  std::string optDecodedCacheSize = "0";
+  sipiopt.add_option("--decodedcachesize",
+                     optDecodedCacheSize,
+                     "Maximal size of the decoded JPEG, PNG and striped TIFF images kept in memory for cropping tiles, e.g. '1G' (0: disabled).")->envname(
+      "SIPI_DECODEDCACHESIZE");
+
+  std::string optRasterCacheSize = "0";
+  sipiopt.add_option("--rastercachesize",
+                     optRasterCacheSize,
+                     "Maximal size of the scaled rasters shared by renditions which differ only in rotation, quality or format, e.g. '200M' (0: disabled).")->envname(
+      "SIPI_RASTERCACHESIZE");
+
+  std::string optDerivativeSize = "0";
+  sipiopt.add_option("--derivativesize",
+                     optDerivativeSize,
+                     "Maximal size of the tiled JPEG2000 derivatives of repeatedly requested JPEG, PNG and striped TIFF files, e.g. '10G' (0: no transcoding).")->envname(
+      "SIPI_DERIVATIVESIZE");
+
+  std::string optDerivativeDir;
+  sipiopt.add_option("--derivativedir",
+                     optDerivativeDir,
+                     "Directory of the JPEG2000 derivatives, must not be within the cache directory (default: the cache directory with suffix '_derivatives').")->envname(
+      "SIPI_DERIVATIVEDIR");
+
+  int optDerivativeThreshold = 3;
+  sipiopt.add_option("--derivativethreshold",
+                     optDerivativeThreshold,
+                     "Number of region requests after which a file is transcoded into a JPEG2000 derivative.")->envname(
+      "SIPI_DERIVATIVETHRESHOLD");
+
+  std::string optInfoIndex;
+  sipiopt.add_option("--infoindex",
+                     optInfoIndex,
+                     "Path of the persistent index of image dimensions (default: '.sipiinfo' in the cache directory).")->envname(
+      "SIPI_INFOINDEX");
+
+  int optInfoCacheSize = 10000;
+  sipiopt.add_option("--infocachesize",
+                     optInfoCacheSize,
+                     "Maximal number of info.json responses kept in memory (0: disabled).")->envname(
+      "SIPI_INFOCACHESIZE");
+
+  int optPreflightCacheSize = 0;
+  sipiopt.add_option("--preflightcachesize",
+                     optPreflightCacheSize,
+                     "Maximal number of cached results of the Lua pre_flight function (0: disabled).")->envname(
+      "SIPI_PREFLIGHTCACHESIZE");
+
+  int optPreflightCacheTtl = 60;
+  sipiopt.add_option("--preflightcachettl",
+                     optPreflightCacheTtl,
+                     "Number of seconds a cached result of the Lua pre_flight function is valid.")->envname(
+      "SIPI_PREFLIGHTCACHETTL");
+
+  std::string optPreflightCacheHeaders = "cookie";
+  sipiopt.add_option("--preflightcacheheaders",
+                     optPreflightCacheHeaders,
+                     "Comma separated list of request headers which are part of the key of the pre_flight cache.")->envname(
+      "SIPI_PREFLIGHTCACHEHEADERS");
+
   std::string optThumbSize = "!128,128";
   sipiopt.add_option("--thumbsize", optThumbSize, "Size of the thumbnails (to be used within Lua).")->envname(
       "SIPI_THUMBSIZE");
@@ -952,6 +1114,18 @@ int main(int argc, char *argv[]) {
         if (!sipiopt.get_option("--nthreads")->empty()) sipiConf.setNThreads(optNThreads);
       }
 
+      if (!config_loaded) {
+        sipiConf.setComputeThreads(optComputeThreads);
+      } else {
+        if (!sipiopt.get_option("--computethreads")->empty()) sipiConf.setComputeThreads(optComputeThreads);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setJ2kThreads(optJ2kThreads);
+      } else {
+        if (!sipiopt.get_option("--j2kthreads")->empty()) sipiConf.setJ2kThreads(optJ2kThreads);
+      }
+
       size_t l = optMaxPostSize.length();
       char c = optMaxPostSize[l - 1];
       tsize_t maxpost_size;
@@ -1062,6 +1236,130 @@ int main(int argc, char *argv[]) {
         if (!sipiopt.get_option("--cachehysteresis")->empty()) sipiConf.setCacheHysteresis(optCacheHysteresis);
       }
 
+      if (!config_loaded) {
+        sipiConf.setCachePolicy(optCachePolicy);
+      } else {
+        if (!sipiopt.get_option("--cachepolicy")->empty()) sipiConf.setCachePolicy(optCachePolicy);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setCacheAdmission(optCacheAdmission);
+      } else {
+        if (!sipiopt.get_option("--cacheadmission")->empty()) sipiConf.setCacheAdmission(optCacheAdmission);
+      }
+
+      l = optMemCacheSize.length();
+      c = optMemCacheSize[l - 1];
+      tsize_t memcache_size;
+      if (c == 'M') {
+        memcache_size = stoll(optMemCacheSize.substr(0, l - 1)) * 1024 * 1024;
+      } else if (c == 'G') {
+        memcache_size = stoll(optMemCacheSize.substr(0, l - 1)) * 1024 * 1024 * 1024;
+      } else {
+        memcache_size = stoll(optMemCacheSize);
+      }
+      if (!config_loaded) {
+        sipiConf.setMemCacheSize(memcache_size);
+      } else {
+        if (!sipiopt.get_option("--memcachesize")->empty()) sipiConf.setMemCacheSize(memcache_size);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setMemCacheRevalidate(optMemCacheRevalidate);
+      } else {
+        if (!sipiopt.get_option("--memcacherevalidate")->empty()) sipiConf.setMemCacheRevalidate(optMemCacheRevalidate);
+      }
+
+      l = optDecodedCacheSize.length();
+      c = optDecodedCacheSize[l - 1];
+      tsize_t decoded_cache_size;
+      if (c == 'M') {
+        decoded_cache_size = stoll(optDecodedCacheSize.substr(0, l - 1)) * 1024 * 1024;
+      } else if (c == 'G') {
+        decoded_cache_size = stoll(optDecodedCacheSize.substr(0, l - 1)) * 1024 * 1024 * 1024;
+      } else {
+        decoded_cache_size = stoll(optDecodedCacheSize);
+      }
+      if (!config_loaded) {
+        sipiConf.setDecodedCacheSize(decoded_cache_size);
+      } else {
+        if (!sipiopt.get_option("--decodedcachesize")->empty()) sipiConf.setDecodedCacheSize(decoded_cache_size);
+      }
+
+      l = optRasterCacheSize.length();
+      c = optRasterCacheSize[l - 1];
+      tsize_t raster_cache_size;
+      if (c == 'M') {
+        raster_cache_size = stoll(optRasterCacheSize.substr(0, l - 1)) * 1024 * 1024;
+      } else if (c == 'G') {
+        raster_cache_size = stoll(optRasterCacheSize.substr(0, l - 1)) * 1024 * 1024 * 1024;
+      } else {
+        raster_cache_size = stoll(optRasterCacheSize);
+      }
+      if (!config_loaded) {
+        sipiConf.setRasterCacheSize(raster_cache_size);
+      } else {
+        if (!sipiopt.get_option("--rastercachesize")->empty()) sipiConf.setRasterCacheSize(raster_cache_size);
+      }
+
+      l = optDerivativeSize.length();
+      c = optDerivativeSize[l - 1];
+      tsize_t derivative_size;
+      if (c == 'M') {
+        derivative_size = stoll(optDerivativeSize.substr(0, l - 1)) * 1024 * 1024;
+      } else if (c == 'G') {
+        derivative_size = stoll(optDerivativeSize.substr(0, l - 1)) * 1024 * 1024 * 1024;
+      } else {
+        derivative_size = stoll(optDerivativeSize);
+      }
+      if (!config_loaded) {
+        sipiConf.setDerivativeSize(derivative_size);
+      } else {
+        if (!sipiopt.get_option("--derivativesize")->empty()) sipiConf.setDerivativeSize(derivative_size);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setDerivativeDir(optDerivativeDir);
+      } else {
+        if (!sipiopt.get_option("--derivativedir")->empty()) sipiConf.setDerivativeDir(optDerivativeDir);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setDerivativeThreshold(optDerivativeThreshold);
+      } else {
+        if (!sipiopt.get_option("--derivativethreshold")->empty()) sipiConf.setDerivativeThreshold(optDerivativeThreshold);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setInfoIndex(optInfoIndex);
+      } else {
+        if (!sipiopt.get_option("--infoindex")->empty()) sipiConf.setInfoIndex(optInfoIndex);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setInfoCacheSize(optInfoCacheSize);
+      } else {
+        if (!sipiopt.get_option("--infocachesize")->empty()) sipiConf.setInfoCacheSize(optInfoCacheSize);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setPreflightCacheSize(optPreflightCacheSize);
+      } else {
+        if (!sipiopt.get_option("--preflightcachesize")->empty()) sipiConf.setPreflightCacheSize(optPreflightCacheSize);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setPreflightCacheTtl(optPreflightCacheTtl);
+      } else {
+        if (!sipiopt.get_option("--preflightcachettl")->empty()) sipiConf.setPreflightCacheTtl(optPreflightCacheTtl);
+      }
+
+      if (!config_loaded) {
+        sipiConf.setPreflightCacheHeaders(optPreflightCacheHeaders);
+      } else {
+        if (!sipiopt.get_option("--preflightcacheheaders")->empty()) sipiConf.setPreflightCacheHeaders(optPreflightCacheHeaders);
+      }
+
       if (!config_loaded) {
         sipiConf.setThumbSize(optThumbSize);
       } else {
@@ -1230,6 +1528,8 @@ int main(int argc, char *argv[]) {
       server.dirs_to_exclude(sipiConf.getSubdirExcludes());
       server.scaling_quality(sipiConf.getScalingQuality());
       server.jpeg_quality(sipiConf.getJpegQuality());
+      server.compute_pool(sipiConf.getComputeThreads());
+      Sipi::SipiIOJ2k::setNumThreads(sipiConf.getJ2kThreads());
 
       //
       // cache parameter...
@@ -1241,8 +1541,46 @@ int main(int argc, char *argv[]) {
         size_t cachesize = sipiConf.getCacheSize();
         int nfiles = sipiConf.getCacheNFiles();
         float hysteresis = sipiConf.getCacheHysteresis();
-        server.cache(cachedir, cachesize, nfiles, hysteresis);
+        Sipi::SipiCache::EvictionPolicy eviction = (sipiConf.getCachePolicy() == "gdsf") ?
+            Sipi::SipiCache::EVICT_GDSF : Sipi::SipiCache::EVICT_LRU;
+        Sipi::SipiCache::AdmissionPolicy admission = (sipiConf.getCacheAdmission() == "tinylfu") ?
+            Sipi::SipiCache::ADMIT_TINYLFU : Sipi::SipiCache::ADMIT_ALL;
+        server.cache(cachedir, cachesize, nfiles, hysteresis, eviction, admission);
+        server.memcache(sipiConf.getMemCacheSize(), sipiConf.getMemCacheRevalidate());
+      }
+
+      std::string info_index = sipiConf.getInfoIndex();
+      if (info_index.empty() && !cachedir.empty()) info_index = cachedir + "/.sipiinfo";
+      server.info_index(info_index);
+      server.info_cache(sipiConf.getInfoCacheSize() > 0 ? sipiConf.getInfoCacheSize() : 0,
+                        sipiConf.getMemCacheRevalidate());
+      server.decoded_cache(sipiConf.getDecodedCacheSize());
+      server.raster_cache(sipiConf.getRasterCacheSize());
+
+      std::string derivative_dir = sipiConf.getDerivativeDir();
+      if (derivative_dir.empty() && !cachedir.empty()) { // next to the cache directory, never inside
+        std::string cachebase = cachedir;
+        while ((cachebase.size() > 1) && (cachebase.back() == '/')) cachebase.pop_back();
+        derivative_dir = cachebase + "_derivatives";
+      }
+      server.derivatives(derivative_dir, sipiConf.getDerivativeSize(),
+                         sipiConf.getDerivativeThreshold() > 0 ? sipiConf.getDerivativeThreshold() : 1);
+
+      //
+      // the names of the request headers which are part of the key of the pre_flight cache
+      //
+      std::vector<std::string> preflight_headers;
+      std::stringstream preflight_headers_ss(sipiConf.getPreflightCacheHeaders());
+      std::string preflight_header;
+      while (std::getline(preflight_headers_ss, preflight_header, ',')) {
+        preflight_header.erase(0, preflight_header.find_first_not_of(" \t"));
+        preflight_header.erase(preflight_header.find_last_not_of(" \t") + 1);
+        if (preflight_header.empty()) continue;
+        std::transform(preflight_header.begin(), preflight_header.end(), preflight_header.begin(), ::tolower);
+        preflight_headers.push_back(preflight_header);
       }
+      server.preflight_cache(sipiConf.getPreflightCacheSize() > 0 ? sipiConf.getPreflightCacheSize() : 0,
+                             sipiConf.getPreflightCacheTtl(), preflight_headers);
 
       server.imgroot(sipiConf.getImgRoot());
       server.initscript(sipiConf.getInitScript());
@@ -0,0 +1,163 @@
+/*
+ * Writes the TIFF test images in test/_test_data/images. All of them contain the same synthetic pattern
+ * (see pattern()), stored in strips, in tiles, in separate planes and as pyramids, thus the pixels of a
+ * region must not depend on the file it has been read from. The reduced resolution levels are subsampled
+ * by powers of 2, pixel (x, y) of the level 2^k contains pattern(x << k, y << k). The padding of the tiles
+ * at the right and bottom border is filled with garbage.
+ *
+ * The images are part of the repository, the program is only needed to change them:
+ *     c++ -std=c++17 -o make_tiff_fixtures make_tiff_fixtures.cpp -ltiff && ./make_tiff_fixtures images
+ */
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <tiffio.h>
+
+static const uint32_t width = 300;
+static const uint32_t height = 200;
+
+//
+// sample c of the pixel (x, y). The second page of pyramid_reduced.tif is inverted.
+//
+static uint32_t pattern(uint32_t x, uint32_t y, uint32_t c, int bps, bool inverted) {
+    uint32_t v;
+    switch (c) {
+        case 0: v = x & 0xff; break;
+        case 1: v = y & 0xff; break;
+        default: v = (((x >> 4) ^ (y >> 4)) * 37) & 0xff;
+    }
+    if (bps == 16) v = (v << 8) | ((3 * x + y) & 0xff);
+    return inverted ? ((1u << bps) - 1) - v : v;
+}
+
+typedef enum {
+    STRIPS, TILES, TILES_SEPARATE
+} Layout;
+
+typedef struct {
+    uint32_t width;   //!< width of the full resolution image
+    uint32_t height;  //!< height of the full resolution image
+    int bps;
+    bool inverted;
+} Image;
+
+static void put_sample(std::vector<uint8_t> &buf, size_t index, uint32_t v, int bps) {
+    if (bps == 16) {
+        uint16_t s = (uint16_t) v;
+        memcpy(&buf[2 * index], &s, 2);
+    } else {
+        buf[index] = (uint8_t) v;
+    }
+}
+
+//
+// writes the level 2^shift of the image as a directory
+//
+static bool write_dir(TIFF *tif, const Image &img, int shift, Layout layout, uint32_t tilesize, uint32_t subfiletype,
+                      const std::vector<uint64_t> &subifds = {}) {
+    uint32_t w = img.width >> shift, h = img.height >> shift;
+    size_t ps = img.bps / 8;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, w);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, h);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, img.bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (layout == TILES_SEPARATE) ? PLANARCONFIG_SEPARATE : PLANARCONFIG_CONTIG);
+    if (subfiletype != 0) TIFFSetField(tif, TIFFTAG_SUBFILETYPE, subfiletype);
+    if (!subifds.empty()) TIFFSetField(tif, TIFFTAG_SUBIFD, (uint16_t) subifds.size(), subifds.data());
+
+    if (layout == STRIPS) {
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1); // the untiled reader reads the rows of a region directly
+        std::vector<uint8_t> line(w * 3 * ps);
+        for (uint32_t y = 0; y < h; y++) {
+            for (uint32_t x = 0; x < w; x++) {
+                for (uint32_t c = 0; c < 3; c++) {
+                    put_sample(line, x * 3 + c, pattern(x << shift, y << shift, c, img.bps, img.inverted), img.bps);
+                }
+            }
+            if (TIFFWriteScanline(tif, line.data(), y, 0) < 0) return false;
+        }
+    } else {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, tilesize);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, tilesize);
+        uint32_t nplanes = (layout == TILES_SEPARATE) ? 3 : 1;
+        uint32_t spp = 3 / nplanes;
+        std::vector<uint8_t> tile(tilesize * tilesize * spp * ps);
+        for (uint32_t plane = 0; plane < nplanes; plane++) {
+            for (uint32_t ty = 0; ty < h; ty += tilesize) {
+                for (uint32_t tx = 0; tx < w; tx += tilesize) {
+                    for (uint32_t y = 0; y < tilesize; y++) {
+                        for (uint32_t x = 0; x < tilesize; x++) {
+                            for (uint32_t c = 0; c < spp; c++) {
+                                uint32_t v = 0x55; // padding
+                                if ((tx + x < w) && (ty + y < h)) {
+                                    v = pattern((tx + x) << shift, (ty + y) << shift, plane + c, img.bps,
+                                                img.inverted);
+                                }
+                                put_sample(tile, (y * tilesize + x) * spp + c, v, img.bps);
+                            }
+                        }
+                    }
+                    if (TIFFWriteTile(tif, tile.data(), tx, ty, 0, plane) < 0) return false;
+                }
+            }
+        }
+    }
+    return TIFFWriteDirectory(tif) != 0;
+}
+
+int main(int argc, char *argv[]) {
+    std::string dir = (argc > 1) ? argv[1] : ".";
+    Image img = {width, height, 8, false};
+    Image img16 = {width, height, 16, false};
+    Image page2 = {120, 80, 8, true};
+    bool ok = true;
+
+    auto write = [&](const std::string &name, auto dirs) {
+        TIFF *tif = TIFFOpen((dir + "/" + name).c_str(), "w");
+        if (tif == nullptr) {
+            ok = false;
+            return;
+        }
+        if (!dirs(tif)) {
+            fprintf(stderr, "Couldn't write %s\n", name.c_str());
+            ok = false;
+        }
+        TIFFClose(tif);
+    };
+
+    write("strips.tif", [&](TIFF *tif) { return write_dir(tif, img, 0, STRIPS, 0, 0); });
+    write("strips16.tif", [&](TIFF *tif) { return write_dir(tif, img16, 0, STRIPS, 0, 0); });
+    write("tiled.tif", [&](TIFF *tif) { return write_dir(tif, img, 0, TILES, 64, 0); });
+    write("tiled16.tif", [&](TIFF *tif) { return write_dir(tif, img16, 0, TILES, 64, 0); });
+    write("tiled_separate.tif", [&](TIFF *tif) { return write_dir(tif, img, 0, TILES_SEPARATE, 64, 0); });
+    write("tiled16_separate.tif", [&](TIFF *tif) { return write_dir(tif, img16, 0, TILES_SEPARATE, 64, 0); });
+
+    //
+    // the reduced levels 2 and 4 as SubIFDs of the main image
+    //
+    write("pyramid_subifd.tif", [&](TIFF *tif) {
+        return write_dir(tif, img, 0, TILES, 64, 0, {0, 0}) &&
+               write_dir(tif, img, 1, TILES, 32, FILETYPE_REDUCEDIMAGE) &&
+               write_dir(tif, img, 2, TILES, 32, FILETYPE_REDUCEDIMAGE);
+    });
+
+    //
+    // the reduced levels as top level directories following the main image, and a second page
+    // with a reduced level of its own
+    //
+    write("pyramid_reduced.tif", [&](TIFF *tif) {
+        return write_dir(tif, img, 0, TILES, 64, 0) &&
+               write_dir(tif, img, 1, TILES, 32, FILETYPE_REDUCEDIMAGE) &&
+               write_dir(tif, img, 2, TILES, 32, FILETYPE_REDUCEDIMAGE) &&
+               write_dir(tif, page2, 0, TILES, 32, FILETYPE_PAGE) &&
+               write_dir(tif, page2, 1, TILES, 32, FILETYPE_REDUCEDIMAGE);
+    });
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Microbenchmark of the checks of the IIIF url parts: the regular expressions which were compiled
+ * for every request, compared with the hand written matchers and the parser classes.
+ */
+#include <benchmark/benchmark.h>
+
+#include <regex>
+#include <string>
+
+#include "iiifparser/SipiQualityFormat.h"
+#include "iiifparser/SipiRegion.h"
+#include "iiifparser/SipiRotation.h"
+#include "iiifparser/SipiSize.h"
+
+static const std::string region_str = "1024,2048,512,512";
+static const std::string size_str = "256,";
+static const std::string rotation_str = "!90";
+static const std::string qualform_str = "default.jpg";
+
+static void BM_RegexPerRequest(benchmark::State &state) {
+    for (auto _ : state) {
+        bool ok = std::regex_match(qualform_str, std::regex("^(color|gray|bitonal|default)\\.(jpg|tif|png|jp2|pdf)$")) &&
+                  std::regex_match(rotation_str, std::regex("^!?[-+]?[0-9]*\\.?[0-9]*$")) &&
+                  std::regex_match(size_str, std::regex("^(\\^?max)|(\\^?pct:[0-9]*\\.?[0-9]*)|(\\^?[0-9]*,)|(\\^?,[0-9]*)|(\\^?!?[0-9]*,[0-9]*)$")) &&
+                  std::regex_match(region_str, std::regex("^(full)|(square)|([0-9]+,[0-9]+,[0-9]+,[0-9]+)|(pct:[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*)$"));
+        benchmark::DoNotOptimize(ok);
+    }
+}
+BENCHMARK(BM_RegexPerRequest);
+
+static void BM_Matchers(benchmark::State &state) {
+    for (auto _ : state) {
+        bool ok = Sipi::SipiQualityFormat::is_valid(qualform_str) && Sipi::SipiRotation::is_valid(rotation_str) &&
+                  Sipi::SipiSize::is_valid(size_str) && Sipi::SipiRegion::is_valid(region_str);
+        benchmark::DoNotOptimize(ok);
+    }
+}
+BENCHMARK(BM_Matchers);
+
+static void BM_Parsers(benchmark::State &state) {
+    for (auto _ : state) {
+        Sipi::SipiRegion region(region_str);
+        Sipi::SipiSize size(size_str);
+        Sipi::SipiRotation rotation(rotation_str);
+        Sipi::SipiQualityFormat quality_format(qualform_str);
+        benchmark::DoNotOptimize(region);
+        benchmark::DoNotOptimize(size);
+        benchmark::DoNotOptimize(rotation);
+        benchmark::DoNotOptimize(quality_format);
+    }
+}
+BENCHMARK(BM_Parsers);
+
+BENCHMARK_MAIN();
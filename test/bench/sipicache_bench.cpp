@@ -0,0 +1,105 @@
+/*
+ * Microbenchmarks of the file cache index: throughput of SipiCache::check() against the number of
+ * threads, and the startup time (reading the snapshot and reconciling it with the cache directory)
+ * of a synthetic cache directory with a given number of entries.
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "SipiCache.h"
+
+static const char *origpath = "/tmp/sipicache_bench_orig.tif";
+
+static std::string make_tmpdir(void) {
+    char tmpl[] = "/tmp/sipicache_bench_XXXXXX";
+    if (mkdtemp(tmpl) == nullptr) abort();
+    return tmpl;
+}
+
+static std::string canonical_url(size_t i) {
+    return "http://localhost/iiif/2/image" + std::to_string(i % 1000) + ".tif/full/" + std::to_string(i) +
+           ",/0/default.jpg";
+}
+
+//
+// fills the cache directory with nentries cache files, the destructor of the cache writes the snapshot
+//
+static void populate(const std::string &cachedir, size_t nentries) {
+    std::ofstream(origpath) << "original";
+    Sipi::SipiCache cache(cachedir);
+    for (size_t i = 0; i < nentries; i++) {
+        std::string canonical = canonical_url(i);
+        std::string cachepath = cache.getNewCacheFileName(canonical);
+        cache.add(origpath, canonical, cachepath, 4000, 3000);
+    }
+}
+
+//
+// one cache with 100000 entries shared by all check() benchmarks
+//
+static const size_t check_entries = 100000;
+
+struct CheckCache {
+    std::string cachedir;
+    std::unique_ptr<Sipi::SipiCache> cache;
+
+    CheckCache() : cachedir(make_tmpdir()) {
+        populate(cachedir, check_entries);
+        cache.reset(new Sipi::SipiCache(cachedir));
+    }
+
+    ~CheckCache() {
+        cache.reset();
+        std::filesystem::remove_all(cachedir);
+        std::filesystem::remove(origpath);
+    }
+};
+
+static Sipi::SipiCache &check_cache(void) {
+    static CheckCache check;
+    return *check.cache;
+}
+
+static void BM_Check(benchmark::State &state) {
+    Sipi::SipiCache &cache = check_cache();
+    struct stat fileinfo;
+    if (stat(origpath, &fileinfo) != 0) abort();
+    std::vector<std::string> urls;
+    for (size_t i = state.thread_index(); i < check_entries; i += 97) urls.push_back(canonical_url(i));
+    size_t i = 0;
+    for (auto _ : state) {
+        std::string res = cache.check(origpath, urls[i], false, &fileinfo);
+        benchmark::DoNotOptimize(res);
+        if (++i == urls.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Check)->ThreadRange(1, 16)->UseRealTime();
+
+//
+// construction of the cache from a snapshot with range(0) entries and as many files on disk
+//
+static void BM_Startup(benchmark::State &state) {
+    std::string cachedir = make_tmpdir();
+    populate(cachedir, state.range(0));
+    for (auto _ : state) {
+        std::unique_ptr<Sipi::SipiCache> cache(new Sipi::SipiCache(cachedir));
+        state.PauseTiming();
+        cache.reset();
+        state.ResumeTiming();
+    }
+    std::filesystem::remove_all(cachedir);
+    std::filesystem::remove(origpath);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Startup)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
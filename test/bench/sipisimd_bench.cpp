@@ -0,0 +1,72 @@
+/*
+ * Microbenchmark of the resampling kernels at every instruction set level: the Lanczos resampler which
+ * is used for high quality scaling, and the bilinear row kernel of SipiImage::scaleMedium(). The level is
+ * the benchmark argument (0 = scalar, 1 = SSE4.1, 2 = AVX2); levels the CPU does not support fall back to the
+ * best supported one, the label shows the level actually used.
+ */
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "SipiResampler.h"
+#include "SipiSimd.h"
+
+using Sipi::SipiSimd;
+
+template<typename T>
+static std::vector<T> random_image(size_t n, int maxval) {
+    std::mt19937 rng(4711);
+    std::uniform_int_distribution<int> dist(0, maxval);
+    std::vector<T> v(n);
+    for (auto &x : v) x = (T) dist(rng);
+    return v;
+}
+
+static void set_level(benchmark::State &state) {
+    SipiSimd::level((SipiSimd::Level) state.range(0));
+    state.SetLabel(SipiSimd::name(SipiSimd::level()));
+}
+
+//
+// 4000x3000 RGB down to 1000x750, a typical thumbnail of a large master
+//
+template<typename T>
+static void BM_Resample(benchmark::State &state) {
+    set_level(state);
+    const size_t nx = 4000, ny = 3000, nnx = 1000, nny = 750, nc = 3;
+    auto in = random_image<T>(nx * ny * nc, (1 << (8 * sizeof(T))) - 1);
+    std::vector<T> out(nnx * nny * nc);
+    Sipi::SipiResampler resampler(nx, ny, nnx, nny, nc);
+    for (auto _ : state) {
+        resampler.resample(in.data(), out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) (in.size() * sizeof(T)));
+}
+BENCHMARK_TEMPLATE(BM_Resample, uint8_t)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Resample, uint16_t)->DenseRange(0, 2)->Unit(benchmark::kMillisecond);
+
+//
+// one destination row of 2000 RGB pixels from a source row of 3000 pixels
+//
+template<typename T>
+static void BM_Bilinear(benchmark::State &state) {
+    set_level(state);
+    const size_t nx = 3000, nnx = 2000, nc = 3;
+    auto row0 = random_image<T>(nx * nc, (1 << (8 * sizeof(T))) - 1);
+    auto row1 = random_image<T>(nx * nc, (1 << (8 * sizeof(T))) - 1);
+    std::vector<float> xlut(nnx);
+    for (size_t i = 0; i < nnx; i++) xlut[i] = (float) i * (float) (nx - 1) / (float) nnx;
+    std::vector<T> out(nnx * nc);
+    for (auto _ : state) {
+        SipiSimd::bilinear(row0.data(), row1.data(), nc, xlut.data(), nnx, 0.37F, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed((int64_t) state.iterations() * (int64_t) nnx);
+}
+BENCHMARK_TEMPLATE(BM_Bilinear, uint8_t)->DenseRange(0, 2);
+BENCHMARK_TEMPLATE(BM_Bilinear, uint16_t)->DenseRange(0, 2);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,77 @@
+/*
+ * libFuzzer target for the IIIF url matchers and parsers. Each input is checked by the hand written
+ * matchers and, for differential testing, by the regular expressions they replaced. Strings which
+ * are accepted are passed on to the parser classes, as in SipiHttpServer.
+ *
+ * Build with -DSIPI_BUILD_FUZZERS=ON using clang, then run e.g.
+ *     ./iiifparser_fuzz -max_len=64 corpus/
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <regex>
+#include <string>
+
+#include "SipiError.h"
+#include "iiifparser/SipiQualityFormat.h"
+#include "iiifparser/SipiRegion.h"
+#include "iiifparser/SipiRotation.h"
+#include "iiifparser/SipiSize.h"
+
+static const std::regex qualform_ex("^(color|gray|bitonal|default)\\.(jpg|tif|png|jp2|pdf)$");
+static const std::regex rotation_ex("^!?[-+]?[0-9]*\\.?[0-9]*$");
+static const std::regex size_ex(
+        "^(\\^?max)|(\\^?pct:[0-9]*\\.?[0-9]*)|(\\^?[0-9]*,)|(\\^?,[0-9]*)|(\\^?!?[0-9]*,[0-9]*)$");
+static const std::regex region_ex(
+        "^(full)|(square)|([0-9]+,[0-9]+,[0-9]+,[0-9]+)|(pct:[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*)$");
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    std::string str(reinterpret_cast<const char *>(data), size);
+
+    bool region_ok = Sipi::SipiRegion::is_valid(str);
+    bool size_ok = Sipi::SipiSize::is_valid(str);
+    bool rotation_ok = Sipi::SipiRotation::is_valid(str);
+    bool qualform_ok = Sipi::SipiQualityFormat::is_valid(str);
+
+    if ((region_ok != std::regex_match(str, region_ex)) || (size_ok != std::regex_match(str, size_ex)) ||
+        (rotation_ok != std::regex_match(str, rotation_ex)) || (qualform_ok != std::regex_match(str, qualform_ex))) {
+        abort();
+    }
+
+    //
+    // the parsers may reject a syntactically valid parameter (e.g. a size of 0), but must not crash
+    //
+    try {
+        if (region_ok) {
+            Sipi::SipiRegion region(str);
+            int x, y;
+            size_t w, h;
+            (void) region.crop_coords(4000, 3000, x, y, w, h);
+        }
+    } catch (const Sipi::SipiError &err) {
+    }
+    try {
+        if (size_ok) {
+            Sipi::SipiSize size(str);
+            size_t w, h;
+            int reduce = 5;
+            bool redonly;
+            (void) size.get_size(4000, 3000, w, h, reduce, redonly);
+        }
+    } catch (const Sipi::SipiError &err) {
+    } catch (const Sipi::SipiSizeError &err) {
+    }
+    try {
+        if (rotation_ok) {
+            Sipi::SipiRotation rotation(str);
+        }
+    } catch (const Sipi::SipiError &err) {
+    }
+    try {
+        if (qualform_ok) {
+            Sipi::SipiQualityFormat quality_format(str);
+        }
+    } catch (const Sipi::SipiError &err) {
+    }
+    return 0;
+}
@@ -0,0 +1,4 @@
+--
+-- Init script of the server tests. There is no pre_flight function, thus the images are
+-- read from the image root without any access checks.
+--
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+#
+# Server test of the tiled TIFF reader: sipi is started with test/_test_data/images as image root, then
+# the same regions are requested from the tiled and pyramidal TIFFs and from the untiled one. The results
+# are requested as PNG, thus the decoded pixels can be compared exactly.
+#
+#     test_tiff_regions.py <path to sipi> <path to test/_test_data/images>
+#
+# Only the python standard library is needed.
+#
+import json
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+import unittest
+import urllib.request
+import zlib
+
+SIPI = None
+IMAGES = None
+
+
+def pattern(x, y, c, bps, inverted=False):
+    """Sample c of pixel (x, y) of the test images, see test/_test_data/make_tiff_fixtures.cpp"""
+    if c == 0:
+        v = x & 0xff
+    elif c == 1:
+        v = y & 0xff
+    else:
+        v = (((x >> 4) ^ (y >> 4)) * 37) & 0xff
+    if bps == 16:
+        v = (v << 8) | ((3 * x + y) & 0xff)
+    return ((1 << bps) - 1) - v if inverted else v
+
+
+def decode_png(data):
+    """Decodes a non-interlaced PNG. Returns width, height, samples per pixel, bits per sample and the samples."""
+    if data[:8] != b'\x89PNG\r\n\x1a\n':
+        raise ValueError('not a PNG')
+    pos = 8
+    idat = b''
+    while pos < len(data):
+        length, ctype = struct.unpack('>I4s', data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if ctype == b'IHDR':
+            width, height, bps, colortype, _, _, interlace = struct.unpack('>IIBBBBB', chunk)
+        elif ctype == b'IDAT':
+            idat += chunk
+        pos += length + 12
+    if interlace != 0:
+        raise ValueError('interlaced PNG')
+    nc = {0: 1, 2: 3, 4: 2, 6: 4}[colortype]
+    bpp = nc * bps // 8
+    stride = width * bpp
+    raw = zlib.decompress(idat)
+    rows = []
+    prev = bytearray(stride)
+    for y in range(height):
+        ftype = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):
+            a = line[i - bpp] if i >= bpp else 0
+            b = prev[i]
+            c = prev[i - bpp] if i >= bpp else 0
+            if ftype == 1:
+                line[i] = (line[i] + a) & 0xff
+            elif ftype == 2:
+                line[i] = (line[i] + b) & 0xff
+            elif ftype == 3:
+                line[i] = (line[i] + ((a + b) >> 1)) & 0xff
+            elif ftype == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                pred = a if (pa <= pb and pa <= pc) else (b if pb <= pc else c)
+                line[i] = (line[i] + pred) & 0xff
+        rows.append(bytes(line))
+        prev = line
+    pixels = b''.join(rows)
+    if bps == 16:
+        samples = list(struct.unpack('>%dH' % (len(pixels) // 2), pixels))
+    else:
+        samples = list(pixels)
+    return width, height, nc, bps, samples
+
+
+class TiffRegionsTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp(prefix='sipi_server_test_')
+        for d in ('cache', 'tmp', 'scripts', 'server'):
+            os.mkdir(os.path.join(cls.tmpdir, d))
+        with socket.socket() as s:
+            s.bind(('127.0.0.1', 0))
+            cls.port = s.getsockname()[1]
+        cls.log = open(os.path.join(cls.tmpdir, 'sipi.log'), 'w+')
+        initscript = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'sipi.init.lua')
+        cls.sipi = subprocess.Popen([SIPI, '--serverport', str(cls.port), '--imgroot', IMAGES,
+                                     '--initscript', initscript,
+                                     '--cachedir', os.path.join(cls.tmpdir, 'cache'),
+                                     '--tmpdir', os.path.join(cls.tmpdir, 'tmp'),
+                                     '--scriptdir', os.path.join(cls.tmpdir, 'scripts'),
+                                     '--docroot', os.path.join(cls.tmpdir, 'server')],
+                                    stdout=cls.log, stderr=subprocess.STDOUT)
+        deadline = time.time() + 30
+        while True:
+            try:
+                socket.create_connection(('127.0.0.1', cls.port), timeout=1).close()
+                break
+            except OSError:
+                if cls.sipi.poll() is not None or time.time() > deadline:
+                    cls.tearDownClass()
+                    raise RuntimeError('sipi did not start')
+                time.sleep(0.2)
+
+    @classmethod
+    def tearDownClass(cls):
+        if cls.sipi.poll() is None:
+            cls.sipi.terminate()
+            try:
+                cls.sipi.wait(10)
+            except subprocess.TimeoutExpired:
+                cls.sipi.kill()
+        cls.log.seek(0)
+        sys.stderr.write(cls.log.read()[-4000:])
+        cls.log.close()
+        shutil.rmtree(cls.tmpdir, ignore_errors=True)
+
+    def get(self, path):
+        with urllib.request.urlopen('http://127.0.0.1:%d/images/%s' % (self.port, path), timeout=30) as response:
+            self.assertEqual(response.status, 200)
+            return response.read()
+
+    def region(self, identifier, region, size='max'):
+        return decode_png(self.get('%s/%s/%s/0/default.png' % (identifier, region, size)))
+
+    def assert_pattern(self, image, x0, y0, shift, inverted=False):
+        width, height, nc, bps, samples = image
+        for y in range(height):
+            for x in range(width):
+                for c in range(nc):
+                    expected = pattern((x0 + x) << shift, (y0 + y) << shift, c, bps, inverted)
+                    actual = samples[(y * width + x) * nc + c]
+                    if actual != expected:
+                        self.fail('pixel (%d, %d), sample %d: %d != %d' % (x, y, c, actual, expected))
+
+    regions = ['full', '0,0,64,64', '10,20,100,50', '63,63,2,2', '250,150,50,50', '290,0,100,300']
+
+    def test_regions_as_untiled(self):
+        for tiled, untiled in [('tiled.tif', 'strips.tif'), ('tiled_separate.tif', 'strips.tif'),
+                               ('pyramid_subifd.tif', 'strips.tif'), ('pyramid_reduced.tif', 'strips.tif'),
+                               ('tiled16.tif', 'strips16.tif'), ('tiled16_separate.tif', 'strips16.tif')]:
+            for region in self.regions:
+                with self.subTest(file=tiled, region=region):
+                    self.assertEqual(self.region(tiled, region), self.region(untiled, region))
+
+    def test_region_pixels(self):
+        image = self.region('tiled.tif', '10,20,100,50')
+        self.assertEqual(image[:4], (100, 50, 3, 8))
+        self.assert_pattern(image, 10, 20, 0)
+
+    def test_reduced_levels(self):
+        for pyramid in ('pyramid_subifd.tif', 'pyramid_reduced.tif'):
+            for region, size, x0, y0, shift, w, h in [('full', '150,', 0, 0, 1, 150, 100),
+                                                      ('full', 'pct:25', 0, 0, 2, 75, 50),
+                                                      ('64,32,128,64', '64,32', 32, 16, 1, 64, 32),
+                                                      ('200,100,100,100', '50,', 100, 50, 1, 50, 50)]:
+                with self.subTest(file=pyramid, region=region, size=size):
+                    image = self.region(pyramid, region, size)
+                    self.assertEqual(image[:2], (w, h))
+                    self.assert_pattern(image, x0, y0, shift)
+
+    def test_pyramids_agree(self):
+        for size in ('100,', '40,', '!120,70'):
+            with self.subTest(size=size):
+                self.assertEqual(self.region('pyramid_subifd.tif', '30,20,240,160', size),
+                                 self.region('pyramid_reduced.tif', '30,20,240,160', size))
+
+    def test_info(self):
+        info = json.loads(self.get('pyramid_reduced.tif/info.json'))
+        self.assertEqual((info['width'], info['height']), (300, 200))
+        self.assertEqual(info['numpages'], 2)  # the reduced resolution directories are not pages
+        self.assertEqual(info['tiles'][0]['width'], 64)
+        info = json.loads(self.get('pyramid_subifd.tif/info.json'))
+        self.assertNotIn('numpages', info)
+        info = json.loads(self.get('pyramid_reduced.tif@2/info.json'))
+        self.assertEqual((info['width'], info['height']), (120, 80))
+
+    def test_second_page(self):
+        image = self.region('pyramid_reduced.tif@2', '10,10,50,30')
+        self.assertEqual(image[:2], (50, 30))
+        self.assert_pattern(image, 10, 10, 0, inverted=True)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        sys.exit('usage: test_tiff_regions.py <sipi> <images>')
+    SIPI = os.path.abspath(sys.argv[1])
+    IMAGES = os.path.abspath(sys.argv[2])
+    unittest.main(argv=sys.argv[:1] + sys.argv[3:])
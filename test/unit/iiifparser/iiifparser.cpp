@@ -0,0 +1,108 @@
+#include "gtest/gtest.h"
+
+#include <random>
+#include <regex>
+#include <string>
+
+#include "iiifparser/SipiQualityFormat.h"
+#include "iiifparser/SipiRegion.h"
+#include "iiifparser/SipiRotation.h"
+#include "iiifparser/SipiSize.h"
+
+//
+// the regular expressions which were used to check the parts of a IIIF url before the
+// hand written matchers replaced them. The matchers must accept exactly the same strings
+//
+static const std::regex qualform_ex("^(color|gray|bitonal|default)\\.(jpg|tif|png|jp2|pdf)$");
+static const std::regex rotation_ex("^!?[-+]?[0-9]*\\.?[0-9]*$");
+static const std::regex size_ex(
+        "^(\\^?max)|(\\^?pct:[0-9]*\\.?[0-9]*)|(\\^?[0-9]*,)|(\\^?,[0-9]*)|(\\^?!?[0-9]*,[0-9]*)$");
+static const std::regex region_ex(
+        "^(full)|(square)|([0-9]+,[0-9]+,[0-9]+,[0-9]+)|(pct:[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*,[0-9]*\\.?[0-9]*)$");
+
+TEST(IIIFParser, Region) {
+    EXPECT_TRUE(Sipi::SipiRegion::is_valid("full"));
+    EXPECT_TRUE(Sipi::SipiRegion::is_valid("square"));
+    EXPECT_TRUE(Sipi::SipiRegion::is_valid("0,0,512,512"));
+    EXPECT_TRUE(Sipi::SipiRegion::is_valid("pct:10,10.5,.5,80."));
+    EXPECT_TRUE(Sipi::SipiRegion::is_valid("pct:,,,"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid(""));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("fullx"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("0,0,512"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("0,0,512,"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("0,0,512,512,1"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("0.5,0,512,512"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid("-1,0,512,512"));
+    EXPECT_FALSE(Sipi::SipiRegion::is_valid(std::string("full\0x", 6)));
+}
+
+TEST(IIIFParser, Size) {
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("max"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("^max"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("pct:50"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("^pct:150.5"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("512,"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid(",512"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("512,256"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("!512,512"));
+    EXPECT_TRUE(Sipi::SipiSize::is_valid("^!512,512"));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid(""));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid("full"));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid("512"));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid("512,256,1"));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid("!^512,512"));
+    EXPECT_FALSE(Sipi::SipiSize::is_valid(std::string("max\0", 4)));
+}
+
+TEST(IIIFParser, Rotation) {
+    EXPECT_TRUE(Sipi::SipiRotation::is_valid("0"));
+    EXPECT_TRUE(Sipi::SipiRotation::is_valid("90"));
+    EXPECT_TRUE(Sipi::SipiRotation::is_valid("!180"));
+    EXPECT_TRUE(Sipi::SipiRotation::is_valid("-22.5"));
+    EXPECT_TRUE(Sipi::SipiRotation::is_valid("!+.5"));
+    EXPECT_FALSE(Sipi::SipiRotation::is_valid("90deg"));
+    EXPECT_FALSE(Sipi::SipiRotation::is_valid("1.2.3"));
+    EXPECT_FALSE(Sipi::SipiRotation::is_valid("+!90"));
+    EXPECT_FALSE(Sipi::SipiRotation::is_valid(std::string("90\0", 3)));
+}
+
+TEST(IIIFParser, QualityFormat) {
+    EXPECT_TRUE(Sipi::SipiQualityFormat::is_valid("default.jpg"));
+    EXPECT_TRUE(Sipi::SipiQualityFormat::is_valid("color.tif"));
+    EXPECT_TRUE(Sipi::SipiQualityFormat::is_valid("gray.png"));
+    EXPECT_TRUE(Sipi::SipiQualityFormat::is_valid("bitonal.jp2"));
+    EXPECT_TRUE(Sipi::SipiQualityFormat::is_valid("default.pdf"));
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid("default"));
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid("native.jpg"));
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid("default.gif"));
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid("default.jpg.jpg"));
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid("default.jpgx"));
+    // an embedded NUL must not end the comparison
+    EXPECT_FALSE(Sipi::SipiQualityFormat::is_valid(std::string("default.jpg\0x", 13)));
+
+    Sipi::SipiQualityFormat qf("gray.png");
+    EXPECT_EQ(qf.quality(), Sipi::SipiQualityFormat::GRAY);
+    EXPECT_EQ(qf.format(), Sipi::SipiQualityFormat::PNG);
+}
+
+// random strings over the alphabet of the IIIF parameters are classified exactly like by the regular expressions
+TEST(IIIFParser, SameAsRegex) {
+    static const char alphabet[] = "0123456789.,:!^+-pctmaxfulsqredjgifnobt";
+    std::mt19937 rng(4711);
+    std::uniform_int_distribution<size_t> len_dist(0, 14);
+    std::uniform_int_distribution<size_t> char_dist(0, sizeof(alphabet) - 2);
+    const char *seeds[] = {"full", "square", "max", "^max", "pct:", "default.", "color.", "!", "^!"};
+    std::uniform_int_distribution<size_t> seed_dist(0, sizeof(seeds) / sizeof(seeds[0]));
+
+    for (int i = 0; i < 200000; i++) {
+        size_t seed = seed_dist(rng);
+        std::string str = (seed < sizeof(seeds) / sizeof(seeds[0])) ? seeds[seed] : "";
+        size_t len = len_dist(rng);
+        for (size_t j = 0; j < len; j++) str.push_back(alphabet[char_dist(rng)]);
+
+        ASSERT_EQ(Sipi::SipiRegion::is_valid(str), std::regex_match(str, region_ex)) << "region: " << str;
+        ASSERT_EQ(Sipi::SipiSize::is_valid(str), std::regex_match(str, size_ex)) << "size: " << str;
+        ASSERT_EQ(Sipi::SipiRotation::is_valid(str), std::regex_match(str, rotation_ex)) << "rotation: " << str;
+        ASSERT_EQ(Sipi::SipiQualityFormat::is_valid(str), std::regex_match(str, qualform_ex)) << "format: " << str;
+    }
+}
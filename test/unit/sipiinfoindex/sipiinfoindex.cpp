@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SipiInfoIndex.h"
+
+class SipiInfoIndexTest : public ::testing::Test {
+protected:
+    std::string dir;
+    std::string indexfile;
+    std::string imgfile;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/sipiinfoindex_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        indexfile = dir + "/index";
+        imgfile = dir + "/image.tif";
+        write_file(imgfile, "some image data");
+    }
+
+    void TearDown() override {
+        unlink(indexfile.c_str());
+        unlink(imgfile.c_str());
+        unlink((dir + "/other.tif").c_str());
+        rmdir(dir.c_str());
+    }
+
+    static void write_file(const std::string &path, const std::string &content) {
+        std::ofstream out(path, std::ios::trunc);
+        out << content;
+    }
+
+    static struct stat stat_file(const std::string &path) {
+        struct stat fileinfo;
+        EXPECT_EQ(stat(path.c_str(), &fileinfo), 0);
+        return fileinfo;
+    }
+
+    static Sipi::SipiImgInfo make_info() {
+        Sipi::SipiImgInfo info;
+        info.success = Sipi::SipiImgInfo::DIMS;
+        info.width = 4000;
+        info.height = 3000;
+        info.tile_width = 256;
+        info.tile_height = 256;
+        info.clevels = 5;
+        info.numpages = 1;
+        info.internalmimetype = "image/tiff";
+        return info;
+    }
+};
+
+// an entry is found again, also after the index has been closed and reopened
+TEST_F(SipiInfoIndexTest, RoundTrip) {
+    struct stat fileinfo = stat_file(imgfile);
+    {
+        Sipi::SipiInfoIndex index(indexfile, 64);
+        index.insert(imgfile, 0, fileinfo, make_info());
+
+        Sipi::SipiImgInfo info;
+        ASSERT_TRUE(index.lookup(imgfile, 0, fileinfo, info));
+        EXPECT_EQ(info.success, Sipi::SipiImgInfo::DIMS);
+        EXPECT_EQ(info.width, 4000);
+        EXPECT_EQ(info.height, 3000);
+        EXPECT_EQ(info.tile_width, 256);
+        EXPECT_EQ(info.tile_height, 256);
+        EXPECT_EQ(info.clevels, 5);
+        EXPECT_EQ(info.numpages, 1);
+        EXPECT_EQ(info.internalmimetype, "image/tiff");
+    }
+    Sipi::SipiInfoIndex index(indexfile);
+    Sipi::SipiImgInfo info;
+    ASSERT_TRUE(index.lookup(imgfile, 0, fileinfo, info));
+    EXPECT_EQ(info.width, 4000);
+    EXPECT_EQ(info.height, 3000);
+}
+
+// an entry is invalid as soon as the size or the modification time of the file changes
+TEST_F(SipiInfoIndexTest, InvalidatedByChangedFile) {
+    Sipi::SipiInfoIndex index(indexfile, 64);
+    struct stat fileinfo = stat_file(imgfile);
+    index.insert(imgfile, 0, fileinfo, make_info());
+
+    write_file(imgfile, "other, longer image data");
+    struct stat changed = stat_file(imgfile);
+    Sipi::SipiImgInfo info;
+    EXPECT_FALSE(index.lookup(imgfile, 0, changed, info));
+
+    struct stat touched = fileinfo;
+    touched.st_mtime += 1;
+    EXPECT_FALSE(index.lookup(imgfile, 0, touched, info));
+
+    // a new entry replaces the outdated one
+    Sipi::SipiImgInfo newinfo = make_info();
+    newinfo.width = 17;
+    index.insert(imgfile, 0, changed, newinfo);
+    ASSERT_TRUE(index.lookup(imgfile, 0, changed, info));
+    EXPECT_EQ(info.width, 17);
+}
+
+// path and page number are both part of the key
+TEST_F(SipiInfoIndexTest, KeyedByPathAndPage) {
+    Sipi::SipiInfoIndex index(indexfile, 64);
+    struct stat fileinfo = stat_file(imgfile);
+    index.insert(imgfile, 0, fileinfo, make_info());
+
+    Sipi::SipiImgInfo info;
+    EXPECT_FALSE(index.lookup(imgfile, 1, fileinfo, info));
+
+    // another file with the same mtime and size must not get the dimensions of the first one
+    std::string other = dir + "/other.tif";
+    write_file(other, "some image data");
+    EXPECT_FALSE(index.lookup(other, 0, fileinfo, info));
+}
+
+// an index file with an invalid header is reinitialized
+TEST_F(SipiInfoIndexTest, InvalidIndexIsReset) {
+    write_file(indexfile, "this is not an index");
+    struct stat fileinfo = stat_file(imgfile);
+    Sipi::SipiInfoIndex index(indexfile, 64);
+    Sipi::SipiImgInfo info;
+    EXPECT_FALSE(index.lookup(imgfile, 0, fileinfo, info));
+    index.insert(imgfile, 0, fileinfo, make_info());
+    EXPECT_TRUE(index.lookup(imgfile, 0, fileinfo, info));
+}
@@ -0,0 +1,198 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "SipiImage.h"
+#include "formats/SipiIOTiff.h"
+#include "iiifparser/SipiRegion.h"
+#include "iiifparser/SipiSize.h"
+
+//
+// The images in test/_test_data/images contain the same pattern stored in strips, in tiles, in separate
+// planes and as pyramids (see test/_test_data/make_tiff_fixtures.cpp). The regions read from the tiled
+// files have to be identical with the regions read from the untiled ones.
+//
+static const std::string images = SIPI_TEST_IMAGES;
+
+static uint32_t pattern(uint32_t x, uint32_t y, uint32_t c, int bps, bool inverted) {
+    uint32_t v;
+    switch (c) {
+        case 0: v = x & 0xff; break;
+        case 1: v = y & 0xff; break;
+        default: v = (((x >> 4) ^ (y >> 4)) * 37) & 0xff;
+    }
+    if (bps == 16) v = (v << 8) | ((3 * x + y) & 0xff);
+    return inverted ? ((1u << bps) - 1) - v : v;
+}
+
+//
+// gives access to the pixels
+//
+class TestImage : public Sipi::SipiImage {
+public:
+    uint32_t sample(size_t x, size_t y, size_t c) const {
+        size_t i = (y * nx + x) * nc + c;
+        return (bps == 16) ? ((const uint16_t *) pixels)[i] : pixels[i];
+    }
+
+    bool same_pixels(const TestImage &other) const {
+        if ((nx != other.nx) || (ny != other.ny) || (nc != other.nc) || (bps != other.bps)) return false;
+        return memcmp(pixels, other.pixels, nx * ny * nc * bps / 8) == 0;
+    }
+
+    //
+    // the pixels have to be those of the level 2^shift, starting at (x0, y0) of the level
+    //
+    ::testing::AssertionResult shows_pattern(size_t x0, size_t y0, int shift, bool inverted = false) const {
+        for (size_t y = 0; y < ny; y++) {
+            for (size_t x = 0; x < nx; x++) {
+                for (size_t c = 0; c < nc; c++) {
+                    uint32_t expected = pattern((x0 + x) << shift, (y0 + y) << shift, c, bps, inverted);
+                    if (sample(x, y, c) != expected) {
+                        return ::testing::AssertionFailure() << "pixel (" << x << ", " << y << "), sample " << c
+                                                             << ": " << sample(x, y, c) << " != " << expected;
+                    }
+                }
+            }
+        }
+        return ::testing::AssertionSuccess();
+    }
+};
+
+static void read(TestImage &img, const std::string &file, const std::string &region, const std::string &size,
+                 int pagenum = 0) {
+    img.read(images + "/" + file, pagenum, std::make_shared<Sipi::SipiRegion>(region),
+             std::make_shared<Sipi::SipiSize>(size));
+}
+
+class SipiIOTiffTest : public ::testing::TestWithParam<std::string> {
+protected:
+    static void SetUpTestSuite() {
+        Sipi::SipiIOTiff::initLibrary();
+    }
+};
+
+static const char *regions[] = {
+        "full", "0,0,64,64", "10,20,100,50", "63,63,2,2", "250,150,50,50", "299,199,1,1", "290,0,100,300",
+        "pct:10,10,50,50"
+};
+
+// full resolution regions of the tiled files are identical with those of the untiled file
+TEST_P(SipiIOTiffTest, RegionsAsUntiled) {
+    std::string strips = (GetParam().find("16") != std::string::npos) ? "strips16.tif" : "strips.tif";
+    for (const char *region : regions) {
+        SCOPED_TRACE(region);
+        TestImage tiled, untiled;
+        read(tiled, GetParam(), region, "max");
+        read(untiled, strips, region, "max");
+        EXPECT_TRUE(tiled.same_pixels(untiled));
+        EXPECT_EQ(tiled.getNc(), 3u);
+    }
+    TestImage img;
+    read(img, GetParam(), "10,20,100,50", "max");
+    EXPECT_EQ(img.getNx(), 100u);
+    EXPECT_EQ(img.getNy(), 50u);
+    EXPECT_TRUE(img.shows_pattern(10, 20, 0));
+}
+
+INSTANTIATE_TEST_SUITE_P(TiledFiles, SipiIOTiffTest,
+                         ::testing::Values("tiled.tif", "tiled_separate.tif", "pyramid_subifd.tif",
+                                           "pyramid_reduced.tif", "tiled16.tif", "tiled16_separate.tif"));
+
+class SipiIOTiffPyramidTest : public SipiIOTiffTest {};
+
+// sizes which correspond to a reduced level are read from it, no scaling is involved
+TEST_P(SipiIOTiffPyramidTest, ReducedLevels) {
+    struct {
+        const char *region, *size;
+        size_t x0, y0;
+        int shift;
+        size_t w, h;
+    } cases[] = {
+            {"full", "150,", 0, 0, 1, 150, 100},
+            {"full", "pct:25", 0, 0, 2, 75, 50},
+            {"64,32,128,64", "64,32", 32, 16, 1, 64, 32},
+            {"64,32,128,64", "32,", 16, 8, 2, 32, 16},
+            {"200,100,100,100", "50,", 100, 50, 1, 50, 50},
+    };
+    for (const auto &c : cases) {
+        SCOPED_TRACE(std::string(c.region) + " " + c.size);
+        TestImage img;
+        read(img, GetParam(), c.region, c.size);
+        ASSERT_EQ(img.getNx(), c.w);
+        ASSERT_EQ(img.getNy(), c.h);
+        EXPECT_TRUE(img.shows_pattern(c.x0, c.y0, c.shift));
+    }
+}
+
+// both kinds of pyramids give the same result for sizes between the levels
+TEST_P(SipiIOTiffPyramidTest, ScaledFromLevel) {
+    for (const char *size : {"100,", "40,", "!120,70"}) {
+        SCOPED_TRACE(size);
+        TestImage img, other;
+        read(img, GetParam(), "30,20,240,160", size);
+        read(other, "pyramid_subifd.tif", "30,20,240,160", size);
+        EXPECT_TRUE(img.same_pixels(other));
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Pyramids, SipiIOTiffPyramidTest,
+                         ::testing::Values("pyramid_subifd.tif", "pyramid_reduced.tif"));
+
+// info of tiled and pyramidal files; reduced resolution directories are not pages
+TEST(SipiIOTiffDimTest, TilesLevelsAndPages) {
+    Sipi::SipiIOTiff::initLibrary();
+    Sipi::SipiImage img;
+    Sipi::SipiImgInfo info = img.getDim(images + "/strips.tif");
+    EXPECT_EQ(info.width, 300);
+    EXPECT_EQ(info.height, 200);
+    EXPECT_EQ(info.tile_width, 0);
+    EXPECT_EQ(info.numpages, 0);
+
+    info = img.getDim(images + "/tiled.tif");
+    EXPECT_EQ(info.tile_width, 64);
+    EXPECT_EQ(info.tile_height, 64);
+    EXPECT_EQ(info.clevels, 0);
+
+    info = img.getDim(images + "/pyramid_subifd.tif");
+    EXPECT_EQ(info.clevels, 2);
+    EXPECT_EQ(info.numpages, 0);
+
+    info = img.getDim(images + "/pyramid_reduced.tif");
+    EXPECT_EQ(info.width, 300);
+    EXPECT_EQ(info.clevels, 2);
+    EXPECT_EQ(info.numpages, 2);
+
+    info = img.getDim(images + "/pyramid_reduced.tif", 2);
+    EXPECT_EQ(info.width, 120);
+    EXPECT_EQ(info.height, 80);
+    EXPECT_EQ(info.clevels, 1);
+    EXPECT_EQ(info.numpages, 2);
+
+    EXPECT_THROW(img.getDim(images + "/pyramid_reduced.tif", 3), Sipi::SipiImageError);
+}
+
+// the second page of a multipage pyramid, with its own reduced level
+TEST(SipiIOTiffPageTest, SecondPage) {
+    Sipi::SipiIOTiff::initLibrary();
+    TestImage img;
+    read(img, "pyramid_reduced.tif", "10,10,50,30", "max", 2);
+    ASSERT_EQ(img.getNx(), 50u);
+    ASSERT_EQ(img.getNy(), 30u);
+    EXPECT_TRUE(img.shows_pattern(10, 10, 0, true));
+
+    TestImage reduced;
+    read(reduced, "pyramid_reduced.tif", "full", "60,", 2);
+    ASSERT_EQ(reduced.getNx(), 60u);
+    EXPECT_TRUE(reduced.shows_pattern(0, 0, 1, true));
+
+    TestImage first;
+    read(first, "pyramid_reduced.tif", "full", "max", 1);
+    EXPECT_TRUE(first.shows_pattern(0, 0, 0));
+
+    TestImage missing;
+    EXPECT_THROW(read(missing, "pyramid_reduced.tif", "full", "max", 3), Sipi::SipiImageError);
+}
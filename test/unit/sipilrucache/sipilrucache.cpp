@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+#include "SipiLruCache.h"
+
+TEST(SipiLruCache, GetAndAdd) {
+    Sipi::SipiLruCache<std::string> cache(100, 50);
+    std::string value;
+    EXPECT_FALSE(cache.get("a", value));
+
+    EXPECT_TRUE(cache.add("a", "value a", 10));
+    ASSERT_TRUE(cache.get("a", value));
+    EXPECT_EQ(value, "value a");
+
+    // an existing entry is replaced, its size is accounted for only once
+    EXPECT_TRUE(cache.add("a", "new value a", 20));
+    ASSERT_TRUE(cache.get("a", value));
+    EXPECT_EQ(value, "new value a");
+
+    Sipi::SipiLruStats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 1u);
+    EXPECT_EQ(stats.nbytes, 20u);
+    EXPECT_EQ(stats.max_nbytes, 100u);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.evictions, 0u);
+}
+
+// empty values and values larger than the maximal entry size are not added
+TEST(SipiLruCache, EntrySize) {
+    Sipi::SipiLruCache<int> cache(100, 50);
+    EXPECT_EQ(cache.maxEntrySize(), 50u);
+    EXPECT_FALSE(cache.add("empty", 1, 0));
+    EXPECT_FALSE(cache.add("large", 2, 51));
+    EXPECT_TRUE(cache.add("max", 3, 50));
+    int value;
+    EXPECT_FALSE(cache.get("large", value));
+    EXPECT_EQ(cache.stats().nbytes, 50u);
+}
+
+// the least recently used entries are evicted when the byte budget is exhausted
+TEST(SipiLruCache, ByteBudget) {
+    Sipi::SipiLruCache<int> cache(100, 50);
+    EXPECT_TRUE(cache.add("a", 1, 40));
+    EXPECT_TRUE(cache.add("b", 2, 40));
+    int value;
+    EXPECT_TRUE(cache.get("a", value)); // "b" is now the least recently used entry
+
+    EXPECT_TRUE(cache.add("c", 3, 30));
+    EXPECT_FALSE(cache.get("b", value));
+    EXPECT_TRUE(cache.get("a", value));
+    EXPECT_EQ(value, 1);
+    EXPECT_TRUE(cache.get("c", value));
+    EXPECT_EQ(value, 3);
+
+    Sipi::SipiLruStats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 2u);
+    EXPECT_EQ(stats.nbytes, 70u);
+    EXPECT_EQ(stats.evictions, 1u);
+
+    // several entries may have to go for a large one
+    EXPECT_TRUE(cache.add("d", 4, 50));
+    EXPECT_TRUE(cache.add("e", 5, 50));
+    stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 2u);
+    EXPECT_EQ(stats.nbytes, 100u);
+    EXPECT_EQ(stats.evictions, 3u);
+}
+
+TEST(SipiLruCache, Remove) {
+    Sipi::SipiLruCache<int> cache(100, 50);
+    EXPECT_TRUE(cache.add("a", 1, 10));
+    EXPECT_TRUE(cache.remove("a"));
+    EXPECT_FALSE(cache.remove("a"));
+    int value;
+    EXPECT_FALSE(cache.get("a", value));
+    EXPECT_EQ(cache.stats().nbytes, 0u);
+}
+
+// an entry found to be outdated after get() is removed and the lookup counts as a miss
+TEST(SipiLruCache, Invalidate) {
+    Sipi::SipiLruCache<std::shared_ptr<int>> cache(100, 50);
+    auto first = std::make_shared<int>(1);
+    EXPECT_TRUE(cache.add("a", first, 10));
+    std::shared_ptr<int> value;
+    ASSERT_TRUE(cache.get("a", value));
+    cache.invalidate("a", value);
+    EXPECT_FALSE(cache.get("a", value));
+    Sipi::SipiLruStats stats = cache.stats();
+    EXPECT_EQ(stats.hits, 0u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.nbytes, 0u);
+
+    // an entry which has been replaced meanwhile is kept
+    EXPECT_TRUE(cache.add("a", first, 10));
+    ASSERT_TRUE(cache.get("a", value));
+    auto second = std::make_shared<int>(2);
+    EXPECT_TRUE(cache.add("a", second, 10));
+    cache.invalidate("a", value);
+    ASSERT_TRUE(cache.get("a", value));
+    EXPECT_EQ(*value, 2);
+}
@@ -0,0 +1,99 @@
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "SipiMemCache.h"
+
+class SipiMemCacheTest : public ::testing::Test {
+protected:
+    std::string dir;
+    std::string origfile;
+    std::string cachefile;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/sipimemcache_XXXXXX";
+        ASSERT_NE(mkdtemp(tmpl), nullptr);
+        dir = tmpl;
+        origfile = dir + "/orig.tif";
+        cachefile = dir + "/cache_0001";
+        write_file(origfile, "original");
+        write_file(cachefile, "rendered image");
+    }
+
+    void TearDown() override {
+        unlink(origfile.c_str());
+        unlink(cachefile.c_str());
+        rmdir(dir.c_str());
+    }
+
+    static void write_file(const std::string &path, const std::string &content) {
+        std::ofstream out(path, std::ios::trunc);
+        out << content;
+    }
+};
+
+TEST_F(SipiMemCacheTest, AddAndGet) {
+    Sipi::SipiMemCache cache(1024, 10);
+    EXPECT_EQ(cache.get("host/iiif/orig.tif/full/max/0/default.jpg"), nullptr);
+    EXPECT_TRUE(cache.add(origfile, "host/iiif/orig.tif/full/max/0/default.jpg", cachefile));
+
+    time_t orig_mtime = 0;
+    auto data = cache.get("host/iiif/orig.tif/full/max/0/default.jpg", &orig_mtime);
+    ASSERT_NE(data, nullptr);
+    EXPECT_EQ(*data, "rendered image");
+    struct stat fileinfo;
+    ASSERT_EQ(stat(origfile.c_str(), &fileinfo), 0);
+    EXPECT_EQ(orig_mtime, fileinfo.st_mtime);
+
+    cache.remove("host/iiif/orig.tif/full/max/0/default.jpg");
+    EXPECT_EQ(cache.get("host/iiif/orig.tif/full/max/0/default.jpg"), nullptr);
+
+    Sipi::SipiMemCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 0u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+}
+
+// the stat information of the original passed by the caller is used instead of a stat() of the original
+TEST_F(SipiMemCacheTest, AddWithFileinfo) {
+    Sipi::SipiMemCache cache(1024, 10);
+    struct stat fileinfo;
+    ASSERT_EQ(stat(origfile.c_str(), &fileinfo), 0);
+    fileinfo.st_mtime = 1000000000;
+    EXPECT_TRUE(cache.add(dir + "/missing.tif", "canonical", cachefile, &fileinfo));
+
+    time_t orig_mtime = 0;
+    EXPECT_NE(cache.get("canonical", &orig_mtime), nullptr);
+    EXPECT_EQ(orig_mtime, 1000000000);
+}
+
+// files larger than an eighth of the budget are not loaded
+TEST_F(SipiMemCacheTest, TooLarge) {
+    Sipi::SipiMemCache cache(64, 10);
+    EXPECT_FALSE(cache.add(origfile, "canonical", cachefile));
+    EXPECT_EQ(cache.stats().nentries, 0u);
+}
+
+// after the revalidation interval, an entry of a modified original is dropped
+TEST_F(SipiMemCacheTest, Revalidation) {
+    Sipi::SipiMemCache cache(1024, 0);
+    EXPECT_TRUE(cache.add(origfile, "canonical", cachefile));
+    EXPECT_NE(cache.get("canonical"), nullptr);
+
+    struct timeval times[2] = {{1000000000, 0}, {1000000000, 0}};
+    ASSERT_EQ(utimes(origfile.c_str(), times), 0);
+    EXPECT_EQ(cache.get("canonical"), nullptr);
+    EXPECT_EQ(cache.get("canonical"), nullptr);
+
+    Sipi::SipiMemCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 0u);
+    EXPECT_EQ(stats.nbytes, 0u);
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+}
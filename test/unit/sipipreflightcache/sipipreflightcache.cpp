@@ -0,0 +1,97 @@
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SipiPreflightCache.h"
+
+static Sipi::SipiPreflightCache::PreflightInfo make_info(const std::string &type) {
+    return {{"type", type}, {"infile", "/images/" + type + ".jp2"}};
+}
+
+// the key contains prefix, identifier and the header values, and different parts give different keys
+TEST(SipiPreflightCache, Key) {
+    std::string k1 = Sipi::SipiPreflightCache::key("iiif", "img.jp2", {"sid=1"});
+    EXPECT_EQ(k1, Sipi::SipiPreflightCache::key("iiif", "img.jp2", {"sid=1"}));
+    EXPECT_NE(k1, Sipi::SipiPreflightCache::key("iiif", "img.jp2", {"sid=2"}));
+    EXPECT_NE(k1, Sipi::SipiPreflightCache::key("iiif", "other.jp2", {"sid=1"}));
+    EXPECT_NE(Sipi::SipiPreflightCache::key("a", "bc", {}), Sipi::SipiPreflightCache::key("ab", "c", {}));
+    EXPECT_NE(Sipi::SipiPreflightCache::key("iiif", "img.jp2", {"", "x"}),
+              Sipi::SipiPreflightCache::key("iiif", "img.jp2", {"x", ""}));
+}
+
+TEST(SipiPreflightCache, GetAndStats) {
+    Sipi::SipiPreflightCache cache(10, 60, {"cookie"});
+    Sipi::SipiPreflightCache::PreflightInfo info;
+    EXPECT_FALSE(cache.get("a", info));
+
+    cache.add("a", make_info("allow"));
+    ASSERT_TRUE(cache.get("a", info));
+    EXPECT_EQ(info["type"], "allow");
+    EXPECT_EQ(info["infile"], "/images/allow.jp2");
+
+    // a new result replaces the old one
+    cache.add("a", make_info("deny"));
+    ASSERT_TRUE(cache.get("a", info));
+    EXPECT_EQ(info["type"], "deny");
+
+    Sipi::SipiPreflightCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 1u);
+    EXPECT_EQ(stats.max_nentries, 10u);
+    EXPECT_EQ(stats.ttl, 60);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.expired, 0u);
+
+    cache.clear();
+    EXPECT_FALSE(cache.get("a", info));
+    EXPECT_EQ(cache.stats().nentries, 0u);
+}
+
+// entries are dropped as soon as their time to live has elapsed
+TEST(SipiPreflightCache, TimeToLive) {
+    Sipi::SipiPreflightCache cache(10, 1, {"cookie"});
+    Sipi::SipiPreflightCache::PreflightInfo info;
+    cache.add("a", make_info("allow"));
+    EXPECT_TRUE(cache.get("a", info));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    EXPECT_FALSE(cache.get("a", info));
+    Sipi::SipiPreflightCache::Stats stats = cache.stats();
+    EXPECT_EQ(stats.nentries, 0u);
+    EXPECT_EQ(stats.expired, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+
+    Sipi::SipiPreflightCache nottl(10, 0, {"cookie"});
+    nottl.add("a", make_info("allow"));
+    EXPECT_FALSE(nottl.get("a", info));
+}
+
+// if the cache is full, the least recently used entry is evicted
+TEST(SipiPreflightCache, LeastRecentlyUsed) {
+    Sipi::SipiPreflightCache cache(3, 60, {"cookie"});
+    Sipi::SipiPreflightCache::PreflightInfo info;
+    cache.add("a", make_info("a"));
+    cache.add("b", make_info("b"));
+    cache.add("c", make_info("c"));
+    EXPECT_TRUE(cache.get("a", info)); // "b" is now the least recently used entry
+
+    cache.add("d", make_info("d"));
+    EXPECT_EQ(cache.stats().nentries, 3u);
+    EXPECT_FALSE(cache.get("b", info));
+    EXPECT_TRUE(cache.get("a", info));
+    EXPECT_TRUE(cache.get("c", info));
+    ASSERT_TRUE(cache.get("d", info));
+    EXPECT_EQ(info["type"], "d");
+}
+
+// a cache without entries never stores anything
+TEST(SipiPreflightCache, Disabled) {
+    Sipi::SipiPreflightCache cache(0, 60, {"cookie"});
+    Sipi::SipiPreflightCache::PreflightInfo info;
+    cache.add("a", make_info("allow"));
+    EXPECT_FALSE(cache.get("a", info));
+    EXPECT_EQ(cache.stats().nentries, 0u);
+}
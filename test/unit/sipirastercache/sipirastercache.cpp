@@ -0,0 +1,38 @@
+#include "gtest/gtest.h"
+
+#include <string>
+
+#include "SipiRasterCache.h"
+
+// renditions which differ only in rotation, quality or format share the raster
+TEST(SipiRasterCache, CanonicalKey) {
+    std::string key = Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                            "localhost/iiif/img.jp2/0,0,512,512/256,/0/default.jpg", true);
+    EXPECT_EQ(key, Sipi::SipiRasterCache::key("/images/img.jp2", 1000, 4711, 0, "0,0,512,512", "256,", true));
+    EXPECT_EQ(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                         "localhost/iiif/img.jp2/0,0,512,512/256,/!90/gray.jpg", true));
+    EXPECT_EQ(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                         "otherhost/iiif/img.jp2/0,0,512,512/256,/0/default.png", true));
+
+    // region, size, file, page and bit depth are part of the key
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                         "localhost/iiif/img.jp2/0,0,512,512/128,/0/default.jpg", true));
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                         "localhost/iiif/img.jp2/512,0,512,512/256,/0/default.jpg", true));
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1001, 4711, 0,
+                                                         "localhost/iiif/img.jp2/0,0,512,512/256,/0/default.jpg", true));
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4712, 0,
+                                                         "localhost/iiif/img.jp2/0,0,512,512/256,/0/default.jpg", true));
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 1,
+                                                         "localhost/iiif/img.jp2@1/0,0,512,512/256,/0/default.jpg", true));
+    EXPECT_NE(key, Sipi::SipiRasterCache::canonical_key("/images/img.jp2", 1000, 4711, 0,
+                                                         "localhost/iiif/img.jp2/0,0,512,512/256,/0/default.tif", false));
+}
+
+TEST(SipiRasterCache, CanonicalKeyTooShort) {
+    EXPECT_EQ(Sipi::SipiRasterCache::canonical_key("/img.jp2", 0, 0, 0, "", false), "");
+    EXPECT_EQ(Sipi::SipiRasterCache::canonical_key("/img.jp2", 0, 0, 0, "/0/default.jpg", false), "");
+    EXPECT_EQ(Sipi::SipiRasterCache::canonical_key("/img.jp2", 0, 0, 0, "256,/0/default.jpg", false), "");
+    EXPECT_EQ(Sipi::SipiRasterCache::canonical_key("/img.jp2", 0, 0, 0, "/full/256,/0/default.jpg", false),
+              Sipi::SipiRasterCache::key("/img.jp2", 0, 0, 0, "full", "256,", false));
+}
@@ -0,0 +1,203 @@
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "SipiSimd.h"
+#include "SipiResampler.h"
+
+using Sipi::SipiSimd;
+
+//
+// The vectorized kernels must give exactly the results of the scalar kernels. Every test runs the same input
+// through all instruction sets the CPU supports and compares the output with the scalar one. Instruction sets
+// the CPU does not support fall back to the best supported one, so they are compared, too, but test nothing new.
+//
+class SipiSimdTest : public ::testing::Test {
+public:
+    std::mt19937 rng{4711};
+    SipiSimd::Level saved;
+
+    void SetUp() override {
+        saved = SipiSimd::level();
+    }
+
+    void TearDown() override {
+        SipiSimd::level(saved);
+    }
+
+    template<typename T>
+    std::vector<T> random_vector(size_t n, int64_t lo, int64_t hi) {
+        std::uniform_int_distribution<int64_t> dist(lo, hi);
+        std::vector<T> v(n);
+        for (auto &x : v) x = (T) dist(rng);
+        return v;
+    }
+
+    //
+    // runs f at every level and compares its result with the scalar one
+    //
+    template<typename F>
+    void compare_levels(F f) {
+        SipiSimd::level(SipiSimd::SCALAR);
+        auto expected = f();
+        for (auto level : {SipiSimd::SSE41, SipiSimd::AVX2}) {
+            SipiSimd::level(level);
+            SCOPED_TRACE(SipiSimd::name(SipiSimd::level()));
+            EXPECT_EQ(f(), expected);
+        }
+    }
+};
+
+TEST_F(SipiSimdTest, Accumulate8) {
+    for (size_t n : {1, 7, 8, 15, 16, 33, 1000}) {
+        auto src = random_vector<uint8_t>(n, 0, 255);
+        auto accu = random_vector<int32_t>(n, -100000, 100000);
+        for (int32_t weight : {-4096, -1, 0, 1, 16383}) {
+            compare_levels([&] {
+                std::vector<int32_t> a = accu;
+                SipiSimd::accumulate(src.data(), weight, a.data(), n);
+                return a;
+            });
+        }
+    }
+}
+
+TEST_F(SipiSimdTest, Accumulate16) {
+    for (size_t n : {1, 3, 4, 7, 8, 17, 1000}) {
+        auto src = random_vector<uint16_t>(n, 0, 65535);
+        auto accu = random_vector<int64_t>(n, -10000000000LL, 10000000000LL);
+        for (int32_t weight : {-4096, -1, 0, 1, 16383}) {
+            compare_levels([&] {
+                std::vector<int64_t> a = accu;
+                SipiSimd::accumulate(src.data(), weight, a.data(), n);
+                return a;
+            });
+        }
+    }
+}
+
+//
+// random contributions like those of SipiResampler: n destination samples, each with up to maxtaps weights
+// starting somewhere in a source row of width nx. The weights may be negative, and the sums may be out of range
+// to check the clamping. As in SipiResampler, the weights of a destination sample add up to at most 2^15, so the
+// 32 bit sums of the 8 bit kernels cannot overflow.
+//
+template<typename T>
+static void check_convolve(SipiSimdTest *t, std::mt19937 &rng, size_t nc, size_t n, size_t nx, size_t maxtaps) {
+    const int shift = 20;
+    std::uniform_int_distribution<size_t> tapsdist(1, maxtaps);
+    std::uniform_int_distribution<int32_t> wdist(-(1 << 12) / (int32_t) maxtaps, (1 << 15) / (int32_t) maxtaps);
+    std::uniform_int_distribution<int32_t> indist(-2000, 255 * 64 + 2000);
+    std::vector<size_t> start(n), ntaps(n);
+    std::vector<int32_t> weights(n * maxtaps, 0);
+    for (size_t i = 0; i < n; i++) {
+        ntaps[i] = tapsdist(rng);
+        start[i] = std::uniform_int_distribution<size_t>(0, nx - ntaps[i])(rng);
+        for (size_t k = 0; k < ntaps[i]; k++) weights[i * maxtaps + k] = wdist(rng);
+    }
+    std::vector<int32_t> in(nx * nc + 1); // one more sample, see SipiSimd::convolve()
+    for (auto &x : in) x = indist(rng);
+    if (sizeof(T) == 2) {
+        for (auto &x : in) x *= 257;
+    }
+    t->compare_levels([&] {
+        std::vector<T> out(n * nc);
+        SipiSimd::convolve(in.data(), nc, n, start.data(), ntaps.data(), weights.data(), maxtaps, shift,
+                           out.data());
+        return out;
+    });
+}
+
+TEST_F(SipiSimdTest, Convolve8) {
+    for (size_t nc = 1; nc <= 4; nc++) {
+        for (size_t maxtaps : {1, 6, 7, 13, 40}) {
+            for (size_t n : {1, 5, 64, 333}) {
+                SCOPED_TRACE("nc=" + std::to_string(nc) + " maxtaps=" + std::to_string(maxtaps) + " n=" +
+                             std::to_string(n));
+                check_convolve<uint8_t>(this, rng, nc, n, 400, maxtaps);
+            }
+        }
+    }
+}
+
+TEST_F(SipiSimdTest, Convolve16) {
+    for (size_t nc = 1; nc <= 4; nc++) {
+        for (size_t maxtaps : {1, 7, 40}) {
+            SCOPED_TRACE("nc=" + std::to_string(nc) + " maxtaps=" + std::to_string(maxtaps));
+            check_convolve<uint16_t>(this, rng, nc, 100, 400, maxtaps);
+        }
+    }
+}
+
+//
+// x positions as used by SipiImage::scaleMedium(), including exact pixel positions (rx < 0.01)
+//
+static std::vector<float> make_xlut(std::mt19937 &rng, size_t n, size_t nx) {
+    std::uniform_real_distribution<float> dist(0.0F, (float) (nx - 1) - 0.001F);
+    std::vector<float> xlut(n);
+    for (size_t i = 0; i < n; i++) xlut[i] = (i % 5 == 0) ? (float) (i % (nx - 1)) : dist(rng);
+    return xlut;
+}
+
+template<typename T>
+static void check_bilinear(SipiSimdTest *t, std::mt19937 &rng, size_t nc, size_t n, size_t nx, int64_t maxval) {
+    std::uniform_int_distribution<int64_t> dist(0, maxval);
+    std::vector<T> row0(nx * nc), row1(nx * nc);
+    for (auto &x : row0) x = (T) dist(rng);
+    for (auto &x : row1) x = (T) dist(rng);
+    auto xlut = make_xlut(rng, n, nx);
+    for (float ry : {0.0F, 0.005F, 0.01F, 0.25F, 0.5F, 0.999F}) {
+        SCOPED_TRACE("ry=" + std::to_string(ry));
+        t->compare_levels([&] {
+            std::vector<T> out(n * nc);
+            SipiSimd::bilinear(row0.data(), row1.data(), nc, xlut.data(), n, ry, out.data());
+            return out;
+        });
+    }
+}
+
+TEST_F(SipiSimdTest, Bilinear8) {
+    for (size_t nc = 1; nc <= 4; nc++) {
+        for (size_t n : {1, 3, 4, 9, 250}) {
+            SCOPED_TRACE("nc=" + std::to_string(nc) + " n=" + std::to_string(n));
+            check_bilinear<uint8_t>(this, rng, nc, n, 300, 255);
+        }
+    }
+}
+
+TEST_F(SipiSimdTest, Bilinear16) {
+    for (size_t nc = 1; nc <= 4; nc++) {
+        for (size_t n : {1, 3, 4, 9, 250}) {
+            SCOPED_TRACE("nc=" + std::to_string(nc) + " n=" + std::to_string(n));
+            check_bilinear<uint16_t>(this, rng, nc, n, 300, 65535);
+        }
+    }
+}
+
+//
+// the whole resampler, down- and upscaling
+//
+TEST_F(SipiSimdTest, Resampler) {
+    struct { size_t nx, ny, nnx, nny; } sizes[] = {{317, 211, 100, 67}, {64, 48, 150, 101}, {1000, 20, 999, 7}};
+    for (const auto &s : sizes) {
+        for (size_t nc = 1; nc <= 4; nc++) {
+            SCOPED_TRACE(std::to_string(s.nx) + "x" + std::to_string(s.ny) + " -> " + std::to_string(s.nnx) + "x" +
+                         std::to_string(s.nny) + " nc=" + std::to_string(nc));
+            Sipi::SipiResampler resampler(s.nx, s.ny, s.nnx, s.nny, nc);
+            auto in8 = random_vector<uint8_t>(s.nx * s.ny * nc, 0, 255);
+            compare_levels([&] {
+                std::vector<uint8_t> out(s.nnx * s.nny * nc);
+                resampler.resample(in8.data(), out.data());
+                return out;
+            });
+            auto in16 = random_vector<uint16_t>(s.nx * s.ny * nc, 0, 65535);
+            compare_levels([&] {
+                std::vector<uint16_t> out(s.nnx * s.nny * nc);
+                resampler.resample(in16.data(), out.data());
+                return out;
+            });
+        }
+    }
+}